@@ -1,15 +1,12 @@
 #include <iostream>
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include <unistd.h>
 #include <string>
-#include <netdb.h>   // For getaddrinfo
-#include <cstring>   // For memset
 #include <chrono>    // For std::chrono
 #include <ctime>     // For std::time_t, std::localtime
 #include <iomanip>   // For std::put_time
 #include <thread>    // Required for std::thread
 #include <mutex>     // Required for std::mutex
+#include "http_client.h"
+#include "load_generator.h"
 
 // Mutex for thread-safe logging
 std::mutex log_mutex;
@@ -24,62 +21,33 @@ void log_message(const std::string& level, const std::string& message) {
               << "] [" << level << "] " << message << std::endl;
 }
 
+// One client for the whole program: it caches the server's address and
+// keeps connections to it open, so concurrent requests share a small pool
+// of keep-alive connections instead of each opening its own.
+HttpClient& http_client() {
+    static HttpClient client;
+    return client;
+}
+
 // Function to send a GET request and receive a response
 std::string fetch(const std::string& path, const std::string& server_address, int port) {
     auto start_time = std::chrono::high_resolution_clock::now();
 
-    int sock = 0;
-    struct addrinfo hints, *res, *p;
-    int status;
-    char buffer[1024] = {0};
-
-    memset(&hints, 0, sizeof hints);
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-
-    if ((status = getaddrinfo(server_address.c_str(), std::to_string(port).c_str(), &hints, &res)) != 0) {
-        log_message("ERROR", "getaddrinfo for " + path + ": " + std::string(gai_strerror(status)));
-        return "";
-    }
-
-    for(p = res; p != NULL; p = p->ai_next) {
-        if ((sock = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
-            log_message("ERROR", "client " + path + ": socket failed");
-            continue;
-        }
-
-        if (connect(sock, p->ai_addr, p->ai_addrlen) == -1) {
-            close(sock);
-            log_message("ERROR", "client " + path + ": connect failed");
-            continue;
-        }
-        break;
-    }
-
-    if (p == NULL) {
-        log_message("ERROR", "client " + path + ": failed to connect");
+    HttpClientResponse response;
+    try {
+        response = http_client().get(server_address, port, path).get();
+    } catch (const HttpClientError& error) {
+        log_message("ERROR", "client " + path + ": " + error.what());
         return "";
     }
-
-    freeaddrinfo(res);
-    log_message("INFO", "Connected to server for " + path + " request.");
-
-    std::string message = "GET " + path + "\n";
-    send(sock, message.c_str(), message.length(), 0);
-    log_message("INFO", "Message sent: " + message);
-
-    read(sock, buffer, 1024);
-    std::string response(buffer);
-    log_message("INFO", "Server response for " + path + ": " + response);
-
-    close(sock);
-    log_message("INFO", "Closed connection to server for " + path + ".");
+    log_message("INFO", "Server response for " + path + ": " + std::to_string(response.status) + " " +
+                response.reason + "\n" + response.body);
 
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
     log_message("INFO", "Request to " + path + " took " + std::to_string(duration.count()) + " ms.");
 
-    return response;
+    return response.body;
 }
 
 // Helper function to send a request in a separate thread
@@ -91,7 +59,12 @@ void send_request(const std::string& path, const std::string& server_address, in
     log_message("INFO", "----------------------------------------");
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // `client bench ...` runs the load generator instead of the demo requests
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        return bench_main(argc - 1, argv + 1);
+    }
+
     // Common variables for all requests
     int port = 8080;
     std::string server_address = "server"; // Use the server container name
@@ -110,7 +83,10 @@ int main() {
     thread3.join();
     thread4.join();
 
-    log_message("INFO", "All client requests sent and responses received.");
+    HttpClientStats stats = http_client().stats();
+    log_message("INFO", "All client requests sent and responses received: " + std::to_string(stats.requests) +
+                " requests over " + std::to_string(stats.connections_opened) + " connections (" +
+                std::to_string(stats.pipelined) + " pipelined, " + std::to_string(stats.reused) + " reused).");
 
     std::string input_path;
     while (true) {
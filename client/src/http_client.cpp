@@ -0,0 +1,863 @@
+#include "http_client.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <strings.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+constexpr size_t kMaxResponseHead = 64 * 1024;
+constexpr auto kScanInterval = std::chrono::milliseconds(50); // Granularity of every timeout
+
+bool equals_ignore_case(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+bool contains_ignore_case(std::string_view haystack, std::string_view needle) {
+    for (size_t i = 0; i + needle.size() <= haystack.size(); ++i) {
+        if (strncasecmp(haystack.data() + i, needle.data(), needle.size()) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+bool has_header(const HttpClientRequest& request, std::string_view name) {
+    for (const auto& header : request.headers) {
+        if (equals_ignore_case(header.first, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string serialize(const HttpClientRequest& request) {
+    std::string wire;
+    wire.reserve(128 + request.target.size() + request.body.size());
+    wire += request.method;
+    wire += ' ';
+    wire += request.target.empty() ? "/" : request.target;
+    wire += " HTTP/1.1\r\n";
+    if (!has_header(request, "Host")) {
+        wire += "Host: ";
+        wire += request.host;
+        if (request.port != 80) {
+            wire += ':';
+            wire += std::to_string(request.port);
+        }
+        wire += "\r\n";
+    }
+    for (const auto& header : request.headers) {
+        wire += header.first;
+        wire += ": ";
+        wire += header.second;
+        wire += "\r\n";
+    }
+    bool body_expected = request.method == "POST" || request.method == "PUT" || request.method == "PATCH";
+    if ((!request.body.empty() || body_expected) && !has_header(request, "Content-Length")) {
+        wire += "Content-Length: ";
+        wire += std::to_string(request.body.size());
+        wire += "\r\n";
+    }
+    wire += "\r\n";
+    wire += request.body;
+    return wire;
+}
+
+// Incremental HTTP/1.1 response reader. Bodies are delimited by
+// Content-Length, chunked encoding or, failing both, the server closing the
+// connection; interim 1xx responses are skipped.
+class ResponseReader {
+public:
+    enum class Result { NeedMore, Complete, Error };
+
+    // Resets for the next response; `head_request` responses have no body.
+    void start(bool head_request) {
+        state_ = State::Head;
+        head_request_ = head_request;
+        close_after_ = false;
+        remaining_ = 0;
+        response_ = HttpClientResponse();
+    }
+
+    // Consumes bytes of `in` from `offset` on. On Complete, `out` holds the
+    // response and `offset` points past it.
+    Result read(const std::string& in, size_t& offset, HttpClientResponse& out, std::string& error) {
+        while (true) {
+            switch (state_) {
+                case State::Head: {
+                    size_t end = in.find("\r\n\r\n", offset);
+                    if (end == std::string::npos) {
+                        if (in.size() - offset > kMaxResponseHead) {
+                            error = "response head too large";
+                            return Result::Error;
+                        }
+                        return Result::NeedMore;
+                    }
+                    if (!parse_head(std::string_view(in).substr(offset, end - offset), error)) {
+                        return Result::Error;
+                    }
+                    offset = end + 4;
+                    if (response_.status / 100 == 1 && response_.status != 101) {
+                        response_ = HttpClientResponse(); // Interim response, the real one follows
+                        continue;
+                    }
+                    if (head_request_ || response_.status == 204 || response_.status == 304) {
+                        return complete(out);
+                    }
+                    if (chunked_) {
+                        state_ = State::ChunkSize;
+                    } else if (content_length_ >= 0) {
+                        remaining_ = static_cast<size_t>(content_length_);
+                        state_ = State::Body;
+                    } else {
+                        close_after_ = true;
+                        state_ = State::UntilClose;
+                    }
+                    break;
+                }
+                case State::Body: {
+                    size_t take = std::min(remaining_, in.size() - offset);
+                    response_.body.append(in, offset, take);
+                    offset += take;
+                    remaining_ -= take;
+                    if (remaining_ > 0) {
+                        return Result::NeedMore;
+                    }
+                    return complete(out);
+                }
+                case State::ChunkSize: {
+                    size_t end = in.find("\r\n", offset);
+                    if (end == std::string::npos) {
+                        return in.size() - offset > 1024 ? fail("chunk size line too long", error) : Result::NeedMore;
+                    }
+                    char* parsed_end = nullptr;
+                    unsigned long long size = std::strtoull(in.c_str() + offset, &parsed_end, 16);
+                    if (parsed_end == in.c_str() + offset) {
+                        return fail("malformed chunk size", error);
+                    }
+                    offset = end + 2; // Chunk extensions after ';' are ignored
+                    remaining_ = static_cast<size_t>(size);
+                    state_ = size == 0 ? State::Trailers : State::ChunkData;
+                    break;
+                }
+                case State::ChunkData: {
+                    size_t take = std::min(remaining_, in.size() - offset);
+                    response_.body.append(in, offset, take);
+                    offset += take;
+                    remaining_ -= take;
+                    if (remaining_ > 0) {
+                        return Result::NeedMore;
+                    }
+                    state_ = State::ChunkEnd;
+                    break;
+                }
+                case State::ChunkEnd:
+                    if (in.size() - offset < 2) {
+                        return Result::NeedMore;
+                    }
+                    if (in.compare(offset, 2, "\r\n") != 0) {
+                        return fail("malformed chunk", error);
+                    }
+                    offset += 2;
+                    state_ = State::ChunkSize;
+                    break;
+                case State::Trailers: {
+                    size_t end = in.find("\r\n", offset);
+                    if (end == std::string::npos) {
+                        return Result::NeedMore;
+                    }
+                    bool last = end == offset; // Trailer fields are dropped
+                    offset = end + 2;
+                    if (last) {
+                        return complete(out);
+                    }
+                    break;
+                }
+                case State::UntilClose:
+                    response_.body.append(in, offset, std::string::npos);
+                    offset = in.size();
+                    return Result::NeedMore;
+            }
+        }
+    }
+
+    // The server closed the connection. A body that runs until then is
+    // complete; anything else was cut short.
+    bool finish_at_close(HttpClientResponse& out) {
+        if (state_ != State::UntilClose) {
+            return false;
+        }
+        complete(out);
+        return true;
+    }
+
+    bool close_after() const { return close_after_; }
+
+private:
+    enum class State { Head, Body, ChunkSize, ChunkData, ChunkEnd, Trailers, UntilClose };
+
+    bool parse_head(std::string_view head, std::string& error) {
+        chunked_ = false;
+        content_length_ = -1;
+        size_t line_end = std::min(head.find("\r\n"), head.size());
+        std::string_view status_line = head.substr(0, line_end);
+        if (status_line.size() < 12 || status_line.compare(0, 5, "HTTP/") != 0 || status_line[8] != ' ') {
+            error = "malformed status line";
+            return false;
+        }
+        bool http10 = status_line.compare(0, 8, "HTTP/1.0") == 0;
+        response_.status = std::atoi(std::string(status_line.substr(9, 3)).c_str());
+        response_.reason = std::string(trim(status_line.substr(12)));
+        if (response_.status < 100 || response_.status > 999) {
+            error = "malformed status code";
+            return false;
+        }
+
+        bool keep_alive = !http10;
+        size_t position = line_end + 2;
+        while (position < head.size()) {
+            size_t end = std::min(head.find("\r\n", position), head.size());
+            std::string_view line = head.substr(position, end - position);
+            position = end + 2;
+            size_t colon = line.find(':');
+            if (colon == std::string_view::npos) {
+                continue;
+            }
+            std::string_view name = trim(line.substr(0, colon));
+            std::string_view value = trim(line.substr(colon + 1));
+            if (equals_ignore_case(name, "Content-Length")) {
+                content_length_ = std::atoll(std::string(value).c_str());
+            } else if (equals_ignore_case(name, "Transfer-Encoding")) {
+                chunked_ = contains_ignore_case(value, "chunked");
+            } else if (equals_ignore_case(name, "Connection")) {
+                if (contains_ignore_case(value, "close")) {
+                    keep_alive = false;
+                } else if (contains_ignore_case(value, "keep-alive")) {
+                    keep_alive = true;
+                }
+            }
+            response_.headers.emplace_back(std::string(name), std::string(value));
+        }
+        close_after_ = !keep_alive;
+        return true;
+    }
+
+    Result complete(HttpClientResponse& out) {
+        out = std::move(response_);
+        response_ = HttpClientResponse();
+        state_ = State::Head;
+        return Result::Complete;
+    }
+
+    Result fail(const char* message, std::string& error) {
+        error = message;
+        return Result::Error;
+    }
+
+    State state_ = State::Head;
+    HttpClientResponse response_;
+    bool head_request_ = false;
+    bool chunked_ = false;
+    bool close_after_ = false;
+    long long content_length_ = -1;
+    size_t remaining_ = 0;
+};
+
+} // namespace
+
+const std::string* HttpClientResponse::header(std::string_view name) const {
+    for (const auto& field : headers) {
+        if (equals_ignore_case(field.first, name)) {
+            return &field.second;
+        }
+    }
+    return nullptr;
+}
+
+struct HttpClient::Pending {
+    std::string key;            // Endpoint, "host:port"
+    AddressList addresses;
+    std::string wire;           // The serialized request
+    bool idempotent = false;    // May be pipelined and resent
+    bool head = false;
+    int attempts = 0;
+    Clock::time_point deadline;
+    std::promise<HttpClientResponse> promise;
+};
+
+struct HttpClient::Connection {
+    Endpoint* endpoint = nullptr;
+    int fd = -1;                // -1 once dropped
+    bool connected = false;
+    bool broken = false;        // A send failed: take what the server still sends, then drop
+    bool watching_writable = false;
+    uint64_t responses = 0;     // Responses received so far; > 0 means reused
+    std::string out;
+    size_t out_offset = 0;
+    std::deque<PendingPtr> in_flight; // In send order; the front is being answered
+    std::string in;
+    size_t in_offset = 0;
+    ResponseReader reader;
+    Clock::time_point connect_deadline;
+    Clock::time_point idle_since;
+};
+
+struct HttpClient::Endpoint {
+    std::string key;
+    std::vector<std::unique_ptr<Connection>> connections;
+    std::deque<PendingPtr> waiting;  // No connection could take these yet
+    size_t next_address = 0;         // Connections rotate over the resolved addresses
+};
+
+HttpClient::HttpClient(const HttpClientOptions& options) : options_(options) {
+    options_.max_connections_per_endpoint = std::max<size_t>(1, options_.max_connections_per_endpoint);
+    options_.max_pipeline_depth = std::max<size_t>(1, options_.max_pipeline_depth);
+    options_.max_attempts = std::max(1, options_.max_attempts);
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wakeup_fd_ < 0) {
+        throw HttpClientError(std::string("HttpClient: ") + std::strerror(errno));
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr; // The wakeup; connections carry their Connection*
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event);
+    thread_ = std::thread(&HttpClient::loop, this);
+}
+
+HttpClient::~HttpClient() {
+    stopping_.store(true);
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeup_fd_, &one, sizeof(one));
+    (void)ignored;
+    thread_.join();
+    fail_everything("HttpClient destroyed with the request pending");
+    close(wakeup_fd_);
+    close(epoll_fd_);
+}
+
+std::future<HttpClientResponse> HttpClient::get(const std::string& host, int port, const std::string& target) {
+    HttpClientRequest request;
+    request.host = host;
+    request.port = port;
+    request.target = target;
+    return send(std::move(request));
+}
+
+std::future<HttpClientResponse> HttpClient::send(HttpClientRequest request) {
+    PendingPtr pending(new Pending());
+    std::future<HttpClientResponse> future = pending->promise.get_future();
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    try {
+        pending->addresses = resolve(request.host, request.port);
+    } catch (const HttpClientError&) {
+        pending->promise.set_exception(std::current_exception());
+        return future;
+    }
+    pending->key = request.host + ":" + std::to_string(request.port);
+    pending->wire = serialize(request);
+    pending->idempotent = request.method == "GET" || request.method == "HEAD" || request.method == "OPTIONS";
+    pending->head = request.method == "HEAD";
+    pending->deadline = Clock::now() + options_.request_timeout;
+
+    {
+        std::lock_guard<std::mutex> guard(submissions_mutex_);
+        if (stopping_.load()) {
+            pending->promise.set_exception(std::make_exception_ptr(HttpClientError("HttpClient is shutting down")));
+            return future;
+        }
+        submissions_.push_back(std::move(pending));
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeup_fd_, &one, sizeof(one));
+    (void)ignored;
+    return future;
+}
+
+HttpClientStats HttpClient::stats() const {
+    HttpClientStats stats;
+    stats.requests = requests_.load(std::memory_order_relaxed);
+    stats.connections_opened = connections_opened_.load(std::memory_order_relaxed);
+    stats.reused = reused_.load(std::memory_order_relaxed);
+    stats.pipelined = pipelined_.load(std::memory_order_relaxed);
+    stats.retries = retries_.load(std::memory_order_relaxed);
+    stats.dns_lookups = dns_lookups_.load(std::memory_order_relaxed);
+    stats.open_connections = open_connections_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+HttpClient::AddressList HttpClient::resolve(const std::string& host, int port) {
+    std::string key = host + ":" + std::to_string(port);
+    {
+        std::lock_guard<std::mutex> guard(dns_mutex_);
+        auto it = dns_cache_.find(key);
+        if (it != dns_cache_.end() && it->second.expires > Clock::now()) {
+            return it->second.addresses;
+        }
+    }
+
+    // Resolved without the lock: a slow lookup must not hold up requests to
+    // names that are cached. Two threads may race to resolve the same name;
+    // both answers are equally good.
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* results = nullptr;
+    dns_lookups_.fetch_add(1, std::memory_order_relaxed);
+    int status = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &results);
+    if (status != 0) {
+        throw HttpClientError("resolving " + host + ": " + gai_strerror(status));
+    }
+    auto addresses = std::make_shared<std::vector<Address>>();
+    for (addrinfo* result = results; result != nullptr; result = result->ai_next) {
+        Address address{};
+        std::memcpy(&address.storage, result->ai_addr, result->ai_addrlen);
+        address.length = result->ai_addrlen;
+        addresses->push_back(address);
+    }
+    freeaddrinfo(results);
+    if (addresses->empty()) {
+        throw HttpClientError("resolving " + host + ": no addresses");
+    }
+
+    std::lock_guard<std::mutex> guard(dns_mutex_);
+    dns_cache_[key] = CachedAddresses{addresses, Clock::now() + options_.dns_ttl};
+    return addresses;
+}
+
+void HttpClient::forget_addresses(const std::string& key) {
+    std::lock_guard<std::mutex> guard(dns_mutex_);
+    dns_cache_.erase(key);
+}
+
+void HttpClient::loop() {
+    std::vector<epoll_event> events(256);
+    Clock::time_point next_scan = Clock::now() + kScanInterval;
+    while (!stopping_.load()) {
+        int timeout = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(next_scan - Clock::now()).count());
+        int ready = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), std::max(0, timeout));
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        for (int i = 0; i < ready; ++i) {
+            if (events[i].data.ptr == nullptr) {
+                uint64_t count;
+                ssize_t ignored = read(wakeup_fd_, &count, sizeof(count));
+                (void)ignored;
+                take_submissions();
+                continue;
+            }
+            Connection& connection = *static_cast<Connection*>(events[i].data.ptr);
+            if (connection.fd >= 0) {
+                on_event(connection, events[i].events);
+            }
+        }
+        closed_.clear();
+
+        Clock::time_point now = Clock::now();
+        if (now >= next_scan) {
+            expire(now);
+            closed_.clear();
+            next_scan = now + kScanInterval;
+        }
+    }
+}
+
+void HttpClient::take_submissions() {
+    std::vector<PendingPtr> batch;
+    {
+        std::lock_guard<std::mutex> guard(submissions_mutex_);
+        batch.swap(submissions_);
+    }
+    for (PendingPtr& pending : batch) {
+        std::unique_ptr<Endpoint>& endpoint = endpoints_[pending->key];
+        if (!endpoint) {
+            endpoint.reset(new Endpoint());
+            endpoint->key = pending->key;
+        }
+        dispatch(*endpoint, std::move(pending));
+    }
+}
+
+void HttpClient::dispatch(Endpoint& endpoint, PendingPtr pending) {
+    // Requests queued earlier keep their turn.
+    if (!endpoint.waiting.empty() || !place(endpoint, pending)) {
+        endpoint.waiting.push_back(std::move(pending));
+    }
+}
+
+// Sends `pending` on an idle connection, a new one, or pipelined behind
+// others, in that order of preference. Returns false, leaving `pending`
+// alone, if every connection is busy; true once it was sent or failed.
+bool HttpClient::place(Endpoint& endpoint, PendingPtr& pending) {
+    Connection* best = nullptr;
+    for (const std::unique_ptr<Connection>& connection : endpoint.connections) {
+        if (connection->broken) {
+            continue;
+        }
+        if (connection->in_flight.empty()) {
+            assign(*connection, std::move(pending));
+            return true;
+        }
+        // Nothing goes behind a request that may not be resent, and a
+        // request that may not be resent goes behind nothing.
+        if (pending->idempotent && connection->in_flight.back()->idempotent &&
+            connection->in_flight.front()->idempotent &&
+            connection->in_flight.size() < options_.max_pipeline_depth &&
+            (best == nullptr || connection->in_flight.size() < best->in_flight.size())) {
+            best = connection.get();
+        }
+    }
+
+    if (endpoint.connections.size() < options_.max_connections_per_endpoint) {
+        std::string error;
+        Connection* connection = open_connection(endpoint, pending->addresses, error);
+        if (connection != nullptr) {
+            assign(*connection, std::move(pending));
+        } else {
+            pending->attempts++;
+            retry_or_fail(endpoint, std::move(pending), error, false);
+        }
+        return true;
+    }
+    if (best != nullptr) {
+        assign(*best, std::move(pending));
+        return true;
+    }
+    return false;
+}
+
+void HttpClient::assign(Connection& connection, PendingPtr pending) {
+    pending->attempts++;
+    if (connection.responses > 0) {
+        reused_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!connection.in_flight.empty()) {
+        pipelined_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        connection.reader.start(pending->head);
+    }
+    connection.out += pending->wire;
+    connection.in_flight.push_back(std::move(pending));
+    if (connection.connected) {
+        flush(connection);
+    }
+}
+
+void HttpClient::fill_from_waiting(Endpoint& endpoint) {
+    while (!endpoint.waiting.empty()) {
+        PendingPtr pending = std::move(endpoint.waiting.front());
+        endpoint.waiting.pop_front();
+        if (!place(endpoint, pending)) {
+            endpoint.waiting.push_front(std::move(pending));
+            return;
+        }
+    }
+}
+
+HttpClient::Connection* HttpClient::open_connection(Endpoint& endpoint, const AddressList& addresses,
+                                                    std::string& error) {
+    const Address& address = (*addresses)[endpoint.next_address++ % addresses->size()];
+    int fd = socket(address.storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        error = std::string("socket: ") + std::strerror(errno);
+        return nullptr;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address.storage), address.length) < 0 &&
+        errno != EINPROGRESS) {
+        error = "connect to " + endpoint.key + ": " + std::strerror(errno);
+        close(fd);
+        forget_addresses(endpoint.key);
+        return nullptr;
+    }
+
+    std::unique_ptr<Connection> connection(new Connection());
+    connection->endpoint = &endpoint;
+    connection->fd = fd;
+    connection->connect_deadline = Clock::now() + options_.connect_timeout;
+    connection->watching_writable = true; // Writable once connected
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.ptr = connection.get();
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+        error = std::string("epoll_ctl: ") + std::strerror(errno);
+        close(fd);
+        return nullptr;
+    }
+    connections_opened_.fetch_add(1, std::memory_order_relaxed);
+    open_connections_.fetch_add(1, std::memory_order_relaxed);
+    endpoint.connections.push_back(std::move(connection));
+    return endpoint.connections.back().get();
+}
+
+void HttpClient::on_event(Connection& connection, uint32_t events) {
+    if (!connection.connected) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0) {
+            forget_addresses(connection.endpoint->key);
+            drop_connection(connection, "connect to " + connection.endpoint->key + ": " + std::strerror(error));
+            return;
+        }
+        if ((events & (EPOLLOUT | EPOLLIN)) == 0) {
+            return;
+        }
+        connection.connected = true;
+        flush(connection);
+        if (connection.fd < 0) {
+            return;
+        }
+    } else if (events & EPOLLOUT) {
+        flush(connection);
+        if (connection.fd < 0) {
+            return;
+        }
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        receive(connection);
+    }
+}
+
+void HttpClient::flush(Connection& connection) {
+    while (connection.out_offset < connection.out.size()) {
+        ssize_t n = ::send(connection.fd, connection.out.data() + connection.out_offset,
+                           connection.out.size() - connection.out_offset, MSG_NOSIGNAL);
+        if (n > 0) {
+            connection.out_offset += static_cast<size_t>(n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            watch_writable(connection, true);
+            return;
+        } else {
+            // Usually the server closed after answering an earlier request,
+            // and that response may still be unread: keep reading until the
+            // close, which then resends what is left.
+            connection.broken = true;
+            connection.out.clear();
+            connection.out_offset = 0;
+            watch_writable(connection, false);
+            return;
+        }
+    }
+    connection.out.clear();
+    connection.out_offset = 0;
+    watch_writable(connection, false);
+}
+
+void HttpClient::watch_writable(Connection& connection, bool writable) {
+    if (connection.watching_writable == writable) {
+        return;
+    }
+    epoll_event event{};
+    event.events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.ptr = &connection;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+    connection.watching_writable = writable;
+}
+
+void HttpClient::receive(Connection& connection) {
+    char buffer[65536];
+    while (true) {
+        ssize_t n = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            connection.in.append(buffer, static_cast<size_t>(n));
+        } else if (n == 0) {
+            HttpClientResponse response;
+            if (!connection.in_flight.empty() && connection.reader.finish_at_close(response)) {
+                finish_response(connection, std::move(response));
+            }
+            if (connection.fd >= 0) {
+                drop_connection(connection, "connection closed by " + connection.endpoint->key);
+            }
+            return;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            drop_connection(connection, std::string("recv: ") + std::strerror(errno));
+            return;
+        }
+
+        // Responses to pipelined requests may arrive back to back in one read.
+        while (connection.in_offset < connection.in.size()) {
+            if (connection.in_flight.empty()) {
+                drop_connection(connection, "unexpected data from " + connection.endpoint->key);
+                return;
+            }
+            HttpClientResponse response;
+            std::string error;
+            ResponseReader::Result result = connection.reader.read(connection.in, connection.in_offset, response, error);
+            if (result == ResponseReader::Result::Error) {
+                drop_connection(connection, error + " from " + connection.endpoint->key);
+                return;
+            }
+            if (result == ResponseReader::Result::NeedMore) {
+                break;
+            }
+            finish_response(connection, std::move(response));
+            if (connection.fd < 0) {
+                return;
+            }
+        }
+        if (connection.in_offset == connection.in.size()) {
+            connection.in.clear();
+            connection.in_offset = 0;
+        } else if (connection.in_offset > 65536) {
+            connection.in.erase(0, connection.in_offset);
+            connection.in_offset = 0;
+        }
+    }
+}
+
+void HttpClient::finish_response(Connection& connection, HttpClientResponse response) {
+    PendingPtr pending = std::move(connection.in_flight.front());
+    connection.in_flight.pop_front();
+    connection.responses++;
+    bool close_after = connection.reader.close_after();
+    pending->promise.set_value(std::move(response));
+
+    if (close_after) {
+        // The server answers nothing more on this connection. The request
+        // next in line was never processed, so resending it does not use up
+        // an attempt (drop_connection() refunds the ones behind it).
+        if (!connection.in_flight.empty()) {
+            connection.in_flight.front()->attempts--;
+        }
+        drop_connection(connection, "connection closed by " + connection.endpoint->key);
+        return;
+    }
+    if (!connection.in_flight.empty()) {
+        connection.reader.start(connection.in_flight.front()->head);
+    } else {
+        connection.idle_since = Clock::now();
+    }
+    fill_from_waiting(*connection.endpoint);
+}
+
+void HttpClient::drop_connection(Connection& connection, const std::string& reason) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.fd, nullptr);
+    close(connection.fd);
+    connection.fd = -1;
+    open_connections_.fetch_sub(1, std::memory_order_relaxed);
+
+    Endpoint& endpoint = *connection.endpoint;
+    std::deque<PendingPtr> orphans = std::move(connection.in_flight);
+    bool sent = connection.connected;
+    for (std::unique_ptr<Connection>& owned : endpoint.connections) {
+        if (owned.get() == &connection) {
+            closed_.push_back(std::move(owned));
+            owned = std::move(endpoint.connections.back());
+            endpoint.connections.pop_back();
+            break;
+        }
+    }
+    for (size_t i = 0; i < orphans.size(); ++i) {
+        // Requests behind the first are idempotent and were only waiting
+        // for it; each connection that breaks charges one attempt, to the
+        // request at its front.
+        if (i > 0) {
+            orphans[i]->attempts--;
+        }
+        retry_or_fail(endpoint, std::move(orphans[i]), reason, sent);
+    }
+    fill_from_waiting(endpoint);
+}
+
+void HttpClient::retry_or_fail(Endpoint& endpoint, PendingPtr pending, const std::string& reason, bool sent) {
+    // A request the server may have acted on is only resent if repeating
+    // it is harmless.
+    if ((!sent || pending->idempotent) && pending->attempts < options_.max_attempts &&
+        Clock::now() < pending->deadline && !stopping_.load()) {
+        retries_.fetch_add(1, std::memory_order_relaxed);
+        dispatch(endpoint, std::move(pending));
+        return;
+    }
+    pending->promise.set_exception(std::make_exception_ptr(HttpClientError(reason)));
+}
+
+void HttpClient::expire(Clock::time_point now) {
+    for (auto& entry : endpoints_) {
+        Endpoint& endpoint = *entry.second;
+        for (auto it = endpoint.waiting.begin(); it != endpoint.waiting.end();) {
+            if ((*it)->deadline <= now) {
+                (*it)->promise.set_exception(
+                    std::make_exception_ptr(HttpClientError("request to " + endpoint.key + " timed out")));
+                it = endpoint.waiting.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        std::vector<Connection*> connections;
+        for (const std::unique_ptr<Connection>& connection : endpoint.connections) {
+            connections.push_back(connection.get());
+        }
+        for (Connection* connection : connections) {
+            if (connection->fd < 0) {
+                continue; // Dropped while an earlier one was handled
+            } else if (!connection->connected && connection->connect_deadline <= now) {
+                forget_addresses(endpoint.key);
+                drop_connection(*connection, "connect to " + endpoint.key + " timed out");
+            } else if (!connection->in_flight.empty() && connection->in_flight.front()->deadline <= now) {
+                // The requests behind it are resent on another connection.
+                PendingPtr pending = std::move(connection->in_flight.front());
+                connection->in_flight.pop_front();
+                pending->promise.set_exception(
+                    std::make_exception_ptr(HttpClientError("request to " + endpoint.key + " timed out")));
+                drop_connection(*connection, "request to " + endpoint.key + " timed out");
+            } else if (connection->in_flight.empty() && now - connection->idle_since >= options_.idle_timeout) {
+                drop_connection(*connection, "idle");
+            }
+        }
+    }
+}
+
+void HttpClient::fail_everything(const std::string& reason) {
+    auto fail = [&reason](PendingPtr& pending) {
+        pending->promise.set_exception(std::make_exception_ptr(HttpClientError(reason)));
+    };
+    for (auto& entry : endpoints_) {
+        Endpoint& endpoint = *entry.second;
+        for (PendingPtr& pending : endpoint.waiting) {
+            fail(pending);
+        }
+        for (std::unique_ptr<Connection>& connection : endpoint.connections) {
+            for (PendingPtr& pending : connection->in_flight) {
+                fail(pending);
+            }
+            close(connection->fd);
+        }
+    }
+    endpoints_.clear();
+    std::lock_guard<std::mutex> guard(submissions_mutex_);
+    for (PendingPtr& pending : submissions_) {
+        fail(pending);
+    }
+    submissions_.clear();
+}
@@ -0,0 +1,166 @@
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include <sys/socket.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Thrown through a request's future when it cannot be answered: the name
+// does not resolve, the server cannot be reached, the connection broke and
+// the request could not safely be resent, the timeout passed, or the
+// response was malformed.
+class HttpClientError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+struct HttpClientRequest {
+    std::string host;
+    int port = 80;
+    std::string method = "GET";
+    std::string target = "/";       // Path and query, e.g. "/hello?block=1"
+    std::vector<std::pair<std::string, std::string>> headers; // Host, Content-Length and Transfer-Encoding are added
+    std::string body;
+};
+
+struct HttpClientResponse {
+    int status = 0;
+    std::string reason;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;               // Content-Length or chunked bodies are decoded
+
+    // First header named `name` (any case), or nullptr.
+    const std::string* header(std::string_view name) const;
+};
+
+struct HttpClientOptions {
+    size_t max_connections_per_endpoint = 8;
+    size_t max_pipeline_depth = 16;      // Requests in flight on one connection; 1 disables pipelining
+    std::chrono::milliseconds connect_timeout{3000};
+    std::chrono::milliseconds request_timeout{10000}; // From send() to the last response byte
+    std::chrono::milliseconds idle_timeout{30000};    // Pooled connections unused this long are closed
+    std::chrono::seconds dns_ttl{60};
+    int max_attempts = 2;                // Sends of one request when a reused connection breaks
+};
+
+// Counters since the client was created.
+struct HttpClientStats {
+    uint64_t requests = 0;
+    uint64_t connections_opened = 0;
+    uint64_t reused = 0;            // Requests sent on a connection that had already carried a response
+    uint64_t pipelined = 0;         // Requests sent while another was still in flight on the connection
+    uint64_t retries = 0;           // Requests resent after their connection broke
+    uint64_t dns_lookups = 0;       // getaddrinfo calls; the rest were answered from the cache
+    size_t open_connections = 0;
+};
+
+// HTTP/1.1 client with a pool of keep-alive connections per host:port, a
+// DNS cache, and pipelining. One background thread runs an epoll loop over
+// every connection; send() only queues the request and returns a future, so
+// any number of threads can issue requests concurrently.
+//
+// A request goes to an idle pooled connection, else to a new connection
+// while the endpoint has fewer than max_connections_per_endpoint, else it is
+// pipelined behind the requests in flight on the least busy connection.
+// Only GET, HEAD and OPTIONS are pipelined, and only they are resent when a
+// kept-alive connection turns out to be closed (the server timed it out or
+// answered "Connection: close" with requests still queued behind). Others
+// wait for a connection of their own.
+class HttpClient {
+public:
+    explicit HttpClient(const HttpClientOptions& options = HttpClientOptions());
+
+    // Fails every request still pending with HttpClientError.
+    ~HttpClient();
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    // Queues `request`. Resolving a name that is not cached blocks the
+    // calling thread for the getaddrinfo() call; nothing else does.
+    std::future<HttpClientResponse> send(HttpClientRequest request);
+
+    std::future<HttpClientResponse> get(const std::string& host, int port, const std::string& target);
+
+    HttpClientStats stats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Address {
+        sockaddr_storage storage;
+        socklen_t length;
+    };
+    using AddressList = std::shared_ptr<const std::vector<Address>>;
+
+    struct CachedAddresses {
+        AddressList addresses;
+        Clock::time_point expires;
+    };
+
+    struct Pending;
+    struct Connection;
+    struct Endpoint;
+    using PendingPtr = std::unique_ptr<Pending>;
+
+    AddressList resolve(const std::string& host, int port);
+    void forget_addresses(const std::string& key);
+
+    void loop();
+    void take_submissions();
+    void dispatch(Endpoint& endpoint, PendingPtr pending);
+    bool place(Endpoint& endpoint, PendingPtr& pending);
+    void assign(Connection& connection, PendingPtr pending);
+    void fill_from_waiting(Endpoint& endpoint);
+    Connection* open_connection(Endpoint& endpoint, const AddressList& addresses, std::string& error);
+    void on_event(Connection& connection, uint32_t events);
+    void flush(Connection& connection);
+    void receive(Connection& connection);
+    void finish_response(Connection& connection, HttpClientResponse response);
+    void drop_connection(Connection& connection, const std::string& reason);
+    void retry_or_fail(Endpoint& endpoint, PendingPtr pending, const std::string& reason, bool sent);
+    void expire(Clock::time_point now);
+    void watch_writable(Connection& connection, bool writable);
+    void fail_everything(const std::string& reason);
+
+    HttpClientOptions options_;
+    int epoll_fd_ = -1;
+    int wakeup_fd_ = -1;
+    std::thread thread_;
+    std::atomic<bool> stopping_{false};
+
+    std::mutex submissions_mutex_;
+    std::vector<PendingPtr> submissions_;
+
+    std::mutex dns_mutex_;
+    std::map<std::string, CachedAddresses> dns_cache_; // Keyed by "host:port"
+
+    // Owned by the loop thread.
+    std::map<std::string, std::unique_ptr<Endpoint>> endpoints_;
+    // Connections dropped while handling a batch of events; freed after the
+    // batch, as later events in it may still point at them.
+    std::vector<std::unique_ptr<Connection>> closed_;
+
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> connections_opened_{0};
+    std::atomic<uint64_t> reused_{0};
+    std::atomic<uint64_t> pipelined_{0};
+    std::atomic<uint64_t> retries_{0};
+    std::atomic<uint64_t> dns_lookups_{0};
+    std::atomic<size_t> open_connections_{0};
+};
+
+#endif // HTTP_CLIENT_H
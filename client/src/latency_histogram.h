@@ -0,0 +1,102 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// HDR-style latency histogram: log-linear buckets with 1024 linear
+// sub-buckets per power of two, so every recorded value keeps about three
+// significant digits (< 0.1% error) from 1 ns up to roughly an hour. Values
+// are nanoseconds. Recording is O(1) and never allocates; each benchmark
+// thread owns its own histogram and they are merged at the end.
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts_(kBucketCount, 0) {}
+
+    void record(int64_t value) {
+        if (value < 0) {
+            value = 0;
+        }
+        if (value > kMaxValue) {
+            value = kMaxValue;
+        }
+        counts_[index_of(static_cast<uint64_t>(value))]++;
+        total_++;
+        sum_ += value;
+        min_ = total_ == 1 ? value : std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        if (other.total_ > 0) {
+            min_ = total_ == 0 ? other.min_ : std::min(min_, other.min_);
+            max_ = std::max(max_, other.max_);
+        }
+        total_ += other.total_;
+        sum_ += other.sum_;
+    }
+
+    uint64_t count() const { return total_; }
+    int64_t min() const { return min_; }
+    int64_t max() const { return max_; }
+    double mean() const { return total_ == 0 ? 0.0 : static_cast<double>(sum_) / static_cast<double>(total_); }
+
+    // Smallest recorded value v such that `percentile` percent of all
+    // samples are <= v (reported as the upper edge of its bucket).
+    int64_t percentile(double percentile) const {
+        if (total_ == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total_) + 0.5);
+        rank = std::max<uint64_t>(1, std::min(rank, total_));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return std::min(upper_edge(i), max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static constexpr int kSubBucketBits = 10;                      // 1024 sub-buckets per power of two
+    static constexpr uint64_t kSubBuckets = 1ull << kSubBucketBits;
+    static constexpr int kMaxExponent = 42;                        // 2^42 ns is about 73 minutes
+    static constexpr int64_t kMaxValue = (1ll << kMaxExponent) - 1;
+    static constexpr size_t kBucketCount = 2 * kSubBuckets + (kMaxExponent - kSubBucketBits - 1) * kSubBuckets;
+
+    // Values below 2048 map to themselves; above that, the top eleven bits
+    // of the value select the bucket.
+    static size_t index_of(uint64_t value) {
+        if (value < 2 * kSubBuckets) {
+            return static_cast<size_t>(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);                // >= kSubBucketBits + 1
+        int shift = exponent - kSubBucketBits;
+        uint64_t sub = (value >> shift) - kSubBuckets;              // [0, kSubBuckets)
+        return static_cast<size_t>(2 * kSubBuckets + (shift - 1) * kSubBuckets + sub);
+    }
+
+    static int64_t upper_edge(size_t index) {
+        if (index < 2 * kSubBuckets) {
+            return static_cast<int64_t>(index);
+        }
+        size_t offset = index - 2 * kSubBuckets;
+        int shift = static_cast<int>(offset / kSubBuckets) + 1;
+        uint64_t sub = offset % kSubBuckets + kSubBuckets;
+        return static_cast<int64_t>(((sub + 1) << shift) - 1);
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    int64_t sum_ = 0;
+    int64_t min_ = 0;
+    int64_t max_ = 0;
+};
+
+#endif // LATENCY_HISTOGRAM_H
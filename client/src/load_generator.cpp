@@ -0,0 +1,922 @@
+#include "load_generator.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <strings.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace {
+
+// All benchmark timestamps are CLOCK_MONOTONIC nanoseconds, the clock
+// timerfd understands, so due times can be armed directly.
+int64_t monotonic_ns() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000ll + now.tv_nsec;
+}
+
+// Shared, read-only inputs of every worker thread.
+struct BenchPlan {
+    const BenchOptions* options;
+    sockaddr_storage address;
+    socklen_t address_length;
+    std::vector<std::string> requests;   // Serialized GET for each entry of options->paths
+    std::vector<double> cumulative;      // Running sum of the path weights
+    int64_t start_ns;
+    int64_t end_ns;                      // Stop issuing requests due at or after this (duration mode)
+    int64_t interval_ns;                 // Per-connection gap between requests (open loop only)
+    std::atomic<int64_t> budget;         // Requests left to issue (request-count mode)
+};
+
+enum class BenchState { Idle, Connecting, Writing, Reading };
+
+struct BenchConnection {
+    int index = 0;                       // Global connection number, used to stagger open-loop schedules
+    int fd = -1;
+    BenchState state = BenchState::Idle;
+    bool reused = false;                 // The socket already carried a response
+    bool retried = false;                // The current request was resent on a fresh socket once
+    bool done = false;
+
+    size_t path = 0;
+    size_t written = 0;
+    std::string in;
+    size_t head_length = 0;              // 0 until the response head is complete
+    int64_t content_length = -1;         // -1: body runs until the server closes (unless chunked)
+    bool chunked = false;                // Transfer-Encoding: chunked
+    bool last_chunk = false;             // Chunked: the zero-size chunk is in, trailers follow
+    size_t chunk_offset = 0;             // Chunked: where the next chunk-size or trailer line starts
+    bool close_after = false;
+    int status = 0;
+
+    int64_t due_ns = 0;                  // When the next request should start
+    int64_t intended_ns = 0;             // When the in-flight request was due
+    int64_t sent_ns = 0;
+    int64_t deadline_ns = 0;
+};
+
+class BenchWorker {
+public:
+    BenchWorker(BenchPlan& plan, int first_connection, int connection_count, uint64_t seed)
+        : plan_(plan), options_(*plan.options), random_(seed), connections_(connection_count) {
+        for (int i = 0; i < connection_count; ++i) {
+            connections_[i].index = first_connection + i;
+        }
+        path_counts_.assign(options_.paths.size(), 0);
+    }
+
+    void run() {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        epoll_event timer{};
+        timer.events = EPOLLIN;
+        timer.data.u32 = kTimerTag;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &timer);
+
+        double per_second = options_.rate / 1e9;
+        for (BenchConnection& connection : connections_) {
+            // Spread the first requests evenly over one interval instead of
+            // sending them all at t=0.
+            connection.due_ns = plan_.start_ns;
+            if (options_.rate > 0) {
+                connection.due_ns += static_cast<int64_t>(connection.index / per_second) % plan_.interval_ns;
+            }
+            schedule(connection);
+        }
+
+        std::vector<epoll_event> events(256);
+        int64_t next_timeout_scan = plan_.start_ns;
+        while (in_flight_ > 0 || !due_.empty()) {
+            int64_t now = monotonic_ns();
+            issue_due(now);
+            if (now >= next_timeout_scan) {
+                expire(now);
+                next_timeout_scan = now + 10000000; // 10 ms
+            }
+            if (in_flight_ == 0 && due_.empty()) {
+                break;
+            }
+
+            arm_timer(due_.empty() ? next_timeout_scan : std::min(due_.top().first, next_timeout_scan));
+            int ready = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), -1);
+            if (ready < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            for (int i = 0; i < ready; ++i) {
+                if (events[i].data.u32 == kTimerTag) {
+                    uint64_t expirations;
+                    ssize_t ignored = read(timer_fd_, &expirations, sizeof(expirations));
+                    (void)ignored;
+                    continue;
+                }
+                progress(connections_[events[i].data.u32]);
+            }
+        }
+
+        for (BenchConnection& connection : connections_) {
+            close_socket(connection);
+        }
+        close(timer_fd_);
+        close(epoll_fd_);
+
+        for (size_t i = 0; i < path_counts_.size(); ++i) {
+            if (path_counts_[i] > 0) {
+                result.path_counts[options_.paths[i].path] += path_counts_[i];
+            }
+        }
+    }
+
+    BenchResult result;
+    int64_t finished_ns = 0;             // When the last response arrived
+
+private:
+    static constexpr uint32_t kTimerTag = 0xffffffffu;
+    using DueEntry = std::pair<int64_t, uint32_t>;
+
+    // Queues `connection` to send its next request at connection.due_ns, or
+    // retires it when the run is over.
+    void schedule(BenchConnection& connection) {
+        connection.state = BenchState::Idle;
+        if (options_.requests == 0 && connection.due_ns >= plan_.end_ns) {
+            connection.done = true;
+            return;
+        }
+        due_.push(DueEntry(connection.due_ns, static_cast<uint32_t>(&connection - connections_.data())));
+    }
+
+    void issue_due(int64_t now) {
+        while (!due_.empty() && due_.top().first <= now) {
+            BenchConnection& connection = connections_[due_.top().second];
+            due_.pop();
+            if (options_.requests > 0 && plan_.budget.fetch_sub(1, std::memory_order_relaxed) <= 0) {
+                connection.done = true;
+                continue;
+            }
+            start_request(connection, now);
+        }
+    }
+
+    void start_request(BenchConnection& connection, int64_t now) {
+        double pick = std::uniform_real_distribution<double>(0.0, plan_.cumulative.back())(random_);
+        connection.path = static_cast<size_t>(
+            std::upper_bound(plan_.cumulative.begin(), plan_.cumulative.end(), pick) - plan_.cumulative.begin());
+        connection.path = std::min(connection.path, plan_.cumulative.size() - 1);
+
+        // Open loop: latency counts from when the request was due, even if
+        // this connection was still busy with the previous one.
+        connection.intended_ns = options_.rate > 0 ? connection.due_ns : now;
+        connection.due_ns = options_.rate > 0 ? connection.due_ns + plan_.interval_ns : now;
+        connection.retried = false;
+        in_flight_++;
+        send_request(connection, now);
+    }
+
+    // (Re)sends the connection's current request, connecting first if needed.
+    void send_request(BenchConnection& connection, int64_t now) {
+        connection.written = 0;
+        connection.in.clear();
+        connection.head_length = 0;
+        connection.content_length = -1;
+        connection.chunked = false;
+        connection.last_chunk = false;
+        connection.chunk_offset = 0;
+        connection.close_after = false;
+        connection.status = 0;
+        connection.sent_ns = now;
+        connection.deadline_ns = now + static_cast<int64_t>(options_.timeout_ms) * 1000000;
+
+        if (connection.fd >= 0) {
+            connection.state = BenchState::Writing;
+            progress(connection);
+            return;
+        }
+
+        const sockaddr* address = reinterpret_cast<const sockaddr*>(&plan_.address);
+        connection.fd = socket(address->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (connection.fd < 0) {
+            fail(connection, result.connect_errors);
+            return;
+        }
+        int one = 1;
+        setsockopt(connection.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        connection.reused = false;
+        result.reconnects++;
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        event.data.u32 = static_cast<uint32_t>(&connection - connections_.data());
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, connection.fd, &event);
+
+        if (connect(connection.fd, address, plan_.address_length) < 0 && errno != EINPROGRESS) {
+            fail(connection, result.connect_errors);
+            return;
+        }
+        connection.state = BenchState::Connecting;
+    }
+
+    // Advances whatever the connection is waiting for; safe to call on any
+    // readiness event, spurious or not.
+    void progress(BenchConnection& connection) {
+        if (connection.state == BenchState::Connecting) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error == EINPROGRESS || error == EALREADY) {
+                return;
+            }
+            if (error != 0) {
+                fail(connection, result.connect_errors);
+                return;
+            }
+            connection.state = BenchState::Writing;
+        }
+
+        if (connection.state == BenchState::Writing) {
+            const std::string& request = plan_.requests[connection.path];
+            while (connection.written < request.size()) {
+                ssize_t n = send(connection.fd, request.data() + connection.written,
+                                 request.size() - connection.written, MSG_NOSIGNAL);
+                if (n > 0) {
+                    connection.written += static_cast<size_t>(n);
+                } else if (n < 0 && errno == EINTR) {
+                    continue;
+                } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    return;
+                } else {
+                    lost(connection);
+                    return;
+                }
+            }
+            connection.state = BenchState::Reading;
+        }
+
+        if (connection.state == BenchState::Reading) {
+            char buffer[16384];
+            while (true) {
+                ssize_t n = recv(connection.fd, buffer, sizeof(buffer), 0);
+                if (n > 0) {
+                    connection.in.append(buffer, static_cast<size_t>(n));
+                    result.bytes_read += static_cast<uint64_t>(n);
+                    if (response_complete(connection)) {
+                        complete(connection);
+                        return;
+                    }
+                } else if (n == 0) {
+                    if (connection.head_length > 0 && connection.content_length < 0 && !connection.chunked) {
+                        complete(connection); // Body delimited by the server closing
+                    } else {
+                        lost(connection);
+                    }
+                    return;
+                } else if (errno == EINTR) {
+                    continue;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return;
+                } else {
+                    lost(connection);
+                    return;
+                }
+            }
+        }
+    }
+
+    // Parses the head once it has arrived; true when the whole body is in.
+    bool response_complete(BenchConnection& connection) {
+        if (connection.head_length == 0) {
+            size_t end = connection.in.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                return false;
+            }
+            connection.head_length = end + 4;
+            if (connection.in.compare(0, 5, "HTTP/") == 0 && connection.in.size() > 12) {
+                connection.status = std::atoi(connection.in.c_str() + 9);
+            }
+
+            size_t line = connection.in.find("\r\n") + 2;
+            while (line < end) {
+                size_t next = connection.in.find("\r\n", line);
+                const char* header = connection.in.c_str() + line;
+                if (strncasecmp(header, "Content-Length:", 15) == 0) {
+                    connection.content_length = std::atoll(header + 15);
+                } else if (strncasecmp(header, "Transfer-Encoding:", 18) == 0) {
+                    std::string value = connection.in.substr(line + 18, next - line - 18);
+                    connection.chunked = strcasestr(value.c_str(), "chunked") != nullptr;
+                } else if (strncasecmp(header, "Connection:", 11) == 0) {
+                    std::string value = connection.in.substr(line + 11, next - line - 11);
+                    connection.close_after = strcasestr(value.c_str(), "close") != nullptr;
+                }
+                line = next + 2;
+            }
+            if (connection.status == 204 || connection.status == 304 || connection.status / 100 == 1) {
+                connection.content_length = 0;
+                connection.chunked = false;
+            } else if (connection.chunked) {
+                connection.content_length = -1; // Transfer-Encoding overrides Content-Length
+                connection.chunk_offset = connection.head_length;
+            }
+        }
+        if (connection.chunked) {
+            return chunked_complete(connection);
+        }
+        return connection.content_length >= 0 &&
+               connection.in.size() >= connection.head_length + static_cast<size_t>(connection.content_length);
+    }
+
+    // Walks the chunk framing as far as it has arrived, without copying the
+    // body, as ResponseReader does in the client library. True once the
+    // last chunk and the trailer section are in. Malformed framing never
+    // completes, and the request times out.
+    bool chunked_complete(BenchConnection& connection) {
+        while (connection.chunk_offset < connection.in.size()) {
+            size_t end = connection.in.find("\r\n", connection.chunk_offset);
+            if (end == std::string::npos) {
+                return false;
+            }
+            if (connection.last_chunk) {
+                bool empty = end == connection.chunk_offset; // Trailer fields are skipped
+                connection.chunk_offset = end + 2;
+                if (empty) {
+                    return true;
+                }
+                continue;
+            }
+            char* parsed_end = nullptr;
+            unsigned long long size = std::strtoull(connection.in.c_str() + connection.chunk_offset, &parsed_end, 16);
+            if (parsed_end == connection.in.c_str() + connection.chunk_offset) {
+                return false;
+            }
+            if (size == 0) {
+                connection.last_chunk = true;
+                connection.chunk_offset = end + 2;
+            } else {
+                connection.chunk_offset = end + 2 + static_cast<size_t>(size) + 2; // Data and its CRLF
+            }
+        }
+        return false;
+    }
+
+    void complete(BenchConnection& connection) {
+        int64_t now = monotonic_ns();
+        result.completed++;
+        result.latency.record(now - connection.intended_ns);
+        result.service_time.record(now - connection.sent_ns);
+        result.status_counts[connection.status]++;
+        if (connection.status < 200 || connection.status >= 300) {
+            result.non_2xx++;
+        }
+        path_counts_[connection.path]++;
+        finished_ns = std::max(finished_ns, now);
+
+        if (!options_.keep_alive || connection.close_after) {
+            close_socket(connection);
+        } else {
+            connection.reused = true;
+        }
+        finish(connection, now);
+    }
+
+    // The socket died mid-request. A kept-alive socket that the server closed
+    // while idle fails before any response byte; that request is resent once
+    // on a fresh connection instead of being counted as an error.
+    void lost(BenchConnection& connection) {
+        bool stale = connection.reused && !connection.retried && connection.in.empty();
+        close_socket(connection);
+        if (stale) {
+            connection.retried = true;
+            send_request(connection, monotonic_ns());
+            return;
+        }
+        fail(connection, result.io_errors);
+    }
+
+    void fail(BenchConnection& connection, uint64_t& counter) {
+        counter++;
+        close_socket(connection);
+        int64_t now = monotonic_ns();
+        finished_ns = std::max(finished_ns, now);
+        if (&counter == &result.connect_errors && options_.rate <= 0) {
+            connection.due_ns = now + 10000000; // Do not spin on a refused connect in closed-loop mode
+        }
+        finish(connection, now);
+    }
+
+    void finish(BenchConnection& connection, int64_t now) {
+        in_flight_--;
+        if (options_.rate <= 0 && connection.due_ns < now) {
+            connection.due_ns = now;
+        }
+        schedule(connection); // Sent from the main loop, which avoids recursing here
+    }
+
+    void expire(int64_t now) {
+        for (BenchConnection& connection : connections_) {
+            if (connection.state != BenchState::Idle && connection.deadline_ns <= now) {
+                fail(connection, result.timeouts);
+            }
+        }
+    }
+
+    void close_socket(BenchConnection& connection) {
+        if (connection.fd >= 0) {
+            close(connection.fd); // Also removes it from the epoll set
+            connection.fd = -1;
+        }
+        connection.reused = false;
+    }
+
+    void arm_timer(int64_t at_ns) {
+        if (at_ns == armed_ns_) {
+            return;
+        }
+        armed_ns_ = at_ns;
+        itimerspec spec{};
+        spec.it_value.tv_sec = at_ns / 1000000000;
+        spec.it_value.tv_nsec = at_ns % 1000000000;
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+            spec.it_value.tv_nsec = 1; // Zero would disarm the timer
+        }
+        timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    BenchPlan& plan_;
+    const BenchOptions& options_;
+    std::mt19937_64 random_;
+    std::vector<BenchConnection> connections_;
+    std::priority_queue<DueEntry, std::vector<DueEntry>, std::greater<DueEntry>> due_;
+    std::vector<uint64_t> path_counts_;
+    int in_flight_ = 0;
+    int epoll_fd_ = -1;
+    int timer_fd_ = -1;
+    int64_t armed_ns_ = -1;
+};
+
+void merge_result(BenchResult& total, const BenchResult& part) {
+    total.completed += part.completed;
+    total.connect_errors += part.connect_errors;
+    total.io_errors += part.io_errors;
+    total.timeouts += part.timeouts;
+    total.non_2xx += part.non_2xx;
+    total.reconnects += part.reconnects;
+    total.bytes_read += part.bytes_read;
+    for (const auto& entry : part.status_counts) {
+        total.status_counts[entry.first] += entry.second;
+    }
+    for (const auto& entry : part.path_counts) {
+        total.path_counts[entry.first] += entry.second;
+    }
+    total.latency.merge(part.latency);
+    total.service_time.merge(part.service_time);
+}
+
+std::string format_duration(int64_t ns) {
+    char buffer[32];
+    if (ns < 1000) {
+        std::snprintf(buffer, sizeof(buffer), "%lldns", static_cast<long long>(ns));
+    } else if (ns < 1000000) {
+        std::snprintf(buffer, sizeof(buffer), "%.2fus", ns / 1e3);
+    } else if (ns < 1000000000) {
+        std::snprintf(buffer, sizeof(buffer), "%.2fms", ns / 1e6);
+    } else {
+        std::snprintf(buffer, sizeof(buffer), "%.2fs", ns / 1e9);
+    }
+    return buffer;
+}
+
+std::string json_escape(const std::string& value) {
+    std::string out;
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            out += buffer;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+const double kReportedPercentiles[] = {50.0, 90.0, 99.0, 99.9};
+
+void write_latency_json(std::ostringstream& out, const LatencyHistogram& histogram) {
+    out << "{\"min_us\": " << histogram.min() / 1e3 << ", \"mean_us\": " << histogram.mean() / 1e3
+        << ", \"max_us\": " << histogram.max() / 1e3;
+    for (double percentile : kReportedPercentiles) {
+        std::ostringstream name;
+        name << percentile;
+        std::string key = name.str();
+        std::replace(key.begin(), key.end(), '.', '_');
+        out << ", \"p" << key << "_us\": " << histogram.percentile(percentile) / 1e3;
+    }
+    out << "}";
+}
+
+void write_latency_text(std::ostringstream& out, const LatencyHistogram& histogram) {
+    out << "    min " << format_duration(histogram.min()) << "  mean "
+        << format_duration(static_cast<int64_t>(histogram.mean())) << "  max " << format_duration(histogram.max()) << "\n";
+    out << "   ";
+    for (double percentile : kReportedPercentiles) {
+        out << " p" << percentile << " " << format_duration(histogram.percentile(percentile));
+    }
+    out << "\n";
+}
+
+// Fetches the server's /metrics with one blocking request and picks out the
+// counters ServerStats needs. Returns false if the server could not be
+// scraped or does not export them.
+bool scrape_server_stats(const BenchPlan& plan, ServerStats& stats) {
+    int fd = socket(plan.address.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    timeval timeout{2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    std::string response;
+    std::string request = "GET /metrics HTTP/1.1\r\nHost: " + plan.options->host + "\r\nConnection: close\r\n\r\n";
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&plan.address), plan.address_length) == 0 &&
+        send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size())) {
+        char buffer[16384];
+        ssize_t n;
+        while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+            response.append(buffer, static_cast<size_t>(n));
+        }
+    }
+    close(fd);
+
+    bool have_requests = false;
+    bool have_syscalls = false;
+    std::istringstream lines(response);
+    std::string line;
+    while (std::getline(lines, line)) {
+        const std::string backend_prefix = "event_loop_backend{backend=\"";
+        if (line.compare(0, backend_prefix.size(), backend_prefix) == 0) {
+            stats.backend = line.substr(backend_prefix.size(), line.find('"', backend_prefix.size()) - backend_prefix.size());
+        } else if (line.compare(0, 20, "http_requests_total ") == 0) {
+            stats.requests = std::strtoull(line.c_str() + 20, nullptr, 10);
+            have_requests = true;
+        } else if (line.compare(0, 26, "event_loop_syscalls_total ") == 0) {
+            stats.syscalls = std::strtoull(line.c_str() + 26, nullptr, 10);
+            have_syscalls = true;
+        } else if (line.compare(0, 31, "process_heap_allocations_total ") == 0) {
+            stats.allocations = std::strtoull(line.c_str() + 31, nullptr, 10);
+            stats.have_allocations = true;
+        }
+    }
+    stats.available = have_requests && have_syscalls;
+    return stats.available;
+}
+
+bool parse_number(const char* text, double& value) {
+    char* end = nullptr;
+    value = std::strtod(text, &end);
+    return end != text && *end == '\0' && std::isfinite(value);
+}
+
+} // namespace
+
+std::string bench_usage() {
+    return "Usage: client bench [options]\n"
+           "  --host HOST            Server host name or address (default: server)\n"
+           "  --port PORT            Server port (default: 8080)\n"
+           "  -c, --connections N    Concurrent connections (default: 16)\n"
+           "  -t, --threads N        Client threads, each driving its share of connections (default: 2)\n"
+           "  -d, --duration SEC     How long to send requests (default: 10)\n"
+           "  -n, --requests N       Send exactly N requests instead of running for a duration\n"
+           "  -r, --rate RPS         Target requests/s across all connections (open loop). Latency is\n"
+           "                         measured from when each request was due, correcting for\n"
+           "                         coordinated omission. Default 0: closed loop, as fast as possible.\n"
+           "  --no-keep-alive        Open a new connection for every request\n"
+           "  --path PATH[@WEIGHT]   Add PATH to the request mix with a relative weight (default: /hello).\n"
+           "                         Repeat for a weighted mix, e.g. --path /hello@3 --path /metrics@1\n"
+           "  --timeout MS           Per-request timeout, counted as an error (default: 5000)\n"
+           "  --json FILE            Also write the report as JSON to FILE (\"-\" prints only JSON to stdout)\n"
+           "  --server-stats         Scrape the server's /metrics before and after the run and report its\n"
+           "                         I/O backend and system calls per request (for A/B runs)\n"
+           "  --help                 Show this help\n";
+}
+
+bool parse_bench_options(int argc, char** argv, BenchOptions& options, bool& help, std::string& error) {
+    enum { kHost = 1000, kPort, kNoKeepAlive, kPath, kTimeout, kJson, kServerStats, kHelp };
+    static const option long_options[] = {
+        {"host", required_argument, nullptr, kHost},
+        {"port", required_argument, nullptr, kPort},
+        {"connections", required_argument, nullptr, 'c'},
+        {"threads", required_argument, nullptr, 't'},
+        {"duration", required_argument, nullptr, 'd'},
+        {"requests", required_argument, nullptr, 'n'},
+        {"rate", required_argument, nullptr, 'r'},
+        {"no-keep-alive", no_argument, nullptr, kNoKeepAlive},
+        {"path", required_argument, nullptr, kPath},
+        {"timeout", required_argument, nullptr, kTimeout},
+        {"json", required_argument, nullptr, kJson},
+        {"server-stats", no_argument, nullptr, kServerStats},
+        {"help", no_argument, nullptr, kHelp},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    help = false;
+    optind = 1;
+    opterr = 0;
+    int option_char;
+    while ((option_char = getopt_long(argc, argv, "c:t:d:n:r:", long_options, nullptr)) != -1) {
+        double value = 0;
+        bool numeric = optarg != nullptr && parse_number(optarg, value);
+        switch (option_char) {
+            case kHost: options.host = optarg; break;
+            case kPort: options.port = static_cast<int>(value); numeric = numeric && value > 0 && value < 65536; break;
+            case 'c': options.connections = static_cast<int>(value); numeric = numeric && value >= 1; break;
+            case 't': options.threads = static_cast<int>(value); numeric = numeric && value >= 1; break;
+            case 'd': options.duration_seconds = value; numeric = numeric && value > 0; break;
+            case 'n': options.requests = static_cast<uint64_t>(value); numeric = numeric && value >= 1; break;
+            case 'r': options.rate = value; numeric = numeric && value >= 0; break;
+            case kTimeout: options.timeout_ms = static_cast<int>(value); numeric = numeric && value >= 1; break;
+            case kNoKeepAlive: options.keep_alive = false; break;
+            case kJson: options.json_path = optarg; break;
+            case kServerStats: options.server_stats = true; break;
+            case kHelp: help = true; return true;
+            case kPath: {
+                BenchPath entry;
+                std::string spec = optarg;
+                size_t at = spec.rfind('@');
+                entry.path = spec.substr(0, at);
+                numeric = true;
+                if (at != std::string::npos) {
+                    numeric = parse_number(spec.c_str() + at + 1, entry.weight) && entry.weight > 0;
+                }
+                if (entry.path.empty() || entry.path[0] != '/') {
+                    error = "path must start with '/': " + spec;
+                    return false;
+                }
+                options.paths.push_back(entry);
+                break;
+            }
+            default:
+                error = "unknown or incomplete option: " + std::string(argv[optind - 1]);
+                return false;
+        }
+        if (optarg != nullptr && option_char != kHost && option_char != kJson && !numeric) {
+            error = "invalid value for " + std::string(argv[optind - 1]) + ": " + optarg;
+            return false;
+        }
+    }
+    if (optind < argc) {
+        error = "unexpected argument: " + std::string(argv[optind]);
+        return false;
+    }
+    if (options.paths.empty()) {
+        options.paths.push_back(BenchPath{"/hello", 1.0});
+    }
+    options.threads = std::min(options.threads, options.connections);
+    return true;
+}
+
+BenchResult run_benchmark(const BenchOptions& options) {
+    BenchPlan plan;
+    plan.options = &options;
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* resolved = nullptr;
+    int status = getaddrinfo(options.host.c_str(), std::to_string(options.port).c_str(), &hints, &resolved);
+    if (status != 0 || resolved == nullptr) {
+        std::cerr << "getaddrinfo(" << options.host << "): " << gai_strerror(status) << std::endl;
+        BenchResult failed;
+        failed.connect_errors = 1;
+        return failed;
+    }
+    std::memcpy(&plan.address, resolved->ai_addr, resolved->ai_addrlen);
+    plan.address_length = resolved->ai_addrlen;
+    freeaddrinfo(resolved);
+
+    std::string host_header = options.host + ":" + std::to_string(options.port);
+    double total_weight = 0;
+    for (const BenchPath& path : options.paths) {
+        plan.requests.push_back("GET " + path.path + " HTTP/1.1\r\nHost: " + host_header +
+                                "\r\nUser-Agent: client-bench\r\nConnection: " +
+                                (options.keep_alive ? "keep-alive" : "close") + "\r\n\r\n");
+        total_weight += path.weight;
+        plan.cumulative.push_back(total_weight);
+    }
+
+    plan.interval_ns = options.rate > 0
+        ? std::max<int64_t>(1, static_cast<int64_t>(options.connections * 1e9 / options.rate))
+        : 0;
+    plan.budget.store(static_cast<int64_t>(options.requests));
+
+    ServerStats before;
+    if (options.server_stats && !scrape_server_stats(plan, before)) {
+        std::cerr << "client bench: could not read event_loop_syscalls_total from /metrics" << std::endl;
+    }
+    plan.start_ns = monotonic_ns();
+    plan.end_ns = options.requests > 0 ? INT64_MAX
+                                       : plan.start_ns + static_cast<int64_t>(options.duration_seconds * 1e9);
+
+    // Connections are split as evenly as possible across threads.
+    std::vector<std::unique_ptr<BenchWorker>> workers;
+    int first = 0;
+    for (int i = 0; i < options.threads; ++i) {
+        int count = options.connections / options.threads + (i < options.connections % options.threads ? 1 : 0);
+        workers.emplace_back(new BenchWorker(plan, first, count, 0x9e3779b97f4a7c15ull * (i + 1)));
+        first += count;
+    }
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back(&BenchWorker::run, worker.get());
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    BenchResult total;
+    int64_t finished = plan.start_ns;
+    for (auto& worker : workers) {
+        merge_result(total, worker->result);
+        finished = std::max(finished, worker->finished_ns);
+    }
+    total.elapsed_seconds = (finished - plan.start_ns) / 1e9;
+
+    ServerStats after;
+    if (before.available && scrape_server_stats(plan, after)) {
+        total.server = after;
+        total.server.requests = after.requests - before.requests;
+        total.server.syscalls = after.syscalls - before.syscalls;
+        total.server.have_allocations = before.have_allocations && after.have_allocations;
+        total.server.allocations = after.allocations - before.allocations;
+    }
+    return total;
+}
+
+std::string format_report(const BenchOptions& options, const BenchResult& result) {
+    std::ostringstream out;
+    out << "Benchmark @ http://" << options.host << ":" << options.port << "\n";
+    out << "  " << options.threads << " threads, " << options.connections << " connections, keep-alive "
+        << (options.keep_alive ? "on" : "off") << ", ";
+    if (options.rate > 0) {
+        out << "open loop at " << options.rate << " req/s\n";
+    } else {
+        out << "closed loop\n";
+    }
+
+    double total_weight = 0;
+    for (const BenchPath& path : options.paths) {
+        total_weight += path.weight;
+    }
+    out << "  Mix:";
+    for (const BenchPath& path : options.paths) {
+        auto count = result.path_counts.find(path.path);
+        out << " " << path.path << " (" << std::lround(100.0 * path.weight / total_weight) << "%, "
+            << (count == result.path_counts.end() ? 0 : count->second) << " sent)";
+    }
+    out << "\n\n";
+
+    double seconds = result.elapsed_seconds > 0 ? result.elapsed_seconds : 1.0;
+    uint64_t errors = result.connect_errors + result.io_errors + result.timeouts;
+    char line[160];
+    std::snprintf(line, sizeof(line), "  %llu requests in %.2fs, %.2f MB read\n",
+                  static_cast<unsigned long long>(result.completed), result.elapsed_seconds, result.bytes_read / 1e6);
+    out << line;
+    std::snprintf(line, sizeof(line), "  Throughput: %.1f req/s, %.2f MB/s\n",
+                  result.completed / seconds, result.bytes_read / 1e6 / seconds);
+    out << line;
+    out << "  Errors: " << errors << " (connect " << result.connect_errors << ", read/write " << result.io_errors
+        << ", timeout " << result.timeouts << "), non-2xx responses: " << result.non_2xx
+        << ", connections opened: " << result.reconnects << "\n";
+    out << "  Status codes:";
+    for (const auto& entry : result.status_counts) {
+        out << " " << entry.first << "=" << entry.second;
+    }
+    out << "\n";
+    if (result.server.available) {
+        std::snprintf(line, sizeof(line), "  Server (%s): %.3f syscalls/request (%llu syscalls, %llu requests)\n",
+                      result.server.backend.c_str(),
+                      result.server.requests > 0 ? static_cast<double>(result.server.syscalls) / result.server.requests : 0.0,
+                      static_cast<unsigned long long>(result.server.syscalls),
+                      static_cast<unsigned long long>(result.server.requests));
+        out << line;
+        if (result.server.have_allocations) {
+            std::snprintf(line, sizeof(line), "  Server heap: %.3f allocations/request (%llu allocations)\n",
+                          result.server.requests > 0 ? static_cast<double>(result.server.allocations) / result.server.requests : 0.0,
+                          static_cast<unsigned long long>(result.server.allocations));
+            out << line;
+        }
+    }
+    out << "\n";
+
+    out << (options.rate > 0 ? "  Latency (from scheduled send, corrected for coordinated omission):\n"
+                             : "  Latency:\n");
+    write_latency_text(out, result.latency);
+    if (options.rate > 0) {
+        out << "  Service time (from actual send):\n";
+        write_latency_text(out, result.service_time);
+    }
+    return out.str();
+}
+
+std::string format_report_json(const BenchOptions& options, const BenchResult& result) {
+    std::ostringstream out;
+    double seconds = result.elapsed_seconds > 0 ? result.elapsed_seconds : 1.0;
+    out << "{\n";
+    out << "  \"target\": \"" << json_escape(options.host) << ":" << options.port << "\",\n";
+    out << "  \"threads\": " << options.threads << ",\n";
+    out << "  \"connections\": " << options.connections << ",\n";
+    out << "  \"keep_alive\": " << (options.keep_alive ? "true" : "false") << ",\n";
+    out << "  \"rate\": " << options.rate << ",\n";
+    out << "  \"paths\": [";
+    for (size_t i = 0; i < options.paths.size(); ++i) {
+        auto count = result.path_counts.find(options.paths[i].path);
+        out << (i > 0 ? ", " : "") << "{\"path\": \"" << json_escape(options.paths[i].path)
+            << "\", \"weight\": " << options.paths[i].weight << ", \"sent\": "
+            << (count == result.path_counts.end() ? 0 : count->second) << "}";
+    }
+    out << "],\n";
+    out << "  \"elapsed_seconds\": " << result.elapsed_seconds << ",\n";
+    out << "  \"requests\": " << result.completed << ",\n";
+    out << "  \"requests_per_second\": " << result.completed / seconds << ",\n";
+    out << "  \"bytes_read\": " << result.bytes_read << ",\n";
+    out << "  \"errors\": {\"connect\": " << result.connect_errors << ", \"io\": " << result.io_errors
+        << ", \"timeout\": " << result.timeouts << ", \"non_2xx\": " << result.non_2xx << "},\n";
+    out << "  \"connections_opened\": " << result.reconnects << ",\n";
+    out << "  \"status_codes\": {";
+    bool first = true;
+    for (const auto& entry : result.status_counts) {
+        out << (first ? "" : ", ") << "\"" << entry.first << "\": " << entry.second;
+        first = false;
+    }
+    out << "},\n";
+    if (result.server.available) {
+        out << "  \"server\": {\"backend\": \"" << json_escape(result.server.backend) << "\", \"requests\": "
+            << result.server.requests << ", \"syscalls\": " << result.server.syscalls << ", \"syscalls_per_request\": "
+            << (result.server.requests > 0 ? static_cast<double>(result.server.syscalls) / result.server.requests : 0.0);
+        if (result.server.have_allocations) {
+            out << ", \"allocations\": " << result.server.allocations << ", \"allocations_per_request\": "
+                << (result.server.requests > 0 ? static_cast<double>(result.server.allocations) / result.server.requests : 0.0);
+        }
+        out << "},\n";
+    }
+    out << "  \"latency\": ";
+    write_latency_json(out, result.latency);
+    out << ",\n  \"service_time\": ";
+    write_latency_json(out, result.service_time);
+    out << "\n}\n";
+    return out.str();
+}
+
+int bench_main(int argc, char** argv) {
+    BenchOptions options;
+    bool help = false;
+    std::string error;
+    if (!parse_bench_options(argc, argv, options, help, error)) {
+        std::cerr << "client bench: " << error << "\n\n" << bench_usage();
+        return 2;
+    }
+    if (help) {
+        std::cout << bench_usage();
+        return 0;
+    }
+
+    BenchResult result = run_benchmark(options);
+
+    if (options.json_path == "-") {
+        std::cout << format_report_json(options, result);
+    } else {
+        std::cout << format_report(options, result);
+        if (!options.json_path.empty()) {
+            std::ofstream file(options.json_path);
+            file << format_report_json(options, result);
+            if (!file) {
+                std::cerr << "client bench: could not write " << options.json_path << std::endl;
+                return 1;
+            }
+        }
+    }
+    return result.completed > 0 ? 0 : 1;
+}
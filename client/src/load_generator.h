@@ -0,0 +1,75 @@
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "latency_histogram.h"
+
+// One entry of the request mix: GET `path` with relative `weight`.
+struct BenchPath {
+    std::string path;
+    double weight = 1.0;
+};
+
+struct BenchOptions {
+    std::string host = "server";
+    int port = 8080;
+    int connections = 16;
+    int threads = 2;
+    double duration_seconds = 10;  // Ignored when `requests` is set
+    uint64_t requests = 0;         // Total requests to send; 0 runs for `duration_seconds`
+    double rate = 0;               // Target requests/s across all connections; 0 = closed loop (as fast as possible)
+    bool keep_alive = true;        // false opens a new connection for every request
+    int timeout_ms = 5000;         // Per-request timeout, counted as an error
+    std::vector<BenchPath> paths;  // Defaults to /hello
+    std::string json_path;         // Where to write the JSON report ("-" = stdout); empty = none
+    bool server_stats = false;     // Scrape the server's /metrics before and after the run
+};
+
+// What the server reported on /metrics about the run (--server-stats), to
+// compare server builds or I/O backends (SERVER_IO_BACKEND) side by side.
+struct ServerStats {
+    bool available = false;
+    std::string backend;           // event_loop_backend label, e.g. "epoll" or "io_uring"
+    uint64_t requests = 0;         // Growth of http_requests_total during the run
+    uint64_t syscalls = 0;         // Growth of event_loop_syscalls_total during the run
+    bool have_allocations = false; // Server exports process_heap_allocations_total
+    uint64_t allocations = 0;      // Growth of process_heap_allocations_total during the run
+};
+
+struct BenchResult {
+    double elapsed_seconds = 0;
+    uint64_t completed = 0;        // Responses fully received, any status
+    uint64_t connect_errors = 0;
+    uint64_t io_errors = 0;        // Resets and truncated responses
+    uint64_t timeouts = 0;
+    uint64_t non_2xx = 0;
+    uint64_t reconnects = 0;       // Connections (re)opened during the run
+    uint64_t bytes_read = 0;
+    std::map<int, uint64_t> status_counts;
+    std::map<std::string, uint64_t> path_counts;
+    // Measured from when each request was *due* to be sent, so a stalled
+    // server is charged for the requests it delayed (coordinated omission).
+    // Equal to `service_time` in closed-loop mode.
+    LatencyHistogram latency;
+    LatencyHistogram service_time; // From the request's first byte written to the response's last byte read
+    ServerStats server;
+};
+
+// Parses `bench` command-line options. Returns false (with `error` set)
+// on invalid input; `help` is set when usage was requested.
+bool parse_bench_options(int argc, char** argv, BenchOptions& options, bool& help, std::string& error);
+
+std::string bench_usage();
+
+BenchResult run_benchmark(const BenchOptions& options);
+
+std::string format_report(const BenchOptions& options, const BenchResult& result);
+std::string format_report_json(const BenchOptions& options, const BenchResult& result);
+
+// Entry point for `client bench ...`; returns the process exit code.
+int bench_main(int argc, char** argv);
+
+#endif // LOAD_GENERATOR_H
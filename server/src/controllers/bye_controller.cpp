@@ -1,6 +1,14 @@
 #include <string>
 #include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "bye_controller.h"
 
-std::string getBye(const HttpRequest& request) {
-    return "HTTP/1.1 200 OK\nContent-Type: text/plain\n\nGoodbye!\n";
+static const std::shared_ptr<const PreparedResponse> kBye = prepare_response(200, "Goodbye!\n");
+
+HttpResponse getBye(const HttpRequest& request) {
+    return HttpResponse::prepared(kBye);
+}
+
+void registerByeRoutes(Router& router) {
+    router.get("/bye", getBye);
 }
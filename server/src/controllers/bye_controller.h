@@ -3,7 +3,11 @@
 
 #include <string>
 #include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "../utils/router.h"
 
-std::string getBye(const HttpRequest& request);
+HttpResponse getBye(const HttpRequest& request);
+
+void registerByeRoutes(Router& router);
 
 #endif // BYE_CONTROLLER_H
@@ -1,6 +1,14 @@
 #include <string>
 #include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "health_controller.h"
 
-std::string getHealthStatus(const HttpRequest& request) {
-    return "HTTP/1.1 200 OK\nContent-Type: text/plain\n\nServer is healthy!\n";
+static const std::shared_ptr<const PreparedResponse> kHealthy = prepare_response(200, "Server is healthy!\n");
+
+HttpResponse getHealthStatus(const HttpRequest& request) {
+    return HttpResponse::prepared(kHealthy);
+}
+
+void registerHealthRoutes(Router& router) {
+    router.get("/health", getHealthStatus);
 }
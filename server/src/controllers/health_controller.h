@@ -3,7 +3,11 @@
 
 #include <string>
 #include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "../utils/router.h"
 
-std::string getHealthStatus(const HttpRequest& request);
+HttpResponse getHealthStatus(const HttpRequest& request);
+
+void registerHealthRoutes(Router& router);
 
 #endif // HEALTH_CONTROLLER_H
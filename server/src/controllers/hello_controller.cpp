@@ -1,6 +1,15 @@
 #include <string>
 #include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "hello_controller.h"
 
-std::string getHello(const HttpRequest& request) {
-    return "HTTP/1.1 200 OK\nContent-Type: text/plain\n\nHello, World!\n";
+// Serialized once at startup; every request shares the same bytes.
+static const std::shared_ptr<const PreparedResponse> kHello = prepare_response(200, "Hello, World!\n");
+
+HttpResponse getHello(const HttpRequest& request) {
+    return HttpResponse::prepared(kHello);
+}
+
+void registerHelloRoutes(Router& router) {
+    router.get("/hello", getHello);
 }
@@ -3,7 +3,11 @@
 
 #include <string>
 #include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "../utils/router.h"
 
-std::string getHello(const HttpRequest& request);
+HttpResponse getHello(const HttpRequest& request);
+
+void registerHelloRoutes(Router& router);
 
 #endif // HELLO_CONTROLLER_H
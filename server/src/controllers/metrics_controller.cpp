@@ -1,30 +1,223 @@
 #include <string>
-#include <map>
 #include <sstream>
 #include "../utils/httprequest.h"
 #include "metrics_controller.h"
+#include "../net/response_cache.h"
+#include "../utils/access_log.h"
+#include "../utils/logger.h"
 
-std::string getMetrics(const HttpRequest& request, int total_requests, const std::map<std::string, int>& endpoint_counts) {
+// Escapes a label value as the Prometheus text format requires: only
+// backslash, double quote and newline, so every route pattern stays distinct.
+static std::string label_safe(const std::string& name) {
+    std::string escaped;
+    escaped.reserve(name.size());
+    for (char c : name) {
+        switch (c) {
+            case '\\': escaped += "\\\\"; break;
+            case '"': escaped += "\\\""; break;
+            case '\n': escaped += "\\n"; break;
+            default: escaped += c; break;
+        }
+    }
+    return escaped;
+}
+
+HttpResponse getMetrics(const HttpRequest& request, const MetricsSnapshot& metrics, const WorkerPoolStats& pool_stats,
+                        const AdmissionStats& admission_stats) {
     std::stringstream response_body;
 
     response_body << "# HELP http_requests_total Total number of HTTP requests.\n";
     response_body << "# TYPE http_requests_total counter\n";
-    response_body << "http_requests_total " << total_requests << "\n\n";
+    response_body << "http_requests_total " << metrics.total_requests << "\n\n";
 
     response_body << "# HELP http_requests_endpoint_total Total number of HTTP requests per endpoint.\n";
     response_body << "# TYPE http_requests_endpoint_total counter\n";
-    for (const auto& pair : endpoint_counts) {
-        std::string endpoint_name = pair.first;
-        // Prometheus labels should be safe: replace non-alphanumeric with underscores
-        for (char &c : endpoint_name) {
-            if (!std::isalnum(c)) {
-                c = '_';
-            }
+    for (const MetricsSnapshot::Endpoint& endpoint : metrics.endpoints) {
+        if (endpoint.requests == 0) {
+            continue;
+        }
+        response_body << "http_requests_endpoint_total{endpoint=\"" << label_safe(endpoint.name) << "\"} " << endpoint.requests << "\n";
+    }
+
+    response_body << "\n# HELP http_responses_total Total number of HTTP responses per status code.\n";
+    response_body << "# TYPE http_responses_total counter\n";
+    for (const auto& status : metrics.status_counts) {
+        response_body << "http_responses_total{code=\"" << status.first << "\"} " << status.second << "\n";
+    }
+
+    response_body << "\n# HELP http_request_duration_seconds Time from a request being parsed to its response being ready.\n";
+    response_body << "# TYPE http_request_duration_seconds histogram\n";
+    for (const MetricsSnapshot::Endpoint& endpoint : metrics.endpoints) {
+        if (endpoint.requests == 0) {
+            continue;
         }
-        response_body << "http_requests_endpoint_total{endpoint=\"" << endpoint_name << "\"} " << pair.second << "\n";
+        std::string label = "endpoint=\"" + label_safe(endpoint.name) + "\"";
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < Metrics::kLatencyBounds.size(); ++b) {
+            cumulative += endpoint.latency_buckets[b];
+            response_body << "http_request_duration_seconds_bucket{" << label << ",le=\"" << Metrics::kLatencyBounds[b] << "\"} " << cumulative << "\n";
+        }
+        cumulative += endpoint.latency_buckets.back();
+        response_body << "http_request_duration_seconds_bucket{" << label << ",le=\"+Inf\"} " << cumulative << "\n";
+        response_body << "http_request_duration_seconds_sum{" << label << "} " << endpoint.latency_ns_sum / 1e9 << "\n";
+        response_body << "http_request_duration_seconds_count{" << label << "} " << endpoint.requests << "\n";
+    }
+
+    response_body << "\n# HELP worker_pool_threads Number of worker threads running request handlers.\n";
+    response_body << "# TYPE worker_pool_threads gauge\n";
+    response_body << "worker_pool_threads " << pool_stats.threads << "\n";
+    response_body << "# HELP worker_pool_busy_threads Worker threads currently running a handler.\n";
+    response_body << "# TYPE worker_pool_busy_threads gauge\n";
+    response_body << "worker_pool_busy_threads " << pool_stats.busy_threads << "\n";
+    response_body << "# HELP worker_pool_queue_depth Requests waiting for a worker.\n";
+    response_body << "# TYPE worker_pool_queue_depth gauge\n";
+    response_body << "worker_pool_queue_depth " << pool_stats.queue_depth << "\n";
+    response_body << "# HELP worker_pool_queue_capacity Maximum number of requests that can wait for a worker.\n";
+    response_body << "# TYPE worker_pool_queue_capacity gauge\n";
+    response_body << "worker_pool_queue_capacity " << pool_stats.queue_capacity << "\n";
+    response_body << "# HELP worker_pool_tasks_total Requests handed to the worker pool.\n";
+    response_body << "# TYPE worker_pool_tasks_total counter\n";
+    response_body << "worker_pool_tasks_total " << pool_stats.submitted << "\n";
+    response_body << "# HELP worker_pool_rejected_total Submissions refused because the queue was full.\n";
+    response_body << "# TYPE worker_pool_rejected_total counter\n";
+    response_body << "worker_pool_rejected_total " << pool_stats.rejected << "\n";
+    response_body << "# HELP worker_pool_queue_wait_seconds Time requests spent queued before a worker picked them up.\n";
+    response_body << "# TYPE worker_pool_queue_wait_seconds summary\n";
+    response_body << "worker_pool_queue_wait_seconds_sum " << pool_stats.wait_ns_total / 1e9 << "\n";
+    response_body << "worker_pool_queue_wait_seconds_count " << pool_stats.started << "\n";
+    response_body << "# HELP worker_pool_queue_wait_seconds_max Longest time a request has spent queued.\n";
+    response_body << "# TYPE worker_pool_queue_wait_seconds_max gauge\n";
+    response_body << "worker_pool_queue_wait_seconds_max " << pool_stats.wait_ns_max / 1e9 << "\n";
+    response_body << "# HELP worker_pool_queue_delay_seconds Recent queue wait (moving average) that load shedding compares against its target.\n";
+    response_body << "# TYPE worker_pool_queue_delay_seconds gauge\n";
+    response_body << "worker_pool_queue_delay_seconds " << pool_stats.wait_ns_average / 1e9 << "\n";
+
+    static const char* kShedReasons[] = {"connection_limit", "rate_limit", "queue_delay"};
+    response_body << "\n# HELP admission_connections Open client connections across all event loops.\n";
+    response_body << "# TYPE admission_connections gauge\n";
+    response_body << "admission_connections " << admission_stats.connections << "\n";
+    response_body << "# HELP admission_max_connections Connection cap (0 = unlimited).\n";
+    response_body << "# TYPE admission_max_connections gauge\n";
+    response_body << "admission_max_connections " << admission_stats.max_connections << "\n";
+    response_body << "# HELP admission_shed_connections_total Connections answered and closed at accept.\n";
+    response_body << "# TYPE admission_shed_connections_total counter\n";
+    for (size_t r = 0; r < static_cast<size_t>(ShedReason::Count); ++r) {
+        response_body << "admission_shed_connections_total{reason=\"" << kShedReasons[r] << "\"} " << metrics.shed_connections[r] << "\n";
+    }
+    response_body << "# HELP admission_shed_requests_total Requests answered 429 or 503 without running a handler.\n";
+    response_body << "# TYPE admission_shed_requests_total counter\n";
+    for (size_t r = 0; r < static_cast<size_t>(ShedReason::Count); ++r) {
+        response_body << "admission_shed_requests_total{reason=\"" << kShedReasons[r] << "\"} " << metrics.shed_requests[r] << "\n";
     }
+    response_body << "# HELP admission_rate_limit_clients Client IPs with a rate limiter bucket, out of admission_rate_limit_capacity.\n";
+    response_body << "# TYPE admission_rate_limit_clients gauge\n";
+    response_body << "admission_rate_limit_clients " << admission_stats.clients_tracked << "\n";
+    response_body << "# HELP admission_rate_limit_capacity Client IPs the rate limiter can track at once.\n";
+    response_body << "# TYPE admission_rate_limit_capacity gauge\n";
+    response_body << "admission_rate_limit_capacity " << admission_stats.clients_capacity << "\n";
+    response_body << "# HELP admission_rate_limit_evictions_total Client buckets evicted to make room for another client.\n";
+    response_body << "# TYPE admission_rate_limit_evictions_total counter\n";
+    response_body << "admission_rate_limit_evictions_total " << admission_stats.client_evictions << "\n";
 
-    std::string response = "HTTP/1.1 200 OK\nContent-Type: text/plain; version=0.0.4; charset=utf-8\n\n" + response_body.str();
+    response_body << "\n# HELP http_parser_requests_total Requests parsed successfully.\n";
+    response_body << "# TYPE http_parser_requests_total counter\n";
+    response_body << "http_parser_requests_total " << metrics.parsed_requests << "\n";
+    response_body << "# HELP http_parser_malformed_total Requests rejected as malformed.\n";
+    response_body << "# TYPE http_parser_malformed_total counter\n";
+    response_body << "http_parser_malformed_total " << metrics.malformed_requests << "\n";
+    response_body << "# HELP http_parser_bytes_total Request bytes scanned by the parser.\n";
+    response_body << "# TYPE http_parser_bytes_total counter\n";
+    response_body << "http_parser_bytes_total " << metrics.parsed_bytes << "\n";
+    response_body << "# HELP http_parser_seconds_total Time spent parsing; bytes_total / seconds_total is the parse throughput.\n";
+    response_body << "# TYPE http_parser_seconds_total counter\n";
+    response_body << "http_parser_seconds_total " << metrics.parse_ns / 1e9 << "\n";
 
-    return response;
+    response_body << "\n# HELP timer_wheel_timers Timers currently armed in the event loops' timer wheels.\n";
+    response_body << "# TYPE timer_wheel_timers gauge\n";
+    response_body << "timer_wheel_timers " << metrics.timers_armed << "\n";
+    response_body << "# HELP timer_wheel_expirations_total Timers that fired.\n";
+    response_body << "# TYPE timer_wheel_expirations_total counter\n";
+    response_body << "timer_wheel_expirations_total " << metrics.timers_fired << "\n";
+    static const char* kTimeoutReasons[] = {"header", "request", "idle"};
+    response_body << "# HELP http_connection_timeouts_total Connections closed (or answered 408) because a deadline expired.\n";
+    response_body << "# TYPE http_connection_timeouts_total counter\n";
+    for (size_t k = 0; k < static_cast<size_t>(TimeoutKind::Count); ++k) {
+        response_body << "http_connection_timeouts_total{reason=\"" << kTimeoutReasons[k] << "\"} " << metrics.timeouts[k] << "\n";
+    }
+
+    response_body << "\n# HELP event_loop_backend I/O backend the event loops run on.\n";
+    response_body << "# TYPE event_loop_backend gauge\n";
+    response_body << "event_loop_backend{backend=\"" << metrics.io_backend << "\"} 1\n";
+    response_body << "# HELP event_loop_syscalls_total System calls made for network I/O; divide by http_requests_total for syscalls per request.\n";
+    response_body << "# TYPE event_loop_syscalls_total counter\n";
+    response_body << "event_loop_syscalls_total " << metrics.io_syscalls << "\n";
+    if (metrics.heap_allocations_counted) {
+        response_body << "\n# HELP process_heap_allocations_total Heap allocations made by the server; divide by http_requests_total for allocations per request.\n";
+        response_body << "# TYPE process_heap_allocations_total counter\n";
+        response_body << "process_heap_allocations_total " << metrics.heap_allocations << "\n";
+    }
+
+    response_body << "\n# HELP static_file_cache_requests_total Static file lookups answered from the mapped file cache (hit) or from disk (miss).\n";
+    response_body << "# TYPE static_file_cache_requests_total counter\n";
+    response_body << "static_file_cache_requests_total{result=\"hit\"} " << metrics.file_cache_hits << "\n";
+    response_body << "static_file_cache_requests_total{result=\"miss\"} " << metrics.file_cache_misses << "\n";
+    response_body << "# HELP sendfile_bytes_total Response bytes sent from files with sendfile().\n";
+    response_body << "# TYPE sendfile_bytes_total counter\n";
+    response_body << "sendfile_bytes_total " << metrics.sendfile_bytes << "\n";
+
+    static const char* kCacheResults[] = {"hit", "miss", "coalesced"};
+    ResponseCacheStats cache_stats = ResponseCache::getInstance().stats();
+    response_body << "\n# HELP response_cache_requests_total Requests to cached routes answered from the cache (hit), by their handler (miss), or with a concurrent miss's response (coalesced).\n";
+    response_body << "# TYPE response_cache_requests_total counter\n";
+    for (size_t r = 0; r < static_cast<size_t>(ResponseCacheResult::Count); ++r) {
+        response_body << "response_cache_requests_total{result=\"" << kCacheResults[r] << "\"} " << metrics.response_cache[r] << "\n";
+    }
+    response_body << "# HELP response_cache_evictions_total Cached responses dropped to stay within the cache size.\n";
+    response_body << "# TYPE response_cache_evictions_total counter\n";
+    response_body << "response_cache_evictions_total " << metrics.response_cache_evictions << "\n";
+    response_body << "# HELP response_cache_entries Responses currently cached.\n";
+    response_body << "# TYPE response_cache_entries gauge\n";
+    response_body << "response_cache_entries " << cache_stats.entries << "\n";
+    response_body << "# HELP response_cache_bytes Bytes of cached responses, out of response_cache_capacity_bytes.\n";
+    response_body << "# TYPE response_cache_bytes gauge\n";
+    response_body << "response_cache_bytes " << cache_stats.bytes << "\n";
+    response_body << "# HELP response_cache_capacity_bytes Size limit of the response cache (0 = disabled).\n";
+    response_body << "# TYPE response_cache_capacity_bytes gauge\n";
+    response_body << "response_cache_capacity_bytes " << cache_stats.capacity_bytes << "\n";
+
+    LoggerStats log_stats = Logger::getInstance().stats();
+    response_body << "\n# HELP log_records_written_total Log records written to the console and log file.\n";
+    response_body << "# TYPE log_records_written_total counter\n";
+    response_body << "log_records_written_total " << log_stats.written << "\n";
+    response_body << "# HELP log_records_dropped_total Log records discarded because the async log queue was full.\n";
+    response_body << "# TYPE log_records_dropped_total counter\n";
+    response_body << "log_records_dropped_total " << log_stats.dropped << "\n";
+    response_body << "# HELP log_queue_depth Log records waiting for the background writer.\n";
+    response_body << "# TYPE log_queue_depth gauge\n";
+    response_body << "log_queue_depth " << log_stats.queue_depth << "\n";
+
+    if (AccessLog::getInstance().enabled()) {
+        AccessLogStats access_stats = AccessLog::getInstance().stats();
+        response_body << "# HELP access_log_records_total Responses recorded in the binary access log.\n";
+        response_body << "# TYPE access_log_records_total counter\n";
+        response_body << "access_log_records_total " << access_stats.records << "\n";
+        response_body << "# HELP access_log_dropped_total Access log records lost because a log file could not be created.\n";
+        response_body << "# TYPE access_log_dropped_total counter\n";
+        response_body << "access_log_dropped_total " << access_stats.dropped << "\n";
+        response_body << "# HELP access_log_files_total Access log files created, rotations included.\n";
+        response_body << "# TYPE access_log_files_total counter\n";
+        response_body << "access_log_files_total " << access_stats.files << "\n";
+    }
+
+    return HttpResponse(200, response_body.str(), "text/plain; version=0.0.4; charset=utf-8");
+}
+
+void registerMetricsRoutes(Router& router, std::vector<const WorkerPool*> pools, const AdmissionControl& admission) {
+    router.get("/metrics", [pools, &admission](const HttpRequest& request) {
+        WorkerPoolStats pool_stats;
+        for (const WorkerPool* pool : pools) {
+            accumulate(pool_stats, pool->stats());
+        }
+        return getMetrics(request, Metrics::getInstance().snapshot(), pool_stats, admission.stats());
+    });
 }
@@ -2,8 +2,19 @@
 #define METRICS_CONTROLLER_H
 
 #include <string>
+#include <vector>
+#include "../net/admission.h"
 #include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "../utils/metrics.h"
+#include "../utils/router.h"
+#include "../utils/worker_pool.h"
 
-std::string getMetrics(const HttpRequest& request, int total_requests, const std::map<std::string, int>& endpoint_counts);
+HttpResponse getMetrics(const HttpRequest& request, const MetricsSnapshot& metrics, const WorkerPoolStats& pool_stats,
+                        const AdmissionStats& admission_stats);
+
+// `pools` are summed into one set of worker_pool_* metrics (there is one
+// pool per event loop in SO_REUSEPORT mode).
+void registerMetricsRoutes(Router& router, std::vector<const WorkerPool*> pools, const AdmissionControl& admission);
 
 #endif // METRICS_CONTROLLER_H
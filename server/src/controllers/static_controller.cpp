@@ -0,0 +1,190 @@
+#include <strings.h>
+#include <algorithm>
+#include <charconv>
+#include <string>
+#include "../utils/metrics.h"
+#include "static_controller.h"
+
+static const std::shared_ptr<const PreparedResponse> kFileNotFound = prepare_response(404, "File not found\n");
+
+static std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// Whether an If-None-Match list names `etag`. The comparison is weak, as
+// RFC 9110 requires for If-None-Match, so a W/ prefix is ignored.
+static bool etag_matches(std::string_view list, std::string_view etag) {
+    if (trim(list) == "*") {
+        return true;
+    }
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view candidate = trim(list.substr(0, comma));
+        if (candidate.substr(0, 2) == "W/") {
+            candidate.remove_prefix(2);
+        }
+        if (candidate == etag) {
+            return true;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+static bool parse_size(std::string_view text, size_t& value) {
+    const char* end = text.data() + text.size();
+    return !text.empty() && std::from_chars(text.data(), end, value).ptr == end;
+}
+
+enum class RangeResult {
+    Ignore,         // No usable single range: send the whole file
+    Satisfiable,
+    Unsatisfiable   // Answer 416
+};
+
+// Parses a single "bytes=first-last", "bytes=first-" or "bytes=-suffix"
+// range against a file of `size` bytes. Multi-range requests are answered
+// with the whole file, which RFC 9110 allows.
+static RangeResult parse_range(std::string_view header, size_t size, size_t& first, size_t& last) {
+    if (header.size() < 6 || strncasecmp(header.data(), "bytes=", 6) != 0) {
+        return RangeResult::Ignore;
+    }
+    std::string_view spec = trim(header.substr(6));
+    size_t dash = spec.find('-');
+    if (dash == std::string_view::npos || spec.find(',') != std::string_view::npos) {
+        return RangeResult::Ignore;
+    }
+    std::string_view start = spec.substr(0, dash);
+    std::string_view end = spec.substr(dash + 1);
+    if (start.empty()) {
+        size_t suffix = 0;
+        if (!parse_size(end, suffix)) {
+            return RangeResult::Ignore;
+        }
+        if (suffix == 0 || size == 0) {
+            return RangeResult::Unsatisfiable;
+        }
+        first = size > suffix ? size - suffix : 0;
+        last = size - 1;
+        return RangeResult::Satisfiable;
+    }
+    if (!parse_size(start, first)) {
+        return RangeResult::Ignore;
+    }
+    last = size > 0 ? size - 1 : 0;
+    if (!end.empty()) {
+        size_t requested = 0;
+        if (!parse_size(end, requested) || requested < first) {
+            return RangeResult::Ignore;
+        }
+        last = std::min(last, requested);
+    }
+    return first < size ? RangeResult::Satisfiable : RangeResult::Unsatisfiable;
+}
+
+static void add_validators(HttpResponse& response, const StaticFile& file) {
+    response.add_header("ETag", file.etag);
+    response.add_header("Last-Modified", file.last_modified);
+    response.add_header("Accept-Ranges", "bytes");
+}
+
+// Relative links in a directory's index.html only resolve against the
+// directory when its URL ends in a slash.
+static HttpResponse redirect_to_directory(const HttpRequest& request) {
+    HttpResponse response(301, "Moved permanently\n");
+    response.add_header("Location", std::string(request.path) + "/");
+    return response;
+}
+
+HttpResponse getStaticFile(const HttpRequest& request, std::string_view path, FileCache& cache) {
+    if (path.empty() && (request.path.empty() || request.path.back() != '/')) {
+        return redirect_to_directory(request); // The root itself, e.g. "/static"
+    }
+    std::string decoded;
+    bool cache_hit = false;
+    std::shared_ptr<const StaticFile> file;
+    if (decode_url_path(path, decoded)) {
+        file = cache.open(decoded, cache_hit);
+    }
+    if (!file) {
+        return HttpResponse::prepared(kFileNotFound);
+    }
+    if (file->directory) {
+        return redirect_to_directory(request);
+    }
+    Metrics::getInstance().record_file_cache(cache_hit);
+
+    // If-None-Match takes precedence over If-Modified-Since.
+    bool not_modified = false;
+    std::string_view none_match = request.header("If-None-Match");
+    if (!none_match.empty()) {
+        not_modified = etag_matches(none_match, file->etag);
+    } else {
+        std::time_t since = 0;
+        std::string_view modified_since = request.header("If-Modified-Since");
+        not_modified = !modified_since.empty() && parse_http_date(modified_since, since) && file->modified <= since;
+    }
+    if (not_modified) {
+        HttpResponse response(304, std::string(), std::string());
+        add_validators(response, *file);
+        return response;
+    }
+
+    // If-Range: the range only applies while the client's partial copy is current.
+    std::string_view range = request.header("Range");
+    std::string_view if_range = request.header("If-Range");
+    if (!range.empty() && (if_range.empty() || if_range == file->etag || if_range == file->last_modified)) {
+        size_t first = 0;
+        size_t last = 0;
+        switch (parse_range(range, file->size, first, last)) {
+            case RangeResult::Unsatisfiable: {
+                HttpResponse response(416, "Range not satisfiable\n");
+                response.add_header("Content-Range", "bytes */" + std::to_string(file->size));
+                return response;
+            }
+            case RangeResult::Satisfiable: {
+                size_t length = last - first + 1;
+                HttpResponse response = file->head
+                    ? HttpResponse::borrowed(206, file->bytes().substr(first, length), file, file->content_type)
+                    : HttpResponse::file(206, file->handle, static_cast<off_t>(first), length, file->content_type);
+                add_validators(response, *file);
+                response.add_header("Content-Range", "bytes " + std::to_string(first) + "-" + std::to_string(last) +
+                                                     "/" + std::to_string(file->size));
+                return response;
+            }
+            case RangeResult::Ignore:
+                break;
+        }
+    }
+
+    if (file->head) {
+        return HttpResponse::with_head(file->head, file->bytes(), file);
+    }
+    HttpResponse response = HttpResponse::file(200, file->handle, 0, file->size, file->content_type);
+    add_validators(response, *file);
+    return response;
+}
+
+void registerStaticRoutes(Router& router, const std::string& prefix, FileCache& cache) {
+    std::string pattern = prefix;
+    while (!pattern.empty() && pattern.back() == '/') {
+        pattern.pop_back();
+    }
+    RouteHandler handler = [&cache](const HttpRequest& request) {
+        const HttpField* rest = request.path_params.find("*");
+        return getStaticFile(request, rest != nullptr ? rest->value : std::string_view(), cache);
+    };
+    // HEAD is how caches and CDNs revalidate; the event loop sends the
+    // same head, validators and Content-Length without the body.
+    router.get(pattern + "/*", handler);
+    router.add("HEAD", pattern + "/*", handler);
+}
@@ -0,0 +1,19 @@
+#ifndef STATIC_CONTROLLER_H
+#define STATIC_CONTROLLER_H
+
+#include <string>
+#include "../utils/file_cache.h"
+#include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "../utils/router.h"
+
+// Answers GET requests for files below the cache's document root, with
+// ETag/Last-Modified validators, conditional 304s and single byte ranges.
+// A directory without a trailing slash is redirected to one (301).
+// `path` is the file's path relative to the root, still URL-encoded.
+HttpResponse getStaticFile(const HttpRequest& request, std::string_view path, FileCache& cache);
+
+// Serves `cache`'s document root under `prefix` (e.g. "/static").
+void registerStaticRoutes(Router& router, const std::string& prefix, FileCache& cache);
+
+#endif // STATIC_CONTROLLER_H
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "../net/async.h"
+#include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "stream_controller.h"
+
+static const uint64_t kDefaultBytes = 1024 * 1024;
+static const size_t kDefaultChunk = 16 * 1024;
+static const int kMaxIntervalMs = 10000;
+
+// Printable lines, repeated to make up every /stream body.
+static const std::string kPattern = [] {
+    std::string pattern;
+    const char alphabet[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    while (pattern.size() < 64 * 1024) {
+        pattern.append(alphabet, sizeof(alphabet) - 1);
+        pattern += '\n';
+    }
+    return pattern;
+}();
+
+template <typename T>
+static T query_number(const HttpRequest& request, std::string_view name, T fallback) {
+    const HttpField* field = request.query_params.find(name);
+    T value = fallback;
+    if (field != nullptr) {
+        std::from_chars(field->value.data(), field->value.data() + field->value.size(), value);
+    }
+    return value;
+}
+
+Task<HttpResponse> postUpload(const HttpRequest& request) {
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t bytes = 0;
+    auto add = [&hash, &bytes](std::string_view data) {
+        for (char c : data) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        }
+        bytes += data.size();
+    };
+
+    if (request.body_stream) {
+        std::string chunk;
+        while (co_await request.body_stream->read(chunk)) {
+            add(chunk);
+        }
+    } else {
+        add(request.body);
+    }
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    co_return HttpResponse(200, "Received " + std::to_string(bytes) + " bytes, fnv1a64 " + hex + "\n");
+}
+
+Task<HttpResponse> postEcho(const HttpRequest& request) {
+    std::string_view content_type = request.header("Content-Type");
+    co_return HttpResponse::stream(200, [request](BodyStream& out) -> Task<void> {
+        if (!request.body_stream) {
+            co_await out.write(request.body);
+            co_return;
+        }
+        std::string chunk;
+        while (co_await request.body_stream->read(chunk)) {
+            co_await out.write(chunk);
+        }
+    }, content_type.empty() ? "application/octet-stream" : std::string(content_type));
+}
+
+Task<HttpResponse> getStream(const HttpRequest& request, uint64_t max_bytes) {
+    uint64_t bytes = std::min(query_number<uint64_t>(request, "bytes", kDefaultBytes), max_bytes);
+    size_t chunk = std::clamp<size_t>(query_number<size_t>(request, "chunk", kDefaultChunk), 1, kPattern.size());
+    int interval_ms = std::clamp(query_number<int>(request, "interval_ms", 0), 0, kMaxIntervalMs);
+
+    co_return HttpResponse::stream(200, [bytes, chunk, interval_ms](BodyStream& out) -> Task<void> {
+        for (uint64_t sent = 0; sent < bytes;) {
+            size_t offset = static_cast<size_t>(sent % kPattern.size());
+            size_t size = static_cast<size_t>(std::min<uint64_t>({chunk, bytes - sent, kPattern.size() - offset}));
+            co_await out.write(std::string_view(kPattern).substr(offset, size));
+            sent += size;
+            if (interval_ms > 0 && sent < bytes) {
+                co_await sleep_for(std::chrono::milliseconds(interval_ms));
+            }
+        }
+    });
+}
+
+void registerStreamRoutes(Router& router, uint64_t max_bytes) {
+    router.add_async("POST", "/upload", postUpload);
+    router.add_async("POST", "/echo", postEcho);
+    router.get_async("/stream", [max_bytes](const HttpRequest& request) { return getStream(request, max_bytes); });
+}
@@ -0,0 +1,29 @@
+#ifndef STREAM_CONTROLLER_H
+#define STREAM_CONTROLLER_H
+
+#include <cstdint>
+#include <string>
+#include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "../utils/router.h"
+#include "../utils/task.h"
+
+// Reads the request body as it arrives and answers with its length and
+// FNV-1a hash, in constant memory whatever the body's size.
+Task<HttpResponse> postUpload(const HttpRequest& request);
+
+// Sends the request body straight back as a chunked response, piece by
+// piece as it arrives.
+Task<HttpResponse> postEcho(const HttpRequest& request);
+
+// Streams a generated body as a chunked response. Query parameters: bytes
+// (total, default 1 MiB, at most `max_bytes`), chunk (bytes per write,
+// default 16 KiB, at most 64 KiB) and interval_ms (pause between writes,
+// default 0).
+Task<HttpResponse> getStream(const HttpRequest& request, uint64_t max_bytes);
+
+// Demonstration routes, registered only with SERVER_DEMO_ROUTES=1: they
+// let any client make the server hash, echo or generate large bodies.
+void registerStreamRoutes(Router& router, uint64_t max_bytes);
+
+#endif // STREAM_CONTROLLER_H
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "../utils/trace.h"
+#include "trace_controller.h"
+
+static const size_t kDefaultCount = 20;
+static const size_t kMaxCount = 1000;
+
+static void append_json_string(std::string& out, const char* text) {
+    out += '"';
+    for (const char* c = text; *c != '\0'; ++c) {
+        unsigned char byte = static_cast<unsigned char>(*c);
+        if (byte == '"' || byte == '\\') {
+            out += '\\';
+            out += *c;
+        } else if (byte < 0x20 || byte >= 0x7f) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", byte);
+            out += escaped;
+        } else {
+            out += *c;
+        }
+    }
+    out += '"';
+}
+
+static void append_microseconds(std::string& out, int64_t ns) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", ns / 1e3);
+    out += text;
+}
+
+// One row per request, one column per stage, in microseconds.
+static std::string render_text(const std::vector<TraceRecord>& records, size_t held) {
+    std::string out = "# " + std::to_string(records.size()) + " slowest of " + std::to_string(held) +
+                      " traced requests (1 in " + std::to_string(Tracer::getInstance().sample_every()) +
+                      " sampled), microseconds\n";
+    char line[256];
+    std::snprintf(line, sizeof(line), "%10s", "total");
+    out += line;
+    for (const TraceSpan& span : trace_spans(TraceRecord())) {
+        std::snprintf(line, sizeof(line), " %9s", span.name);
+        out += line;
+    }
+    out += "  status conn  request\n";
+    for (const TraceRecord& record : records) {
+        std::snprintf(line, sizeof(line), "%10.1f", record.total_ns() / 1e3);
+        out += line;
+        for (const TraceSpan& span : trace_spans(record)) {
+            if (span.begin_ns < 0) {
+                std::snprintf(line, sizeof(line), " %9s", "-");
+            } else {
+                std::snprintf(line, sizeof(line), " %9.1f", (span.end_ns - span.begin_ns) / 1e3);
+            }
+            out += line;
+        }
+        std::snprintf(line, sizeof(line), "  %6u %-5s %s %s\n", record.status, record.new_connection ? "new" : "reuse",
+                      record.method, record.path);
+        out += line;
+    }
+    return out;
+}
+
+// Trace-event format: each request gets its own row ("thread"), with the
+// whole request as the outer slice and its stages nested inside.
+static std::string render_chrome(const std::vector<TraceRecord>& records) {
+    int64_t origin = 0;
+    for (const TraceRecord& record : records) {
+        int64_t start = record.at[static_cast<size_t>(TraceStage::Start)];
+        if (origin == 0 || start < origin) {
+            origin = start;
+        }
+    }
+
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    auto event = [&](const char* name, size_t row, int64_t begin, int64_t end) {
+        out += first ? "\n" : ",\n";
+        first = false;
+        out += "{\"name\":";
+        append_json_string(out, name);
+        out += ",\"cat\":\"request\",\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(row) + ",\"ts\":";
+        append_microseconds(out, begin - origin);
+        out += ",\"dur\":";
+        append_microseconds(out, end - begin);
+        out += "}";
+    };
+    for (size_t i = 0; i < records.size(); ++i) {
+        const TraceRecord& record = records[i];
+        std::string label = std::string(record.method) + " " + record.path + " " + std::to_string(record.status);
+        out += first ? "\n" : ",\n";
+        first = false;
+        out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(i + 1) + ",\"args\":{\"name\":";
+        append_json_string(out, label.c_str());
+        out += "}}";
+        event(record.new_connection ? "request (new connection)" : "request", i + 1,
+              record.at[static_cast<size_t>(TraceStage::Start)], record.at[static_cast<size_t>(TraceStage::Sent)]);
+        for (const TraceSpan& span : trace_spans(record)) {
+            if (span.begin_ns >= 0) {
+                event(span.name, i + 1, span.begin_ns, span.end_ns);
+            }
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+HttpResponse getTrace(const HttpRequest& request) {
+    if (!SERVER_TRACING || Tracer::getInstance().sample_every() == 0) {
+        return HttpResponse(404, "Request tracing is off (set SERVER_TRACE_SAMPLE).\n");
+    }
+    size_t count = kDefaultCount;
+    const HttpField* n = request.query_params.find("n");
+    if (n != nullptr) {
+        std::from_chars(n->value.data(), n->value.data() + n->value.size(), count);
+        count = std::min(count, kMaxCount);
+    }
+    size_t held = 0;
+    std::vector<TraceRecord> records = Tracer::getInstance().slowest(count, held);
+
+    const HttpField* format = request.query_params.find("format");
+    if (format != nullptr && format->value == "chrome") {
+        return HttpResponse(200, render_chrome(records), "application/json");
+    }
+    return HttpResponse(200, render_text(records, held));
+}
+
+void registerTraceRoutes(Router& router) {
+    router.get("/debug/trace", getTrace);
+}
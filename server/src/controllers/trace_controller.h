@@ -0,0 +1,17 @@
+#ifndef TRACE_CONTROLLER_H
+#define TRACE_CONTROLLER_H
+
+#include <string>
+#include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "../utils/router.h"
+
+// Dumps the slowest recently traced requests with their per-stage
+// breakdown. Query parameters: n (how many, default 20) and format ("text",
+// the default, or "chrome" for Chrome trace-event JSON that chrome://tracing
+// and Perfetto open).
+HttpResponse getTrace(const HttpRequest& request);
+
+void registerTraceRoutes(Router& router);
+
+#endif // TRACE_CONTROLLER_H
@@ -0,0 +1,149 @@
+#include "admission.h"
+#include <algorithm>
+
+ClientRateLimiter::ClientRateLimiter(double rate, double burst, size_t clients)
+    : rate_per_ns_(rate / 1e9), burst_(burst),
+      sets_(std::max<size_t>(1, (clients + kShards * kWays - 1) / (kShards * kWays))) {
+    for (size_t s = 0; s < kShards; ++s) {
+        shards_.emplace_back(new Shard());
+        shards_.back()->buckets.resize(sets_ * kWays);
+    }
+}
+
+ClientRateLimiter::Shard& ClientRateLimiter::shard_for(uint32_t address, size_t& set) const {
+    // Fibonacci hashing: the top bits pick the shard, the next ones the set,
+    // so neighbouring addresses land far apart.
+    uint64_t hash = static_cast<uint64_t>(address) * 0x9E3779B97F4A7C15ull;
+    set = static_cast<size_t>((hash >> 26) % sets_);
+    return *shards_[hash >> 58];
+}
+
+void ClientRateLimiter::refill(Bucket& bucket, int64_t now_ns) const {
+    if (now_ns > bucket.updated_ns) {
+        bucket.tokens = std::min(burst_, bucket.tokens + static_cast<double>(now_ns - bucket.updated_ns) * rate_per_ns_);
+        bucket.updated_ns = now_ns;
+    }
+}
+
+bool ClientRateLimiter::try_acquire(uint32_t address, Clock::time_point now) {
+    int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    size_t set = 0;
+    Shard& shard = shard_for(address, set);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    Bucket* ways = &shard.buckets[set * kWays];
+    Bucket* bucket = nullptr;
+    Bucket* victim = &ways[0];
+    for (size_t w = 0; w < kWays; ++w) {
+        if (ways[w].used && ways[w].address == address) {
+            bucket = &ways[w];
+            break;
+        }
+        // Prefer a free bucket, otherwise the one seen longest ago.
+        if (victim->used && (!ways[w].used || ways[w].updated_ns < victim->updated_ns)) {
+            victim = &ways[w];
+        }
+    }
+    if (bucket == nullptr) {
+        if (victim->used) {
+            shard.evictions.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            shard.tracked.fetch_add(1, std::memory_order_relaxed);
+        }
+        bucket = victim;
+        bucket->address = address;
+        bucket->used = true;
+        bucket->tokens = burst_;
+        bucket->updated_ns = now_ns;
+    }
+    refill(*bucket, now_ns);
+    if (bucket->tokens < 1.0) {
+        return false;
+    }
+    bucket->tokens -= 1.0;
+    return true;
+}
+
+bool ClientRateLimiter::has_token(uint32_t address, Clock::time_point now) {
+    int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    size_t set = 0;
+    Shard& shard = shard_for(address, set);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    Bucket* ways = &shard.buckets[set * kWays];
+    for (size_t w = 0; w < kWays; ++w) {
+        if (ways[w].used && ways[w].address == address) {
+            refill(ways[w], now_ns);
+            return ways[w].tokens >= 1.0;
+        }
+    }
+    return true;
+}
+
+size_t ClientRateLimiter::tracked() const {
+    size_t total = 0;
+    for (const std::unique_ptr<Shard>& shard : shards_) {
+        total += shard->tracked.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t ClientRateLimiter::evictions() const {
+    uint64_t total = 0;
+    for (const std::unique_ptr<Shard>& shard : shards_) {
+        total += shard->evictions.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+AdmissionControl::AdmissionControl(const Options& options)
+    : max_connections_(std::max(0, options.max_connections)), max_queue_delay_(options.max_queue_delay) {
+    if (options.rate > 0) {
+        double burst = options.burst > 0 ? options.burst : options.rate;
+        limiter_.reset(new ClientRateLimiter(options.rate, std::max(1.0, burst), options.clients));
+    }
+}
+
+bool AdmissionControl::admit_connection(uint32_t address, ClientRateLimiter::Clock::time_point now,
+                                        ShedReason& reason) {
+    // A client already out of tokens would only be answered 429 on its
+    // first request; turn it away before it costs a connection.
+    if (limiter_ && !limiter_->has_token(address, now)) {
+        reason = ShedReason::RateLimit;
+        return false;
+    }
+    int open = connections_.fetch_add(1, std::memory_order_relaxed);
+    if (max_connections_ > 0 && open >= max_connections_) {
+        connections_.fetch_sub(1, std::memory_order_relaxed);
+        reason = ShedReason::ConnectionLimit;
+        return false;
+    }
+    return true;
+}
+
+void AdmissionControl::release_connection() {
+    connections_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool AdmissionControl::admit_request(uint32_t address, ClientRateLimiter::Clock::time_point now,
+                                     std::chrono::nanoseconds queue_delay, ShedReason& reason) {
+    if (limiter_ && !limiter_->try_acquire(address, now)) {
+        reason = ShedReason::RateLimit;
+        return false;
+    }
+    if (max_queue_delay_.count() > 0 && queue_delay > max_queue_delay_) {
+        reason = ShedReason::QueueDelay;
+        return false;
+    }
+    return true;
+}
+
+AdmissionStats AdmissionControl::stats() const {
+    AdmissionStats stats;
+    stats.connections = connections_.load(std::memory_order_relaxed);
+    stats.max_connections = max_connections_;
+    if (limiter_) {
+        stats.clients_tracked = limiter_->tracked();
+        stats.clients_capacity = limiter_->capacity();
+        stats.client_evictions = limiter_->evictions();
+    }
+    return stats;
+}
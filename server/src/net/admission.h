@@ -0,0 +1,124 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "../utils/metrics.h"
+
+// Per-client token buckets in a fixed-size table. The table is split into
+// shards with a lock each, and every shard is set-associative: a client IP
+// hashes to one set of kWays buckets, and a new client takes over the set's
+// least recently seen bucket. Memory therefore stays bounded however many
+// addresses show up, and an evicted client merely starts over with a full
+// bucket. A decision locks one shard and scans one set, so event loops on
+// different cores rarely contend.
+class ClientRateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kShards = 64;
+    static constexpr size_t kWays = 8;
+
+    // `rate` tokens per second refill each bucket up to `burst`; `clients`
+    // is the number of buckets, rounded up to fill every shard.
+    ClientRateLimiter(double rate, double burst, size_t clients);
+
+    ClientRateLimiter(const ClientRateLimiter&) = delete;
+    ClientRateLimiter& operator=(const ClientRateLimiter&) = delete;
+
+    // Takes one token from the bucket of `address` (IPv4, network byte
+    // order). Returns false, taking nothing, if the bucket is empty.
+    bool try_acquire(uint32_t address, Clock::time_point now);
+
+    // Whether the bucket of `address` holds a token, without taking it.
+    // Unknown clients have a full bucket and are not added to the table.
+    bool has_token(uint32_t address, Clock::time_point now);
+
+    size_t capacity() const { return shards_.size() * sets_ * kWays; }
+    size_t tracked() const;     // Buckets in use
+    uint64_t evictions() const; // Clients pushed out of a full set
+
+private:
+    struct Bucket {
+        uint32_t address = 0;
+        bool used = false;
+        double tokens = 0;
+        int64_t updated_ns = 0; // Last refill, also the recency for eviction
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::vector<Bucket> buckets; // sets_ * kWays, one set after the other
+        std::atomic<size_t> tracked{0};
+        std::atomic<uint64_t> evictions{0};
+    };
+
+    Shard& shard_for(uint32_t address, size_t& set) const;
+    void refill(Bucket& bucket, int64_t now_ns) const;
+
+    double rate_per_ns_;
+    double burst_;
+    size_t sets_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+// Point-in-time view of an AdmissionControl, for /metrics.
+struct AdmissionStats {
+    int connections = 0;         // Open connections, across all event loops
+    int max_connections = 0;     // 0 = unlimited
+    size_t clients_tracked = 0;  // Rate limiter buckets in use
+    size_t clients_capacity = 0;
+    uint64_t client_evictions = 0;
+};
+
+// Decides, before any work is spent on it, whether a connection or request
+// is served or shed with a short prepared answer. Shared by every event loop
+// and cheap enough for the accept path: admitting a connection is one atomic
+// increment plus, with rate limiting on, a lookup in one rate limiter shard.
+//
+// Three limits, each off by default:
+//   - a global cap on open connections (503 at accept),
+//   - a token bucket per client IP, refilled at a fixed request rate (429;
+//     checked at accept and charged per request),
+//   - load shedding: requests are answered 503 while the worker queue delay
+//     measured by the WorkerPool is above a target.
+class AdmissionControl {
+public:
+    struct Options {
+        int max_connections = 0;   // 0 = unlimited
+        double rate = 0;           // Requests per second per client IP, 0 = unlimited
+        double burst = 0;          // Bucket size; 0 = one second's worth of `rate`
+        size_t clients = 65536;    // Client IPs the rate limiter tracks at once
+        std::chrono::nanoseconds max_queue_delay{0}; // 0 = never shed on queue delay
+    };
+
+    explicit AdmissionControl(const Options& options);
+
+    AdmissionControl(const AdmissionControl&) = delete;
+    AdmissionControl& operator=(const AdmissionControl&) = delete;
+
+    // Called for every accepted socket. On true the connection holds a slot
+    // until release_connection(); on false `reason` says why it is shed.
+    bool admit_connection(uint32_t address, ClientRateLimiter::Clock::time_point now, ShedReason& reason);
+    void release_connection();
+
+    // Called for every parsed request, with the current worker queue delay
+    // (WorkerPool::queue_delay()).
+    bool admit_request(uint32_t address, ClientRateLimiter::Clock::time_point now,
+                       std::chrono::nanoseconds queue_delay, ShedReason& reason);
+
+    AdmissionStats stats() const;
+
+private:
+    int max_connections_;
+    std::chrono::nanoseconds max_queue_delay_;
+    std::unique_ptr<ClientRateLimiter> limiter_; // nullptr without a rate limit
+    alignas(64) std::atomic<int> connections_{0};
+};
+
+#endif // ADMISSION_H
@@ -0,0 +1,41 @@
+#include "async.h"
+#include <sys/epoll.h>
+#include <stdexcept>
+#include "event_loop.h"
+
+static EventLoop& require_loop() {
+    EventLoop* loop = EventLoop::current();
+    if (loop == nullptr) {
+        throw std::logic_error("co_await outside of an event loop handler");
+    }
+    return *loop;
+}
+
+void SleepAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    EventLoop& loop = require_loop();
+    auto deadline = std::chrono::steady_clock::now() + duration_;
+    timer_.callback = [&loop, handle]() { loop.resume(handle); };
+    // May run on a worker thread: the wheel belongs to the loop, so the loop
+    // arms the timer itself. Nothing may touch *this after post(): the
+    // handler can already be resumed (and this awaiter gone) by then.
+    TimerWheel::Timer* timer = &timer_;
+    loop.post([&loop, timer, deadline]() { loop.add_timer(*timer, deadline); });
+}
+
+void IoAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    EventLoop& loop = require_loop();
+    wait_.handle = handle;
+    loop.watch(wait_);
+}
+
+SleepAwaiter sleep_for(std::chrono::steady_clock::duration duration) {
+    return SleepAwaiter(duration);
+}
+
+IoAwaiter wait_readable(int fd) {
+    return IoAwaiter(fd, EPOLLIN);
+}
+
+IoAwaiter wait_writable(int fd) {
+    return IoAwaiter(fd, EPOLLOUT);
+}
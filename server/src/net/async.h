@@ -0,0 +1,60 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include "../utils/timer_wheel.h"
+
+class EventLoop;
+
+// Awaitables for coroutine handlers (see task.h). They suspend the handler
+// and hand the wait to the EventLoop serving the request, so a waiting
+// request holds only its coroutine frame, not a thread. When the wait is
+// over the loop resumes the handler on the worker pool. They must be awaited
+// from a handler started by an EventLoop; elsewhere they throw
+// std::logic_error.
+
+class SleepAwaiter {
+public:
+    explicit SleepAwaiter(std::chrono::steady_clock::duration duration) : duration_(duration) {}
+
+    bool await_ready() const noexcept { return duration_ <= std::chrono::steady_clock::duration::zero(); }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const noexcept {}
+
+private:
+    std::chrono::steady_clock::duration duration_;
+    TimerWheel::Timer timer_; // Lives in the suspended handler's frame until it fires
+};
+
+// A pending readiness wait, registered one-shot in the loop's epoll set.
+struct IoWait {
+    int fd = -1;
+    uint32_t events = 0;                 // EPOLLIN and/or EPOLLOUT
+    uint32_t ready = 0;                  // Events reported by epoll
+    std::coroutine_handle<> handle;
+};
+
+class IoAwaiter {
+public:
+    IoAwaiter(int fd, uint32_t events) { wait_.fd = fd; wait_.events = events; }
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    uint32_t await_resume() const noexcept { return wait_.ready; }
+
+private:
+    IoWait wait_;
+};
+
+// co_await sleep_for(std::chrono::seconds(1));
+SleepAwaiter sleep_for(std::chrono::steady_clock::duration duration);
+
+// co_await wait_readable(fd) / wait_writable(fd) on a non-blocking socket
+// owned by the handler. Returns the epoll flags that fired (EPOLLERR and
+// EPOLLHUP included), so the caller can tell readiness from failure.
+IoAwaiter wait_readable(int fd);
+IoAwaiter wait_writable(int fd);
+
+#endif // ASYNC_H
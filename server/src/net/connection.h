@@ -0,0 +1,95 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "../utils/access_log.h"
+#include "../utils/arena.h"
+#include "../utils/body_stream.h"
+#include "../utils/httprequest_parser.h"
+#include "../utils/httpresponse.h"
+#include "../utils/timer_wheel.h"
+#include "../utils/trace.h"
+
+// Where a connection is in its request/response cycle. The event loop only
+// advances the state when enough bytes have arrived or left the socket, so a
+// connection survives any number of partial reads and partial writes.
+enum class ConnectionState {
+    ReadingRequest,   // Accumulating bytes until a full request is buffered
+    Processing,       // Request handed to the worker pool; waiting for its response (a streamed body keeps arriving)
+    WritingResponse,  // Writing out_head + the response payload; back to ReadingRequest on keep-alive
+    Closing           // Last response sent (or peer gone); connection will be closed
+};
+
+// Per-connection state owned by exactly one EventLoop.
+struct Connection {
+    int fd = -1;
+    uint64_t id = 0;            // Unique per loop; tells a late worker completion apart from a reused fd
+    std::string client_ip;
+    int client_port = 0;
+    uint32_t client_address = 0; // IPv4 address in network byte order, the rate limiter's key
+
+    ConnectionState state = ConnectionState::ReadingRequest;
+    bool peer_closed = false;   // Peer shut down its write side (read() returned 0)
+    bool keep_alive = false;    // Whether to read the next request once the current response is written
+    bool chunked_responses = false; // The client speaks HTTP/1.1, so a streamed response can be chunked
+    bool head_request = false;  // HEAD: the response's head goes out, its body (payload, file or stream) does not
+    int requests_served = 0;
+    std::chrono::steady_clock::time_point last_active; // Last time bytes were read or a response finished
+    std::chrono::steady_clock::time_point request_started; // First byte of the current request (accept time for the first one)
+    TimerWheel::Timer timer;    // Fires at whichever deadline applies in the current state
+
+    std::string in_buffer;      // Receive buffer; requests are parsed in place
+    size_t in_consumed = 0;     // Bytes of in_buffer already handed off as complete requests
+    HttpRequestParser parser;   // Resumes where it stopped when more bytes arrive
+    std::shared_ptr<Arena> arena; // Storage of the request being handled; reset for the next one
+    BodyDecoder body_decoder;   // Frames a streamed request body until its last byte is in
+    std::shared_ptr<BodyStream> request_body; // Where that body goes; null once the handler has answered (the rest is discarded)
+    bool body_paused = false;   // request_body is full: reading stops until the handler catches up
+    bool continue_sent = false; // The current request's Expect: 100-continue has been answered
+    HttpResponse response;      // Response being written; its body is sent straight from where it lives
+    std::string out_head;       // Serialized status line and headers (empty for prepared responses)
+    RequestTrace trace;         // Stage timestamps of the current request, if it is sampled
+    AccessRecord access;        // Access log record of the current request, filled in as it goes
+    size_t out_offset = 0;      // How much of out_head + payload (or chunk) has already been written
+    std::shared_ptr<BodyStream> response_body; // Body of a streamed response on its way from the handler
+    std::string chunk_frame;    // Size line of the chunk being sent, after the previous chunk's CRLF
+    std::string chunk_data;     // The chunk being sent, taken from response_body
+    bool last_chunk = false;    // The terminating chunk is queued
+
+    // io_uring backend: requests in flight that still point at this
+    // Connection (it is only freed once all of them have completed), and the
+    // message of the send in flight, which must stay put until it completes.
+    int uring_ops = 0;
+    bool receiving = false;     // The multishot receive is armed
+    bool nonblocking = false;   // Socket switched to O_NONBLOCK for sendfile()
+    bool sending = false;       // A send is in flight
+    msghdr send_message{};
+    iovec send_segments[3]{};
+
+    std::string peer() const { return client_ip + ":" + std::to_string(client_port); }
+
+    // What follows out_head, and the file range after that, as actually sent.
+    std::string_view payload() const { return response.payload(keep_alive, !head_request); }
+    size_t file_length() const { return head_request ? 0 : response.file_length(); }
+
+    // Bytes of the next request have arrived, or the connection is new and
+    // still owes its first request. False only while idle between requests.
+    bool request_pending() const { return requests_served == 0 || in_buffer.size() > in_consumed; }
+
+    // Whether to take bytes off the socket: to parse the next request, or to
+    // feed a streamed body that has room for them.
+    bool wants_input() const {
+        if (body_decoder.active()) {
+            return !body_paused && state != ConnectionState::Closing;
+        }
+        return state == ConnectionState::ReadingRequest;
+    }
+};
+
+#endif // CONNECTION_H
@@ -0,0 +1,1536 @@
+#include "event_loop.h"
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "../utils/access_log.h"
+#include "../utils/httprequest_parser.h"
+#include "../utils/httpresponse.h"
+#include "../utils/logger.h"
+#include "../utils/metrics.h"
+
+bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return false;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Once this many bytes at the front of a receive buffer have been consumed,
+// pipelined leftovers are moved to the front to bound the buffer's growth.
+static const size_t kCompactThreshold = 64 * 1024;
+
+// Unprocessed bytes read ahead of the parser or of a streamed body; the
+// socket keeps the rest, so a large body is never pulled in faster than
+// its handler takes it.
+static const size_t kReadAhead = 64 * 1024;
+
+// Unread bytes of a request body the loop reads and drops, to keep the
+// connection, when the handler answers without reading all of it. Beyond
+// that (or for a chunked body of unknown length) it closes instead.
+static const uint64_t kMaxBodyDrain = 256 * 1024;
+
+// Error responses the loop answers by itself, serialized once at startup.
+static std::shared_ptr<const PreparedResponse> prepare_error(int status) {
+    return prepare_response(status, std::string(status_reason(status)) + "\n");
+}
+
+static const std::shared_ptr<const PreparedResponse> kServiceUnavailable =
+    prepare_response(HttpResponse(503, "Server is overloaded\n").add_header("Retry-After", "1"));
+static const std::shared_ptr<const PreparedResponse> kTooManyConnections =
+    prepare_response(HttpResponse(503, "Too many connections\n").add_header("Retry-After", "1"));
+static const std::shared_ptr<const PreparedResponse> kTooManyRequests =
+    prepare_response(HttpResponse(429, "Too many requests\n").add_header("Retry-After", "1"));
+static const std::shared_ptr<const PreparedResponse> kBadRequest = prepare_error(400);
+static const std::shared_ptr<const PreparedResponse> kPayloadTooLarge = prepare_error(413);
+static const std::shared_ptr<const PreparedResponse> kUriTooLong = prepare_error(414);
+static const std::shared_ptr<const PreparedResponse> kExpectationFailed = prepare_error(417);
+static const std::shared_ptr<const PreparedResponse> kHeadersTooLarge = prepare_error(431);
+static const std::shared_ptr<const PreparedResponse> kNotImplemented = prepare_error(501);
+static const std::shared_ptr<const PreparedResponse> kVersionNotSupported = prepare_error(505);
+static const std::shared_ptr<const PreparedResponse> kInternalError = prepare_error(500);
+static const std::shared_ptr<const PreparedResponse> kRequestTimeout = prepare_error(408);
+static const std::shared_ptr<const PreparedResponse> kHandlerTimeout = prepare_error(503);
+
+// Resolution of the timer wheel; deadlines fire at most this late.
+static const std::chrono::milliseconds kTimerTick(10);
+
+// io_uring backend sizing, per loop: submission queue slots, and the
+// provided receive buffers shared by all of the loop's connections.
+static const unsigned kRingEntries = 4096;
+static const uint16_t kReceiveBufferGroup = 0;
+static const unsigned kReceiveBuffers = 1024;
+static const unsigned kReceiveBufferSize = 4096;
+
+// io_uring user_data is a Connection or IoWait pointer (at least 8-byte
+// aligned) with the operation in the low three bits.
+enum UringOp : uint64_t {
+    kUringIgnore = 0,   // Cancellations; their targets report on their own
+    kUringAccept = 1,
+    kUringWakeup = 2,
+    kUringIoWait = 3,
+    kUringReceive = 4,
+    kUringSend = 5,
+    kUringClose = 6,
+    kUringWritable = 7  // Socket writable again for sendfile()
+};
+static const uint64_t kUringOpMask = 7;
+
+static uint64_t uring_tag(const void* object, UringOp op) {
+    return reinterpret_cast<uintptr_t>(object) | op;
+}
+
+// epoll data.ptr values with the low bit set are IoWait registrations from
+// coroutine handlers; Connection and IoWait objects are at least 4-byte
+// aligned, so the bit is free.
+static void* tag_io_wait(IoWait* wait) {
+    return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(wait) | 1);
+}
+
+static IoWait* as_io_wait(void* ptr) {
+    uintptr_t bits = reinterpret_cast<uintptr_t>(ptr);
+    return (bits & 1) != 0 ? reinterpret_cast<IoWait*>(bits & ~static_cast<uintptr_t>(1)) : nullptr;
+}
+
+static thread_local EventLoop* current_loop = nullptr;
+
+EventLoop::CurrentLoop::CurrentLoop(EventLoop* loop) : previous_(current_loop) {
+    current_loop = loop;
+}
+
+EventLoop::CurrentLoop::~CurrentLoop() {
+    current_loop = previous_;
+}
+
+EventLoop* EventLoop::current() {
+    return current_loop;
+}
+
+EventLoop::EventLoop(int listen_fd, const ServerConfig& config, WorkerPool& pool, AdmissionControl& admission,
+                     RequestHandler handler)
+    : backend_(config.io_backend), epoll_fd_(-1), listen_fd_(listen_fd), wakeup_fd_(-1), max_events_(config.max_events),
+      keepalive_timeout_(std::chrono::milliseconds(config.keepalive_timeout_ms)),
+      header_timeout_(std::chrono::milliseconds(config.header_timeout_ms)),
+      request_timeout_(std::chrono::milliseconds(config.request_timeout_ms)),
+      max_keepalive_requests_(config.max_keepalive_requests),
+      stream_buffer_(static_cast<size_t>(config.stream_buffer_kb) * 1024),
+      access_log_(AccessLog::getInstance().enabled()),
+      backpressure_(config.backpressure), pool_(pool), admission_(admission),
+      handler_(std::move(handler)),
+      head_buffers_(256, 4096), timers_(kTimerTick, std::chrono::steady_clock::now()) {
+    parser_limits_.max_body = static_cast<size_t>(config.max_buffered_body);
+    parser_limits_.max_stream_body = static_cast<uint64_t>(config.max_body_mb) * 1024 * 1024;
+
+    if (backend_ == IoBackend::IoUring) {
+        ring_.reset(new IoUring(kRingEntries));
+        ring_->setup_buffers(kReceiveBufferGroup, kReceiveBuffers, kReceiveBufferSize);
+
+        // Workers write to this eventfd after queueing a completion. The ring
+        // reads it asynchronously, so it stays blocking: io_uring would
+        // otherwise fail the read with EAGAIN instead of waiting for a write.
+        wakeup_fd_ = eventfd(0, EFD_CLOEXEC);
+        if (wakeup_fd_ < 0) {
+            throw std::runtime_error(std::string("eventfd failed: ") + std::strerror(errno));
+        }
+        return;
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        throw std::runtime_error(std::string("epoll_create1 failed: ") + std::strerror(errno));
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
+    event.data.ptr = nullptr; // nullptr marks the listening socket
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event) < 0) {
+        close(epoll_fd_);
+        throw std::runtime_error(std::string("epoll_ctl(listen) failed: ") + std::strerror(errno));
+    }
+
+    // Workers write to this eventfd after queueing a completion.
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ < 0) {
+        close(epoll_fd_);
+        throw std::runtime_error(std::string("eventfd failed: ") + std::strerror(errno));
+    }
+    epoll_event wakeup{};
+    wakeup.events = EPOLLIN | EPOLLET;
+    wakeup.data.ptr = &wakeup_fd_; // Address of the member marks the wakeup fd
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &wakeup) < 0) {
+        close(wakeup_fd_);
+        close(epoll_fd_);
+        throw std::runtime_error(std::string("epoll_ctl(eventfd) failed: ") + std::strerror(errno));
+    }
+}
+
+EventLoop::~EventLoop() {
+    for (auto& entry : connections_) {
+        close(entry.first);
+    }
+    if (wakeup_fd_ >= 0) {
+        close(wakeup_fd_);
+    }
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+    }
+}
+
+void EventLoop::run() {
+    CurrentLoop scope(this);
+    if (ring_) {
+        run_uring();
+    } else {
+        run_epoll();
+    }
+}
+
+void EventLoop::run_epoll() {
+    std::vector<epoll_event> events(max_events_);
+
+    while (!drained()) {
+        int timeout_ms = poll_timeout_ms(std::chrono::steady_clock::now());
+        int ready = epoll_wait(epoll_fd_, events.data(), max_events_, timeout_ms);
+        ++syscalls_;
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR(std::string("epoll_wait failed: ") + std::strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < ready; ++i) {
+            if (events[i].data.ptr == nullptr) {
+                handle_accept();
+                continue;
+            }
+            if (events[i].data.ptr == &wakeup_fd_) {
+                uint64_t counter;
+                while (read(wakeup_fd_, &counter, sizeof(counter)) > 0) {
+                    ++syscalls_;
+                }
+                ++syscalls_;
+                drain_completions();
+                continue;
+            }
+            if (IoWait* wait = as_io_wait(events[i].data.ptr)) {
+                // One-shot: drop the registration, then hand the handler back.
+                // The IoWait lives in the handler's frame; do not touch it after resume().
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, wait->fd, nullptr);
+                ++syscalls_;
+                wait->ready = events[i].events;
+                resume(wait->handle);
+                continue;
+            }
+
+            Connection& connection = *static_cast<Connection*>(events[i].data.ptr);
+            uint32_t flags = events[i].events;
+
+            if (flags & (EPOLLERR | EPOLLHUP)) {
+                close_connection(connection);
+                continue;
+            }
+            if (flags & (EPOLLIN | EPOLLRDHUP)) {
+                handle_readable(connection);
+            }
+            if (connection.state == ConnectionState::Closing) {
+                continue;
+            }
+            if ((flags & EPOLLOUT) && connection.state == ConnectionState::WritingResponse) {
+                handle_writable(connection);
+            }
+        }
+
+        if (!deferred_.empty()) {
+            retry_deferred();
+        }
+
+        run_timers(std::chrono::steady_clock::now());
+        publish_syscalls();
+
+        // Connections closed during this batch are freed only now, so no
+        // event above can observe a dangling Connection pointer.
+        closed_.clear();
+    }
+}
+
+void EventLoop::run_uring() {
+    arm_accept();
+    arm_wakeup();
+
+    while (!drained()) {
+        std::chrono::milliseconds timeout(poll_timeout_ms(std::chrono::steady_clock::now()));
+        if (!ring_->submit_and_wait(timeout)) {
+            LOG_ERROR(std::string("io_uring_enter failed: ") + std::strerror(errno));
+            return;
+        }
+        ring_->for_each_completion([this](const io_uring_cqe& cqe) { handle_completion(cqe); });
+
+        if (!deferred_.empty()) {
+            retry_deferred();
+        }
+
+        run_timers(std::chrono::steady_clock::now());
+        publish_syscalls();
+        closed_.clear();
+    }
+}
+
+void EventLoop::handle_completion(const io_uring_cqe& cqe) {
+    UringOp op = static_cast<UringOp>(cqe.user_data & kUringOpMask);
+    void* object = reinterpret_cast<void*>(cqe.user_data & ~kUringOpMask);
+    Connection* connection = nullptr;
+    switch (op) {
+        case kUringIgnore:
+            return;
+        case kUringAccept:
+            handle_accepted(cqe);
+            return;
+        case kUringWakeup:
+            if (cqe.res < 0) {
+                LOG_ERROR(std::string("eventfd read failed: ") + std::strerror(-cqe.res));
+                return;
+            }
+            drain_completions();
+            arm_wakeup();
+            return;
+        case kUringIoWait: {
+            // The IoWait lives in the handler's frame; do not touch it after resume().
+            IoWait* wait = static_cast<IoWait*>(object);
+            wait->ready = cqe.res > 0 ? static_cast<uint32_t>(cqe.res) : static_cast<uint32_t>(EPOLLERR);
+            resume(wait->handle);
+            return;
+        }
+        case kUringReceive:
+            connection = static_cast<Connection*>(object);
+            handle_received(*connection, cqe);
+            break;
+        case kUringSend:
+            connection = static_cast<Connection*>(object);
+            handle_sent(*connection, cqe);
+            break;
+        case kUringClose:
+            connection = static_cast<Connection*>(object);
+            connection->uring_ops--;
+            break;
+        case kUringWritable:
+            connection = static_cast<Connection*>(object);
+            connection->uring_ops--;
+            if (connection->state != ConnectionState::Closing) {
+                submit_send(*connection); // An error shows up as a failed sendfile()
+            }
+            break;
+    }
+    if (connection->state == ConnectionState::Closing && connection->uring_ops == 0) {
+        draining_.erase(connection);
+    }
+}
+
+void EventLoop::arm_accept() {
+    // One multishot accept keeps producing a completion per connection
+    // until it is cancelled or fails.
+    io_uring_sqe* sqe = ring_->get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = kUringAccept;
+    accept_armed_ = true;
+}
+
+void EventLoop::arm_wakeup() {
+    io_uring_sqe* sqe = ring_->get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeup_fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeup_value_);
+    sqe->len = sizeof(wakeup_value_);
+    sqe->user_data = kUringWakeup;
+}
+
+void EventLoop::arm_receive(Connection& connection) {
+    io_uring_sqe* sqe = ring_->get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection.fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kReceiveBufferGroup;
+    sqe->user_data = uring_tag(&connection, kUringReceive);
+    connection.uring_ops++;
+    connection.receiving = true;
+}
+
+void EventLoop::handle_accepted(const io_uring_cqe& cqe) {
+    if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+        accept_armed_ = false;
+    }
+    if (cqe.res >= 0) {
+        // A multishot accept cannot hand back one address per connection.
+        sockaddr_in client_address{};
+        socklen_t client_addrlen = sizeof(client_address);
+        getpeername(cqe.res, reinterpret_cast<sockaddr*>(&client_address), &client_addrlen);
+        ++syscalls_;
+        add_connection(cqe.res, client_address);
+    } else if (cqe.res != -ECANCELED) {
+        LOG_ERROR(std::string("accept failed: ") + std::strerror(-cqe.res));
+    }
+    if (!accept_armed_ && accepting_) {
+        arm_accept();
+    }
+}
+
+void EventLoop::handle_received(Connection& connection, const io_uring_cqe& cqe) {
+    if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+        connection.uring_ops--;
+        connection.receiving = false;
+    }
+    if (cqe.res > 0) {
+        uint16_t buffer = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (connection.state != ConnectionState::Closing) {
+            append_input(connection, ring_->buffer(buffer), static_cast<size_t>(cqe.res));
+        }
+        ring_->recycle_buffer(buffer);
+    }
+    if (connection.state == ConnectionState::Closing) {
+        return;
+    }
+    if (cqe.res == 0) {
+        connection.peer_closed = true;
+    } else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+        close_connection(connection); // -ECANCELED: paused by pause_body()
+        return;
+    }
+    // Out of provided buffers (or the kernel ended the multishot): re-arm.
+    if (!connection.receiving && !connection.peer_closed && !connection.body_paused) {
+        arm_receive(connection);
+    }
+    // Bytes that arrive while a request is being processed just wait in
+    // the buffer, as they would in the socket with epoll, unless they are
+    // its streamed body.
+    if (connection.state == ConnectionState::ReadingRequest || connection.body_decoder.active()) {
+        handle_readable(connection);
+    }
+}
+
+void EventLoop::submit_send(Connection& connection) {
+    int count = fill_segments(connection, connection.send_segments);
+    while (count == 0 && connection.response_body && next_chunk(connection)) {
+        count = fill_segments(connection, connection.send_segments);
+    }
+    if (count == 0) {
+        if (connection.state == ConnectionState::Closing || (connection.response_body && !connection.last_chunk)) {
+            return; // Failed, or waiting for the producer, whose stream calls stream_ready()
+        }
+        if (connection.file_length() > 0) {
+            // io_uring has no sendfile operation. Call sendfile() directly
+            // on the (then non-blocking) socket and let the ring report when
+            // a full socket buffer has room again.
+            if (!connection.nonblocking) {
+                set_nonblocking(connection.fd);
+                connection.nonblocking = true;
+                syscalls_ += 2;
+            }
+            WriteResult result = write_file(connection);
+            if (result == WriteResult::Failed) {
+                return;
+            }
+            if (result == WriteResult::Blocked) {
+                io_uring_sqe* sqe = ring_->get_sqe();
+                sqe->opcode = IORING_OP_POLL_ADD;
+                sqe->fd = connection.fd;
+                sqe->poll32_events = POLLOUT;
+                sqe->user_data = uring_tag(&connection, kUringWritable);
+                connection.uring_ops++;
+                return;
+            }
+        }
+        finish_response(connection);
+        return;
+    }
+    connection.send_message = msghdr{};
+    connection.send_message.msg_iov = connection.send_segments;
+    connection.send_message.msg_iovlen = static_cast<size_t>(count);
+
+    io_uring_sqe* sqe = ring_->get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = connection.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&connection.send_message);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | (connection.file_length() > 0 ? MSG_MORE : 0);
+    sqe->user_data = uring_tag(&connection, kUringSend);
+    connection.uring_ops++;
+    connection.sending = true;
+}
+
+void EventLoop::handle_sent(Connection& connection, const io_uring_cqe& cqe) {
+    connection.uring_ops--;
+    connection.sending = false;
+    if (connection.state == ConnectionState::Closing) {
+        return;
+    }
+    if (cqe.res < 0) {
+        if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+            submit_send(connection);
+        } else {
+            close_connection(connection);
+        }
+        return;
+    }
+    connection.out_offset += static_cast<size_t>(cqe.res);
+    // A client that keeps reading a large response is not cut off.
+    connection.last_active = std::chrono::steady_clock::now();
+    update_deadline(connection);
+    submit_send(connection); // Finishes the response once everything is out
+}
+
+void EventLoop::publish_syscalls() {
+    if (ring_) {
+        uint64_t enters = ring_->enter_calls();
+        syscalls_ += enters - counted_enters_;
+        counted_enters_ = enters;
+    }
+    if (syscalls_ > 0) {
+        Metrics::getInstance().record_syscalls(syscalls_);
+        syscalls_ = 0;
+    }
+}
+
+void EventLoop::handle_accept() {
+    // Edge-triggered: drain the accept queue until the kernel reports EAGAIN.
+    while (true) {
+        sockaddr_in client_address{};
+        socklen_t client_addrlen = sizeof(client_address);
+        int client_socket = accept4(listen_fd_, (struct sockaddr *)&client_address, &client_addrlen,
+                                    SOCK_NONBLOCK | SOCK_CLOEXEC);
+        ++syscalls_;
+        if (client_socket < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            LOG_ERROR(std::string("accept failed: ") + std::strerror(errno));
+            return;
+        }
+        add_connection(client_socket, client_address);
+    }
+}
+
+void EventLoop::add_connection(int client_socket, const sockaddr_in& client_address) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    ShedReason reason;
+    if (!admission_.admit_connection(client_address.sin_addr.s_addr, now, reason)) {
+        shed_connection(client_socket, reason);
+        return;
+    }
+
+    std::unique_ptr<Connection> connection(new Connection());
+    connection->fd = client_socket;
+    connection->id = next_connection_id_++;
+    connection->client_address = client_address.sin_addr.s_addr;
+    connection->last_active = now;
+    connection->request_started = connection->last_active;
+    connection->parser = HttpRequestParser(parser_limits_);
+    Connection* raw = connection.get();
+    connection->timer.callback = [this, raw]() { handle_deadline(*raw); };
+    char client_ip[INET_ADDRSTRLEN];
+    if (inet_ntop(AF_INET, &(client_address.sin_addr), client_ip, INET_ADDRSTRLEN) != nullptr) {
+        connection->client_ip = client_ip;
+        connection->client_port = ntohs(client_address.sin_port);
+    } else {
+        connection->client_ip = "UNKNOWN";
+        connection->client_port = 0;
+    }
+
+    if (ring_) {
+        arm_receive(*connection);
+    } else {
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = connection.get();
+        ++syscalls_;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client_socket, &event) < 0) {
+            LOG_ERROR(std::string("epoll_ctl(client) failed: ") + std::strerror(errno));
+            close(client_socket);
+            admission_.release_connection();
+            return;
+        }
+    }
+
+    if (!access_log_) {
+        LOG_INFO("Client connected from " + connection->peer());
+    }
+    update_deadline(*connection);
+    connections_[client_socket] = std::move(connection);
+}
+
+void EventLoop::shed_connection(int client_socket, ShedReason reason) {
+    // Answered before any Connection exists: the socket is fresh, so the
+    // short response fits its send buffer and goes out without waiting.
+    const PreparedResponse& response = reason == ShedReason::RateLimit ? *kTooManyRequests : *kTooManyConnections;
+    ssize_t ignored = send(client_socket, response.close_bytes.data(), response.close_bytes.size(),
+                           MSG_DONTWAIT | MSG_NOSIGNAL);
+    (void)ignored;
+    close(client_socket);
+    syscalls_ += 2;
+    Metrics::getInstance().record_shed(reason, true);
+    Metrics::getInstance().record_status(response.status);
+}
+
+void EventLoop::handle_readable(Connection& connection) {
+    bool more = true;
+    while (more) {
+        more = !ring_ && read_socket(connection); // io_uring has already delivered the bytes
+        if (connection.body_decoder.active()) {
+            feed_body(connection);
+        }
+        if (connection.state == ConnectionState::ReadingRequest && !connection.body_decoder.active()) {
+            parse_buffered(connection);
+        }
+        more = more && connection.wants_input();
+    }
+    if (connection.body_decoder.active() && connection.peer_closed && !connection.body_paused &&
+        connection.state != ConnectionState::Closing) {
+        LOG_INFO("Client " + connection.peer() + " closed the connection in the middle of a request body.");
+        close_connection(connection);
+    }
+    if (connection.state != ConnectionState::Closing) {
+        update_deadline(connection);
+    }
+}
+
+void EventLoop::append_input(Connection& connection, const char* data, size_t size) {
+    connection.last_active = std::chrono::steady_clock::now();
+    if (connection.state == ConnectionState::ReadingRequest && !connection.request_pending()) {
+        connection.request_started = connection.last_active; // First byte after an idle period
+    }
+    connection.in_buffer.append(data, size);
+}
+
+bool EventLoop::read_socket(Connection& connection) {
+    // Returns true if it stopped at kReadAhead rather than because the
+    // socket ran dry: the caller processes the bytes and calls again.
+    char buffer[4096];
+    while (connection.wants_input()) {
+        ssize_t n = read(connection.fd, buffer, sizeof(buffer));
+        ++syscalls_;
+        if (n > 0) {
+            append_input(connection, buffer, static_cast<size_t>(n));
+            if (connection.in_buffer.size() - connection.in_consumed >= kReadAhead) {
+                return true;
+            }
+            continue;
+        }
+        if (n == 0) {
+            connection.peer_closed = true;
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        close_connection(connection);
+        break;
+    }
+    return false;
+}
+
+void EventLoop::parse_buffered(Connection& connection) {
+    HttpRequestView view;
+    std::string_view pending(connection.in_buffer.data() + connection.in_consumed,
+                             connection.in_buffer.size() - connection.in_consumed);
+    ParseStatus status = connection.parser.feed(pending, view);
+    if (status == ParseStatus::Complete) {
+        process_request(connection, view);
+        return;
+    }
+    if (status == ParseStatus::Malformed) {
+        reject_malformed(connection);
+        return;
+    }
+    if (connection.peer_closed) {
+        close_connection(connection);
+        return;
+    }
+    if (connection.parser.headers_complete() && connection.parser.expects_continue() && !connection.continue_sent) {
+        send_continue(connection); // A buffered body is still to come
+    }
+}
+
+void EventLoop::send_continue(Connection& connection) {
+    // Nothing else is being written while the loop waits for a request
+    // body, so the interim response goes straight into the empty send
+    // buffer. Should it not fit, the client sends the body anyway once its
+    // own wait runs out (RFC 9110 section 10.1.1).
+    static const char kContinue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    ssize_t ignored = send(connection.fd, kContinue, sizeof(kContinue) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    (void)ignored;
+    ++syscalls_;
+    connection.continue_sent = true;
+}
+
+void EventLoop::process_request(Connection& connection, const HttpRequestView& view) {
+    std::chrono::steady_clock::time_point parsed_at = std::chrono::steady_clock::now();
+    connection.trace.begin(connection.request_started, parsed_at, connection.parser.parse_ns(),
+                           connection.requests_served == 0);
+    if (access_log_) {
+        connection.access.method = static_cast<uint8_t>(access_method(view.method));
+        connection.access.bytes_received = view.length;
+        connection.access.flags = (connection.requests_served == 0 ? kAccessNewConnection : 0) |
+                                  (view.stream_body ? kAccessStreamed : 0);
+    } else {
+        LOG_INFO("Client message from " + connection.peer() + ": " +
+                 std::string(connection.in_buffer, connection.in_consumed, view.length));
+    }
+    connection.trace.mark(TraceStage::Logged);
+
+    connection.state = ConnectionState::Processing;
+    connection.head_request = view.method == "HEAD";
+    if (!admit_request(connection, view, parsed_at)) {
+        return;
+    }
+
+    // Handlers run on another thread while this loop keeps appending to the
+    // receive buffer, so the request is copied into the connection's arena.
+    // The previous handler's frame may still be on its way out on a worker
+    // thread; if it still holds the arena, that one is left to it.
+    if (!connection.arena || connection.arena.use_count() > 1) {
+        connection.arena = std::make_shared<Arena>();
+    } else {
+        connection.arena->reset();
+    }
+    HttpRequest request = HttpRequestParser::to_request(view, connection.arena);
+    request.received_at = parsed_at;
+    connection.trace.describe(request.method, request.path);
+    consume_request(connection, view.length);
+    connection.requests_served++;
+    connection.keep_alive = wants_keep_alive(request) && connection.requests_served < max_keepalive_requests_;
+    connection.chunked_responses = request.version == "HTTP/1.1";
+    if (view.stream_body) {
+        // The body stays behind the head in the receive buffer; feed_body()
+        // hands it to the handler as it arrives.
+        connection.body_decoder.start(view, parser_limits_.max_stream_body);
+        if (view.expect_continue && connection.in_consumed == connection.in_buffer.size()) {
+            send_continue(connection);
+        }
+        connection.request_body = std::make_shared<BodyStream>(stream_buffer_);
+        connect_stream(*connection.request_body, connection);
+        request.body_stream = connection.request_body;
+    }
+
+    // The task owns copies of everything it needs: the Connection may be
+    // closed and freed by this loop while the handler is still running.
+    int fd = connection.fd;
+    uint64_t id = connection.id;
+    std::string peer = connection.peer();
+    connection.trace.mark(TraceStage::Queued);
+    WorkerPool::Task task = [this, fd, id, peer, request, trace = connection.trace]() mutable {
+        CurrentLoop scope(this);
+        trace.mark(TraceStage::HandlerStart);
+        run_handler(handler_(std::move(request), std::move(peer)), fd, id, trace);
+    };
+    dispatch(connection, std::move(task));
+    if (connection.body_decoder.active() && connection.state != ConnectionState::Closing) {
+        feed_body(connection); // Body bytes that came with the head
+    }
+}
+
+bool EventLoop::admit_request(Connection& connection, const HttpRequestView& view,
+                              std::chrono::steady_clock::time_point now) {
+    ShedReason reason;
+    if (admission_.admit_request(connection.client_address, now, pool_.queue_delay(), reason)) {
+        return true;
+    }
+    std::shared_ptr<const PreparedResponse> response =
+        reason == ShedReason::RateLimit ? kTooManyRequests : kServiceUnavailable;
+    LOG_WARN("Shedding request from " + connection.peer() + " with " + std::to_string(response->status) + ".");
+    Metrics::getInstance().record_shed(reason, false);
+    Metrics::getInstance().record_status(response->status);
+
+    // Closing makes a client that ignores Retry-After pay for a new
+    // connection, which admission control sees first.
+    consume_request(connection, view.length);
+    connection.requests_served++;
+    connection.keep_alive = false;
+    start_response(connection, HttpResponse::prepared(std::move(response)));
+    return false;
+}
+
+void EventLoop::consume_request(Connection& connection, size_t length) {
+    connection.parser.reset();
+    connection.continue_sent = false;
+    consume_input(connection, length);
+}
+
+void EventLoop::consume_input(Connection& connection, size_t length) {
+    connection.in_consumed += length;
+    if (connection.in_consumed == connection.in_buffer.size()) {
+        // Common case: nothing pipelined behind this request. clear() keeps
+        // the capacity, so the buffer is reused without reallocating.
+        connection.in_buffer.clear();
+        connection.in_consumed = 0;
+    } else if (connection.in_consumed >= kCompactThreshold) {
+        connection.in_buffer.erase(0, connection.in_consumed);
+        connection.in_consumed = 0;
+    }
+}
+
+void EventLoop::reject_malformed(Connection& connection) {
+    std::shared_ptr<const PreparedResponse> response = kBadRequest;
+    switch (connection.parser.error_status()) {
+        case 413: response = kPayloadTooLarge; break;
+        case 414: response = kUriTooLong; break;
+        case 417: response = kExpectationFailed; break;
+        case 431: response = kHeadersTooLarge; break;
+        case 501: response = kNotImplemented; break;
+        case 505: response = kVersionNotSupported; break;
+        default: break;
+    }
+    int status = response->status;
+    LOG_WARN("Malformed request from " + connection.peer() + ", answering " + std::to_string(status) + ".");
+
+    Metrics::getInstance().record_status(status);
+
+    // The stream can no longer be framed reliably, so close after answering.
+    connection.keep_alive = false;
+    connection.state = ConnectionState::Processing;
+    start_response(connection, HttpResponse::prepared(std::move(response)));
+}
+
+void EventLoop::feed_body(Connection& connection) {
+    while (connection.body_decoder.active() && !connection.body_paused &&
+           connection.in_consumed < connection.in_buffer.size()) {
+        std::string_view pending(connection.in_buffer.data() + connection.in_consumed,
+                                 connection.in_buffer.size() - connection.in_consumed);
+        std::string_view data;
+        size_t used = connection.body_decoder.decode(pending, data);
+        if (used == 0) {
+            break; // Malformed, or the rest of a chunk-size line is still on its way
+        }
+        // Without a request_body the handler has answered already; the rest is dropped.
+        bool room = !connection.request_body || data.empty() || connection.request_body->put(data);
+        consume_input(connection, used);
+        connection.access.bytes_received += used;
+        if (!room) {
+            pause_body(connection);
+        }
+    }
+    if (connection.body_decoder.failed()) {
+        reject_body(connection);
+        return;
+    }
+    if (connection.body_decoder.done() && connection.request_body) {
+        connection.request_body->finish();
+        connection.request_body.reset();
+    }
+}
+
+void EventLoop::pause_body(Connection& connection) {
+    connection.body_paused = true;
+    if (ring_ && connection.receiving) {
+        // Stop the multishot receive, so the rest of the body waits in the
+        // socket; stream_ready() arms it again.
+        io_uring_sqe* sqe = ring_->get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = uring_tag(&connection, kUringReceive);
+        sqe->user_data = kUringIgnore;
+    }
+}
+
+void EventLoop::reject_body(Connection& connection) {
+    int status = connection.body_decoder.error_status();
+    connection.body_decoder = BodyDecoder();
+    connection.body_paused = false;
+    LOG_WARN("Malformed request body from " + connection.peer() + ", answering " + std::to_string(status) + ".");
+    if (connection.request_body) {
+        connection.request_body->fail(status == 413 ? "request body too large" : "malformed request body");
+        connection.request_body.reset();
+    }
+
+    // The stream can no longer be framed reliably, so close after answering.
+    connection.keep_alive = false;
+    if (connection.state == ConnectionState::Processing) {
+        // The handler's late completion is dropped: the state has moved on.
+        Metrics::getInstance().record_status(status);
+        start_response(connection, HttpResponse::prepared(status == 413 ? kPayloadTooLarge : kBadRequest));
+    } else if (connection.state == ConnectionState::ReadingRequest) {
+        close_connection(connection); // The body was being dropped after the response
+    }
+    // WritingResponse: the connection closes once the handler's response is out.
+}
+
+void EventLoop::connect_stream(BodyStream& stream, const Connection& connection) {
+    int fd = connection.fd;
+    uint64_t id = connection.id;
+    stream.connect([this, fd, id]() { post([this, fd, id]() { stream_ready(fd, id); }); },
+                   [this](std::coroutine_handle<> handle) { resume(handle); });
+}
+
+void EventLoop::stream_ready(int fd, uint64_t connection_id) {
+    auto it = connections_.find(fd);
+    if (it == connections_.end() || it->second->id != connection_id) {
+        return; // The connection went away meanwhile
+    }
+    Connection& connection = *it->second;
+    if (connection.body_paused) {
+        // The handler drained its request body: read on.
+        connection.body_paused = false;
+        handle_readable(connection);
+        if (ring_ && connection.state != ConnectionState::Closing && !connection.body_paused &&
+            !connection.receiving && !connection.peer_closed) {
+            arm_receive(connection);
+        }
+    }
+    if (connection.state == ConnectionState::WritingResponse && connection.response_body && !connection.sending) {
+        // The producer wrote more (or finished).
+        if (ring_) {
+            submit_send(connection);
+        } else {
+            handle_writable(connection);
+        }
+    }
+}
+
+void EventLoop::dispatch(Connection& connection, WorkerPool::Task task) {
+    // Keep requests in order: once anything is parked, new work queues behind it.
+    if (deferred_.empty() && pool_.try_submit(task)) {
+        return;
+    }
+
+    if (backpressure_ == BackpressurePolicy::Reject) {
+        LOG_WARN("Worker queue full, rejecting request from " + connection.peer() + " with 503.");
+        Metrics::getInstance().record_status(503);
+        connection.keep_alive = false;
+        start_response(connection, HttpResponse::prepared(kServiceUnavailable));
+        return;
+    }
+
+    deferred_.push_back(DeferredTask{connection.fd, connection.id, std::move(task)});
+    pause_accepting();
+}
+
+void EventLoop::post_completion(int fd, uint64_t connection_id, HttpResponse response, const RequestTrace& trace) {
+    bool wake;
+    {
+        std::lock_guard<std::mutex> guard(completions_mutex_);
+        // Only the first queued item needs to wake the loop: it takes
+        // everything queued by the time it gets to drain_completions().
+        wake = completions_.empty() && posted_.empty();
+        completions_.push_back(Completion{fd, connection_id, std::move(response), trace});
+    }
+    if (wake) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeup_fd_, &one, sizeof(one));
+        (void)ignored;
+        Metrics::getInstance().record_syscalls(1);
+    }
+}
+
+Detached EventLoop::run_handler(Task<HttpResponse> task, int fd, uint64_t connection_id, RequestTrace trace) {
+    HttpResponse response;
+    try {
+        response = co_await std::move(task);
+    } catch (const std::exception& e) {
+        LOG_ERROR(std::string("Request handler failed: ") + e.what());
+        Metrics::getInstance().record_status(500);
+        response = HttpResponse::prepared(kInternalError);
+    }
+    trace.mark(TraceStage::HandlerEnd);
+    post_completion(fd, connection_id, std::move(response), trace);
+}
+
+Detached EventLoop::run_producer(BodyProducer producer, std::shared_ptr<BodyStream> body) {
+    // `producer` lives in this frame, so a lambda's captures outlive the
+    // coroutine it returns.
+    try {
+        co_await producer(*body);
+        body->finish();
+    } catch (const std::exception& e) {
+        LOG_WARN(std::string("Streamed response stopped: ") + e.what());
+        body->fail(e.what());
+    }
+}
+
+void EventLoop::post(std::function<void()> callback) {
+    bool wake;
+    {
+        std::lock_guard<std::mutex> guard(completions_mutex_);
+        wake = completions_.empty() && posted_.empty();
+        posted_.push_back(std::move(callback));
+    }
+    if (wake) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeup_fd_, &one, sizeof(one));
+        (void)ignored;
+        Metrics::getInstance().record_syscalls(1);
+    }
+}
+
+void EventLoop::drain(std::chrono::steady_clock::time_point deadline) {
+    post([this, deadline]() { start_drain(deadline); });
+}
+
+void EventLoop::start_drain(std::chrono::steady_clock::time_point deadline) {
+    if (stopping_) {
+        return;
+    }
+    stopping_ = true;
+    if (accepting_) {
+        stop_accepting();
+    }
+    // Idle keep-alive connections are left open rather than closed under a
+    // client that may be sending on them right now: their next request is
+    // answered with "Connection: close", or their idle timeout closes them.
+    LOG_INFO("Draining " + std::to_string(connections_.size()) + " connection(s).");
+    drain_timer_.callback = [this]() { close_remaining(); };
+    timers_.schedule(drain_timer_, deadline);
+}
+
+void EventLoop::close_remaining() {
+    if (connections_.empty()) {
+        return;
+    }
+    LOG_WARN("Drain deadline passed, closing " + std::to_string(connections_.size()) + " connection(s).");
+    std::vector<Connection*> open;
+    open.reserve(connections_.size());
+    for (auto& entry : connections_) {
+        open.push_back(entry.second.get());
+    }
+    for (Connection* connection : open) {
+        close_connection(*connection);
+    }
+}
+
+bool EventLoop::drained() const {
+    // With io_uring, closed connections are only gone once their
+    // cancellations and closes have completed.
+    return stopping_ && connections_.empty() && draining_.empty();
+}
+
+void EventLoop::add_timer(TimerWheel::Timer& timer, std::chrono::steady_clock::time_point deadline) {
+    timers_.schedule(timer, deadline);
+}
+
+void EventLoop::run_timers(std::chrono::steady_clock::time_point now) {
+    size_t fired = timers_.advance(now);
+    if (fired > 0 || timers_.size() != published_timers_) {
+        Metrics::getInstance().record_timers(static_cast<int64_t>(timers_.size()) - static_cast<int64_t>(published_timers_), fired);
+        published_timers_ = timers_.size();
+    }
+}
+
+int EventLoop::poll_timeout_ms(std::chrono::steady_clock::time_point now) const {
+    // While requests are parked by backpressure, poll often so they are
+    // retried as soon as workers free up queue space.
+    std::chrono::steady_clock::duration max_wait = deferred_.empty() ? std::chrono::seconds(1) : kTimerTick;
+    return static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(timers_.time_until_next(now, max_wait)).count());
+}
+
+void EventLoop::resume(std::coroutine_handle<> handle) {
+    WorkerPool::Task task = [this, handle]() {
+        CurrentLoop scope(this);
+        handle.resume();
+    };
+    if (!pool_.try_submit(task)) {
+        task(); // Pool saturated: finish on the loop thread rather than drop the request
+    }
+}
+
+void EventLoop::watch(IoWait& wait) {
+    if (ring_) {
+        // The ring is not thread-safe: let the loop queue the poll itself.
+        IoWait* target = &wait;
+        post([this, target]() {
+            io_uring_sqe* sqe = ring_->get_sqe();
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = target->fd;
+            sqe->poll32_events = target->events; // EPOLLIN/EPOLLOUT equal POLLIN/POLLOUT
+            sqe->user_data = uring_tag(target, kUringIoWait);
+        });
+        return;
+    }
+    epoll_event event{};
+    event.events = wait.events | EPOLLONESHOT;
+    event.data.ptr = tag_io_wait(&wait);
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wait.fd, &event) < 0) {
+        throw std::runtime_error(std::string("epoll_ctl(watch) failed: ") + std::strerror(errno));
+    }
+}
+
+void EventLoop::drain_completions() {
+    std::vector<Completion> ready;
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> guard(completions_mutex_);
+        ready.swap(completions_);
+        callbacks.swap(posted_);
+    }
+
+    for (std::function<void()>& callback : callbacks) {
+        callback();
+    }
+
+    for (Completion& completion : ready) {
+        auto it = connections_.find(completion.fd);
+        if (it == connections_.end() || it->second->id != completion.connection_id) {
+            continue; // The connection went away while the handler ran
+        }
+        Connection& connection = *it->second;
+        if (connection.state == ConnectionState::Processing) {
+            connection.trace = completion.trace;
+            start_response(connection, std::move(completion.response));
+        }
+    }
+}
+
+void EventLoop::retry_deferred() {
+    while (!deferred_.empty()) {
+        DeferredTask& front = deferred_.front();
+        auto it = connections_.find(front.fd);
+        if (it == connections_.end() || it->second->id != front.connection_id) {
+            deferred_.pop_front(); // Client gave up while waiting
+            continue;
+        }
+        if (!pool_.try_submit(front.task)) {
+            return;
+        }
+        deferred_.pop_front();
+    }
+    resume_accepting();
+}
+
+void EventLoop::start_response(Connection& connection, HttpResponse response) {
+    connection.trace.mark(TraceStage::WriteStart);
+    connection.response = std::move(response);
+    if (connection.response.is_streamed()) {
+        if (!connection.chunked_responses) {
+            connection.response.set_chunked(false);
+            if (!connection.head_request) {
+                connection.keep_alive = false; // The body ends where the connection does
+            }
+        }
+        if (!connection.head_request) {
+            start_producer(connection);
+        }
+    } else if (connection.body_decoder.active() &&
+               (connection.body_decoder.chunked() || connection.body_decoder.remaining() > kMaxBodyDrain)) {
+        // Answered without reading the body: rather than read the rest only
+        // to drop it, close. (A streamed response may still read it, so it
+        // is only judged in finish_response().)
+        connection.keep_alive = false;
+    }
+    if (stopping_) {
+        connection.keep_alive = false;
+    }
+    connection.out_head = head_buffers_.acquire();
+    connection.response.serialize_head(connection.out_head, connection.keep_alive);
+    connection.out_offset = 0;
+    connection.access.bytes_sent = connection.out_head.size() + connection.payload().size() + connection.file_length();
+    connection.state = ConnectionState::WritingResponse;
+    if (ring_) {
+        submit_send(connection);
+    } else {
+        handle_writable(connection);
+    }
+}
+
+void EventLoop::start_producer(Connection& connection) {
+    std::shared_ptr<BodyStream> body = std::make_shared<BodyStream>(stream_buffer_);
+    connect_stream(*body, connection);
+    connection.response_body = body;
+    connection.chunk_frame.clear();
+    connection.chunk_data.clear();
+    connection.last_chunk = false;
+    WorkerPool::Task task = [this, producer = connection.response.producer(), body]() {
+        CurrentLoop scope(this);
+        run_producer(producer, body);
+    };
+    if (!pool_.try_submit(task)) {
+        task(); // Pool saturated: start it here, it suspends once the stream is full
+    }
+}
+
+bool EventLoop::next_chunk(Connection& connection) {
+    // Loads the next chunk of a streamed response once the previous one is
+    // out. Returns false if the producer has not written it yet, the last
+    // chunk is already out, or the producer failed.
+    if (connection.last_chunk) {
+        return false;
+    }
+    BodyStream::TakeResult result = connection.response_body->take(connection.chunk_data);
+    if (result == BodyStream::TakeResult::Empty) {
+        return false;
+    }
+    if (result == BodyStream::TakeResult::Failed) {
+        // The status line is long gone: cut the body short, so the client
+        // sees it as incomplete rather than as a shorter response.
+        LOG_WARN("Streamed response to " + connection.peer() + " failed: " + connection.response_body->error());
+        close_connection(connection);
+        return false;
+    }
+    bool first = connection.chunk_frame.empty();
+    connection.chunk_frame.clear();
+    if (result == BodyStream::TakeResult::End) {
+        connection.chunk_data.clear();
+        connection.last_chunk = true;
+    }
+    if (connection.response.chunked()) {
+        // "<size in hex>\r\n<data>\r\n", ending with a zero-sized chunk and an
+        // empty trailer. Each chunk's closing CRLF leads the next size line.
+        if (!first) {
+            connection.chunk_frame += "\r\n";
+        }
+        char size[16];
+        char* end = std::to_chars(size, size + sizeof(size), connection.chunk_data.size(), 16).ptr;
+        connection.chunk_frame.append(size, end);
+        connection.chunk_frame += connection.last_chunk ? "\r\n\r\n" : "\r\n";
+    }
+    connection.out_offset = connection.out_head.size();
+    connection.access.bytes_sent += connection.chunk_frame.size() + connection.chunk_data.size();
+    connection.last_active = std::chrono::steady_clock::now();
+    update_deadline(connection);
+    return true;
+}
+
+bool EventLoop::stop_accepting() {
+    if (ring_) {
+        io_uring_sqe* sqe = ring_->get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = kUringAccept;
+        sqe->user_data = kUringIgnore;
+    } else if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, listen_fd_, nullptr) < 0) {
+        return false;
+    }
+    accepting_ = false;
+    return true;
+}
+
+void EventLoop::pause_accepting() {
+    if (accepting_ && stop_accepting()) {
+        LOG_WARN("Worker queue full, pausing accept.");
+    }
+}
+
+void EventLoop::resume_accepting() {
+    if (accepting_ || stopping_) {
+        return;
+    }
+    if (ring_) {
+        accepting_ = true;
+        LOG_INFO("Worker queue drained, resuming accept.");
+        if (!accept_armed_) {
+            arm_accept(); // Otherwise the cancelled accept re-arms when it completes
+        }
+        return;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event) == 0) {
+        accepting_ = true;
+        LOG_INFO("Worker queue drained, resuming accept.");
+        // Connections that queued up while paused raised no new edge.
+        handle_accept();
+    }
+}
+
+int EventLoop::fill_segments(const Connection& connection, iovec* segments) const {
+    // Head and body go out in one gathered write; neither is copied into
+    // a combined buffer. out_offset spans all the pieces. A streamed
+    // response has the current chunk's size line and data after the head.
+    std::string_view pieces[3] = {connection.out_head, connection.payload(), {}};
+    if (connection.response_body) {
+        pieces[1] = connection.chunk_frame;
+        pieces[2] = connection.chunk_data;
+    }
+    int count = 0;
+    size_t offset = connection.out_offset;
+    for (std::string_view piece : pieces) {
+        if (offset >= piece.size()) {
+            offset -= piece.size();
+            continue;
+        }
+        segments[count].iov_base = const_cast<char*>(piece.data()) + offset;
+        segments[count].iov_len = piece.size() - offset;
+        offset = 0;
+        ++count;
+    }
+    return count;
+}
+
+void EventLoop::handle_writable(Connection& connection) {
+    while (true) {
+        iovec segments[3];
+        int count = fill_segments(connection, segments);
+        if (count == 0) {
+            if (connection.response_body && next_chunk(connection)) {
+                continue;
+            }
+            break;
+        }
+
+        // sendmsg() is writev() with flags: MSG_NOSIGNAL keeps a reset peer
+        // from raising SIGPIPE, and MSG_MORE holds back a partial packet
+        // when sendfile() is about to add the body.
+        msghdr message{};
+        message.msg_iov = segments;
+        message.msg_iovlen = static_cast<size_t>(count);
+        int flags = MSG_NOSIGNAL | (connection.file_length() > 0 ? MSG_MORE : 0);
+        ssize_t n = sendmsg(connection.fd, &message, flags);
+        ++syscalls_;
+        if (n > 0) {
+            connection.out_offset += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            extend_write_deadline(connection);
+            return;
+        }
+        close_connection(connection);
+        return;
+    }
+    if (connection.state == ConnectionState::Closing || (connection.response_body && !connection.last_chunk)) {
+        return; // Failed, or waiting for the producer, whose stream calls stream_ready()
+    }
+    if (connection.file_length() > 0) {
+        WriteResult result = write_file(connection);
+        if (result == WriteResult::Blocked) {
+            extend_write_deadline(connection);
+        }
+        if (result != WriteResult::Done) {
+            return;
+        }
+    }
+    finish_response(connection);
+}
+
+void EventLoop::extend_write_deadline(Connection& connection) {
+    // EPOLLOUT resumes the partial write. The deadline moves with every
+    // stall, so a client that keeps reading a large response is not cut off.
+    connection.last_active = std::chrono::steady_clock::now();
+    update_deadline(connection);
+}
+
+EventLoop::WriteResult EventLoop::write_file(Connection& connection) {
+    const HttpResponse& response = connection.response;
+    size_t before = connection.out_head.size() + connection.payload().size();
+    size_t end = before + connection.file_length();
+    while (connection.out_offset < end) {
+        off_t offset = response.file_offset() + static_cast<off_t>(connection.out_offset - before);
+        ssize_t n = sendfile(connection.fd, response.file_fd(), &offset, end - connection.out_offset);
+        ++syscalls_;
+        if (n > 0) {
+            connection.out_offset += static_cast<size_t>(n);
+            Metrics::getInstance().record_sendfile(static_cast<uint64_t>(n));
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return WriteResult::Blocked;
+        }
+        // n == 0: the file shrank below the Content-Length already sent.
+        close_connection(connection);
+        return WriteResult::Failed;
+    }
+    return WriteResult::Done;
+}
+
+void EventLoop::finish_response(Connection& connection) {
+    connection.trace.finish(connection.response.status());
+    if (!access_log_) {
+        LOG_INFO("Response sent to client " + connection.peer() + ".");
+    }
+    int status = connection.response.status();
+    int route = connection.response.route();
+    bool streamed = connection.response.is_streamed();
+    head_buffers_.release(std::move(connection.out_head));
+    connection.out_head.clear();
+    connection.response = HttpResponse();
+    connection.head_request = false;
+    connection.response_body.reset();
+    if (connection.body_decoder.active()) {
+        // Answered without reading all of the body. Read the rest and drop
+        // it if that is cheap; otherwise give up on the connection.
+        if (connection.request_body) {
+            connection.request_body->fail("the response was sent before the body was read");
+            connection.request_body.reset();
+        }
+        connection.body_paused = false;
+        if (connection.body_decoder.chunked() || connection.body_decoder.remaining() > kMaxBodyDrain) {
+            connection.keep_alive = false;
+        }
+    }
+    if (stopping_) {
+        connection.keep_alive = false; // Its head went out before the drain started
+    }
+    if (access_log_) {
+        connection.access.status = static_cast<uint16_t>(status);
+        connection.access.route = route < 0 ? kNoRoute : static_cast<uint16_t>(route);
+        connection.access.flags |= (streamed ? kAccessStreamed : 0) | (connection.keep_alive ? kAccessKeepAlive : 0);
+        log_access(connection);
+    }
+    if (!connection.keep_alive) {
+        close_connection(connection);
+        return;
+    }
+
+    // Persistent connection: go back to reading. Requests are handled one at
+    // a time per connection, so pipelined responses always leave in order.
+    // Bytes that arrived while we were busy raised no new edge, so drain the
+    // socket (and any already-buffered pipelined request) right away.
+    connection.state = ConnectionState::ReadingRequest;
+    connection.out_offset = 0;
+    connection.last_active = std::chrono::steady_clock::now();
+    connection.request_started = connection.last_active; // A pipelined request, if any, starts now
+    handle_readable(connection);
+}
+
+void EventLoop::log_access(Connection& connection) {
+    AccessRecord& record = connection.access;
+    std::chrono::steady_clock::duration latency = std::chrono::steady_clock::now() - connection.request_started;
+    record.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    record.latency_us = static_cast<uint32_t>(std::min<int64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(latency).count(), UINT32_MAX));
+    record.client_address = connection.client_address;
+    record.client_port = static_cast<uint16_t>(connection.client_port);
+    AccessLog::getInstance().record(record);
+    record = AccessRecord();
+}
+
+void EventLoop::update_deadline(Connection& connection) {
+    std::chrono::steady_clock::time_point deadline = connection.request_started + request_timeout_;
+    if (connection.state == ConnectionState::WritingResponse || connection.body_decoder.active()) {
+        // Moves with progress, so a large streamed body is not cut off
+        // while bytes keep flowing.
+        deadline = std::max(deadline, connection.last_active + request_timeout_);
+    } else if (connection.state == ConnectionState::ReadingRequest) {
+        if (!connection.request_pending()) {
+            deadline = connection.last_active + keepalive_timeout_;
+        } else if (!connection.parser.headers_complete()) {
+            // Trickling bytes does not help: the head must be complete in time.
+            deadline = std::min(deadline, connection.request_started + header_timeout_);
+        }
+    }
+    timers_.schedule(connection.timer, deadline);
+}
+
+void EventLoop::handle_deadline(Connection& connection) {
+    switch (connection.state) {
+        case ConnectionState::ReadingRequest: {
+            if (!connection.request_pending()) {
+                Metrics::getInstance().record_timeout(TimeoutKind::Idle);
+                if (!access_log_) {
+                    LOG_INFO("Closing idle connection from " + connection.peer() + ".");
+                }
+                close_connection(connection);
+                return;
+            }
+            bool head_done = connection.parser.headers_complete();
+            Metrics::getInstance().record_timeout(head_done ? TimeoutKind::Request : TimeoutKind::Header);
+            if (connection.in_buffer.size() == connection.in_consumed) {
+                LOG_INFO("Client " + connection.peer() + " sent nothing in time, closing.");
+                close_connection(connection);
+                return;
+            }
+            LOG_WARN("Request from " + connection.peer() + " timed out while reading, answering 408.");
+            Metrics::getInstance().record_status(408);
+            connection.keep_alive = false;
+            connection.state = ConnectionState::Processing;
+            start_response(connection, HttpResponse::prepared(kRequestTimeout));
+            break;
+        }
+        case ConnectionState::Processing:
+            // The handler's late completion is dropped: the state has moved on.
+            Metrics::getInstance().record_timeout(TimeoutKind::Request);
+            LOG_WARN("Request from " + connection.peer() + " timed out in its handler, answering 503.");
+            Metrics::getInstance().record_status(503);
+            connection.keep_alive = false;
+            start_response(connection, HttpResponse::prepared(kHandlerTimeout));
+            break;
+        case ConnectionState::WritingResponse:
+            Metrics::getInstance().record_timeout(TimeoutKind::Request);
+            LOG_WARN("Client " + connection.peer() + " is not reading its response, closing.");
+            close_connection(connection);
+            return;
+        case ConnectionState::Closing:
+            return;
+    }
+    // Still writing the error response: give up on the next tick if the
+    // client does not take it.
+    if (connection.state == ConnectionState::WritingResponse) {
+        timers_.schedule(connection.timer, std::chrono::steady_clock::now());
+    }
+}
+
+void EventLoop::close_connection(Connection& connection) {
+    if (connection.state == ConnectionState::Closing) {
+        return;
+    }
+    connection.state = ConnectionState::Closing;
+    timers_.cancel(connection.timer);
+    admission_.release_connection();
+    // A handler reading the body or producing the response gets an exception.
+    if (connection.request_body) {
+        connection.request_body->fail("client connection closed");
+        connection.request_body.reset();
+    }
+    if (connection.response_body) {
+        connection.response_body->fail("client connection closed");
+        connection.response_body.reset();
+    }
+    if (ring_) {
+        // Cancel the multishot receive and any send, then close. The hard
+        // link orders the two but runs the close even if nothing was pending.
+        ring_->reserve(2);
+        io_uring_sqe* cancel = ring_->get_sqe();
+        cancel->opcode = IORING_OP_ASYNC_CANCEL;
+        cancel->fd = connection.fd;
+        cancel->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        cancel->flags = IOSQE_IO_HARDLINK;
+        cancel->user_data = kUringIgnore;
+        io_uring_sqe* close_op = ring_->get_sqe();
+        close_op->opcode = IORING_OP_CLOSE;
+        close_op->fd = connection.fd;
+        close_op->user_data = uring_tag(&connection, kUringClose);
+        connection.uring_ops++;
+    } else {
+        close(connection.fd); // Closing the fd also removes it from the epoll set
+        ++syscalls_;
+    }
+    if (!access_log_) {
+        LOG_INFO("Client " + connection.peer() + " disconnected.");
+    }
+
+    auto it = connections_.find(connection.fd);
+    if (it != connections_.end()) {
+        if (connection.uring_ops > 0) {
+            draining_[&connection] = std::move(it->second);
+        } else {
+            closed_.push_back(std::move(it->second));
+        }
+        connections_.erase(it);
+    }
+}
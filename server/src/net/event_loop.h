@@ -0,0 +1,237 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <chrono>
+#include <coroutine>
+#include <netinet/in.h>
+#include <sys/uio.h>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "admission.h"
+#include "async.h"
+#include "connection.h"
+#include "uring.h"
+#include "../utils/task.h"
+#include "../utils/timer_wheel.h"
+#include "../utils/trace.h"
+#include "../utils/buffer_pool.h"
+#include "../utils/config.h"
+#include "../utils/httprequest.h"
+#include "../utils/httprequest_parser.h"
+#include "../utils/httpresponse.h"
+#include "../utils/worker_pool.h"
+
+// Event-driven reactor. One EventLoop runs on one thread and owns
+// accept, read, parse and write for every connection it accepts, including
+// persistent (keep-alive) and pipelined HTTP/1.1 connections; parsed
+// requests are handed to the shared WorkerPool and their responses come back
+// through an eventfd-signalled completion queue. Several loops may share the
+// same non-blocking listening socket; the kernel wakes only one of them per
+// incoming connection (EPOLLEXCLUSIVE).
+//
+// Two I/O backends sit under the same connection state machine. The epoll
+// backend is edge-triggered: a readiness event, then accept/read/send calls
+// until EAGAIN. The io_uring backend (IoBackend::IoUring) keeps one
+// multishot accept and one multishot receive per connection armed, with the
+// kernel picking receive buffers from a provided-buffer ring; sends, closes
+// and re-arms queued while handling a batch of completions are all
+// submitted by the single io_uring_enter() that also waits for the next batch.
+//
+// Handlers are coroutines. A handler starts on a worker thread; when it
+// co_awaits a timer or socket readiness (net/async.h) it suspends, the loop
+// takes over the wait, and the handler is resumed on the worker pool once
+// the wait is over. Waiting therefore costs a coroutine frame, not a thread.
+//
+// Large and chunked request bodies, and streamed responses, go through a
+// BodyStream per direction: the handler starts as soon as the request head
+// is parsed and reads the body while the loop keeps receiving it, and a
+// streamed response is sent chunk by chunk while its producer writes it.
+// Whichever side is ahead is paused (the loop stops reading the socket, or
+// the producer is suspended) once the stream holds stream_buffer_ bytes.
+class EventLoop {
+public:
+    // The handler owns its request and peer address (they live in its
+    // coroutine frame), so it may fill in routing results such as path
+    // parameters and keep using them across suspensions.
+    using RequestHandler = std::function<Task<HttpResponse>(HttpRequest request, std::string peer)>;
+
+    EventLoop(int listen_fd, const ServerConfig& config, WorkerPool& pool, AdmissionControl& admission,
+              RequestHandler handler);
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Runs the loop on the calling thread. Returns once drain() has finished.
+    void run();
+
+    // Stops accepting and lets the open connections finish: responses from
+    // then on carry "Connection: close", and whatever is still open at
+    // `deadline` is closed. run() returns when no connection is left. Safe
+    // to call from any thread.
+    void drain(std::chrono::steady_clock::time_point deadline);
+
+    // The loop serving the handler running on the calling thread, or nullptr.
+    static EventLoop* current();
+
+    // Runs `callback` on the loop thread. Safe to call from any thread.
+    void post(std::function<void()> callback);
+
+    // Arms `timer` (owned by the caller) on this loop's timer wheel; its
+    // callback runs on the loop thread once `deadline` has passed. Loop thread only.
+    void add_timer(TimerWheel::Timer& timer, std::chrono::steady_clock::time_point deadline);
+
+    // Resumes a suspended handler on the worker pool, or right away on the
+    // calling thread if the pool is full, so an accepted request is never
+    // dropped. Either way the handler runs with current() == this. Loop
+    // thread only: from any other thread, post() the call to the loop.
+    void resume(std::coroutine_handle<> handle);
+
+    // Registers a one-shot readiness wait for wait.fd (in the epoll set, or
+    // as an io_uring poll); the loop resumes wait.handle when the fd becomes
+    // ready. Safe to call from any thread.
+    void watch(IoWait& wait);
+
+private:
+    // Marks the loop whose handler runs on this thread, see current().
+    class CurrentLoop {
+    public:
+        explicit CurrentLoop(EventLoop* loop);
+        ~CurrentLoop();
+
+    private:
+        EventLoop* previous_;
+    };
+
+
+    // A response produced by a worker, waiting to be picked up by the loop.
+    struct Completion {
+        int fd;
+        uint64_t connection_id;
+        HttpResponse response;
+        RequestTrace trace;
+    };
+
+    // A request the pool could not take yet (BackpressurePolicy::Pause).
+    struct DeferredTask {
+        int fd;
+        uint64_t connection_id;
+        WorkerPool::Task task;
+    };
+
+    // Outcome of writing to a socket until it would block.
+    enum class WriteResult { Done, Blocked, Failed };
+
+    Detached run_handler(Task<HttpResponse> task, int fd, uint64_t connection_id, RequestTrace trace);
+    Detached run_producer(BodyProducer producer, std::shared_ptr<BodyStream> body);
+    void run_epoll();
+    void run_uring();
+    void handle_completion(const io_uring_cqe& cqe);
+    void handle_accepted(const io_uring_cqe& cqe);
+    void handle_received(Connection& connection, const io_uring_cqe& cqe);
+    void handle_sent(Connection& connection, const io_uring_cqe& cqe);
+    void arm_accept();
+    void arm_wakeup();
+    void arm_receive(Connection& connection);
+    void submit_send(Connection& connection);
+    void publish_syscalls();
+    void run_timers(std::chrono::steady_clock::time_point now);
+    void update_deadline(Connection& connection);
+    void handle_deadline(Connection& connection);
+    int poll_timeout_ms(std::chrono::steady_clock::time_point now) const;
+    void handle_accept();
+    void add_connection(int fd, const sockaddr_in& address);
+    void shed_connection(int fd, ShedReason reason);
+    bool admit_request(Connection& connection, const HttpRequestView& view, std::chrono::steady_clock::time_point now);
+    void handle_readable(Connection& connection);
+    bool read_socket(Connection& connection);
+    void append_input(Connection& connection, const char* data, size_t size);
+    void parse_buffered(Connection& connection);
+    void send_continue(Connection& connection);
+    void feed_body(Connection& connection);
+    void pause_body(Connection& connection);
+    void reject_body(Connection& connection);
+    void connect_stream(BodyStream& stream, const Connection& connection);
+    void stream_ready(int fd, uint64_t connection_id);
+    void start_producer(Connection& connection);
+    bool next_chunk(Connection& connection);
+    void handle_writable(Connection& connection);
+    int fill_segments(const Connection& connection, iovec* segments) const;
+    WriteResult write_file(Connection& connection);
+    void extend_write_deadline(Connection& connection);
+    void finish_response(Connection& connection);
+    void log_access(Connection& connection);
+    void process_request(Connection& connection, const HttpRequestView& view);
+    void consume_request(Connection& connection, size_t length);
+    void consume_input(Connection& connection, size_t length);
+    void reject_malformed(Connection& connection);
+    void dispatch(Connection& connection, WorkerPool::Task task);
+    void post_completion(int fd, uint64_t connection_id, HttpResponse response, const RequestTrace& trace);
+    void drain_completions();
+    void retry_deferred();
+    void start_response(Connection& connection, HttpResponse response);
+    void start_drain(std::chrono::steady_clock::time_point deadline);
+    void close_remaining();
+    bool drained() const;
+    bool stop_accepting();
+    void pause_accepting();
+    void resume_accepting();
+    void close_connection(Connection& connection);
+
+    IoBackend backend_;
+    int epoll_fd_;
+    int listen_fd_;
+    int wakeup_fd_;
+    int max_events_;
+    std::chrono::steady_clock::duration keepalive_timeout_;
+    std::chrono::steady_clock::duration header_timeout_;
+    std::chrono::steady_clock::duration request_timeout_;
+    int max_keepalive_requests_;
+    HttpRequestParser::Limits parser_limits_;
+    size_t stream_buffer_; // Capacity of each BodyStream
+    bool access_log_;      // Responses go to the binary AccessLog instead of INFO lines
+    BackpressurePolicy backpressure_;
+    WorkerPool& pool_;
+    AdmissionControl& admission_;
+    RequestHandler handler_;
+
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+    std::vector<std::unique_ptr<Connection>> closed_; // Freed after each epoll batch
+    // io_uring backend: closed connections whose cancelled receive, send or
+    // close has not completed yet; freed when the last one does.
+    std::unordered_map<Connection*, std::unique_ptr<Connection>> draining_;
+    uint64_t next_connection_id_ = 1;
+
+    std::mutex completions_mutex_;
+    std::vector<Completion> completions_;
+    std::vector<std::function<void()>> posted_; // Guarded by completions_mutex_
+
+    std::deque<DeferredTask> deferred_;
+    bool accepting_ = true;
+    bool stopping_ = false;        // drain() was called: no new connections, none kept alive
+    TimerWheel::Timer drain_timer_; // Closes what is left at the drain deadline
+
+    BufferPool head_buffers_; // Response head buffers, reused across connections
+
+    std::unique_ptr<IoUring> ring_; // io_uring backend only
+    uint64_t wakeup_value_ = 0;     // Where the io_uring backend reads the eventfd counter to
+    bool accept_armed_ = false;     // A multishot accept is in flight
+    uint64_t syscalls_ = 0;         // Not yet reported to Metrics
+    uint64_t counted_enters_ = 0;   // ring_->enter_calls() already added to syscalls_
+
+    // Connection deadlines and coroutine sleeps. Arming is O(1), so each
+    // connection's deadline is simply pushed back after every read.
+    TimerWheel timers_;
+    size_t published_timers_ = 0; // timers_.size() last reported to Metrics
+};
+
+// Puts `fd` into non-blocking mode. Returns false on failure.
+bool set_nonblocking(int fd);
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,192 @@
+#include "hot_restart.h"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+extern char** environ;
+
+static const char kChannelVariable[] = "SERVER_HOT_RESTART_FD";
+
+// Sockets passed in one message; the kernel's limit (SCM_MAX_FD) is 253.
+static const size_t kMaxListeners = 253;
+
+// Sent by the successor once its event loops run.
+static const char kReady = 'R';
+
+// Successor side: the socket to report ready on, until notify_ready().
+static int predecessor_channel = -1;
+
+std::string executable_path() {
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0) {
+        return "";
+    }
+    return std::string(path, static_cast<size_t>(length));
+}
+
+bool inherit_listeners(std::vector<int>& fds) {
+    const char* value = std::getenv(kChannelVariable);
+    if (value == nullptr || *value == '\0') {
+        return false;
+    }
+    int channel = std::atoi(value);
+    unsetenv(kChannelVariable); // Not passed on to a successor of our own
+    fcntl(channel, F_SETFD, FD_CLOEXEC);
+
+    uint32_t count = 0;
+    iovec data{&count, sizeof(count)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxListeners)];
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t received;
+    do {
+        received = recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received != static_cast<ssize_t>(sizeof(count))) {
+        close(channel);
+        throw std::runtime_error(received < 0 ? std::string("receiving listening sockets failed: ") + std::strerror(errno)
+                                              : std::string("the previous server process went away before handing over its sockets"));
+    }
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (header == nullptr || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS ||
+        header->cmsg_len != CMSG_LEN(sizeof(int) * count) || (message.msg_flags & MSG_CTRUNC) != 0 || count == 0) {
+        close(channel);
+        throw std::runtime_error("malformed listening socket handoff");
+    }
+    fds.resize(count);
+    std::memcpy(fds.data(), CMSG_DATA(header), sizeof(int) * count);
+    predecessor_channel = channel;
+    return true;
+}
+
+void notify_ready() {
+    if (predecessor_channel < 0) {
+        return;
+    }
+    ssize_t ignored = send(predecessor_channel, &kReady, 1, MSG_NOSIGNAL);
+    (void)ignored; // Nothing to do if the predecessor is gone already
+    close(predecessor_channel);
+    predecessor_channel = -1;
+}
+
+// Waits for the successor's ready byte. False on timeout, or if it closed
+// its end first (it exited, or exec failed).
+static bool wait_ready(int channel, std::chrono::milliseconds timeout, std::string& error) {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        std::chrono::milliseconds left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        pollfd poll_fd{channel, POLLIN, 0};
+        int ready = poll(&poll_fd, 1, static_cast<int>(std::max<int64_t>(left.count(), 0)));
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready == 0) {
+            error = "the new process did not report ready within " + std::to_string(timeout.count()) + " ms";
+            return false;
+        }
+        char byte = 0;
+        ssize_t n = ready > 0 ? read(channel, &byte, 1) : -1;
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 1 && byte == kReady) {
+            return true;
+        }
+        error = n == 0 ? "the new process exited during startup" : std::string("waiting for the new process failed: ") + std::strerror(errno);
+        return false;
+    }
+}
+
+bool start_successor(const std::string& executable, char* const argv[], const std::vector<int>& listen_fds,
+                     std::chrono::milliseconds timeout, std::string& error) {
+    if (executable.empty()) {
+        error = "the server's executable could not be resolved";
+        return false;
+    }
+    if (listen_fds.empty() || listen_fds.size() > kMaxListeners) {
+        error = "cannot hand over " + std::to_string(listen_fds.size()) + " listening sockets";
+        return false;
+    }
+    int channel[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) < 0) {
+        error = std::string("socketpair failed: ") + std::strerror(errno);
+        return false;
+    }
+
+    // Everything the child needs is built before fork(): between fork() and
+    // exec() only async-signal-safe calls are allowed.
+    std::string channel_entry = std::string(kChannelVariable) + "=" + std::to_string(channel[1]);
+    std::vector<char*> environment;
+    for (char** entry = environ; *entry != nullptr; ++entry) {
+        if (std::strncmp(*entry, kChannelVariable, sizeof(kChannelVariable) - 1) != 0 ||
+            (*entry)[sizeof(kChannelVariable) - 1] != '=') {
+            environment.push_back(*entry);
+        }
+    }
+    environment.push_back(&channel_entry[0]);
+    environment.push_back(nullptr);
+    sigset_t no_signals;
+    sigemptyset(&no_signals);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        error = std::string("fork failed: ") + std::strerror(errno);
+        close(channel[0]);
+        close(channel[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // The signals the server waits for are blocked in every thread, and
+        // a blocked mask survives exec().
+        sigprocmask(SIG_SETMASK, &no_signals, nullptr);
+        fcntl(channel[1], F_SETFD, 0);
+        execve(executable.c_str(), argv, environment.data());
+        _exit(127);
+    }
+    close(channel[1]);
+
+    // The message waits in the socket until the successor reads it.
+    uint32_t count = static_cast<uint32_t>(listen_fds.size());
+    iovec data{&count, sizeof(count)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxListeners)];
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    std::memcpy(CMSG_DATA(header), listen_fds.data(), sizeof(int) * count);
+
+    bool ready = false;
+    if (sendmsg(channel[0], &message, MSG_NOSIGNAL) < 0) {
+        error = errno == EPIPE ? std::string("the new process exited during startup")
+                               : std::string("sending listening sockets failed: ") + std::strerror(errno);
+    } else {
+        ready = wait_ready(channel[0], timeout, error);
+    }
+    close(channel[0]);
+    if (!ready) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+    }
+    return ready;
+}
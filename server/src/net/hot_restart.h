@@ -0,0 +1,38 @@
+#ifndef HOT_RESTART_H
+#define HOT_RESTART_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Hot restart: a running server hands over to a freshly exec'd copy of its
+// binary without refusing a connection. The predecessor forks and execs the
+// successor with one end of a Unix domain socket pair inherited (its number
+// in SERVER_HOT_RESTART_FD) and passes its listening sockets over it with
+// SCM_RIGHTS. Both processes then hold the very same sockets, so connections
+// queued in the kernel are accepted by whichever side gets to them first and
+// none is lost in between. Once the successor's event loops are running it
+// reports ready, and only then does the predecessor stop accepting and
+// drain; if the successor fails before that, the predecessor keeps serving.
+
+// Absolute path of the running executable. Resolve it at startup: once the
+// binary has been replaced on disk, /proc/self/exe names the deleted file.
+std::string executable_path();
+
+// Successor side: if this process was started by start_successor(), receives
+// the predecessor's listening sockets into `fds` and returns true; returns
+// false if it was not. Throws std::runtime_error if the handoff fails.
+bool inherit_listeners(std::vector<int>& fds);
+
+// Successor side: tells the predecessor that this process is serving, so it
+// can stop accepting. Does nothing if there is no predecessor.
+void notify_ready();
+
+// Predecessor side: execs `executable` with `argv` and this process's
+// environment, hands it `listen_fds` and waits up to `timeout` for it to
+// report ready. On failure or timeout the successor is killed and reaped,
+// `error` says why, and false is returned.
+bool start_successor(const std::string& executable, char* const argv[], const std::vector<int>& listen_fds,
+                     std::chrono::milliseconds timeout, std::string& error);
+
+#endif // HOT_RESTART_H
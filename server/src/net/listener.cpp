@@ -0,0 +1,83 @@
+#include "listener.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+
+int open_listener(int port, int backlog, bool reuse_port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    // Accepted sockets inherit it. Every response leaves in as few writes as
+    // it can (MSG_MORE marks the partial ones), so Nagle only ever held back
+    // the tail of a streamed response until the client's delayed ACK.
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY; // Listen on all available network interfaces
+    address.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(fd, backlog) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+std::vector<int> parse_cpu_list(const std::string& spec) {
+    std::vector<int> cpus;
+    if (spec == "auto") {
+        unsigned int cores = std::thread::hardware_concurrency();
+        for (unsigned int cpu = 0; cpu < cores; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        return cpus;
+    }
+
+    std::stringstream stream(spec);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char* end = nullptr;
+        long first = std::strtol(item.c_str(), &end, 10);
+        if (end == item.c_str() || first < 0) {
+            continue;
+        }
+        long last = first;
+        if (*end == '-') {
+            const char* rest = end + 1;
+            last = std::strtol(rest, &end, 10);
+            if (end == rest || last < first) {
+                continue;
+            }
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return cpus;
+}
+
+bool pin_current_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
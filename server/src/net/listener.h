@@ -0,0 +1,23 @@
+#ifndef LISTENER_H
+#define LISTENER_H
+
+#include <string>
+#include <vector>
+
+// Creates a non-blocking TCP socket listening on `port` on all interfaces.
+// With `reuse_port`, SO_REUSEPORT is set so several sockets can bind the same
+// port; the kernel then spreads incoming connections across them by hashing
+// the 4-tuple, and each event loop accepts from its own queue. TCP_NODELAY
+// is set for the accepted connections to inherit. Returns -1 (with errno
+// set) on failure.
+int open_listener(int port, int backlog, bool reuse_port);
+
+// CPUs to pin event loops to, from SERVER_CPU_AFFINITY: "" (none), "auto"
+// (every online CPU in order) or a list of CPUs and ranges like "0-3,8".
+// Invalid entries are skipped.
+std::vector<int> parse_cpu_list(const std::string& spec);
+
+// Pins the calling thread to `cpu`. Returns false on failure.
+bool pin_current_thread(int cpu);
+
+#endif // LISTENER_H
@@ -0,0 +1,217 @@
+#include "response_cache.h"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <utility>
+#include "event_loop.h"
+#include "../utils/metrics.h"
+
+ResponseCache& ResponseCache::getInstance() {
+    static ResponseCache instance;
+    return instance;
+}
+
+ResponseCache::ResponseCache() {
+    for (size_t s = 0; s < kShards; ++s) {
+        shards_.emplace_back(new Shard());
+    }
+}
+
+void ResponseCache::configure(size_t capacity_bytes) {
+    capacity_bytes_ = capacity_bytes;
+    shard_capacity_ = capacity_bytes / kShards;
+}
+
+std::string ResponseCache::make_key(const HttpRequest& request) {
+    std::vector<const HttpField*> params;
+    params.reserve(request.query_params.size());
+    size_t length = request.method.size() + request.path.size() + 1;
+    for (const HttpField& param : request.query_params) {
+        params.push_back(&param);
+        length += param.name.size() + param.value.size() + 2;
+    }
+    std::sort(params.begin(), params.end(), [](const HttpField* a, const HttpField* b) {
+        return a->name != b->name ? a->name < b->name : a->value < b->value;
+    });
+
+    std::string key;
+    key.reserve(length);
+    key.append(request.method);
+    key += ' ';
+    key.append(request.path);
+    char separator = '?';
+    for (const HttpField* param : params) {
+        key += separator;
+        key.append(param->name);
+        key += '=';
+        key.append(param->value);
+        separator = '&';
+    }
+    return key;
+}
+
+ResponseCache::Shard& ResponseCache::shard_for(const std::string& key) {
+    return *shards_[std::hash<std::string>{}(key) % kShards];
+}
+
+static bool cacheable(const HttpResponse& response) {
+    return response.status() < 500 && !response.is_streamed() && response.file_length() == 0;
+}
+
+Task<HttpResponse> ResponseCache::fetch(const Route& route, const HttpRequest& request) {
+    if (capacity_bytes_ == 0) {
+        co_return co_await run_route(route, request);
+    }
+    Metrics& metrics = Metrics::getInstance();
+    std::string key = make_key(request);
+    Shard& shard = shard_for(key);
+
+    std::shared_ptr<const PreparedResponse> cached;
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end() && !it->second->computing && Clock::now() < it->second->expires) {
+            it->second->referenced.store(true, std::memory_order_relaxed);
+            cached = it->second->response;
+        }
+    }
+    if (cached) {
+        metrics.record_response_cache(ResponseCacheResult::Hit);
+        co_return HttpResponse::prepared(std::move(cached));
+    }
+
+    // Missed under the shared lock; look again under the exclusive one, as
+    // another request may have started (or finished) this key meanwhile.
+    std::shared_ptr<Entry> entry;
+    bool computing = false;
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end() && it->second->computing) {
+            entry = it->second;
+            computing = true;
+        } else if (it != shard.entries.end() && Clock::now() < it->second->expires) {
+            it->second->referenced.store(true, std::memory_order_relaxed);
+            cached = it->second->response;
+        } else {
+            entry = std::make_shared<Entry>();
+            if (it != shard.entries.end()) {
+                // Expired: the new entry takes over its place.
+                shard.bytes -= it->second->bytes;
+                entry->order = it->second->order;
+                it->second = entry;
+            } else {
+                shard.order.push_back(key);
+                entry->order = std::prev(shard.order.end());
+                shard.entries.emplace(key, entry);
+            }
+        }
+    }
+    if (cached) {
+        metrics.record_response_cache(ResponseCacheResult::Hit);
+        co_return HttpResponse::prepared(std::move(cached));
+    }
+    if (computing) {
+        metrics.record_response_cache(ResponseCacheResult::Coalesced);
+        std::shared_ptr<const PreparedResponse> shared = co_await CoalesceAwaiter(shard, entry);
+        if (shared) {
+            co_return HttpResponse::prepared(std::move(shared));
+        }
+        co_return co_await run_route(route, request); // The first request's response could not be shared
+    }
+
+    metrics.record_response_cache(ResponseCacheResult::Miss);
+    HttpResponse response;
+    try {
+        response = co_await run_route(route, request);
+    } catch (...) {
+        complete(shard, key, entry, nullptr, route.cache_ttl);
+        throw;
+    }
+    if (!cacheable(response)) {
+        complete(shard, key, entry, nullptr, route.cache_ttl);
+        co_return response;
+    }
+    std::shared_ptr<const PreparedResponse> prepared = prepare_response(response);
+    complete(shard, key, entry, prepared, route.cache_ttl);
+    co_return HttpResponse::prepared(std::move(prepared));
+}
+
+bool ResponseCache::CoalesceAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    std::unique_lock<std::shared_mutex> lock(shard_.mutex);
+    if (!entry_->computing) {
+        return false; // Finished since fetch() looked: carry on without suspending
+    }
+    entry_->waiters.push_back(Waiter{handle, EventLoop::current()});
+    return true;
+}
+
+void ResponseCache::complete(Shard& shard, const std::string& key, const std::shared_ptr<Entry>& entry,
+                             std::shared_ptr<const PreparedResponse> response, std::chrono::milliseconds ttl) {
+    std::vector<Waiter> waiters;
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        // A computing entry is never replaced or evicted, so it is still
+        // the one stored under `key`.
+        entry->computing = false;
+        entry->response = response; // Shared with the waiters even if it is not kept
+        waiters.swap(entry->waiters);
+        size_t bytes = response ? key.size() + response->keep_alive_bytes.size() + response->close_bytes.size() : 0;
+        if (response && bytes <= shard_capacity_) {
+            entry->expires = Clock::now() + ttl;
+            entry->bytes = bytes;
+            shard.bytes += bytes;
+            evict(shard);
+        } else {
+            shard.order.erase(entry->order);
+            shard.entries.erase(key);
+        }
+    }
+    // This runs on the worker that computed the response, while a waiter
+    // belongs to its own loop (another one with SERVER_REUSE_PORT), whose
+    // resume() may only be called from that loop's thread.
+    for (const Waiter& waiter : waiters) {
+        if (waiter.loop != nullptr) {
+            EventLoop* loop = waiter.loop;
+            std::coroutine_handle<> handle = waiter.handle;
+            loop->post([loop, handle]() { loop->resume(handle); });
+        } else {
+            waiter.handle.resume();
+        }
+    }
+}
+
+void ResponseCache::evict(Shard& shard) {
+    // Every entry is passed over at most once after its reference bit is
+    // cleared, so two rounds find a victim unless all are computing.
+    size_t steps = shard.order.size() * 2;
+    uint64_t evicted = 0;
+    Clock::time_point now = Clock::now();
+    while (shard.bytes > shard_capacity_ && steps-- > 0) {
+        auto it = shard.entries.find(shard.order.front());
+        Entry& entry = *it->second;
+        if (entry.computing || (entry.referenced.exchange(false, std::memory_order_relaxed) && now < entry.expires)) {
+            shard.order.splice(shard.order.end(), shard.order, shard.order.begin());
+            continue;
+        }
+        shard.bytes -= entry.bytes;
+        shard.order.pop_front();
+        shard.entries.erase(it);
+        ++evicted;
+    }
+    if (evicted > 0) {
+        Metrics::getInstance().record_response_cache_evictions(evicted);
+    }
+}
+
+ResponseCacheStats ResponseCache::stats() const {
+    ResponseCacheStats stats;
+    stats.capacity_bytes = capacity_bytes_;
+    for (const std::unique_ptr<Shard>& shard : shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard->mutex);
+        stats.entries += shard->entries.size();
+        stats.bytes += shard->bytes;
+    }
+    return stats;
+}
@@ -0,0 +1,119 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../utils/httprequest.h"
+#include "../utils/httpresponse.h"
+#include "../utils/router.h"
+#include "../utils/task.h"
+
+class EventLoop;
+
+// Point-in-time size of the ResponseCache, for /metrics. Hit, miss and
+// eviction counts live in Metrics.
+struct ResponseCacheStats {
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t capacity_bytes = 0;
+};
+
+// Responses of routes marked with Router::cache(), kept for the route's TTL
+// and keyed by method, path and query parameters (sorted, so "?a=1&b=2" and
+// "?b=2&a=1" share an entry). A cached response is serialized once into a
+// PreparedResponse, so a hit sends shared bytes without running the handler.
+//
+// The table is split into shards, each behind a reader-writer lock: a hit
+// takes its shard's lock shared and only sets the entry's reference bit,
+// so hits never wait for each other. When a shard is over its share of the
+// byte budget, entries are evicted in insertion order, skipping (once) any
+// hit since the last pass (the CLOCK approximation of LRU). Expired entries
+// are replaced on their next miss.
+//
+// Concurrent misses on one key are coalesced: the first runs the handler,
+// the others are suspended (holding no thread) and answered with its result.
+// Only complete, non-streamed responses with a status below 500 are kept;
+// when the first request's response is not, the waiting ones run the
+// handler themselves. A cached route must not depend on anything but the
+// key, e.g. on request headers.
+class ResponseCache {
+public:
+    static constexpr size_t kShards = 16;
+
+    static ResponseCache& getInstance();
+
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    // Bytes of serialized responses kept in total (0 disables the cache).
+    // Call at startup, before requests are served.
+    void configure(size_t capacity_bytes);
+
+    // Answers `request` for `route` (whose cache_ttl is set) from the cache,
+    // or runs the route and caches its response.
+    Task<HttpResponse> fetch(const Route& route, const HttpRequest& request);
+
+    ResponseCacheStats stats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // A request suspended behind another one computing the same key.
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        EventLoop* loop = nullptr; // Resumes the waiter on its own loop's pool
+    };
+
+    struct Entry {
+        std::shared_ptr<const PreparedResponse> response; // nullptr while computing or after a failure
+        Clock::time_point expires;
+        size_t bytes = 0;
+        bool computing = true;
+        std::atomic<bool> referenced{false}; // Hit since the eviction hand last passed
+        std::vector<Waiter> waiters;         // Guarded by the shard's mutex
+        std::list<std::string>::iterator order;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<Entry>> entries;
+        std::list<std::string> order; // Eviction order, oldest first
+        size_t bytes = 0;
+    };
+
+    class CoalesceAwaiter {
+    public:
+        CoalesceAwaiter(Shard& shard, std::shared_ptr<Entry> entry) : shard_(shard), entry_(std::move(entry)) {}
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        std::shared_ptr<const PreparedResponse> await_resume() const { return entry_->response; }
+
+    private:
+        Shard& shard_;
+        std::shared_ptr<Entry> entry_;
+    };
+
+    ResponseCache();
+
+    static std::string make_key(const HttpRequest& request);
+    Shard& shard_for(const std::string& key);
+    void complete(Shard& shard, const std::string& key, const std::shared_ptr<Entry>& entry,
+                  std::shared_ptr<const PreparedResponse> response, std::chrono::milliseconds ttl);
+    void evict(Shard& shard);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t capacity_bytes_ = 0;
+    size_t shard_capacity_ = 0;
+};
+
+#endif // RESPONSE_CACHE_H
@@ -0,0 +1,226 @@
+#include "uring.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <vector>
+
+static int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t arg_size) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+static std::runtime_error uring_error(const std::string& what) {
+    return std::runtime_error(what + " failed: " + std::strerror(errno));
+}
+
+IoUring::IoUring(unsigned entries) {
+    io_uring_params params{};
+    // Completions are only reaped from io_uring_enter() on the loop thread,
+    // so the kernel need not interrupt the thread to run completion work.
+    params.flags = IORING_SETUP_COOP_TASKRUN | IORING_SETUP_CLAMP;
+    ring_fd_ = io_uring_setup(entries, &params);
+    if (ring_fd_ < 0) {
+        throw uring_error("io_uring_setup");
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        int error = errno;
+        release();
+        errno = error;
+        throw uring_error("mmap(io_uring sq)");
+    }
+    cq_ring_ = sq_ring_;
+    if (!single_mmap) {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            cq_ring_ = nullptr;
+            int error = errno;
+            release();
+            errno = error;
+            throw uring_error("mmap(io_uring cq)");
+        }
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        int error = errno;
+        release();
+        errno = error;
+        throw uring_error("mmap(io_uring sqes)");
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sqe_tail_ = *sq_tail_;
+    // Submission slot i always refers to sqes_[i], so the indirection array
+    // is filled once here instead of on every submit.
+    unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; ++i) {
+        array[i] = i;
+    }
+
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+IoUring::~IoUring() {
+    release();
+}
+
+void IoUring::release() {
+    if (ring_fd_ >= 0) {
+        close(ring_fd_); // Unregisters the buffer ring before its memory goes away
+    }
+    if (buffers_ != nullptr) {
+        munmap(buffers_, buffers_size_);
+    }
+    if (buffer_ring_ != nullptr) {
+        munmap(buffer_ring_, buffer_ring_size_);
+    }
+    if (sqes_ != nullptr) {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) {
+        munmap(sq_ring_, sq_ring_size_);
+    }
+    buffers_ = nullptr;
+    buffer_ring_ = nullptr;
+    sqes_ = nullptr;
+    cq_ring_ = sq_ring_ = nullptr;
+    ring_fd_ = -1;
+}
+
+bool IoUring::probe(std::string& reason) {
+    try {
+        IoUring ring(8);
+
+        // Multishot receive arrived in Linux 6.0 together with zero-copy
+        // send, so an op-code probe for the latter stands in for a version check.
+        size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        std::vector<unsigned char> storage(probe_size, 0);
+        io_uring_probe* ops = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (io_uring_register(ring.ring_fd_, IORING_REGISTER_PROBE, ops, 256) < 0) {
+            reason = std::string("IORING_REGISTER_PROBE failed: ") + std::strerror(errno);
+            return false;
+        }
+        if (ops->last_op < IORING_OP_SEND_ZC || (ops->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED) == 0) {
+            reason = "kernel older than 6.0 (no multishot receive)";
+            return false;
+        }
+        ring.setup_buffers(0, 1, 64);
+        return true;
+    } catch (const std::exception& e) {
+        reason = e.what();
+        return false;
+    }
+}
+
+void IoUring::reserve(unsigned count) {
+    // Queue too full: hand what is queued to the kernel now, without waiting.
+    while (sq_entries_ - (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE)) < count) {
+        enter(sqe_tail_ - *sq_tail_, 0, std::chrono::milliseconds(0));
+    }
+}
+
+io_uring_sqe* IoUring::get_sqe() {
+    reserve(1);
+    io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++sqe_tail_;
+    return sqe;
+}
+
+bool IoUring::submit_and_wait(std::chrono::milliseconds timeout) {
+    return enter(sqe_tail_ - *sq_tail_, 1, timeout);
+}
+
+bool IoUring::enter(unsigned to_submit, unsigned wait_for, std::chrono::milliseconds timeout) {
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+
+    __kernel_timespec ts{};
+    ts.tv_sec = timeout.count() / 1000;
+    ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+    io_uring_getevents_arg arg{};
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+    unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    ++enter_calls_;
+    if (io_uring_enter(ring_fd_, to_submit, wait_for, flags, &arg, sizeof(arg)) < 0) {
+        // ETIME: the wait timed out. EBUSY: completions must be reaped
+        // before more can be submitted; the caller does that next.
+        return errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN;
+    }
+    return true;
+}
+
+void IoUring::setup_buffers(uint16_t group, unsigned count, unsigned size) {
+    buffer_ring_size_ = count * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, buffer_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        throw uring_error("mmap(buffer ring)");
+    }
+    buffer_ring_ = static_cast<io_uring_buf*>(ring);
+
+    buffers_size_ = static_cast<size_t>(count) * size;
+    void* buffers = mmap(nullptr, buffers_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED) {
+        throw uring_error("mmap(receive buffers)");
+    }
+    buffers_ = static_cast<char*>(buffers);
+    buffer_size_ = size;
+    buffer_mask_ = count - 1;
+
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<uint64_t>(buffer_ring_);
+    registration.ring_entries = count;
+    registration.bgid = group;
+    if (io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        throw uring_error("IORING_REGISTER_PBUF_RING");
+    }
+    for (unsigned id = 0; id < count; ++id) {
+        recycle_buffer(static_cast<uint16_t>(id));
+    }
+}
+
+void IoUring::recycle_buffer(uint16_t id) {
+    io_uring_buf& entry = buffer_ring_[buffer_tail_ & buffer_mask_];
+    entry.addr = reinterpret_cast<uint64_t>(buffer(id));
+    entry.len = buffer_size_;
+    entry.bid = id;
+    ++buffer_tail_;
+    // The ring's tail overlays the reserved field of its first entry.
+    __atomic_store_n(&buffer_ring_[0].resv, buffer_tail_, __ATOMIC_RELEASE);
+}
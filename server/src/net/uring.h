@@ -0,0 +1,110 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Thin io_uring wrapper on the raw syscalls, so the server needs no liburing.
+// It covers what the EventLoop's io_uring backend uses: batched submission,
+// waiting with a timeout, and one ring of provided receive buffers (the
+// kernel picks a free buffer when data arrives, so an idle connection pins
+// no receive memory). One IoUring belongs to one EventLoop thread.
+class IoUring {
+public:
+    // Creates a ring with `entries` submission slots. Throws
+    // std::runtime_error if io_uring is unavailable (old kernel, or blocked
+    // by a seccomp profile as in Docker's default one).
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Whether this kernel supports everything the io_uring backend needs
+    // (multishot accept and receive, provided buffer rings, waits with a
+    // timeout). Fills `reason` when it does not.
+    static bool probe(std::string& reason);
+
+    // A zeroed submission entry, queued for the next submit_and_wait(). If
+    // the queue is full the pending entries are submitted first.
+    io_uring_sqe* get_sqe();
+
+    // Makes sure the next `count` get_sqe() calls land in the same
+    // submission, as linked entries must.
+    void reserve(unsigned count);
+
+    // Submits every queued entry and waits until at least one completion is
+    // ready or `timeout` passes, in a single io_uring_enter(). Returns false
+    // on failure (errno set); timeouts and signals are not failures.
+    bool submit_and_wait(std::chrono::milliseconds timeout);
+
+    // Calls `handler(const io_uring_cqe&)` for each ready completion. The
+    // handler may queue new entries.
+    template <typename Handler>
+    unsigned for_each_completion(Handler&& handler) {
+        unsigned count = 0;
+        unsigned head = *cq_head_;
+        while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+            io_uring_cqe cqe = cqes_[head & cq_mask_];
+            // Release the slot before handling, so a handler that submits
+            // cannot overflow the completion queue with its own entries.
+            __atomic_store_n(cq_head_, ++head, __ATOMIC_RELEASE);
+            handler(cqe);
+            ++count;
+        }
+        return count;
+    }
+
+    // Registers `count` (a power of two) buffers of `size` bytes as provided
+    // buffer group `group`. Throws std::runtime_error on failure.
+    void setup_buffers(uint16_t group, unsigned count, unsigned size);
+
+    // The buffer the kernel filled for a completion with IORING_CQE_F_BUFFER.
+    char* buffer(uint16_t id) const { return buffers_ + static_cast<size_t>(id) * buffer_size_; }
+
+    // Hands a consumed buffer back to the kernel.
+    void recycle_buffer(uint16_t id);
+
+    // io_uring_enter() calls made so far.
+    uint64_t enter_calls() const { return enter_calls_; }
+
+private:
+    void release();
+    bool enter(unsigned to_submit, unsigned wait_for, std::chrono::milliseconds timeout);
+
+    int ring_fd_ = -1;
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;   // Same mapping as sq_ring_ with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sqe_tail_ = 0;     // Entries handed out by get_sqe(), published to *sq_tail_ on submit
+
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    // The kernel's io_uring_buf_ring, addressed as a plain array: compiled
+    // as C++, the header's flexible-array member lands at offset 8, not 0.
+    io_uring_buf* buffer_ring_ = nullptr;
+    size_t buffer_ring_size_ = 0;
+    char* buffers_ = nullptr;
+    size_t buffers_size_ = 0;
+    unsigned buffer_size_ = 0;
+    unsigned buffer_mask_ = 0;
+    uint16_t buffer_tail_ = 0;
+
+    uint64_t enter_calls_ = 0;
+};
+
+#endif // URING_H
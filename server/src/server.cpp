@@ -1,4 +1,5 @@
 #include <iostream>
+#include <signal.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
@@ -9,152 +10,290 @@
 #include <arpa/inet.h> // Required for inet_ntoa
 #include <cstring> // Required for strcpy
 #include <thread> // Required for multithreading
-#include <map> // Required for std::map
-#include <mutex> // Required for std::mutex
+#include <cstdlib>
+#include <memory>
+#include <algorithm>
+#include <cerrno>
+#include <vector>
 #include "utils/httprequest.h"
 #include "utils/httprequest_parser.h"
+#include "utils/httpresponse.h"
 #include "controllers/health_controller.h"
 #include "controllers/metrics_controller.h"
 #include "controllers/hello_controller.h"
 #include "controllers/bye_controller.h"
+#include "controllers/static_controller.h"
+#include "controllers/stream_controller.h"
+#include "controllers/trace_controller.h"
+#include "utils/access_log.h"
 #include "utils/logger.h"
+#include "utils/config.h"
+#include "utils/file_cache.h"
+#include "net/admission.h"
+#include "net/async.h"
+#include "net/event_loop.h"
+#include "net/hot_restart.h"
+#include "net/listener.h"
+#include "net/response_cache.h"
+#include "net/uring.h"
+#include "utils/task.h"
+#include "utils/trace.h"
+#include "utils/worker_pool.h"
+#include "utils/metrics.h"
+#include "utils/router.h"
 
-// Global metrics
-std::map<std::string, int> endpoint_counts;
-std::mutex metrics_mutex;
-int total_requests_count = 0;
+// Routes registered by the controllers; built in main() before the event loops start.
+Router* router = nullptr;
 
-// Function to handle a single client connection
-void handle_client(int client_socket, const std::string& client_ip, int client_port) {
-    Logger::getInstance().log("INFO", "Handling client " + client_ip + ":" + std::to_string(client_port) + " in a new thread.");
+// Handles one parsed request. Starts on a worker pool thread; co_await
+// suspends it without holding the thread (see net/async.h).
+Task<HttpResponse> handle_request(HttpRequest request, std::string peer) {
 
-    // 5. Receive data from the client
-    char buffer[1024] = {0};
-    long valread = read(client_socket, buffer, 1024);
-    std::string client_message(buffer); // Convert char array to std::string
-
-    Logger::getInstance().log("INFO", "Client message from " + client_ip + ":" + std::to_string(client_port) + ": " + client_message);
-
-    HttpRequest request = HttpRequestParser::parse(client_message);
-
-    // Simulate blocking if 'block' query parameter is present
-    if (request.query_params.count("block")) {
+    // Simulate blocking if 'block' query parameter is present. The wait is a
+    // timer on the event loop, so blocked requests do not tie up workers.
+    const HttpField* block = request.query_params.find("block");
+    if (block != nullptr) {
+        int block_duration = 0;
         try {
-            int block_duration = std::stoi(request.query_params["block"]);
-            Logger::getInstance().log("INFO", "Thread for client " + client_ip + ":" + std::to_string(client_port) + " blocking for " + std::to_string(block_duration) + " seconds.");
-            std::this_thread::sleep_for(std::chrono::seconds(block_duration));
-            Logger::getInstance().log("INFO", "Thread for client " + client_ip + ":" + std::to_string(client_port) + " unblocked.");
+            block_duration = std::stoi(std::string(block->value));
         } catch (const std::invalid_argument& e) {
-            Logger::getInstance().log("WARN", "Invalid 'block' parameter for client " + client_ip + ":" + std::to_string(client_port) + ". Ignoring. Error: " + e.what());
+            LOG_WARN("Invalid 'block' parameter for client " + peer + ". Ignoring. Error: " + e.what());
         } catch (const std::out_of_range& e) {
-            Logger::getInstance().log("WARN", "'block' parameter out of range for client " + client_ip + ":" + std::to_string(client_port) + ". Ignoring. Error: " + e.what());
+            LOG_WARN("'block' parameter out of range for client " + peer + ". Ignoring. Error: " + e.what());
+        }
+        if (block_duration > 0) {
+            LOG_INFO("Request from client " + peer + " waiting for " + std::to_string(block_duration) + " seconds.");
+            co_await sleep_for(std::chrono::seconds(block_duration));
+            LOG_INFO("Request from client " + peer + " resumed.");
         }
     }
 
-    // 6. Send a response back to the client based on the message
-    std::string response;
-    if (request.path == "/health") {
-        response = getHealthStatus(request);
-    } else if (request.path == "/metrics") {
-        // Acquire lock for reading metrics
-        std::lock_guard<std::mutex> guard(metrics_mutex);
-        response = getMetrics(request, total_requests_count, endpoint_counts);
-    } else if (request.path == "/hello") {
-        response = getHello(request);
-    } else if (request.path == "/bye") {
-        response = getBye(request);
+    // 6. Build a response based on the request
+    const Route* route = router->match(request);
+    HttpResponse response;
+    if (route->cache_ttl.count() > 0 && request.method == "GET") {
+        response = co_await ResponseCache::getInstance().fetch(*route, request);
+    } else if (route->async_handler) {
+        response = co_await route->async_handler(request);
     } else {
-        response = "HTTP/1.1 404 Not Found\nContent-Type: text/plain\n\nUnknown endpoint\n";
+        response = route->handler(request);
     }
 
-    // Update metrics
-    { // Scoped lock for metrics_mutex
-        std::lock_guard<std::mutex> guard(metrics_mutex);
-        total_requests_count++;
-        // Increment specific endpoint counter
-        if (request.path == "/health") {
-            endpoint_counts["/health"]++;
-        } else if (request.path == "/metrics") {
-            endpoint_counts["/metrics"]++;
-        } else if (request.path == "/hello") {
-            endpoint_counts["/hello"]++;
-        } else if (request.path == "/bye") {
-            endpoint_counts["/bye"]++;
-        } else {
-            endpoint_counts["unknown"]++;
-        }
-    }
+    response.set_route(route->metrics_slot);
 
-    send(client_socket, response.c_str(), response.length(), 0);
-    Logger::getInstance().log("INFO", "Response sent to client " + client_ip + ":" + std::to_string(client_port) + ".");
+    // Update metrics; lock-free, each thread writes its own shard
+    Metrics::getInstance().record_request(route->metrics_slot, response.status(), std::chrono::steady_clock::now() - request.received_at);
 
-    // 7. Close the client socket (connection to this specific client)
-    close(client_socket);
-    Logger::getInstance().log("INFO", "Client " + client_ip + ":" + std::to_string(client_port) + " disconnected.");
+    co_return response;
 }
 
-int main() {
-    // 1. Create a socket
-    int server_fd;
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        Logger::getInstance().log("ERROR", "socket failed");
+int main(int argc, char* argv[]) {
+    (void)argc;
+    // SIGTERM and SIGINT drain and exit; SIGUSR2 hands over to a new process
+    // first (net/hot_restart.h). They are blocked before any thread starts,
+    // so every thread inherits the mask and only the control thread started
+    // below takes them, with sigwait().
+    sigset_t control_signals;
+    sigemptyset(&control_signals);
+    sigaddset(&control_signals, SIGTERM);
+    sigaddset(&control_signals, SIGINT);
+    sigaddset(&control_signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &control_signals, nullptr);
+    std::string executable = executable_path();
+
+    ServerConfig config = ServerConfig::fromEnvironment();
+
+    LoggerOptions log_options;
+    log_options.level = config.log_level == "debug" ? LogLevel::Debug
+                      : config.log_level == "warn" ? LogLevel::Warn
+                      : config.log_level == "error" ? LogLevel::Error
+                      : LogLevel::Info;
+    log_options.async = config.log_mode != "sync";
+    log_options.block_on_full = config.log_overflow == "block";
+    log_options.queue_capacity = static_cast<size_t>(config.log_queue_capacity);
+    Logger::getInstance().configure(log_options);
+
+    AccessLog::Options access_options;
+    access_options.directory = config.access_log_dir;
+    access_options.file_bytes = static_cast<size_t>(config.access_log_mb) * 1024 * 1024;
+    access_options.files = config.access_log_files;
+    try {
+        AccessLog::getInstance().configure(access_options);
+    } catch (const std::exception& e) {
+        LOG_ERROR(e.what());
         exit(EXIT_FAILURE);
     }
 
-    // 2. Bind the socket to an IP address and port
-    sockaddr_in address;
-    int port = 8080;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY; // Listen on all available network interfaces
-    address.sin_port = htons(port);
+    // io_uring may be missing or blocked (Docker's default seccomp profile
+    // denies it); serve with epoll rather than not at all.
+    if (config.io_backend == IoBackend::IoUring) {
+        std::string reason;
+        if (!IoUring::probe(reason)) {
+            LOG_WARN("io_uring unavailable (" + reason + "), falling back to epoll.");
+            config.io_backend = IoBackend::Epoll;
+        }
+    }
+    Tracer::getInstance().configure(static_cast<uint32_t>(config.trace_sample), static_cast<size_t>(config.trace_buffer));
 
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        Logger::getInstance().log("ERROR", "bind failed");
+    std::string backend_name = config.io_backend == IoBackend::IoUring ? "io_uring" : "epoll";
+    Metrics::getInstance().set_io_backend(backend_name);
+
+    // 1. Open the listening socket(s). In SO_REUSEPORT mode every event loop
+    // gets its own listener bound to the same port, so the kernel balances
+    // connections across loops and no accept queue is shared between threads.
+    // A hot restart's successor takes over its predecessor's sockets instead,
+    // and runs at least one loop per socket so that none goes unserved.
+    std::vector<int> listen_fds;
+    try {
+        if (inherit_listeners(listen_fds)) {
+            LOG_INFO("Took over " + std::to_string(listen_fds.size()) + " listening socket(s) from the previous server process.");
+            config.io_threads = std::max(config.io_threads, static_cast<int>(listen_fds.size()));
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR(e.what());
         exit(EXIT_FAILURE);
     }
+    int listener_count = config.reuse_port ? config.io_threads : 1;
+    for (int i = static_cast<int>(listen_fds.size()); i < listener_count; ++i) {
+        int fd = open_listener(config.port, config.listen_backlog, config.reuse_port);
+        if (fd < 0) {
+            LOG_ERROR("listen on port " + std::to_string(config.port) + " failed: " + std::strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        listen_fds.push_back(fd);
+    }
 
-    // 3. Listen for incoming connections
-    if (listen(server_fd, 3) < 0) { // 3 is the maximum length of the queue of pending connections
-        Logger::getInstance().log("ERROR", "listen failed");
-        exit(EXIT_FAILURE);
+    LOG_INFO("Server listening on port " + std::to_string(config.port) + " with " + std::to_string(config.io_threads) + " " + backend_name + " event loop thread(s), " + std::to_string(listen_fds.size()) + " listening socket(s) and " + std::to_string(config.worker_threads) + " worker thread(s)");
+
+    // 2. Start bounded worker pools for request handlers, so slow handlers
+    // (e.g. ?block=N) cannot pile up an unbounded number of threads. With
+    // SO_REUSEPORT each loop gets a private pool (threads and queue split
+    // evenly), so loops share no mutable state on the request path.
+    int pool_count = config.reuse_port ? config.io_threads : 1;
+    std::vector<std::unique_ptr<WorkerPool>> pools;
+    std::vector<const WorkerPool*> pool_views;
+    for (int i = 0; i < pool_count; ++i) {
+        int threads = std::max(1, (config.worker_threads + pool_count - 1) / pool_count);
+        size_t capacity = std::max<size_t>(2, static_cast<size_t>(config.queue_capacity / pool_count));
+        pools.emplace_back(new WorkerPool(threads, capacity));
+        pool_views.push_back(pools.back().get());
     }
 
-    Logger::getInstance().log("INFO", "Server listening on port " + std::to_string(port));
+    // Admission control is shared by all loops: the connection cap and the
+    // per-client rate limits are global, whichever loop a client lands on.
+    AdmissionControl::Options admission_options;
+    admission_options.max_connections = config.max_connections;
+    admission_options.rate = config.rate_limit_rps;
+    admission_options.burst = config.rate_limit_burst;
+    admission_options.clients = static_cast<size_t>(config.rate_limit_clients);
+    admission_options.max_queue_delay = std::chrono::milliseconds(config.shed_queue_delay_ms);
+    AdmissionControl admission(admission_options);
 
-    while (true) { // Main server loop to continuously accept connections
-        // 4. Accept a client connection
-        int client_socket;
-        socklen_t addrlen = sizeof(address);
-        if ((client_socket = accept(server_fd, (struct sockaddr *)&address, &addrlen)) < 0) {
-            Logger::getInstance().log("ERROR", "accept failed");
-            continue; // Continue listening for other connections
+    // Each controller registers its own routes; adding an endpoint only
+    // needs a new register*Routes() call here.
+    Router routes;
+    registerHealthRoutes(routes);
+    registerMetricsRoutes(routes, pool_views, admission);
+    registerHelloRoutes(routes);
+    registerByeRoutes(routes);
+    registerTraceRoutes(routes);
+    if (config.demo_routes) {
+        // A generated /stream body is held to the largest request body.
+        uint64_t max_stream_mb = config.max_body_mb > 0 ? static_cast<uint64_t>(config.max_body_mb) : 1024;
+        registerStreamRoutes(routes, max_stream_mb * 1024 * 1024);
+    }
+
+    // Scrapes within SERVER_METRICS_CACHE_MS of each other share one render.
+    ResponseCache::getInstance().configure(static_cast<size_t>(config.response_cache_mb) * 1024 * 1024);
+    routes.cache("GET", "/metrics", std::chrono::milliseconds(config.metrics_cache_ms));
+    std::unique_ptr<FileCache> static_files;
+    if (!config.static_root.empty()) {
+        FileCache::Options cache_options;
+        cache_options.root = config.static_root;
+        cache_options.max_file_size = static_cast<size_t>(config.static_cache_max_file);
+        cache_options.capacity_bytes = static_cast<size_t>(config.static_cache_mb) * 1024 * 1024;
+        try {
+            static_files.reset(new FileCache(cache_options));
+        } catch (const std::exception& e) {
+            LOG_ERROR(e.what());
+            exit(EXIT_FAILURE);
         }
+        registerStaticRoutes(routes, config.static_prefix, *static_files);
+        LOG_INFO("Serving " + config.static_root + " under " + config.static_prefix + "/");
+    }
+    router = &routes;
 
-        // Get client IP and port using getpeername
-        struct sockaddr_in client_address;
-        socklen_t client_addrlen = sizeof(client_address);
-        char client_ip[INET_ADDRSTRLEN];
-        int client_port;
-
-        if (getpeername(client_socket, (struct sockaddr *)&client_address, &client_addrlen) == 0) {
-            inet_ntop(AF_INET, &(client_address.sin_addr), client_ip, INET_ADDRSTRLEN);
-            client_port = ntohs(client_address.sin_port);
-            Logger::getInstance().log("INFO", "Client connected from " + std::string(client_ip) + ":" + std::to_string(client_port));
-        } else {
-            Logger::getInstance().log("ERROR", "getpeername failed");
-            Logger::getInstance().log("INFO", "Client connected!"); // Fallback if getpeername fails
-            // Assign dummy values if getpeername fails to avoid uninitialized variable use
-            strcpy(client_ip, "UNKNOWN");
-            client_port = 0;
+    // 3. Start a fixed number of event loops. Each one accepts, reads, parses
+    // and writes for its own connections, so the thread count no longer grows
+    // with the number of clients.
+    std::vector<std::unique_ptr<EventLoop>> loops;
+    for (int i = 0; i < config.io_threads; ++i) {
+        int listen_fd = listen_fds[i % listen_fds.size()];
+        WorkerPool& pool = *pools[i % pools.size()];
+        loops.emplace_back(new EventLoop(listen_fd, config, pool, admission, handle_request));
+    }
+
+    // Optionally pin loop i to the i-th CPU of SERVER_CPU_AFFINITY (wrapping
+    // around), keeping each loop's connections in one CPU's caches.
+    std::vector<int> cpus = parse_cpu_list(config.cpu_affinity);
+    auto run_loop = [&loops, &cpus](size_t index) {
+        if (!cpus.empty()) {
+            int cpu = cpus[index % cpus.size()];
+            if (!pin_current_thread(cpu)) {
+                LOG_WARN("Could not pin event loop " + std::to_string(index) + " to CPU " + std::to_string(cpu) + ".");
+            }
         }
+        loops[index]->run();
+    };
 
-        // Create a new thread to handle the client connection
-        std::thread client_thread(handle_client, client_socket, std::string(client_ip), client_port);
-        client_thread.detach(); // Detach the thread so it runs independently
+    std::vector<std::thread> loop_threads;
+    for (size_t i = 1; i < loops.size(); ++i) {
+        loop_threads.emplace_back(run_loop, i);
     }
 
-    // The server_fd will typically be closed only when the server application is shut down.
-    close(server_fd);
+    // 4. Wait for a signal to stop. On SIGUSR2 the loops keep serving until
+    // the successor is up; if it fails, nothing changes and the server waits
+    // for the next signal.
+    std::thread control([&]() {
+        while (true) {
+            int signal = 0;
+            if (sigwait(&control_signals, &signal) != 0) {
+                continue;
+            }
+            if (signal == SIGUSR2) {
+                LOG_INFO("Hot restart: starting " + executable + ".");
+                std::string error;
+                if (!start_successor(executable, argv, listen_fds, std::chrono::milliseconds(config.restart_timeout_ms), error)) {
+                    LOG_ERROR("Hot restart failed: " + error + "; still serving.");
+                    continue;
+                }
+                LOG_INFO("Hot restart: the new process is serving, draining this one.");
+            } else {
+                LOG_INFO(std::string("Received ") + strsignal(signal) + ", draining.");
+            }
+            std::chrono::steady_clock::time_point deadline =
+                std::chrono::steady_clock::now() + std::chrono::milliseconds(config.drain_timeout_ms);
+            for (std::unique_ptr<EventLoop>& loop : loops) {
+                loop->drain(deadline);
+            }
+            return;
+        }
+    });
+
+    notify_ready(); // Hot restart: the predecessor may stop accepting now
+    run_loop(0); // The main thread drives the first loop, until it is drained
 
+    for (std::thread& thread : loop_threads) {
+        thread.join();
+    }
+    control.join();
+
+    // Handlers still running post their responses to the loops: stop the
+    // workers before the loops go away.
+    pools.clear();
+    for (int fd : listen_fds) {
+        close(fd);
+    }
+    LOG_INFO("Server stopped.");
     return 0;
 }
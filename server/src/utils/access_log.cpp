@@ -0,0 +1,221 @@
+#include "access_log.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include "logger.h"
+#include "metrics.h"
+
+// A record's route id is its route's metrics slot, and the header names
+// every slot.
+static_assert(kAccessLogRoutes == Metrics::kMaxEndpoints, "the access log header holds one name per metrics slot");
+
+// After a file could not be created, records are dropped and creating one
+// is retried only every this many records, so a full disk does not turn
+// every request into a failing open().
+static const uint64_t kRetryEvery = 65536;
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+AccessMethod access_method(std::string_view method) {
+    static const std::pair<std::string_view, AccessMethod> kMethods[] = {
+        {"GET", AccessMethod::Get}, {"HEAD", AccessMethod::Head}, {"POST", AccessMethod::Post},
+        {"PUT", AccessMethod::Put}, {"DELETE", AccessMethod::Delete}, {"PATCH", AccessMethod::Patch},
+        {"OPTIONS", AccessMethod::Options},
+    };
+    for (const auto& known : kMethods) {
+        if (known.first == method) {
+            return known.second;
+        }
+    }
+    return AccessMethod::Other;
+}
+
+const char* access_method_name(AccessMethod method) {
+    static const char* kNames[] = {"-", "GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS"};
+    size_t index = static_cast<size_t>(method);
+    return index < static_cast<size_t>(AccessMethod::Count) ? kNames[index] : kNames[0];
+}
+
+class AccessLog::Writer {
+public:
+    Writer(const Options& options, uint32_t id) : options_(options), id_(id), pid_(getpid()) {}
+    ~Writer() { unmap(); }
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    void append(const AccessRecord& record) {
+        if (next_ == capacity_ && !open_file()) {
+            dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        AccessRecord& slot = slots_[next_++];
+        // time_ns marks the slot as written, so it goes in last: a reader
+        // mapping the file while it is written never sees half a record.
+        std::memcpy(reinterpret_cast<char*>(&slot) + sizeof(slot.time_ns),
+                    reinterpret_cast<const char*>(&record) + sizeof(record.time_ns),
+                    sizeof(record) - sizeof(record.time_ns));
+        std::atomic_ref<int64_t>(slot.time_ns).store(record.time_ns, std::memory_order_release);
+        records.store(records.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // Written by the owning thread only, read by stats().
+    std::atomic<uint64_t> records{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> files{0};
+
+private:
+    std::string file_name(int generation) const {
+        // The pid keeps apart the files of two processes writing at once,
+        // as the old and the new one do during a hot restart.
+        std::string name = options_.directory + "/access-" + std::to_string(pid_) + "-" + std::to_string(id_);
+        if (generation > 0) {
+            name += "." + std::to_string(generation);
+        }
+        return name + ".bin";
+    }
+
+    void unmap() {
+        if (map_ != nullptr) {
+            munmap(map_, options_.file_bytes);
+            map_ = nullptr;
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+        slots_ = nullptr;
+        capacity_ = 0;
+        next_ = 0;
+    }
+
+    bool open_file() {
+        if (failed_ && dropped.load(std::memory_order_relaxed) % kRetryEvery != 0) {
+            return false;
+        }
+        unmap();
+        // Shift the older files up; the rename onto the last name deletes
+        // the oldest.
+        for (int generation = options_.files - 1; generation > 0; --generation) {
+            rename(file_name(generation - 1).c_str(), file_name(generation).c_str());
+        }
+
+        // Never truncate: whoever still maps a file of that name (a reader,
+        // or an earlier process with the same pid) would get SIGBUS on the
+        // pages cut off. Unlinking leaves them the old inode instead.
+        std::string name = file_name(0);
+        if (unlink(name.c_str()) != 0 && errno != ENOENT) {
+            return fail(name, "unlink", errno);
+        }
+        fd_ = open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            return fail(name, "open", errno);
+        }
+        // Reserve the blocks up front: running out of disk while writing
+        // through the mapping would be a SIGBUS rather than an error.
+        int error = posix_fallocate(fd_, 0, static_cast<off_t>(options_.file_bytes));
+        if (error == EOPNOTSUPP || error == EINVAL) {
+            error = ftruncate(fd_, static_cast<off_t>(options_.file_bytes)) == 0 ? 0 : errno;
+        }
+        if (error != 0) {
+            return fail(name, "preallocate", error);
+        }
+        void* map = mmap(nullptr, options_.file_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (map == MAP_FAILED) {
+            return fail(name, "mmap", errno);
+        }
+        map_ = static_cast<char*>(map);
+
+        AccessLogHeader* header = reinterpret_cast<AccessLogHeader*>(map_);
+        std::memcpy(header->magic, kAccessLogMagic, sizeof(header->magic));
+        header->version = kAccessLogVersion;
+        header->record_size = sizeof(AccessRecord);
+        header->capacity = (options_.file_bytes - sizeof(AccessLogHeader)) / sizeof(AccessRecord);
+        header->created_ns = now_ns();
+        header->writer = id_;
+        std::vector<std::string> routes = Metrics::getInstance().endpoint_names();
+        header->route_count = static_cast<uint32_t>(std::min(routes.size(), kAccessLogRoutes));
+        for (uint32_t r = 0; r < header->route_count; ++r) {
+            std::strncpy(header->routes[r], routes[r].c_str(), kAccessLogRouteName - 1);
+        }
+
+        slots_ = reinterpret_cast<AccessRecord*>(map_ + sizeof(AccessLogHeader));
+        capacity_ = header->capacity;
+        failed_ = false;
+        files.store(files.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool fail(const std::string& name, const char* step, int error) {
+        if (!failed_) {
+            LOG_ERROR("Access log " + name + ": " + step + " failed: " + std::strerror(error) + "; dropping records.");
+        }
+        failed_ = true;
+        unmap();
+        return false;
+    }
+
+    const Options& options_;
+    uint32_t id_;
+    pid_t pid_;
+    int fd_ = -1;
+    char* map_ = nullptr;
+    AccessRecord* slots_ = nullptr;
+    uint64_t capacity_ = 0;
+    uint64_t next_ = 0;
+    bool failed_ = false;
+};
+
+AccessLog& AccessLog::getInstance() {
+    static AccessLog instance;
+    return instance;
+}
+
+void AccessLog::configure(const Options& options) {
+    options_ = options;
+    enabled_ = !options_.directory.empty();
+    if (!enabled_) {
+        return;
+    }
+    if (access(options_.directory.c_str(), W_OK | X_OK) != 0) {
+        throw std::runtime_error("access log directory " + options_.directory + " is not writable: " +
+                                 std::strerror(errno));
+    }
+    // At least one page of records behind the header.
+    options_.file_bytes = std::max(options_.file_bytes, sizeof(AccessLogHeader) + 4096);
+    options_.files = std::max(options_.files, 1);
+}
+
+AccessLog::Writer& AccessLog::local_writer() {
+    thread_local Writer* writer = nullptr;
+    if (writer == nullptr) {
+        std::lock_guard<std::mutex> guard(writers_mutex_);
+        writers_.emplace_back(new Writer(options_, static_cast<uint32_t>(writers_.size())));
+        writer = writers_.back().get();
+    }
+    return *writer;
+}
+
+void AccessLog::record(const AccessRecord& record) {
+    local_writer().append(record);
+}
+
+AccessLogStats AccessLog::stats() const {
+    AccessLogStats stats;
+    std::lock_guard<std::mutex> guard(writers_mutex_);
+    for (const std::unique_ptr<Writer>& writer : writers_) {
+        stats.records += writer->records.load(std::memory_order_relaxed);
+        stats.dropped += writer->dropped.load(std::memory_order_relaxed);
+        stats.files += writer->files.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
@@ -0,0 +1,122 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// On-disk layout of the binary access log. A file is one AccessLogHeader
+// followed by fixed-size AccessRecord slots, preallocated and zero-filled;
+// slots are filled in order and a slot whose time_ns is still 0 was never
+// written. Fields are little-endian, as written by the x86-64/arm64 hosts
+// the server runs on. tools/accesslog.cpp decodes the files.
+
+static constexpr char kAccessLogMagic[8] = {'S', 'R', 'V', 'A', 'L', 'O', 'G', '1'};
+static constexpr uint32_t kAccessLogVersion = 1;
+static constexpr size_t kAccessLogRoutes = 32;     // Route ids are metrics slots; checked in access_log.cpp
+static constexpr size_t kAccessLogRouteName = 56;  // Bytes per route name, NUL-padded
+static constexpr uint16_t kNoRoute = 0xffff;       // Answered before reaching a route (shed, malformed, timed out)
+
+// Request methods, stored as one byte.
+enum class AccessMethod : uint8_t { Other, Get, Head, Post, Put, Delete, Patch, Options, Count };
+
+AccessMethod access_method(std::string_view method);
+const char* access_method_name(AccessMethod method);
+
+enum AccessFlags : uint8_t {
+    kAccessKeepAlive = 1,      // The connection stayed open after the response
+    kAccessNewConnection = 2,  // First request on its connection
+    kAccessStreamed = 4        // Streamed request or response body
+};
+
+struct AccessLogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;        // sizeof(AccessRecord)
+    uint64_t capacity;           // Record slots in the file
+    int64_t created_ns;          // system_clock nanoseconds since the epoch
+    uint32_t writer;             // Event loop thread that owns the file
+    uint32_t route_count;
+    char routes[kAccessLogRoutes][kAccessLogRouteName]; // Route id -> pattern
+    char reserved[4096 - 40 - kAccessLogRoutes * kAccessLogRouteName];
+};
+
+// One response sent.
+struct AccessRecord {
+    int64_t time_ns = 0;           // When the last byte was sent, system_clock nanoseconds since the epoch
+    uint64_t bytes_received = 0;   // Request head and body bytes read
+    uint64_t bytes_sent = 0;       // Response bytes, head included
+    uint32_t latency_us = 0;       // From the request's first byte to its last response byte
+    uint32_t client_address = 0;   // IPv4, network byte order
+    uint16_t client_port = 0;
+    uint16_t status = 0;
+    uint16_t route = kNoRoute;     // Index into AccessLogHeader::routes
+    uint8_t method = 0;            // AccessMethod
+    uint8_t flags = 0;             // AccessFlags
+};
+
+static_assert(sizeof(AccessLogHeader) == 4096, "the header fills one page");
+static_assert(sizeof(AccessRecord) == 40, "records have a fixed layout");
+static_assert(std::is_trivially_copyable<AccessRecord>::value, "records are copied as raw bytes");
+
+struct AccessLogStats {
+    uint64_t records = 0;
+    uint64_t dropped = 0;  // Not written because a file could not be created
+    uint64_t files = 0;    // Files created, the first one included
+};
+
+// Structured access log: one AccessRecord per response, written into a
+// memory-mapped file owned by the calling thread (each event loop writes its
+// own files, named access-<pid>-<writer>.bin), so recording a request is a
+// handful of stores into the page cache with no lock, no formatting and no
+// system call. The kernel writes the pages back in the background.
+//
+// Files are preallocated to a fixed size. When one is full it is rotated:
+// access-<pid>-<writer>.bin becomes access-<pid>-<writer>.1.bin, older ones
+// move up, and the oldest beyond the configured count is deleted. Rotation
+// is the only step that makes system calls. Files of other processes, such
+// as the predecessor in a hot restart, are never touched.
+class AccessLog {
+public:
+    struct Options {
+        std::string directory;            // "" = off
+        size_t file_bytes = 64 * 1024 * 1024;
+        int files = 4;                    // Files kept per writer, the one being written included
+    };
+
+    static AccessLog& getInstance();
+
+    AccessLog(const AccessLog&) = delete;
+    AccessLog& operator=(const AccessLog&) = delete;
+
+    // Call at startup, before requests are served. Throws
+    // std::runtime_error if the directory is not writable.
+    void configure(const Options& options);
+
+    bool enabled() const { return enabled_; }
+
+    // Appends `record` to the calling thread's file.
+    void record(const AccessRecord& record);
+
+    AccessLogStats stats() const;
+
+private:
+    class Writer;
+
+    AccessLog() = default;
+
+    Writer& local_writer();
+
+    bool enabled_ = false;
+    Options options_;
+    mutable std::mutex writers_mutex_; // Taken once per thread, and for stats()
+    std::vector<std::unique_ptr<Writer>> writers_;
+};
+
+#endif // ACCESS_LOG_H
@@ -0,0 +1,42 @@
+#include "allocation_counter.h"
+#include <atomic>
+#include <cstddef>
+
+namespace {
+
+constexpr size_t kSlots = 64;
+
+struct alignas(64) Slot {
+    std::atomic<uint64_t> count{0};
+};
+
+// Constant-initialized, so allocations made before main() are counted too.
+Slot slots[kSlots];
+std::atomic<size_t> next_slot{0};
+thread_local size_t slot_index = kSlots; // kSlots: not assigned yet
+std::atomic<bool> counted{false};
+
+} // namespace
+
+void count_heap_allocation() {
+    if (slot_index == kSlots) {
+        slot_index = next_slot.fetch_add(1, std::memory_order_relaxed) % kSlots;
+    }
+    slots[slot_index].count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void enable_heap_allocation_count() {
+    counted.store(true, std::memory_order_relaxed);
+}
+
+bool heap_allocations_counted() {
+    return counted.load(std::memory_order_relaxed);
+}
+
+uint64_t heap_allocations() {
+    uint64_t total = 0;
+    for (const Slot& slot : slots) {
+        total += slot.count.load(std::memory_order_relaxed);
+    }
+    return total;
+}
@@ -0,0 +1,23 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+// Heap allocations (operator new calls) made by the whole process so far.
+// allocation_hooks.cpp replaces the global operator new with a malloc
+// wrapper that bumps a per-thread counter, so counting costs one relaxed
+// atomic add on an uncontended cache line. Only executables that link it
+// count: the microbenchmarks always, the server when built with
+// SERVER_COUNT_ALLOCATIONS. /metrics exports the total, which divided by
+// the request count gives allocations per request.
+uint64_t heap_allocations();
+
+// True if the counting operator new is linked in. heap_allocations() stays
+// 0 otherwise.
+bool heap_allocations_counted();
+
+// Used by allocation_hooks.cpp.
+void count_heap_allocation();
+void enable_heap_allocation_count();
+
+#endif // ALLOCATION_COUNTER_H
@@ -0,0 +1,61 @@
+#include "allocation_counter.h"
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new and delete with counting wrappers around
+// malloc and free. Not part of server_core: it is linked as object code into
+// the executables that want the count.
+
+namespace {
+
+// Constant-initialized state in allocation_counter.cpp, so the order of
+// static initialization does not matter.
+const bool registered = (enable_heap_allocation_count(), true);
+
+void* allocate(std::size_t size, std::size_t alignment) {
+    count_heap_allocation();
+    if (size == 0) {
+        size = 1;
+    }
+    while (true) {
+        void* memory = alignment <= alignof(std::max_align_t)
+            ? std::malloc(size)
+            : std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+        if (memory != nullptr) {
+            return memory;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+} // namespace
+
+// The array and nothrow forms of the standard library forward to these.
+void* operator new(std::size_t size) {
+    return allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
@@ -0,0 +1,93 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for data that lives exactly as long as one request.
+// allocate() carves memory out of the current block and reset() releases
+// everything at once; objects placed here are never destroyed, so only
+// trivially destructible types belong in an Arena. Blocks are kept across
+// resets (merged into one if a request needed several), so a connection
+// whose requests are of similar size stops calling malloc after its first
+// request. Not thread-safe: one request's handler or its loop uses it at a time.
+class Arena {
+public:
+    explicit Arena(size_t block_size = 4096) : block_size_(block_size) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        while (current_ < blocks_.size()) {
+            Block& block = blocks_[current_];
+            size_t start = (offset_ + alignment - 1) & ~(alignment - 1);
+            if (start + size <= block.size) {
+                offset_ = start + size;
+                used_ += size;
+                return block.data.get() + start;
+            }
+            ++current_;
+            offset_ = 0;
+        }
+        size_t capacity = std::max(block_size_, size + alignment);
+        if (!blocks_.empty()) {
+            capacity = std::max(capacity, blocks_.back().size * 2);
+        }
+        blocks_.push_back(Block{std::unique_ptr<char[]>(new char[capacity]), capacity});
+        return allocate(size, alignment);
+    }
+
+    template <typename T>
+    T* allocate_array(size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // Copies `text` into the arena and returns the copy.
+    std::string_view copy(std::string_view text) {
+        if (text.empty()) {
+            return std::string_view();
+        }
+        char* data = static_cast<char*>(allocate(text.size(), 1));
+        std::memcpy(data, text.data(), text.size());
+        return std::string_view(data, text.size());
+    }
+
+    // Makes all memory reusable. Everything allocated so far becomes invalid.
+    void reset() {
+        if (blocks_.size() > 1) {
+            // The last request outgrew the first block: keep one block big
+            // enough for it, so the next such request fits without growing.
+            size_t total = 0;
+            for (const Block& block : blocks_) {
+                total += block.size;
+            }
+            blocks_.clear();
+            blocks_.push_back(Block{std::unique_ptr<char[]>(new char[total]), total});
+        }
+        current_ = 0;
+        offset_ = 0;
+        used_ = 0;
+    }
+
+    // Bytes handed out since the last reset.
+    size_t used() const { return used_; }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    size_t block_size_;
+    std::vector<Block> blocks_;
+    size_t current_ = 0; // Block being filled
+    size_t offset_ = 0;  // First free byte in blocks_[current_]
+    size_t used_ = 0;
+};
+
+#endif // ARENA_H
@@ -0,0 +1,129 @@
+#include "body_stream.h"
+#include <stdexcept>
+#include <utility>
+
+void BodyStream::connect(std::function<void()> waker, std::function<void(std::coroutine_handle<>)> resumer) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    waker_ = std::move(waker);
+    resumer_ = std::move(resumer);
+}
+
+bool BodyStream::put(std::string_view data) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    buffer_.append(data);
+    std::coroutine_handle<> reader = buffer_.empty() ? nullptr : std::exchange(waiter_, nullptr);
+    bool full = buffer_.size() >= capacity_;
+    if (full) {
+        loop_waiting_ = true;
+    }
+    wake(lock, reader, false);
+    return !full;
+}
+
+BodyStream::TakeResult BodyStream::take(std::string& out) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!buffer_.empty()) {
+        out.clear();
+        out.swap(buffer_);
+        wake(lock, std::exchange(waiter_, nullptr), false);
+        return TakeResult::Data;
+    }
+    if (failed_) {
+        return TakeResult::Failed;
+    }
+    if (finished_) {
+        return TakeResult::End;
+    }
+    loop_waiting_ = true;
+    return TakeResult::Empty;
+}
+
+void BodyStream::finish() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_ = true;
+    wake(lock, std::exchange(waiter_, nullptr), std::exchange(loop_waiting_, false));
+}
+
+void BodyStream::fail(const std::string& reason) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (failed_) {
+        return;
+    }
+    failed_ = true;
+    error_ = reason;
+    wake(lock, std::exchange(waiter_, nullptr), std::exchange(loop_waiting_, false));
+}
+
+std::string BodyStream::error() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return error_;
+}
+
+bool BodyStream::readable() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return !buffer_.empty() || finished_ || failed_;
+}
+
+bool BodyStream::wait_readable(std::coroutine_handle<> handle) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!buffer_.empty() || finished_ || failed_) {
+        return false; // Arrived since await_ready(): carry on without suspending
+    }
+    waiter_ = handle;
+    return true;
+}
+
+bool BodyStream::read_now(std::string& chunk) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!buffer_.empty()) {
+        chunk.clear();
+        chunk.swap(buffer_);
+        wake(lock, nullptr, std::exchange(loop_waiting_, false));
+        return true;
+    }
+    if (failed_) {
+        throw std::runtime_error(error_);
+    }
+    chunk.clear();
+    return false;
+}
+
+bool BodyStream::write_now(std::string_view data) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (failed_) {
+        return true; // await_resume() throws
+    }
+    buffer_.append(data);
+    bool wake_loop = !buffer_.empty() && std::exchange(loop_waiting_, false);
+    bool room = buffer_.size() < capacity_;
+    wake(lock, nullptr, wake_loop);
+    return room;
+}
+
+bool BodyStream::wait_writable(std::coroutine_handle<> handle) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (failed_ || buffer_.size() < capacity_) {
+        return false;
+    }
+    waiter_ = handle;
+    return true;
+}
+
+void BodyStream::check_failed() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (failed_) {
+        throw std::runtime_error(error_);
+    }
+}
+
+void BodyStream::wake(std::unique_lock<std::mutex>& lock, std::coroutine_handle<> handler, bool loop) {
+    // Callbacks run unlocked: the resumed handler or the loop may come
+    // straight back into the stream.
+    lock.unlock();
+    if (handler && resumer_) {
+        resumer_(handler);
+    }
+    if (loop && waker_) {
+        waker_();
+    }
+}
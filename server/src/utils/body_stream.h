@@ -0,0 +1,109 @@
+#ifndef BODY_STREAM_H
+#define BODY_STREAM_H
+
+#include <coroutine>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Bounded byte pipe carrying a request body from an event loop to a handler,
+// or a response body from a handler to the loop. The loop's side never
+// blocks: put() and take() report a full or empty pipe, and the loop waits
+// for the waker callback. The handler's side co_awaits read() or write() and
+// is suspended, holding only its coroutine frame, while the pipe is empty or
+// full. At most `capacity` bytes plus one write are buffered, so a body of
+// any size passes through in constant memory.
+//
+//     std::string chunk;
+//     while (co_await request.body_stream->read(chunk)) {
+//         consume(chunk);
+//     }
+class BodyStream {
+public:
+    enum class TakeResult {
+        Data,   // `out` holds the next bytes
+        Empty,  // Nothing yet; the waker runs once there is
+        End,    // The producer finished and everything has been taken
+        Failed  // The producer gave up; see error()
+    };
+
+    class ReadAwaiter {
+    public:
+        ReadAwaiter(BodyStream& stream, std::string& chunk) : stream_(stream), chunk_(chunk) {}
+
+        bool await_ready() const { return stream_.readable(); }
+        bool await_suspend(std::coroutine_handle<> handle) { return stream_.wait_readable(handle); }
+        bool await_resume() { return stream_.read_now(chunk_); }
+
+    private:
+        BodyStream& stream_;
+        std::string& chunk_;
+    };
+
+    class WriteAwaiter {
+    public:
+        WriteAwaiter(BodyStream& stream, std::string_view data) : stream_(stream), data_(data) {}
+
+        bool await_ready() { return stream_.write_now(data_); }
+        bool await_suspend(std::coroutine_handle<> handle) { return stream_.wait_writable(handle); }
+        void await_resume() const { stream_.check_failed(); }
+
+    private:
+        BodyStream& stream_;
+        std::string_view data_;
+    };
+
+    explicit BodyStream(size_t capacity) : capacity_(capacity) {}
+
+    BodyStream(const BodyStream&) = delete;
+    BodyStream& operator=(const BodyStream&) = delete;
+
+    // Wiring, done by the loop before either side runs. `waker` tells the
+    // loop that the handler made progress and may be called on any thread;
+    // `resumer` resumes a suspended handler (EventLoop::resume).
+    void connect(std::function<void()> waker, std::function<void(std::coroutine_handle<>)> resumer);
+
+    // Handler side. co_await read(chunk) replaces `chunk` with every byte
+    // buffered so far and returns true, or returns false at the end of the
+    // body. co_await write(data) copies `data` in and suspends while the
+    // pipe is full. Both throw std::runtime_error once the stream failed
+    // (the client went away or sent a malformed body).
+    ReadAwaiter read(std::string& chunk) { return ReadAwaiter(*this, chunk); }
+    WriteAwaiter write(std::string_view data) { return WriteAwaiter(*this, data); }
+
+    // Loop side. put() appends and returns false once the pipe is full; the
+    // waker runs when the handler has drained it. take() swaps the buffered
+    // bytes into `out`, so the two buffers are reused back and forth.
+    bool put(std::string_view data);
+    TakeResult take(std::string& out);
+
+    // Either side: no more bytes will follow, or none can be delivered.
+    void finish();
+    void fail(const std::string& reason);
+
+    std::string error() const;
+
+private:
+    bool readable() const;
+    bool wait_readable(std::coroutine_handle<> handle);
+    bool read_now(std::string& chunk);
+    bool write_now(std::string_view data);
+    bool wait_writable(std::coroutine_handle<> handle);
+    void check_failed() const;
+    void wake(std::unique_lock<std::mutex>& lock, std::coroutine_handle<> handler, bool loop);
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::string buffer_;
+    bool finished_ = false;
+    bool failed_ = false;
+    std::string error_;
+    std::coroutine_handle<> waiter_;  // Handler suspended in read() or write()
+    bool loop_waiting_ = false;       // The loop saw a full (put) or empty (take) pipe
+    std::function<void()> waker_;
+    std::function<void(std::coroutine_handle<>)> resumer_;
+};
+
+#endif // BODY_STREAM_H
@@ -0,0 +1,44 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Free list of string buffers that keep their capacity between uses, so
+// serializing a response head does not allocate once the pool is warm.
+// Not thread-safe: each EventLoop owns its own pool.
+class BufferPool {
+public:
+    BufferPool(size_t max_buffers, size_t max_capacity)
+        : max_buffers_(max_buffers), max_capacity_(max_capacity) {}
+
+    std::string acquire() {
+        if (free_.empty()) {
+            std::string buffer;
+            buffer.reserve(256);
+            return buffer;
+        }
+        std::string buffer = std::move(free_.back());
+        free_.pop_back();
+        return buffer;
+    }
+
+    // Returns `buffer` to the pool; oversized buffers are freed instead so
+    // one large response does not pin memory forever.
+    void release(std::string&& buffer) {
+        if (free_.size() >= max_buffers_ || buffer.capacity() > max_capacity_) {
+            return;
+        }
+        buffer.clear();
+        free_.push_back(std::move(buffer));
+    }
+
+private:
+    size_t max_buffers_;
+    size_t max_capacity_;
+    std::vector<std::string> free_;
+};
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,157 @@
+#include "config.h"
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+
+int env_int(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return fallback;
+    }
+    try {
+        return std::stoi(value);
+    } catch (const std::exception&) {
+        return fallback;
+    }
+}
+
+std::string env_string(const char* name, const std::string& fallback) {
+    const char* value = std::getenv(name);
+    if (value == nullptr) {
+        return fallback;
+    }
+    return value;
+}
+
+ServerConfig ServerConfig::fromEnvironment() {
+    ServerConfig config;
+    config.port = env_int("SERVER_PORT", config.port);
+    config.io_threads = env_int("SERVER_IO_THREADS", config.io_threads);
+    config.listen_backlog = env_int("SERVER_LISTEN_BACKLOG", config.listen_backlog);
+    config.reuse_port = env_int("SERVER_REUSE_PORT", config.reuse_port ? 1 : 0) != 0;
+    config.cpu_affinity = env_string("SERVER_CPU_AFFINITY", config.cpu_affinity);
+    config.max_events = env_int("SERVER_MAX_EVENTS", config.max_events);
+    std::string io_backend = env_string("SERVER_IO_BACKEND", "epoll");
+    config.io_backend = io_backend == "io_uring" ? IoBackend::IoUring : IoBackend::Epoll;
+    config.worker_threads = env_int("SERVER_WORKER_THREADS", config.worker_threads);
+    config.queue_capacity = env_int("SERVER_QUEUE_CAPACITY", config.queue_capacity);
+    config.keepalive_timeout_ms = env_int("SERVER_KEEPALIVE_TIMEOUT_MS", config.keepalive_timeout_ms);
+    config.max_keepalive_requests = env_int("SERVER_MAX_KEEPALIVE_REQUESTS", config.max_keepalive_requests);
+    config.header_timeout_ms = env_int("SERVER_HEADER_TIMEOUT_MS", config.header_timeout_ms);
+    config.request_timeout_ms = env_int("SERVER_REQUEST_TIMEOUT_MS", config.request_timeout_ms);
+    config.max_buffered_body = env_int("SERVER_MAX_BUFFERED_BODY", config.max_buffered_body);
+    config.max_body_mb = env_int("SERVER_MAX_BODY_MB", config.max_body_mb);
+    config.stream_buffer_kb = env_int("SERVER_STREAM_BUFFER_KB", config.stream_buffer_kb);
+    config.demo_routes = env_int("SERVER_DEMO_ROUTES", config.demo_routes ? 1 : 0) != 0;
+    config.static_root = env_string("SERVER_STATIC_ROOT", config.static_root);
+    config.static_prefix = env_string("SERVER_STATIC_PREFIX", config.static_prefix);
+    config.static_cache_max_file = env_int("SERVER_STATIC_CACHE_MAX_FILE", config.static_cache_max_file);
+    config.static_cache_mb = env_int("SERVER_STATIC_CACHE_MB", config.static_cache_mb);
+    config.response_cache_mb = env_int("SERVER_RESPONSE_CACHE_MB", config.response_cache_mb);
+    config.metrics_cache_ms = env_int("SERVER_METRICS_CACHE_MS", config.metrics_cache_ms);
+    config.max_connections = env_int("SERVER_MAX_CONNECTIONS", config.max_connections);
+    config.rate_limit_rps = env_int("SERVER_RATE_LIMIT_RPS", config.rate_limit_rps);
+    config.rate_limit_burst = env_int("SERVER_RATE_LIMIT_BURST", config.rate_limit_burst);
+    config.rate_limit_clients = env_int("SERVER_RATE_LIMIT_CLIENTS", config.rate_limit_clients);
+    config.shed_queue_delay_ms = env_int("SERVER_SHED_QUEUE_DELAY_MS", config.shed_queue_delay_ms);
+    config.trace_sample = env_int("SERVER_TRACE_SAMPLE", config.trace_sample);
+    config.trace_buffer = env_int("SERVER_TRACE_BUFFER", config.trace_buffer);
+    config.drain_timeout_ms = env_int("SERVER_DRAIN_TIMEOUT_MS", config.drain_timeout_ms);
+    config.restart_timeout_ms = env_int("SERVER_RESTART_TIMEOUT_MS", config.restart_timeout_ms);
+    std::string backpressure = env_string("SERVER_BACKPRESSURE", "reject");
+    config.backpressure = backpressure == "pause" ? BackpressurePolicy::Pause : BackpressurePolicy::Reject;
+    config.log_level = env_string("SERVER_LOG_LEVEL", config.log_level);
+    config.log_mode = env_string("SERVER_LOG_MODE", config.log_mode);
+    config.log_overflow = env_string("SERVER_LOG_OVERFLOW", config.log_overflow);
+    config.log_queue_capacity = env_int("SERVER_LOG_QUEUE_CAPACITY", config.log_queue_capacity);
+    config.access_log_dir = env_string("SERVER_ACCESS_LOG_DIR", config.access_log_dir);
+    config.access_log_mb = env_int("SERVER_ACCESS_LOG_MB", config.access_log_mb);
+    config.access_log_files = env_int("SERVER_ACCESS_LOG_FILES", config.access_log_files);
+
+    if (config.io_threads <= 0) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        config.io_threads = cores > 0 ? static_cast<int>(cores) : 1;
+    }
+    if (config.listen_backlog <= 0) {
+        config.listen_backlog = 4096; // The kernel caps it at net.core.somaxconn
+    }
+    if (config.max_events <= 0) {
+        config.max_events = 256;
+    }
+    if (config.worker_threads <= 0) {
+        config.worker_threads = 1;
+    }
+    if (config.queue_capacity <= 0) {
+        config.queue_capacity = 1024;
+    }
+    if (config.log_queue_capacity <= 0) {
+        config.log_queue_capacity = 8192;
+    }
+    if (config.access_log_mb <= 0) {
+        config.access_log_mb = 64;
+    }
+    if (config.access_log_files <= 0) {
+        config.access_log_files = 4;
+    }
+    if (config.keepalive_timeout_ms <= 0) {
+        config.keepalive_timeout_ms = 5000;
+    }
+    if (config.header_timeout_ms <= 0) {
+        config.header_timeout_ms = 10000;
+    }
+    if (config.request_timeout_ms <= 0) {
+        config.request_timeout_ms = 30000;
+    }
+    if (config.max_keepalive_requests <= 0) {
+        config.max_keepalive_requests = 1;
+    }
+    if (config.max_buffered_body < 0) {
+        config.max_buffered_body = 0;
+    }
+    if (config.max_body_mb < 0) {
+        config.max_body_mb = 0;
+    }
+    if (config.stream_buffer_kb <= 0) {
+        config.stream_buffer_kb = 64;
+    }
+    if (config.static_cache_max_file < 0) {
+        config.static_cache_max_file = 0;
+    }
+    if (config.static_cache_mb < 0) {
+        config.static_cache_mb = 0;
+    }
+    if (config.response_cache_mb < 0) {
+        config.response_cache_mb = 0;
+    }
+    if (config.metrics_cache_ms < 0) {
+        config.metrics_cache_ms = 0;
+    }
+    if (config.max_connections < 0) {
+        config.max_connections = 0;
+    }
+    if (config.rate_limit_rps < 0) {
+        config.rate_limit_rps = 0;
+    }
+    if (config.rate_limit_burst < 0) {
+        config.rate_limit_burst = 0;
+    }
+    if (config.rate_limit_clients <= 0) {
+        config.rate_limit_clients = 65536;
+    }
+    if (config.shed_queue_delay_ms < 0) {
+        config.shed_queue_delay_ms = 0;
+    }
+    if (config.trace_sample < 0) {
+        config.trace_sample = 0;
+    }
+    if (config.trace_buffer <= 0) {
+        config.trace_buffer = 1024;
+    }
+    if (config.drain_timeout_ms < 0) {
+        config.drain_timeout_ms = 0;
+    }
+    if (config.restart_timeout_ms <= 0) {
+        config.restart_timeout_ms = 10000;
+    }
+    return config;
+}
@@ -0,0 +1,71 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+
+// What an event loop does when the worker pool queue is full.
+enum class BackpressurePolicy {
+    Reject,  // Answer 503 immediately
+    Pause    // Stop accepting new connections and retry the request until the queue drains
+};
+
+// How event loops talk to the kernel.
+enum class IoBackend {
+    Epoll,   // Readiness notifications, then one read/send/accept call each
+    IoUring  // Batched submissions and completions through a shared ring
+};
+
+// Runtime settings for the server. Every field can be overridden through an
+// environment variable so the Docker setup can tune the server without a rebuild.
+struct ServerConfig {
+    int port = 8080;           // SERVER_PORT
+    int io_threads = 0;        // SERVER_IO_THREADS (0 = one per CPU core)
+    int listen_backlog = 4096; // SERVER_LISTEN_BACKLOG, pending connections the kernel queues per listening socket
+    bool reuse_port = false;   // SERVER_REUSE_PORT ("1" = one SO_REUSEPORT listener and worker pool per event loop)
+    std::string cpu_affinity;  // SERVER_CPU_AFFINITY ("" = no pinning, "auto" = loop i on CPU i, or a list like "0-3,8")
+    int max_events = 256;      // SERVER_MAX_EVENTS, epoll events fetched per wakeup
+    IoBackend io_backend = IoBackend::Epoll; // SERVER_IO_BACKEND ("epoll" or "io_uring", which falls back to epoll if unavailable)
+    int worker_threads = 16;   // SERVER_WORKER_THREADS, threads running request handlers
+    int queue_capacity = 1024; // SERVER_QUEUE_CAPACITY, parsed requests waiting for a worker
+    int keepalive_timeout_ms = 5000;   // SERVER_KEEPALIVE_TIMEOUT_MS, idle time before a persistent connection is closed
+    int max_keepalive_requests = 100;  // SERVER_MAX_KEEPALIVE_REQUESTS, requests served per connection before closing it
+    int header_timeout_ms = 10000;     // SERVER_HEADER_TIMEOUT_MS, time allowed to receive a request's line and headers
+    int request_timeout_ms = 30000;    // SERVER_REQUEST_TIMEOUT_MS, time allowed for a whole request, from first byte to response sent
+    int max_buffered_body = 65536;     // SERVER_MAX_BUFFERED_BODY, largest request body handed to handlers whole (bytes); larger and chunked ones are streamed
+    int max_body_mb = 1024;            // SERVER_MAX_BODY_MB, largest request body accepted, streamed or not (0 = unlimited)
+    int stream_buffer_kb = 64;         // SERVER_STREAM_BUFFER_KB, body bytes buffered per streamed request or response before the sender is paused
+    bool demo_routes = false;          // SERVER_DEMO_ROUTES ("1" = register the /upload, /echo and /stream examples)
+    std::string static_root;           // SERVER_STATIC_ROOT, document root for static files ("" = no static route)
+    std::string static_prefix = "/static"; // SERVER_STATIC_PREFIX, URL path the document root is served under
+    int static_cache_max_file = 65536; // SERVER_STATIC_CACHE_MAX_FILE, largest file kept memory-mapped in the cache (bytes)
+    int static_cache_mb = 64;          // SERVER_STATIC_CACHE_MB, total size of cached files
+    int response_cache_mb = 32;        // SERVER_RESPONSE_CACHE_MB, total size of responses kept for cached GET routes (0 = no caching)
+    int metrics_cache_ms = 1000;       // SERVER_METRICS_CACHE_MS, how long a /metrics render is reused (0 = render every scrape)
+    int max_connections = 0;           // SERVER_MAX_CONNECTIONS, open connections across all loops before new ones get a 503 (0 = unlimited)
+    int rate_limit_rps = 0;            // SERVER_RATE_LIMIT_RPS, requests per second allowed per client IP before a 429 (0 = unlimited)
+    int rate_limit_burst = 0;          // SERVER_RATE_LIMIT_BURST, requests a client IP may send at once (0 = one second's worth)
+    int rate_limit_clients = 65536;    // SERVER_RATE_LIMIT_CLIENTS, client IPs tracked at once; the least recently seen are evicted
+    int shed_queue_delay_ms = 0;       // SERVER_SHED_QUEUE_DELAY_MS, worker queue delay above which requests get a 503 (0 = never)
+    int trace_sample = 100;            // SERVER_TRACE_SAMPLE, trace one request in this many per event loop for /debug/trace (0 = off)
+    int trace_buffer = 1024;           // SERVER_TRACE_BUFFER, traced requests kept per event loop thread
+    int drain_timeout_ms = 30000;      // SERVER_DRAIN_TIMEOUT_MS, time open connections get to finish on shutdown or hot restart
+    int restart_timeout_ms = 10000;    // SERVER_RESTART_TIMEOUT_MS, time a hot restart's successor gets to start serving
+    BackpressurePolicy backpressure = BackpressurePolicy::Reject; // SERVER_BACKPRESSURE ("reject" or "pause")
+    std::string log_level = "info";    // SERVER_LOG_LEVEL ("debug", "info", "warn" or "error")
+    std::string log_mode = "async";    // SERVER_LOG_MODE ("async" or "sync")
+    std::string log_overflow = "drop"; // SERVER_LOG_OVERFLOW, async queue full: "drop" the record or "block" the caller
+    int log_queue_capacity = 8192;     // SERVER_LOG_QUEUE_CAPACITY, records buffered for the async writer
+    std::string access_log_dir;        // SERVER_ACCESS_LOG_DIR, directory of the binary access log ("" = off)
+    int access_log_mb = 64;            // SERVER_ACCESS_LOG_MB, size of each access log file before it is rotated
+    int access_log_files = 4;          // SERVER_ACCESS_LOG_FILES, access log files kept per event loop
+
+    static ServerConfig fromEnvironment();
+};
+
+// Reads an integer environment variable, falling back to `fallback` if unset or invalid.
+int env_int(const char* name, int fallback);
+
+// Reads a string environment variable, falling back to `fallback` if unset.
+std::string env_string(const char* name, const std::string& fallback);
+
+#endif // CONFIG_H
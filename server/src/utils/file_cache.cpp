@@ -0,0 +1,405 @@
+#include "file_cache.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <strings.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include "logger.h"
+
+static const uint32_t kWatchMask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                   IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+StaticFile::~StaticFile() {
+    if (data != nullptr) {
+        munmap(const_cast<char*>(data), size);
+    }
+}
+
+static const char* content_type_for(std::string_view path) {
+    static const std::pair<const char*, const char*> kTypes[] = {
+        {"html", "text/html; charset=utf-8"}, {"htm", "text/html; charset=utf-8"},
+        {"css", "text/css; charset=utf-8"}, {"js", "text/javascript; charset=utf-8"},
+        {"json", "application/json"}, {"txt", "text/plain; charset=utf-8"},
+        {"xml", "application/xml"}, {"svg", "image/svg+xml"}, {"png", "image/png"},
+        {"jpg", "image/jpeg"}, {"jpeg", "image/jpeg"}, {"gif", "image/gif"},
+        {"webp", "image/webp"}, {"ico", "image/x-icon"}, {"woff2", "font/woff2"},
+        {"wasm", "application/wasm"}, {"pdf", "application/pdf"}, {"zip", "application/zip"},
+        {"gz", "application/gzip"}, {"tar", "application/x-tar"},
+    };
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot != std::string_view::npos && (slash == std::string_view::npos || dot > slash)) {
+        std::string_view extension = path.substr(dot + 1);
+        for (const auto& type : kTypes) {
+            if (extension.size() == std::strlen(type.first) &&
+                strncasecmp(extension.data(), type.first, extension.size()) == 0) {
+                return type.second;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+// Drops empty segments and refuses any segment starting with '.', which
+// covers "..", "." and hidden files alike.
+static bool normalize_path(std::string_view path, std::string& normalized) {
+    normalized.clear();
+    while (!path.empty()) {
+        size_t slash = path.find('/');
+        std::string_view segment = path.substr(0, slash);
+        path = slash == std::string_view::npos ? std::string_view() : path.substr(slash + 1);
+        if (segment.empty()) {
+            continue;
+        }
+        if (segment.front() == '.') {
+            return false;
+        }
+        if (!normalized.empty()) {
+            normalized += '/';
+        }
+        normalized.append(segment.data(), segment.size());
+    }
+    return true;
+}
+
+static std::string directory_of(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? std::string() : path.substr(0, slash);
+}
+
+static int64_t modified_ns(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+static bool same_file(const StaticFile& file, const struct stat& st) {
+    return file.inode == st.st_ino && file.size == static_cast<size_t>(st.st_size) &&
+           file.modified_ns == modified_ns(st);
+}
+
+bool decode_url_path(std::string_view encoded, std::string& decoded) {
+    decoded.clear();
+    for (size_t i = 0; i < encoded.size(); ++i) {
+        if (encoded[i] != '%') {
+            decoded += encoded[i];
+            continue;
+        }
+        if (i + 2 >= encoded.size() || !std::isxdigit(static_cast<unsigned char>(encoded[i + 1])) ||
+            !std::isxdigit(static_cast<unsigned char>(encoded[i + 2]))) {
+            return false;
+        }
+        char hex[3] = {encoded[i + 1], encoded[i + 2], '\0'};
+        char value = static_cast<char>(std::strtol(hex, nullptr, 16));
+        if (value == '\0') {
+            return false;
+        }
+        decoded += value;
+        i += 2;
+    }
+    return true;
+}
+
+std::string http_date(std::time_t time) {
+    std::tm parts{};
+    gmtime_r(&time, &parts);
+    char buffer[64];
+    size_t length = std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &parts);
+    return std::string(buffer, length);
+}
+
+bool parse_http_date(std::string_view text, std::time_t& time) {
+    std::string copy(text);
+    std::tm parts{};
+    const char* end = strptime(copy.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &parts);
+    if (end == nullptr || *end != '\0') {
+        return false;
+    }
+    time = timegm(&parts);
+    return true;
+}
+
+FileCache::FileCache(const Options& options) : options_(options), shard_capacity_(options.capacity_bytes / kShards) {
+    for (size_t s = 0; s < kShards; ++s) {
+        shards_.emplace_back(new Shard());
+    }
+    root_fd_ = ::open(options_.root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd_ < 0) {
+        throw std::runtime_error("cannot open document root " + options_.root + ": " + std::strerror(errno));
+    }
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stop_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (inotify_fd_ < 0 || stop_fd_ < 0) {
+        LOG_WARN(std::string("inotify unavailable (") + std::strerror(errno) +
+                 "), cached static files are revalidated on every request.");
+        if (inotify_fd_ >= 0) {
+            close(inotify_fd_);
+            inotify_fd_ = -1;
+        }
+        return;
+    }
+    watcher_ = std::thread(&FileCache::watch_main, this);
+}
+
+FileCache::~FileCache() {
+    if (watcher_.joinable()) {
+        uint64_t one = 1;
+        ssize_t ignored = write(stop_fd_, &one, sizeof(one));
+        (void)ignored;
+        watcher_.join();
+    }
+    for (int fd : {inotify_fd_, stop_fd_, root_fd_}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+std::shared_ptr<const StaticFile> FileCache::open(std::string_view path, bool& cache_hit) {
+    cache_hit = false;
+    std::string relative;
+    if (!normalize_path(path, relative)) {
+        return nullptr;
+    }
+    if (relative.empty()) {
+        relative = "index.html";
+    } else if (path.back() == '/') {
+        relative += "/index.html"; // Cached under the index itself, found without a system call
+    }
+    std::shared_ptr<const StaticFile> cached = lookup(relative);
+    if (cached) {
+        cache_hit = true;
+        return cached;
+    }
+    std::shared_ptr<StaticFile> file = load(relative);
+    if (file && file->head) {
+        insert(relative, file);
+    }
+    return file;
+}
+
+FileCache::Shard& FileCache::shard_for(const std::string& path) {
+    return *shards_[std::hash<std::string>{}(path) % kShards];
+}
+
+std::shared_ptr<const StaticFile> FileCache::lookup(const std::string& path) {
+    Shard& shard = shard_for(path);
+    std::shared_ptr<const StaticFile> file;
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.entries.find(path);
+        if (it == shard.entries.end()) {
+            return nullptr;
+        }
+        it->second->referenced.store(true, std::memory_order_relaxed);
+        file = it->second->file;
+    }
+    if (inotify_fd_ < 0) {
+        struct stat st;
+        if (fstatat(root_fd_, path.c_str(), &st, 0) != 0 || !same_file(*file, st)) {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            auto it = shard.entries.find(path);
+            if (it != shard.entries.end() && it->second->file == file) {
+                evict(shard, path);
+            }
+            return nullptr;
+        }
+    }
+    return file;
+}
+
+std::shared_ptr<StaticFile> FileCache::load(const std::string& path) {
+    int fd = openat(root_fd_, path.c_str(), O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISDIR(st.st_mode)) {
+        close(fd);
+        std::shared_ptr<StaticFile> directory = std::make_shared<StaticFile>();
+        directory->directory = true;
+        return directory;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+
+    std::shared_ptr<StaticFile> file = std::make_shared<StaticFile>();
+    file->size = static_cast<size_t>(st.st_size);
+    file->modified = st.st_mtim.tv_sec;
+    file->modified_ns = modified_ns(st);
+    file->inode = st.st_ino;
+    char etag[64];
+    std::snprintf(etag, sizeof(etag), "\"%llx-%llx-%llx\"", static_cast<unsigned long long>(st.st_ino),
+                  static_cast<unsigned long long>(st.st_size), static_cast<unsigned long long>(file->modified_ns));
+    file->etag = etag;
+    file->last_modified = http_date(file->modified);
+    file->content_type = content_type_for(path);
+
+    if (file->size <= options_.max_file_size && file->size <= shard_capacity_) {
+        void* data = file->size > 0 ? mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+        if (data != MAP_FAILED) {
+            close(fd);
+            file->data = static_cast<const char*>(data);
+            HttpResponse head(200, std::string(), file->content_type);
+            head.add_header("ETag", file->etag);
+            head.add_header("Last-Modified", file->last_modified);
+            head.add_header("Accept-Ranges", "bytes");
+            file->head = prepare_head(head, file->size);
+            return file;
+        }
+    }
+    file->handle = std::make_shared<FileHandle>(fd);
+    return file;
+}
+
+void FileCache::insert(const std::string& path, std::shared_ptr<const StaticFile> file) {
+    std::lock_guard<std::mutex> watch_guard(watch_mutex_);
+    if (inotify_fd_ >= 0) {
+        watch_directory(directory_of(path));
+        // A change between load() and the watch going in would go unnoticed.
+        struct stat st;
+        if (watched_dirs_.count(directory_of(path)) == 0 ||
+            fstatat(root_fd_, path.c_str(), &st, 0) != 0 || !same_file(*file, st)) {
+            return;
+        }
+    }
+    Shard& shard = shard_for(path);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.entries.count(path) != 0) {
+        return; // Another worker loaded it meanwhile
+    }
+    std::unique_ptr<Entry> entry(new Entry());
+    entry->file = std::move(file);
+    shard.order.push_back(path);
+    entry->order = std::prev(shard.order.end());
+    shard.bytes += entry->file->size;
+    shard.entries.emplace(path, std::move(entry));
+    evict_overflow(shard);
+}
+
+void FileCache::evict(Shard& shard, const std::string& path) {
+    auto it = shard.entries.find(path);
+    if (it == shard.entries.end()) {
+        return;
+    }
+    shard.bytes -= it->second->file->size;
+    shard.order.erase(it->second->order);
+    shard.entries.erase(it);
+}
+
+void FileCache::evict_overflow(Shard& shard) {
+    // Every entry is passed over at most once after its reference bit is
+    // cleared, so two rounds always find a victim.
+    size_t steps = shard.order.size() * 2;
+    while (shard.bytes > shard_capacity_ && steps-- > 0) {
+        auto it = shard.entries.find(shard.order.front());
+        if (it->second->referenced.exchange(false, std::memory_order_relaxed)) {
+            shard.order.splice(shard.order.end(), shard.order, shard.order.begin());
+            continue;
+        }
+        shard.bytes -= it->second->file->size;
+        shard.order.pop_front();
+        shard.entries.erase(it);
+    }
+}
+
+void FileCache::evict_prefix(const std::string& directory) {
+    for (const std::unique_ptr<Shard>& shard : shards_) {
+        std::unique_lock<std::shared_mutex> lock(shard->mutex);
+        for (auto it = shard->entries.begin(); it != shard->entries.end();) {
+            const std::string& path = it->first;
+            bool inside = directory.empty() ||
+                          (path.size() > directory.size() && path.compare(0, directory.size(), directory) == 0 &&
+                           path[directory.size()] == '/');
+            if (inside) {
+                shard->bytes -= it->second->file->size;
+                shard->order.erase(it->second->order);
+                it = shard->entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void FileCache::watch_directory(const std::string& directory) {
+    if (watched_dirs_.count(directory) != 0) {
+        return;
+    }
+    std::string full = directory.empty() ? options_.root : options_.root + "/" + directory;
+    int wd = inotify_add_watch(inotify_fd_, full.c_str(), kWatchMask);
+    if (wd < 0) {
+        LOG_WARN("inotify_add_watch(" + full + ") failed: " + std::strerror(errno) + "; its files are not cached.");
+        return;
+    }
+    watches_[wd] = directory;
+    watched_dirs_[directory] = wd;
+}
+
+void FileCache::watch_main() {
+    alignas(inotify_event) char buffer[16 * 1024];
+    pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR(std::string("poll(inotify) failed: ") + std::strerror(errno));
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+        ssize_t n = read(inotify_fd_, buffer, sizeof(buffer));
+        if (n <= 0) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> guard(watch_mutex_);
+        for (char* next = buffer; next < buffer + n;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(next);
+            next += sizeof(inotify_event) + event->len;
+            if ((event->mask & IN_Q_OVERFLOW) != 0) {
+                evict_prefix(""); // Events were lost: trust nothing
+                continue;
+            }
+            auto watch = watches_.find(event->wd);
+            if (watch == watches_.end()) {
+                continue;
+            }
+            std::string directory = watch->second;
+            if ((event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) != 0) {
+                // The directory is gone from its path; a new one may appear
+                // there and needs a watch of its own.
+                evict_prefix(directory);
+                if ((event->mask & IN_IGNORED) == 0) {
+                    inotify_rm_watch(inotify_fd_, event->wd);
+                }
+                watches_.erase(watch);
+                watched_dirs_.erase(directory);
+                continue;
+            }
+            if (event->len > 0) {
+                std::string path = directory.empty() ? std::string(event->name)
+                                                     : directory + "/" + event->name;
+                Shard& shard = shard_for(path);
+                {
+                    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+                    evict(shard, path);
+                }
+                evict_prefix(path); // A subdirectory that was moved or removed
+            }
+        }
+    }
+}
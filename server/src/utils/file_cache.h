@@ -0,0 +1,139 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/types.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "httpresponse.h"
+
+// A regular file below the document root, as returned by FileCache::open().
+// Small files come memory-mapped with their 200 response head serialized in
+// advance; larger ones come as an open descriptor for sendfile().
+struct StaticFile {
+    size_t size = 0;
+    std::time_t modified = 0;        // Seconds since the epoch, as in Last-Modified
+    std::string etag;                // Strong validator, quoted: "inode-size-mtime" in hex
+    std::string last_modified;       // HTTP-date
+    std::string content_type;        // Guessed from the extension
+    ino_t inode = 0;                 // With modified_ns, tells a replaced file apart
+    int64_t modified_ns = 0;
+
+    const char* data = nullptr;      // Cached files: the whole file, mapped read-only
+    std::shared_ptr<const PreparedResponse> head; // Cached files: 200 head with validators
+    std::shared_ptr<const FileHandle> handle;     // Uncached files: open for sendfile()
+    bool directory = false;          // A directory named without a trailing slash; nothing else is set
+
+    StaticFile() = default;
+    ~StaticFile();
+    StaticFile(const StaticFile&) = delete;
+    StaticFile& operator=(const StaticFile&) = delete;
+
+    std::string_view bytes() const { return std::string_view(data, size); }
+};
+
+// Looks up files below a document root and keeps the small, frequently
+// requested ones memory-mapped in a cache bounded in bytes, so serving them
+// costs no system call at all. An inotify watch on every directory holding
+// a cached file evicts entries as soon as the file is modified, replaced or
+// removed; if inotify is unavailable every hit is checked with fstatat()
+// instead, outside any lock.
+//
+// As in ResponseCache, the table is split into shards behind reader-writer
+// locks: a hit takes its shard's lock shared and only sets the entry's
+// reference bit. A shard over its share of the byte budget evicts in
+// insertion order, skipping (once) any entry hit since the last pass.
+//
+// Files should be replaced by renaming a new file over them rather than
+// rewritten in place: a mapped file that is truncated while a response is
+// being sent from it would fault.
+//
+// Thread-safe; handlers on any worker call open() concurrently.
+class FileCache {
+public:
+    struct Options {
+        std::string root;
+        size_t max_file_size = 64 * 1024;      // Larger files are never cached
+        size_t capacity_bytes = 64 * 1024 * 1024;
+    };
+
+    // Throws std::runtime_error if the root cannot be opened.
+    explicit FileCache(const Options& options);
+    ~FileCache();
+
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    // Opens `path`, a decoded path relative to the root ("a/b.css"). A path
+    // ending in a slash is served through its index.html; a directory
+    // named without one comes back with `directory` set, to be redirected.
+    // Returns nullptr if there is no such file, or if the path leaves the
+    // root or names a hidden file ("..", ".git"). Sets `cache_hit` when the
+    // file came from the cache.
+    std::shared_ptr<const StaticFile> open(std::string_view path, bool& cache_hit);
+
+    static constexpr size_t kShards = 16;
+
+private:
+    struct Entry {
+        std::shared_ptr<const StaticFile> file;
+        std::atomic<bool> referenced{false};  // Hit since the eviction hand last passed
+        std::list<std::string>::iterator order;
+    };
+
+    struct alignas(64) Shard {
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, std::unique_ptr<Entry>> entries;
+        std::list<std::string> order; // Eviction order, oldest first
+        size_t bytes = 0;
+    };
+
+    Shard& shard_for(const std::string& path);
+    std::shared_ptr<const StaticFile> lookup(const std::string& path);
+    std::shared_ptr<StaticFile> load(const std::string& path);
+    void insert(const std::string& path, std::shared_ptr<const StaticFile> file);
+    // The callers hold the shard's mutex exclusively.
+    void evict(Shard& shard, const std::string& path);
+    void evict_overflow(Shard& shard);
+    void evict_prefix(const std::string& directory);
+    void watch_directory(const std::string& path);
+    void watch_main();
+
+    Options options_;
+    int root_fd_ = -1;
+    int inotify_fd_ = -1;   // -1: entries are revalidated on every hit
+    int stop_fd_ = -1;      // eventfd that ends watch_main()
+    std::thread watcher_;
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t shard_capacity_ = 0;
+
+    // Guards the watches, and is held across an insert so that the watcher
+    // cannot drop a directory between the check and the entry going in.
+    // Taken before a shard's mutex, never after.
+    std::mutex watch_mutex_;
+    std::unordered_map<int, std::string> watches_;      // inotify descriptor -> directory ("" = root)
+    std::unordered_map<std::string, int> watched_dirs_; // Directory -> inotify descriptor
+};
+
+// Decodes %XX escapes in a URL path. Returns false on a malformed escape
+// or an encoded NUL.
+bool decode_url_path(std::string_view encoded, std::string& decoded);
+
+// Formats `time` as an HTTP-date ("Sun, 06 Nov 1994 08:49:37 GMT").
+std::string http_date(std::time_t time);
+
+// Parses an HTTP-date. Returns false if `text` is not one.
+bool parse_http_date(std::string_view text, std::time_t& time);
+
+#endif // FILE_CACHE_H
@@ -0,0 +1,47 @@
+#include "httprequest.h"
+#include <strings.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+const HttpField* HttpFieldList::find(std::string_view name) const {
+    for (const HttpField& field : *this) {
+        if (field.name == name) {
+            return &field;
+        }
+    }
+    return nullptr;
+}
+
+const HttpField* HttpFieldList::find_ignore_case(std::string_view name) const {
+    for (const HttpField& field : *this) {
+        if (field.name.size() == name.size() && strncasecmp(field.name.data(), name.data(), name.size()) == 0) {
+            return &field;
+        }
+    }
+    return nullptr;
+}
+
+void HttpFieldList::reserve(Arena& arena, size_t capacity) {
+    if (capacity <= capacity_) {
+        return;
+    }
+    HttpField* fields = arena.allocate_array<HttpField>(capacity);
+    if (size_ > 0) {
+        std::memcpy(static_cast<void*>(fields), fields_, size_ * sizeof(HttpField));
+    }
+    fields_ = fields;
+    capacity_ = static_cast<uint32_t>(capacity);
+}
+
+void HttpFieldList::push_back(Arena& arena, HttpField field) {
+    if (size_ == capacity_) {
+        reserve(arena, std::max<size_t>(4, capacity_ * 2));
+    }
+    new (&fields_[size_++]) HttpField(field);
+}
+
+std::string_view HttpRequest::header(std::string_view name) const {
+    const HttpField* field = headers.find_ignore_case(name);
+    return field != nullptr ? field->value : std::string_view();
+}
@@ -1,15 +1,70 @@
 #ifndef HTTP_REQUEST_H
 #define HTTP_REQUEST_H
 
-#include <string>
-#include <map>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include "arena.h"
+#include "body_stream.h"
 
+// A header, query parameter or path parameter.
+struct HttpField {
+    std::string_view name;
+    std::string_view value;
+};
+
+// Small flat list of fields, stored in an Arena. A request carries a
+// handful of them, so a linear scan over one contiguous array beats a tree
+// of separately allocated nodes.
+class HttpFieldList {
+public:
+    const HttpField* begin() const { return fields_; }
+    const HttpField* end() const { return fields_ + size_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // First field named exactly `name`, or nullptr.
+    const HttpField* find(std::string_view name) const;
+
+    // First field whose name matches `name` ignoring ASCII case, or nullptr.
+    const HttpField* find_ignore_case(std::string_view name) const;
+
+    // Makes room for `capacity` fields without growing.
+    void reserve(Arena& arena, size_t capacity);
+
+    // Appends a field; grows into a new arena array when full.
+    void push_back(Arena& arena, HttpField field);
+
+    void pop_back() { --size_; }
+
+private:
+    HttpField* fields_ = nullptr;
+    uint32_t size_ = 0;
+    uint32_t capacity_ = 0;
+};
+
+// A request as handlers see it. Every view points into `arena`, which the
+// request keeps alive: the connection's arena is reset for its next request
+// only once no HttpRequest refers to it any more. Copying a request is
+// therefore cheap and copies share the same storage.
 struct HttpRequest {
-    std::string method;
-    std::string path;
-    std::map<std::string, std::string> headers;
-    std::string body;
-    std::map<std::string, std::string> query_params;
+    std::string_view method;
+    std::string_view path;
+    std::string_view version; // e.g. "HTTP/1.1"; empty for an HTTP/0.9 simple request
+    HttpFieldList headers;
+    std::string_view body;
+    // Set instead of `body` for a chunked body or one larger than the
+    // buffered limit; the handler reads it piece by piece as it arrives.
+    std::shared_ptr<BodyStream> body_stream;
+    HttpFieldList query_params;
+    HttpFieldList path_params; // Filled by Router::match for ":name" and "*" segments
+    std::chrono::steady_clock::time_point received_at; // When the last byte of the request was parsed
+    std::shared_ptr<Arena> arena;
+
+    // Case-insensitive header lookup. Returns an empty view if absent.
+    std::string_view header(std::string_view name) const;
 };
 
 #endif // HTTP_REQUEST_H
@@ -1,87 +1,469 @@
 #include "httprequest_parser.h"
-#include <sstream>
 #include <algorithm>
+#include <chrono>
+#include <strings.h>
+#include "metrics.h"
 
-HttpRequest HttpRequestParser::parse(const std::string& request_string) {
-    HttpRequest request;
-    std::istringstream iss(request_string);
-    std::string line;
-    
-    // Parse request line
-    std::getline(iss, line);
-    parse_request_line(line, request);
+// RFC 9110 token characters, used for methods and header names.
+static bool is_tchar(char c) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        return true;
+    }
+    switch (c) {
+        case '!': case '#': case '$': case '%': case '&': case '\'': case '*':
+        case '+': case '-': case '.': case '^': case '_': case '`': case '|': case '~':
+            return true;
+        default:
+            return false;
+    }
+}
 
-    // Parse headers
-    while (std::getline(iss, line) && line != "\r") { // Headers end with an empty line
-        if (line.back() == '\r') {
-            line.pop_back(); // Remove carriage return
+static bool is_token(std::string_view s) {
+    if (s.empty()) {
+        return false;
+    }
+    for (char c : s) {
+        if (!is_tchar(c)) {
+            return false;
         }
-        size_t colon_pos = line.find(": ");
-        if (colon_pos != std::string::npos) {
-            std::string name = line.substr(0, colon_pos);
-            std::string value = line.substr(colon_pos + 2);
-            request.headers[name] = value;
+    }
+    return true;
+}
+
+static bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+std::string_view HttpRequestView::header(std::string_view name) const {
+    for (size_t i = 0; i < header_count; ++i) {
+        if (iequals(headers[i].name, name)) {
+            return headers[i].value;
         }
     }
+    return std::string_view();
+}
+
+void HttpRequestParser::reset() {
+    phase_ = Phase::RequestLine;
+    line_start_ = 0;
+    scan_offset_ = 0;
+    headers_start_ = 0;
+    body_start_ = 0;
+    content_length_ = 0;
+    has_content_length_ = false;
+    chunked_ = false;
+    interim_responses_ = false;
+    expect_continue_ = false;
+    error_status_ = 0;
+    parse_ns_ = 0;
+    method_ = target_ = version_ = Span{0, 0};
+    header_count_ = 0;
+}
+
+ParseStatus HttpRequestParser::feed(std::string_view buffer, HttpRequestView& request) {
+    auto start = std::chrono::steady_clock::now();
+    size_t scanned_before = scan_offset_;
+    ParseStatus status = advance(buffer, request);
+
+    uint64_t parse_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    parse_ns_ += parse_ns;
+    size_t scanned = status == ParseStatus::Complete ? request.length : scan_offset_;
+    Metrics::getInstance().record_parse(scanned > scanned_before ? scanned - scanned_before : 0, parse_ns,
+                                        status == ParseStatus::Complete, status == ParseStatus::Malformed);
+    return status;
+}
+
+ParseStatus HttpRequestParser::advance(std::string_view buffer, HttpRequestView& request) {
+    while (phase_ != Phase::Body) {
+        size_t newline = buffer.find('\n', scan_offset_);
+        if (newline == std::string_view::npos) {
+            scan_offset_ = buffer.size();
+            if (phase_ == Phase::RequestLine && buffer.size() - line_start_ > limits_.max_request_line) {
+                return fail(414);
+            }
+            if (phase_ == Phase::Headers && buffer.size() - headers_start_ > limits_.max_header_bytes) {
+                return fail(431);
+            }
+            return ParseStatus::NeedMore;
+        }
 
-    // Parse body
-    std::string body_line;
-    while (std::getline(iss, body_line)) {
-        request.body += body_line;
-        if (body_line.back() == '\r') {
-            request.body.pop_back();
+        size_t line_length = newline - line_start_;
+        if (line_length > 0 && buffer[newline - 1] == '\r') {
+            --line_length;
         }
-        if (!iss.eof()) {
-            request.body += "\n";
+        std::string_view line = buffer.substr(line_start_, line_length);
+
+        if (phase_ == Phase::RequestLine) {
+            if (line.empty()) {
+                // Be lenient about stray CRLFs between pipelined requests.
+                line_start_ = scan_offset_ = newline + 1;
+                continue;
+            }
+            if (line.size() > limits_.max_request_line) {
+                return fail(414);
+            }
+            if (!parse_request_line(line)) {
+                return fail(error_status_ != 0 ? error_status_ : 400);
+            }
+            if (version_.length == 0) {
+                // HTTP/0.9 simple request: no headers, no body.
+                body_start_ = newline + 1;
+                phase_ = Phase::Body;
+                break;
+            }
+            phase_ = Phase::Headers;
+            headers_start_ = newline + 1;
+        } else {
+            if (newline + 1 - headers_start_ > limits_.max_header_bytes) {
+                return fail(431);
+            }
+            if (line.empty()) {
+                if (chunked_ && has_content_length_) {
+                    return fail(400); // Ambiguous framing, the stuff of request smuggling (RFC 9112 section 6.3)
+                }
+                body_start_ = newline + 1;
+                phase_ = Phase::Body;
+                break;
+            }
+            if (!parse_header_line(line, line_start_)) {
+                return fail(error_status_ != 0 ? error_status_ : 400);
+            }
         }
+        line_start_ = scan_offset_ = newline + 1;
     }
 
-    return request;
+    if (stream_body()) {
+        // Complete at the end of the head; the caller decodes the body.
+        scan_offset_ = body_start_;
+        build_view(buffer, request);
+        return ParseStatus::Complete;
+    }
+    if (buffer.size() - body_start_ < content_length_) {
+        scan_offset_ = buffer.size();
+        return ParseStatus::NeedMore;
+    }
+    scan_offset_ = body_start_ + content_length_;
+    build_view(buffer, request);
+    return ParseStatus::Complete;
+}
+
+ParseStatus HttpRequestParser::fail(int status) {
+    error_status_ = status;
+    return ParseStatus::Malformed;
 }
 
-std::vector<std::string> HttpRequestParser::split(const std::string& s, char delimiter) {
-    std::vector<std::string> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, delimiter)) {
-        tokens.push_back(token);
+bool HttpRequestParser::parse_request_line(std::string_view line) {
+    size_t line_offset = line_start_;
+    size_t first_space = line.find(' ');
+    if (first_space == std::string_view::npos) {
+        return false;
+    }
+    std::string_view method = line.substr(0, first_space);
+    size_t second_space = line.find(' ', first_space + 1);
+    std::string_view target = line.substr(first_space + 1,
+        second_space == std::string_view::npos ? std::string_view::npos : second_space - first_space - 1);
+
+    if (!is_token(method) || target.empty()) {
+        return false;
+    }
+    if (target[0] != '/' && target != "*") {
+        return false;
+    }
+    for (char c : target) {
+        if (static_cast<unsigned char>(c) <= 0x20 || c == 0x7f) {
+            return false;
+        }
+    }
+
+    method_ = Span{static_cast<uint32_t>(line_offset), static_cast<uint32_t>(method.size())};
+    target_ = Span{static_cast<uint32_t>(line_offset + first_space + 1), static_cast<uint32_t>(target.size())};
+
+    if (second_space == std::string_view::npos) {
+        // A request line without a version is an HTTP/0.9 simple request,
+        // which only ever allowed GET.
+        version_ = Span{0, 0};
+        return method == "GET";
+    }
+
+    std::string_view version = line.substr(second_space + 1);
+    if (version.size() != 8 || version.compare(0, 5, "HTTP/") != 0 ||
+        version[5] < '0' || version[5] > '9' || version[6] != '.' || version[7] < '0' || version[7] > '9') {
+        return false;
     }
-    return tokens;
+    if (version[5] != '1') {
+        error_status_ = 505; // Well-formed, but HTTP/2 and later are not spoken over this framing
+        return false;
+    }
+    version_ = Span{static_cast<uint32_t>(line_offset + second_space + 1), 8};
+    interim_responses_ = version[7] >= '1';
+    return true;
 }
 
-void HttpRequestParser::parse_request_line(const std::string& line, HttpRequest& request) {
-    std::vector<std::string> parts = split(line, ' ');
-    if (parts.size() >= 2) {
-        request.method = parts[0];
-        // Remove trailing \r from path if present
-        if (!parts[1].empty() && parts[1].back() == '\r') {
-            parts[1].pop_back();
+bool HttpRequestParser::parse_header_line(std::string_view line, size_t line_offset) {
+    if (line[0] == ' ' || line[0] == '\t') {
+        return false; // Obsolete line folding is rejected (RFC 9112 section 5.2)
+    }
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) {
+        return false;
+    }
+    std::string_view name = line.substr(0, colon);
+    if (!is_token(name)) {
+        return false;
+    }
+
+    size_t value_start = colon + 1;
+    size_t value_end = line.size();
+    while (value_start < value_end && (line[value_start] == ' ' || line[value_start] == '\t')) {
+        ++value_start;
+    }
+    while (value_end > value_start && (line[value_end - 1] == ' ' || line[value_end - 1] == '\t')) {
+        --value_end;
+    }
+    std::string_view value = line.substr(value_start, value_end - value_start);
+    for (char c : value) {
+        // NUL, a bare CR and other controls but HTAB (RFC 9110 section 5.5).
+        if ((static_cast<unsigned char>(c) < 0x20 && c != '\t') || c == 0x7f) {
+            return false;
         }
-        
-        size_t query_start = parts[1].find('?');
-        if (query_start != std::string::npos) {
-            request.path = parts[1].substr(0, query_start);
-            std::string query_string = parts[1].substr(query_start + 1);
-            parse_query_params(query_string, request);
-        } else {
-            request.path = parts[1];
+    }
+
+    if (header_count_ == HttpRequestView::kMaxHeaders) {
+        error_status_ = 431;
+        return false;
+    }
+
+    if (iequals(name, "Content-Length")) {
+        if (value.empty()) {
+            return false;
+        }
+        uint64_t length = 0;
+        size_t digits = 0;
+        for (char c : value) {
+            if (c < '0' || c > '9') {
+                return false;
+            }
+            if (length == 0 && c == '0') {
+                continue; // Leading zeros do not count towards the length limit
+            }
+            if (++digits > 18) {
+                error_status_ = 413; // Past any body limit, and past what uint64_t holds
+                return false;
+            }
+            length = length * 10 + static_cast<uint64_t>(c - '0');
+        }
+        if (has_content_length_ && content_length_ != length) {
+            return false; // Conflicting Content-Length headers
+        }
+        if (limits_.max_stream_body != 0 && length > limits_.max_stream_body) {
+            error_status_ = 413;
+            return false;
         }
+        content_length_ = length;
+        has_content_length_ = true;
+    } else if (iequals(name, "Transfer-Encoding")) {
+        if (!iequals(value, "chunked")) {
+            error_status_ = 501; // Only chunked is decoded; gzip and friends are not
+            return false;
+        }
+        if (chunked_) {
+            return false; // Chunked twice
+        }
+        chunked_ = true;
+    } else if (iequals(name, "Expect")) {
+        if (!iequals(value, "100-continue")) {
+            error_status_ = 417; // The only expectation there is (RFC 9110 section 10.1.1)
+            return false;
+        }
+        expect_continue_ = interim_responses_; // Ignored in HTTP/1.0, which has no 1xx responses
     }
+
+    header_names_[header_count_] = Span{static_cast<uint32_t>(line_offset), static_cast<uint32_t>(name.size())};
+    header_values_[header_count_] = Span{static_cast<uint32_t>(line_offset + value_start), static_cast<uint32_t>(value.size())};
+    ++header_count_;
+    return true;
 }
 
-void HttpRequestParser::parse_headers(const std::vector<std::string>& lines, HttpRequest& request) {
-    // This function is now mostly handled directly in the parse method, 
-    // but keeping it for conceptual separation if needed later.
+void HttpRequestParser::build_view(std::string_view buffer, HttpRequestView& request) const {
+    request.method = buffer.substr(method_.offset, method_.length);
+    request.target = buffer.substr(target_.offset, target_.length);
+    size_t query_start = request.target.find('?');
+    if (query_start == std::string_view::npos) {
+        request.path = request.target;
+        request.query = std::string_view();
+    } else {
+        request.path = request.target.substr(0, query_start);
+        request.query = request.target.substr(query_start + 1);
+    }
+    request.version = version_.length == 0 ? std::string_view() : buffer.substr(version_.offset, version_.length);
+    for (size_t i = 0; i < header_count_; ++i) {
+        request.headers[i].name = buffer.substr(header_names_[i].offset, header_names_[i].length);
+        request.headers[i].value = buffer.substr(header_values_[i].offset, header_values_[i].length);
+    }
+    request.header_count = header_count_;
+    request.stream_body = stream_body();
+    request.chunked = chunked_;
+    request.expect_continue = expect_continue_;
+    request.content_length = content_length_;
+    request.body = request.stream_body ? std::string_view() : buffer.substr(body_start_, content_length_);
+    request.length = body_start_ + request.body.size();
 }
 
-void HttpRequestParser::parse_query_params(const std::string& query_string, HttpRequest& request) {
-    std::vector<std::string> params = split(query_string, '&');
-    for (const std::string& param : params) {
+HttpRequest HttpRequestParser::to_request(const HttpRequestView& view, std::shared_ptr<Arena> arena) {
+    // Copy the request's bytes in one piece; every field is then a slice of
+    // the copy, found at the same offset as in the receive buffer.
+    const char* first = view.method.data();
+    const char* last = view.target.data() + view.target.size();
+    auto extend = [&last](std::string_view field) {
+        if (!field.empty()) {
+            last = std::max(last, field.data() + field.size());
+        }
+    };
+    extend(view.version);
+    extend(view.body);
+    for (size_t i = 0; i < view.header_count; ++i) {
+        extend(view.headers[i].value);
+    }
+    const char* copy = arena->copy(std::string_view(first, static_cast<size_t>(last - first))).data();
+    auto rebase = [first, copy](std::string_view field) {
+        return field.empty() ? std::string_view() : std::string_view(copy + (field.data() - first), field.size());
+    };
+
+    HttpRequest request;
+    request.method = rebase(view.method);
+    request.path = rebase(view.path);
+    request.version = rebase(view.version);
+    request.body = rebase(view.body);
+    request.headers.reserve(*arena, view.header_count);
+    for (size_t i = 0; i < view.header_count; ++i) {
+        request.headers.push_back(*arena, HttpField{rebase(view.headers[i].name), rebase(view.headers[i].value)});
+    }
+
+    std::string_view query = rebase(view.query);
+    if (!query.empty()) {
+        request.query_params.reserve(*arena, std::count(query.begin(), query.end(), '&') + 1);
+    }
+    while (!query.empty()) {
+        size_t amp = query.find('&');
+        std::string_view param = query.substr(0, amp);
         size_t eq_pos = param.find('=');
-        if (eq_pos != std::string::npos) {
-            std::string name = param.substr(0, eq_pos);
-            std::string value = param.substr(eq_pos + 1);
-            request.query_params[name] = value;
+        if (eq_pos != std::string_view::npos) {
+            request.query_params.push_back(*arena, HttpField{param.substr(0, eq_pos), param.substr(eq_pos + 1)});
+        }
+        if (amp == std::string_view::npos) {
+            break;
+        }
+        query.remove_prefix(amp + 1);
+    }
+    request.arena = std::move(arena);
+    return request;
+}
+
+HttpRequest HttpRequestParser::parse(const std::string& request_string) {
+    HttpRequestParser parser;
+    HttpRequestView view;
+    if (parser.feed(request_string, view) != ParseStatus::Complete) {
+        return HttpRequest();
+    }
+    return to_request(view, std::make_shared<Arena>());
+}
+
+void BodyDecoder::start(const HttpRequestView& request, uint64_t max_length) {
+    chunked_ = request.chunked;
+    remaining_ = chunked_ ? 0 : request.content_length;
+    decoded_ = 0;
+    max_length_ = max_length;
+    trailer_bytes_ = 0;
+    error_status_ = 0;
+    state_ = chunked_ ? State::ChunkSize : remaining_ > 0 ? State::Length : State::Done;
+}
+
+size_t BodyDecoder::decode(std::string_view input, std::string_view& data) {
+    // Chunk-size lines and trailer fields are short; anything longer is junk.
+    static const size_t kMaxLine = 4096;
+    static const size_t kMaxTrailers = 16384;
+
+    data = std::string_view();
+    switch (state_) {
+        case State::Length:
+        case State::ChunkData: {
+            size_t take = static_cast<size_t>(std::min<uint64_t>(remaining_, input.size()));
+            data = input.substr(0, take);
+            remaining_ -= take;
+            if (remaining_ == 0) {
+                state_ = state_ == State::Length ? State::Done : State::ChunkEnd;
+            }
+            return take;
+        }
+        case State::ChunkEnd:
+            if (input.size() < 2) {
+                return input.empty() || input[0] == '\r' ? 0 : fail(400);
+            }
+            if (input[0] != '\r' || input[1] != '\n') {
+                return fail(400);
+            }
+            state_ = State::ChunkSize;
+            return 2;
+        case State::ChunkSize:
+        case State::Trailer: {
+            size_t newline = input.find('\n');
+            if (newline == std::string_view::npos) {
+                return input.size() > kMaxLine ? fail(400) : 0;
+            }
+            std::string_view line = input.substr(0, newline);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (state_ == State::Trailer) {
+                trailer_bytes_ += newline + 1;
+                if (trailer_bytes_ > kMaxTrailers) {
+                    return fail(400);
+                }
+                if (line.empty()) {
+                    state_ = State::Done;
+                }
+                return newline + 1;
+            }
+
+            // Hex size, then optional ";name=value" extensions, which are ignored.
+            uint64_t size = 0;
+            size_t digits = 0;
+            for (; digits < line.size(); ++digits) {
+                char c = line[digits];
+                int value = c >= '0' && c <= '9' ? c - '0'
+                          : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                          : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+                if (value < 0) {
+                    break;
+                }
+                if (digits == 15) {
+                    return fail(413); // Larger than any limit can allow
+                }
+                size = size * 16 + static_cast<uint64_t>(value);
+            }
+            if (digits == 0 || (digits < line.size() && line[digits] != ';' && line[digits] != ' ' &&
+                                line[digits] != '\t')) {
+                return fail(400);
+            }
+            decoded_ += size;
+            if (max_length_ != 0 && decoded_ > max_length_) {
+                return fail(413);
+            }
+            remaining_ = size;
+            state_ = size == 0 ? State::Trailer : State::ChunkData;
+            return newline + 1;
         }
+        case State::Idle:
+        case State::Done:
+        case State::Failed:
+            return 0;
     }
+    return 0;
+}
+
+size_t BodyDecoder::fail(int status) {
+    state_ = State::Failed;
+    error_status_ = status;
+    return 0;
 }
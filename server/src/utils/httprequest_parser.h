@@ -2,18 +2,174 @@
 #define HTTP_REQUEST_PARSER_H
 
 #include "httprequest.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
-#include <vector>
+#include <string_view>
 
+enum class ParseStatus {
+    NeedMore,   // The buffer holds only part of a request; feed again once more bytes arrive
+    Complete,   // A full request is available in the HttpRequestView
+    Malformed   // The bytes can never form a valid request; see error_status()
+};
+
+struct HttpHeaderView {
+    std::string_view name;
+    std::string_view value;
+};
+
+// A parsed request whose fields are slices of the caller's receive buffer.
+// Valid only as long as that buffer is neither modified nor reallocated.
+struct HttpRequestView {
+    static constexpr size_t kMaxHeaders = 64;
+
+    std::string_view method;
+    std::string_view target;   // Path plus query string, as sent
+    std::string_view path;
+    std::string_view query;    // Without the leading '?'
+    std::string_view version;  // Empty for an HTTP/0.9 simple request
+    std::string_view body;     // Empty if the body is streamed
+    HttpHeaderView headers[kMaxHeaders];
+    size_t header_count = 0;
+    size_t length = 0;         // Bytes of the buffer this request occupies (only the head if the body is streamed)
+    bool stream_body = false;  // The body follows the head and is left to a BodyDecoder
+    bool chunked = false;      // Transfer-Encoding: chunked
+    bool expect_continue = false; // Expect: 100-continue on HTTP/1.1: the client waits for a 100 before sending the body
+    uint64_t content_length = 0;
+
+    // Case-insensitive header lookup. Returns an empty view if absent.
+    std::string_view header(std::string_view name) const;
+};
+
+// Resumable, allocation-free HTTP/1.x request parser. Call feed() with the
+// bytes buffered so far (always starting at the first byte of the request);
+// it picks up scanning where the previous call stopped, so bytes that
+// trickle in over many reads are examined only once. Bytes scanned and time
+// spent are reported to Metrics, giving the parse throughput.
+//
+// A Content-Length body of up to Limits::max_body bytes is waited for and
+// included in the view. A larger or chunked body is not: the request is
+// complete at the end of its head, with stream_body set, and the caller
+// decodes the body from the bytes that follow with a BodyDecoder.
 class HttpRequestParser {
 public:
+    struct Limits {
+        size_t max_request_line = 8192;
+        size_t max_header_bytes = 16384;
+        size_t max_body = 64 * 1024;                   // Largest body buffered whole into the request
+        uint64_t max_stream_body = 1024 * 1024 * 1024; // Largest body at all (0 = unlimited)
+    };
+
+    HttpRequestParser() = default;
+    explicit HttpRequestParser(const Limits& limits) : limits_(limits) {}
+
+    ParseStatus feed(std::string_view buffer, HttpRequestView& request);
+
+    // Prepares the parser for the next request on the same connection.
+    void reset();
+
+    // True once the request line and headers have been parsed and only the
+    // body is still outstanding.
+    bool headers_complete() const { return phase_ == Phase::Body; }
+
+    // The request carries Expect: 100-continue and may be answered with an
+    // interim 100 (HTTP/1.1 and later).
+    bool expects_continue() const { return expect_continue_; }
+
+    // Time spent in feed() on the current request, over all its calls.
+    uint64_t parse_ns() const { return parse_ns_; }
+
+    // HTTP status code describing why feed() returned Malformed (400, 413,
+    // 414, 417, 431, 501 or 505).
+    int error_status() const { return error_status_; }
+
+    // Copies a parsed view into `arena` and returns a request pointing there,
+    // which handlers may keep after the receive buffer has moved on.
+    static HttpRequest to_request(const HttpRequestView& view, std::shared_ptr<Arena> arena);
+
+    // Parses a complete request held in a string. Convenience wrapper around
+    // feed(); returns an empty request if the string is incomplete or malformed.
     static HttpRequest parse(const std::string& request_string);
 
 private:
-    static std::vector<std::string> split(const std::string& s, char delimiter);
-    static void parse_request_line(const std::string& line, HttpRequest& request);
-    static void parse_headers(const std::vector<std::string>& lines, HttpRequest& request);
-    static void parse_query_params(const std::string& path, HttpRequest& request);
+    enum class Phase { RequestLine, Headers, Body };
+
+    struct Span {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    ParseStatus advance(std::string_view buffer, HttpRequestView& request);
+    ParseStatus fail(int status);
+    bool parse_request_line(std::string_view line);
+    bool parse_header_line(std::string_view line, size_t line_offset);
+    void build_view(std::string_view buffer, HttpRequestView& request) const;
+    bool stream_body() const { return chunked_ || content_length_ > limits_.max_body; }
+
+    Limits limits_;
+    Phase phase_ = Phase::RequestLine;
+    size_t line_start_ = 0;     // Start of the line currently being scanned
+    size_t scan_offset_ = 0;    // Everything before this has been examined
+    size_t headers_start_ = 0;
+    size_t body_start_ = 0;
+    uint64_t content_length_ = 0;
+    bool has_content_length_ = false;
+    bool chunked_ = false;
+    bool interim_responses_ = false; // HTTP/1.1 or later: a 1xx response may be sent
+    bool expect_continue_ = false;
+    int error_status_ = 0;
+    uint64_t parse_ns_ = 0;
+
+    // Offsets rather than pointers: the receive buffer may move between calls.
+    Span method_{0, 0};
+    Span target_{0, 0};
+    Span version_{0, 0};
+    Span header_names_[HttpRequestView::kMaxHeaders];
+    Span header_values_[HttpRequestView::kMaxHeaders];
+    size_t header_count_ = 0;
+};
+
+// Frames a streamed request body (HttpRequestView::stream_body): counts
+// down its Content-Length, or decodes the chunked transfer coding (RFC 9112
+// section 7.1), skipping chunk extensions and trailer fields. Works on the
+// receive buffer in place; the body bytes it finds are slices of it.
+class BodyDecoder {
+public:
+    // Starts on the body of `request`; a chunked body may decode to at
+    // most `max_length` bytes (0 = unlimited).
+    void start(const HttpRequestView& request, uint64_t max_length);
+
+    // Takes bytes from the front of `input` and returns how many it used,
+    // pointing `data` at the body bytes among them (empty if they were only
+    // framing). Returns 0 if `input` ends inside a chunk-size line or a
+    // trailer field: call again once more bytes have arrived.
+    size_t decode(std::string_view input, std::string_view& data);
+
+    // A body is being decoded: started, not yet done and not failed.
+    bool active() const { return state_ != State::Idle && state_ != State::Done && state_ != State::Failed; }
+    bool done() const { return state_ == State::Done; }
+    bool failed() const { return state_ == State::Failed; }
+    bool chunked() const { return chunked_; }
+
+    // Content-Length bytes still to come; unknown (and 0) for chunked bodies.
+    uint64_t remaining() const { return chunked_ ? 0 : remaining_; }
+
+    // HTTP status describing why decoding failed: 400, or 413 past max_length.
+    int error_status() const { return error_status_; }
+
+private:
+    enum class State { Idle, Length, ChunkSize, ChunkData, ChunkEnd, Trailer, Done, Failed };
+
+    size_t fail(int status);
+
+    State state_ = State::Idle;
+    bool chunked_ = false;
+    uint64_t remaining_ = 0;    // Of the Content-Length, or of the current chunk
+    uint64_t decoded_ = 0;
+    uint64_t max_length_ = 0;
+    size_t trailer_bytes_ = 0;
+    int error_status_ = 0;
 };
 
 #endif // HTTP_REQUEST_PARSER_H
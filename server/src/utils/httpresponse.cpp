@@ -0,0 +1,201 @@
+#include "httpresponse.h"
+#include <strings.h>
+#include <unistd.h>
+
+static bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+bool wants_keep_alive(const HttpRequest& request) {
+    const HttpField* connection = request.headers.find_ignore_case("Connection");
+    if (request.version == "HTTP/1.1") {
+        return connection == nullptr || !iequals(connection->value, "close");
+    }
+    if (request.version == "HTTP/1.0") {
+        return connection != nullptr && iequals(connection->value, "keep-alive");
+    }
+    return false; // HTTP/0.9 has no persistent connections
+}
+
+const char* status_reason(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 413: return "Payload Too Large";
+        case 414: return "URI Too Long";
+        case 416: return "Range Not Satisfiable";
+        case 417: return "Expectation Failed";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        case 505: return "HTTP Version Not Supported";
+        default: return "Unknown";
+    }
+}
+
+std::shared_ptr<const PreparedResponse> prepare_response(int status, const std::string& body,
+                                                         const std::string& content_type) {
+    return prepare_response(HttpResponse(status, body, content_type));
+}
+
+std::shared_ptr<const PreparedResponse> prepare_response(const HttpResponse& response) {
+    std::shared_ptr<PreparedResponse> prepared(new PreparedResponse());
+    prepared->status = response.status();
+    response.serialize_head(prepared->keep_alive_bytes, true);
+    prepared->keep_alive_head = prepared->keep_alive_bytes.size();
+    prepared->keep_alive_bytes += response.payload(true);
+    response.serialize_head(prepared->close_bytes, false);
+    prepared->close_head = prepared->close_bytes.size();
+    prepared->close_bytes += response.payload(false);
+    return prepared;
+}
+
+std::shared_ptr<const PreparedResponse> prepare_head(const HttpResponse& response, size_t content_length) {
+    std::shared_ptr<PreparedResponse> prepared(new PreparedResponse());
+    prepared->status = response.status();
+    HttpResponse head = response;
+    head.borrowed_body_ = std::string_view();
+    head.body_owner_.reset();
+    head.body_.clear();
+    head.file_.reset();
+    head.file_length_ = content_length;
+    head.serialize_head(prepared->keep_alive_bytes, true);
+    head.serialize_head(prepared->close_bytes, false);
+    prepared->keep_alive_head = prepared->keep_alive_bytes.size();
+    prepared->close_head = prepared->close_bytes.size();
+    return prepared;
+}
+
+FileHandle::~FileHandle() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+HttpResponse::HttpResponse(int status, std::string body, std::string content_type)
+    : status_(status), content_type_(std::move(content_type)), body_(std::move(body)) {}
+
+HttpResponse HttpResponse::prepared(std::shared_ptr<const PreparedResponse> prepared) {
+    HttpResponse response;
+    response.status_ = prepared->status;
+    response.prepared_ = std::move(prepared);
+    return response;
+}
+
+HttpResponse HttpResponse::borrowed(int status, std::shared_ptr<const std::string> body, std::string content_type) {
+    HttpResponse response;
+    response.status_ = status;
+    response.content_type_ = std::move(content_type);
+    response.borrowed_body_ = *body;
+    response.body_owner_ = std::move(body);
+    return response;
+}
+
+HttpResponse HttpResponse::borrowed(int status, std::string_view body, std::shared_ptr<const void> owner,
+                                    std::string content_type) {
+    HttpResponse response;
+    response.status_ = status;
+    response.content_type_ = std::move(content_type);
+    response.borrowed_body_ = body;
+    response.body_owner_ = std::move(owner);
+    return response;
+}
+
+HttpResponse HttpResponse::file(int status, std::shared_ptr<const FileHandle> file, off_t offset, size_t length,
+                                std::string content_type) {
+    HttpResponse response;
+    response.status_ = status;
+    response.content_type_ = std::move(content_type);
+    response.file_ = std::move(file);
+    response.file_offset_ = offset;
+    response.file_length_ = length;
+    return response;
+}
+
+HttpResponse HttpResponse::with_head(std::shared_ptr<const PreparedResponse> head, std::string_view body,
+                                     std::shared_ptr<const void> owner) {
+    HttpResponse response;
+    response.status_ = head->status;
+    response.prepared_head_ = std::move(head);
+    response.borrowed_body_ = body;
+    response.body_owner_ = std::move(owner);
+    return response;
+}
+
+HttpResponse HttpResponse::stream(int status, BodyProducer producer, std::string content_type) {
+    HttpResponse response;
+    response.status_ = status;
+    response.content_type_ = std::move(content_type);
+    response.producer_ = std::move(producer);
+    return response;
+}
+
+HttpResponse& HttpResponse::add_header(std::string name, std::string value) {
+    headers_.emplace_back(std::move(name), std::move(value));
+    return *this;
+}
+
+int HttpResponse::status() const {
+    return status_;
+}
+
+void HttpResponse::serialize_head(std::string& out, bool keep_alive) const {
+    if (prepared_) {
+        return;
+    }
+    if (prepared_head_) {
+        out += keep_alive ? prepared_head_->keep_alive_bytes : prepared_head_->close_bytes;
+        return;
+    }
+    out += "HTTP/1.1 ";
+    out += std::to_string(status_);
+    out += ' ';
+    out += status_reason(status_);
+    out += "\r\n";
+    if (!content_type_.empty()) {
+        out += "Content-Type: ";
+        out += content_type_;
+        out += "\r\n";
+    }
+    for (const auto& header : headers_) {
+        out += header.first;
+        out += ": ";
+        out += header.second;
+        out += "\r\n";
+    }
+    // 204 and 304 carry no body, and must not claim one.
+    if (producer_) {
+        if (chunked_) {
+            out += "Transfer-Encoding: chunked\r\n";
+        }
+    } else if (status_ != 204 && status_ != 304) {
+        out += "Content-Length: ";
+        out += std::to_string(payload(keep_alive).size() + file_length_);
+        out += "\r\n";
+    }
+    out += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+}
+
+std::string_view HttpResponse::payload(bool keep_alive, bool with_body) const {
+    if (prepared_) {
+        std::string_view bytes = keep_alive ? prepared_->keep_alive_bytes : prepared_->close_bytes;
+        return with_body ? bytes : bytes.substr(0, keep_alive ? prepared_->keep_alive_head : prepared_->close_head);
+    }
+    if (!with_body) {
+        return std::string_view();
+    }
+    if (body_owner_) {
+        return borrowed_body_;
+    }
+    return body_;
+}
@@ -0,0 +1,148 @@
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include <sys/types.h>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "body_stream.h"
+#include "httprequest.h"
+#include "task.h"
+
+// Returns true if the connection should stay open after answering `request`:
+// HTTP/1.1 defaults to keep-alive unless the client sent "Connection: close",
+// HTTP/1.0 only keeps the connection if it asked for "Connection: keep-alive".
+bool wants_keep_alive(const HttpRequest& request);
+
+// Standard reason phrase for `status` ("OK", "Not Found", ...).
+const char* status_reason(int status);
+
+// A complete response serialized once (typically at startup) and shared by
+// every request that returns it. Both Connection header variants are kept so
+// sending it never touches the bytes.
+struct PreparedResponse {
+    int status = 200;
+    std::string keep_alive_bytes;
+    std::string close_bytes;
+    size_t keep_alive_head = 0; // Length of the status line and headers in keep_alive_bytes
+    size_t close_head = 0;      // ... and in close_bytes
+};
+
+// An open file whose bytes a response sends with sendfile(). Shared by
+// every response reading from it and closed with the last one.
+class FileHandle {
+public:
+    explicit FileHandle(int fd) : fd_(fd) {}
+    ~FileHandle();
+
+    FileHandle(const FileHandle&) = delete;
+    FileHandle& operator=(const FileHandle&) = delete;
+
+    int fd() const { return fd_; }
+
+private:
+    int fd_;
+};
+
+class HttpResponse;
+
+// Writes a streamed response body with co_await body.write(...).
+using BodyProducer = std::function<Task<void>(BodyStream& body)>;
+
+std::shared_ptr<const PreparedResponse> prepare_response(int status, const std::string& body,
+                                                         const std::string& content_type = "text/plain");
+// Same, for a response that needs extra headers (e.g. Retry-After).
+std::shared_ptr<const PreparedResponse> prepare_response(const HttpResponse& response);
+
+// What a handler returns: a status, headers and a body, kept as separate
+// segments so the event loop can send them with one writev() without
+// concatenating them. The body is either owned, borrowed from memory kept
+// alive by a shared pointer (no copy), a whole PreparedResponse, a range
+// of a file that the event loop hands to sendfile(), or streamed.
+class HttpResponse {
+public:
+    HttpResponse() = default;
+    HttpResponse(int status, std::string body, std::string content_type = "text/plain");
+
+    static HttpResponse prepared(std::shared_ptr<const PreparedResponse> prepared);
+    static HttpResponse borrowed(int status, std::shared_ptr<const std::string> body,
+                                 std::string content_type = "text/plain");
+    // `body` points into memory owned by `owner`, e.g. a memory-mapped file.
+    static HttpResponse borrowed(int status, std::string_view body, std::shared_ptr<const void> owner,
+                                 std::string content_type = "text/plain");
+    // `length` bytes of `file` starting at `offset`.
+    static HttpResponse file(int status, std::shared_ptr<const FileHandle> file, off_t offset, size_t length,
+                             std::string content_type);
+    // A borrowed body behind a head serialized in advance, which must
+    // already carry the matching Content-Length (see prepare_head()).
+    static HttpResponse with_head(std::shared_ptr<const PreparedResponse> head, std::string_view body,
+                                  std::shared_ptr<const void> owner);
+
+    // A body of unknown length, produced while it is sent. Once the head is
+    // out, the event loop runs `producer` on a worker thread and sends each
+    // write as one chunk (Transfer-Encoding: chunked); the producer is
+    // suspended while the client is behind by more than the stream buffer.
+    // If it throws, the connection is cut short so the client sees the body
+    // as incomplete.
+    static HttpResponse stream(int status, BodyProducer producer, std::string content_type = "text/plain");
+
+    HttpResponse& add_header(std::string name, std::string value);
+
+    int status() const;
+    bool is_prepared() const { return prepared_ != nullptr; }
+    bool is_streamed() const { return producer_ != nullptr; }
+    const BodyProducer& producer() const { return producer_; }
+
+    // Sends a streamed body as is, ended by closing the connection, for
+    // HTTP/1.0 clients that do not know chunked encoding.
+    void set_chunked(bool chunked) { chunked_ = chunked; }
+    bool chunked() const { return chunked_; }
+
+    // The route (Route::metrics_slot) that produced the response, for the
+    // access log; -1 if none did.
+    void set_route(int route) { route_ = route; }
+    int route() const { return route_; }
+
+    // Appends the status line and headers, including Content-Length (or
+    // Transfer-Encoding) and Connection, to `out`. Prepared responses have
+    // no separate head.
+    void serialize_head(std::string& out, bool keep_alive) const;
+
+    // The bytes that follow the head: the body, or the whole prepared
+    // response. Without the body (the answer to a HEAD request), nothing
+    // but a prepared response's own head.
+    std::string_view payload(bool keep_alive, bool with_body = true) const;
+
+    // The file range sent after the payload; file_length() is 0 if none.
+    int file_fd() const { return file_ ? file_->fd() : -1; }
+    off_t file_offset() const { return file_offset_; }
+    size_t file_length() const { return file_length_; }
+
+private:
+    friend std::shared_ptr<const PreparedResponse> prepare_head(const HttpResponse& response, size_t content_length);
+
+    int status_ = 200;
+    std::string content_type_;
+    std::vector<std::pair<std::string, std::string>> headers_;
+    std::string body_;
+    std::string_view borrowed_body_;
+    std::shared_ptr<const void> body_owner_; // Keeps borrowed_body_ alive
+    std::shared_ptr<const PreparedResponse> prepared_;
+    std::shared_ptr<const PreparedResponse> prepared_head_;
+    std::shared_ptr<const FileHandle> file_;
+    off_t file_offset_ = 0;
+    size_t file_length_ = 0;
+    BodyProducer producer_;
+    bool chunked_ = true;
+    int route_ = -1;
+};
+
+// Serializes only the status line and headers of `response` (whose body is
+// `content_length` bytes long) for HttpResponse::with_head().
+std::shared_ptr<const PreparedResponse> prepare_head(const HttpResponse& response, size_t content_length);
+
+#endif // HTTP_RESPONSE_H
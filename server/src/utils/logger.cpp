@@ -1,5 +1,22 @@
 #include "logger.h"
-#include <sstream> // Required for std::stringstream
+#include <algorithm>
+
+static const char* level_name(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info: return "INFO";
+        case LogLevel::Warn: return "WARN";
+        case LogLevel::Error: return "ERROR";
+    }
+    return "INFO";
+}
+
+static LogLevel parse_level(const std::string& level) {
+    if (level == "DEBUG") return LogLevel::Debug;
+    if (level == "WARN") return LogLevel::Warn;
+    if (level == "ERROR") return LogLevel::Error;
+    return LogLevel::Info;
+}
 
 Logger& Logger::getInstance() {
     static Logger instance; // Guaranteed to be destroyed, instantiated on first use.
@@ -11,6 +28,11 @@ Logger::Logger() {
 }
 
 Logger::~Logger() {
+    if (writer_.joinable()) {
+        stopping_.store(true);
+        writer_cv_.notify_one();
+        writer_.join();
+    }
     if (log_file_.is_open()) {
         log_file_.close();
     }
@@ -18,7 +40,7 @@ Logger::~Logger() {
 
 void Logger::init_log_file() {
     // You can make this configurable or based on environment variables
-    std::string log_file_path = "/var/log/server/server.log"; 
+    std::string log_file_path = "/var/log/server/server.log";
     log_file_.open(log_file_path, std::ios_base::app); // Open in append mode
 
     if (!log_file_.is_open()) {
@@ -26,21 +48,129 @@ void Logger::init_log_file() {
     }
 }
 
+void Logger::configure(const LoggerOptions& options) {
+    min_level_.store(static_cast<int>(options.level), std::memory_order_relaxed);
+    block_on_full_ = options.block_on_full;
+    if (options.async && !queue_) {
+        queue_.reset(new BoundedQueue<Record>(options.queue_capacity));
+        wake_threshold_ = std::max<size_t>(1, queue_->capacity() / 2);
+        writer_ = std::thread(&Logger::writer_main, this);
+    }
+}
+
 void Logger::log(const std::string& level, const std::string& message) {
-    std::lock_guard<std::mutex> guard(log_mutex_);
+    LogLevel parsed = parse_level(level);
+    if (enabled(parsed)) {
+        log(parsed, message);
+    }
+}
+
+void Logger::log(LogLevel level, std::string message) {
+    Record record;
+    record.level = level;
+    record.time = std::chrono::system_clock::now();
+    record.message = std::move(message);
+
+    if (!queue_) {
+        // Synchronous mode: format and write on the calling thread.
+        std::lock_guard<std::mutex> guard(log_mutex_);
+        std::string line;
+        format_record(record, line);
+        write_batch(line);
+        written_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    while (!queue_->try_push(record)) {
+        if (!block_on_full_) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        wake_writer();
+        std::this_thread::yield();
+    }
+    if (queue_->size() >= wake_threshold_) {
+        wake_writer();
+    }
+}
+
+void Logger::wake_writer() {
+    // One producer wins the exchange; the rest see the writer awake. The
+    // lock orders the notification after the writer's predicate check.
+    if (writer_sleeping_.load(std::memory_order_relaxed) && writer_sleeping_.exchange(false, std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> guard(writer_mutex_);
+        writer_cv_.notify_one();
+    }
+}
+
+void Logger::writer_main() {
+    std::string batch;
+    Record record;
+    while (true) {
+        batch.clear();
+        size_t count = 0;
+        while (count < 1024 && queue_->try_pop(record)) {
+            format_record(record, batch);
+            ++count;
+        }
+
+        if (count > 0) {
+            // One write (and one flush) per batch instead of per record.
+            write_batch(batch);
+            written_.fetch_add(count, std::memory_order_relaxed);
+            continue;
+        }
+        if (stopping_.load()) {
+            return;
+        }
+        // The writer polls, keeping log() free of syscalls while the queue
+        // is shallow. A burst that fills half the queue wakes it early.
+        std::unique_lock<std::mutex> lock(writer_mutex_);
+        writer_sleeping_.store(true, std::memory_order_relaxed);
+        writer_cv_.wait_for(lock, std::chrono::milliseconds(10), [this] {
+            return !writer_sleeping_.load(std::memory_order_relaxed) || stopping_.load();
+        });
+        writer_sleeping_.store(false, std::memory_order_relaxed);
+    }
+}
 
-    auto now = std::chrono::system_clock::now();
-    std::time_t current_time = std::chrono::system_clock::to_time_t(now);
+void Logger::format_record(const Record& record, std::string& out) {
+    std::time_t current_time = std::chrono::system_clock::to_time_t(record.time);
+    if (current_time != cached_second_) {
+        std::tm local_time;
+        localtime_r(&current_time, &local_time);
+        std::strftime(cached_timestamp_, sizeof(cached_timestamp_), "%Y-%m-%d %H:%M:%S", &local_time);
+        cached_second_ = current_time;
+    }
 
-    std::stringstream log_stream;
-    log_stream << "[" << std::put_time(std::localtime(&current_time), "%Y-%m-%d %H:%M:%S")
-               << "] [" << level << "] " << message << std::endl;
+    out += '[';
+    out += cached_timestamp_;
+    out += "] [";
+    out += level_name(record.level);
+    out += "] ";
+    out += record.message;
+    out += '\n';
+}
 
+void Logger::write_batch(const std::string& batch) {
     // Write to console
-    std::cout << log_stream.str();
+    std::cout.write(batch.data(), static_cast<std::streamsize>(batch.size()));
 
     // Write to file
     if (log_file_.is_open()) {
-        log_file_ << log_stream.str();
+        log_file_.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+    }
+
+    std::cout.flush();
+    if (log_file_.is_open()) {
+        log_file_.flush();
     }
 }
+
+LoggerStats Logger::stats() const {
+    LoggerStats stats;
+    stats.written = written_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    stats.queue_depth = queue_ ? queue_->size() : 0;
+    return stats;
+}
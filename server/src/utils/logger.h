@@ -8,6 +8,39 @@
 #include <ctime>
 #include <iomanip>
 #include <iostream>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <thread>
+#include <memory>
+#include "bounded_queue.h"
+
+enum class LogLevel { Debug = 0, Info = 1, Warn = 2, Error = 3 };
+
+struct LoggerOptions {
+    LogLevel level = LogLevel::Info;
+    bool async = true;          // Hand records to a background writer thread
+    bool block_on_full = false; // Async only: wait for queue space instead of dropping the record
+    size_t queue_capacity = 8192;
+};
+
+struct LoggerStats {
+    uint64_t written = 0;
+    uint64_t dropped = 0;      // Records discarded because the async queue was full
+    size_t queue_depth = 0;
+};
+
+// Skip building the message entirely when the level is filtered out.
+#define LOG_AT(level, message)                                          \
+    do {                                                                \
+        if (Logger::getInstance().enabled(level)) {                     \
+            Logger::getInstance().log(level, message);                  \
+        }                                                               \
+    } while (0)
+#define LOG_DEBUG(message) LOG_AT(LogLevel::Debug, message)
+#define LOG_INFO(message) LOG_AT(LogLevel::Info, message)
+#define LOG_WARN(message) LOG_AT(LogLevel::Warn, message)
+#define LOG_ERROR(message) LOG_AT(LogLevel::Error, message)
 
 class Logger {
 public:
@@ -17,9 +50,26 @@ public:
     Logger(const Logger&) = delete;
     Logger& operator=(const Logger&) = delete;
 
+    // Applies `options`; starts the background writer when switching to async.
+    // Call once at startup, before other threads log.
+    void configure(const LoggerOptions& options);
+
+    bool enabled(LogLevel level) const {
+        return static_cast<int>(level) >= min_level_.load(std::memory_order_relaxed);
+    }
+
+    void log(LogLevel level, std::string message);
     void log(const std::string& level, const std::string& message);
 
+    LoggerStats stats() const;
+
 private:
+    struct Record {
+        LogLevel level = LogLevel::Info;
+        std::chrono::system_clock::time_point time;
+        std::string message;
+    };
+
     Logger(); // Private constructor to enforce singleton
     ~Logger(); // Private destructor
 
@@ -27,6 +77,27 @@ private:
     std::mutex log_mutex_;
 
     void init_log_file();
+    void writer_main();
+    void wake_writer();
+    void format_record(const Record& record, std::string& out);
+    void write_batch(const std::string& batch);
+
+    std::atomic<int> min_level_{static_cast<int>(LogLevel::Info)};
+    bool block_on_full_ = false;
+    std::unique_ptr<BoundedQueue<Record>> queue_; // Non-null in async mode
+    size_t wake_threshold_ = 0;                   // Queue depth at which producers wake the writer
+    std::thread writer_;
+    std::atomic<bool> stopping_{false};
+    std::atomic<bool> writer_sleeping_{false};    // The writer waits out its poll interval
+    std::mutex writer_mutex_;
+    std::condition_variable writer_cv_;
+
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+
+    // Timestamp prefix, reformatted only when the second changes.
+    std::time_t cached_second_ = 0;
+    char cached_timestamp_[32] = {0};
 };
 
 #endif // LOGGER_H
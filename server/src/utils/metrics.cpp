@@ -0,0 +1,209 @@
+#include "metrics.h"
+#include "allocation_counter.h"
+#include <stdexcept>
+
+Metrics& Metrics::getInstance() {
+    static Metrics instance;
+    return instance;
+}
+
+Metrics::Metrics() : shards_(new Shard[kShards]) {
+    for (size_t s = 0; s < kShards; ++s) {
+        Shard& shard = shards_[s];
+        for (size_t e = 0; e < kMaxEndpoints; ++e) {
+            shard.requests[e].store(0, std::memory_order_relaxed);
+            shard.latency_ns_sum[e].store(0, std::memory_order_relaxed);
+            for (size_t b = 0; b < kBuckets; ++b) {
+                shard.latency_buckets[e][b].store(0, std::memory_order_relaxed);
+            }
+        }
+        for (size_t i = 0; i < kStatusSlots; ++i) {
+            shard.status[i].store(0, std::memory_order_relaxed);
+        }
+        shard.parsed_requests.store(0, std::memory_order_relaxed);
+        shard.malformed_requests.store(0, std::memory_order_relaxed);
+        shard.parsed_bytes.store(0, std::memory_order_relaxed);
+        shard.parse_ns.store(0, std::memory_order_relaxed);
+        shard.timers_armed.store(0, std::memory_order_relaxed);
+        shard.timers_fired.store(0, std::memory_order_relaxed);
+        for (auto& timeouts : shard.timeouts) {
+            timeouts.store(0, std::memory_order_relaxed);
+        }
+        shard.io_syscalls.store(0, std::memory_order_relaxed);
+        shard.file_cache_hits.store(0, std::memory_order_relaxed);
+        shard.file_cache_misses.store(0, std::memory_order_relaxed);
+        shard.sendfile_bytes.store(0, std::memory_order_relaxed);
+        for (auto& result : shard.response_cache) {
+            result.store(0, std::memory_order_relaxed);
+        }
+        shard.response_cache_evictions.store(0, std::memory_order_relaxed);
+        for (size_t r = 0; r < static_cast<size_t>(ShedReason::Count); ++r) {
+            shard.shed_connections[r].store(0, std::memory_order_relaxed);
+            shard.shed_requests[r].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+int Metrics::register_endpoint(const std::string& name) {
+    int slot = endpoint_count_.load(std::memory_order_relaxed);
+    if (slot >= static_cast<int>(kMaxEndpoints)) {
+        throw std::length_error("cannot register endpoint " + name + ": /metrics tracks at most " +
+                                std::to_string(kMaxEndpoints) + " endpoints (Metrics::kMaxEndpoints)");
+    }
+    endpoint_names_[slot] = name;
+    endpoint_count_.store(slot + 1, std::memory_order_release);
+    return slot;
+}
+
+std::vector<std::string> Metrics::endpoint_names() const {
+    int count = endpoint_count_.load(std::memory_order_acquire);
+    return std::vector<std::string>(endpoint_names_, endpoint_names_ + count);
+}
+
+Metrics::Shard& Metrics::local_shard() {
+    // Threads are spread round-robin over the shards. With at most kShards
+    // threads every shard has a single writer, so its cache lines never bounce.
+    thread_local size_t index = next_shard_.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return shards_[index];
+}
+
+size_t Metrics::bucket_for(std::chrono::nanoseconds latency) {
+    double seconds = latency.count() / 1e9;
+    for (size_t b = 0; b < kLatencyBounds.size(); ++b) {
+        if (seconds <= kLatencyBounds[b]) {
+            return b;
+        }
+    }
+    return kLatencyBounds.size();
+}
+
+void Metrics::record_request(int endpoint, int status, std::chrono::nanoseconds latency) {
+    if (endpoint < 0 || endpoint >= static_cast<int>(kMaxEndpoints)) {
+        return;
+    }
+    Shard& shard = local_shard();
+    shard.requests[endpoint].fetch_add(1, std::memory_order_relaxed);
+    shard.latency_ns_sum[endpoint].fetch_add(static_cast<uint64_t>(latency.count()), std::memory_order_relaxed);
+    shard.latency_buckets[endpoint][bucket_for(latency)].fetch_add(1, std::memory_order_relaxed);
+    if (status >= kMinStatus && status <= kMaxStatus) {
+        shard.status[status - kMinStatus].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::record_status(int status) {
+    if (status >= kMinStatus && status <= kMaxStatus) {
+        local_shard().status[status - kMinStatus].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::record_parse(uint64_t bytes, uint64_t parse_ns, bool complete, bool malformed) {
+    Shard& shard = local_shard();
+    shard.parsed_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    shard.parse_ns.fetch_add(parse_ns, std::memory_order_relaxed);
+    if (complete) {
+        shard.parsed_requests.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (malformed) {
+        shard.malformed_requests.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::record_timers(int64_t armed_delta, uint64_t fired) {
+    Shard& shard = local_shard();
+    shard.timers_armed.fetch_add(armed_delta, std::memory_order_relaxed);
+    shard.timers_fired.fetch_add(fired, std::memory_order_relaxed);
+}
+
+void Metrics::record_timeout(TimeoutKind kind) {
+    local_shard().timeouts[static_cast<size_t>(kind)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::record_syscalls(uint64_t count) {
+    local_shard().io_syscalls.fetch_add(count, std::memory_order_relaxed);
+}
+
+void Metrics::record_file_cache(bool hit) {
+    Shard& shard = local_shard();
+    (hit ? shard.file_cache_hits : shard.file_cache_misses).fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::record_sendfile(uint64_t bytes) {
+    local_shard().sendfile_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Metrics::record_response_cache(ResponseCacheResult result) {
+    local_shard().response_cache[static_cast<size_t>(result)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::record_response_cache_evictions(uint64_t count) {
+    local_shard().response_cache_evictions.fetch_add(count, std::memory_order_relaxed);
+}
+
+void Metrics::record_shed(ShedReason reason, bool connection) {
+    Shard& shard = local_shard();
+    (connection ? shard.shed_connections : shard.shed_requests)[static_cast<size_t>(reason)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::set_io_backend(const std::string& name) {
+    io_backend_ = name;
+}
+
+MetricsSnapshot Metrics::snapshot() const {
+    MetricsSnapshot snapshot;
+    snapshot.io_backend = io_backend_;
+    snapshot.heap_allocations = heap_allocations();
+    snapshot.heap_allocations_counted = heap_allocations_counted();
+    int endpoint_count = endpoint_count_.load(std::memory_order_acquire);
+    snapshot.endpoints.resize(endpoint_count);
+    for (int e = 0; e < endpoint_count; ++e) {
+        snapshot.endpoints[e].name = endpoint_names_[e];
+        snapshot.endpoints[e].latency_buckets.assign(kBuckets, 0);
+    }
+    std::vector<uint64_t> status(kStatusSlots, 0);
+
+    for (size_t s = 0; s < kShards; ++s) {
+        const Shard& shard = shards_[s];
+        for (int e = 0; e < endpoint_count; ++e) {
+            MetricsSnapshot::Endpoint& endpoint = snapshot.endpoints[e];
+            endpoint.requests += shard.requests[e].load(std::memory_order_relaxed);
+            endpoint.latency_ns_sum += shard.latency_ns_sum[e].load(std::memory_order_relaxed);
+            for (size_t b = 0; b < kBuckets; ++b) {
+                endpoint.latency_buckets[b] += shard.latency_buckets[e][b].load(std::memory_order_relaxed);
+            }
+        }
+        for (size_t i = 0; i < kStatusSlots; ++i) {
+            status[i] += shard.status[i].load(std::memory_order_relaxed);
+        }
+        snapshot.parsed_requests += shard.parsed_requests.load(std::memory_order_relaxed);
+        snapshot.malformed_requests += shard.malformed_requests.load(std::memory_order_relaxed);
+        snapshot.parsed_bytes += shard.parsed_bytes.load(std::memory_order_relaxed);
+        snapshot.parse_ns += shard.parse_ns.load(std::memory_order_relaxed);
+        snapshot.timers_armed += shard.timers_armed.load(std::memory_order_relaxed);
+        snapshot.timers_fired += shard.timers_fired.load(std::memory_order_relaxed);
+        for (size_t k = 0; k < static_cast<size_t>(TimeoutKind::Count); ++k) {
+            snapshot.timeouts[k] += shard.timeouts[k].load(std::memory_order_relaxed);
+        }
+        snapshot.io_syscalls += shard.io_syscalls.load(std::memory_order_relaxed);
+        snapshot.file_cache_hits += shard.file_cache_hits.load(std::memory_order_relaxed);
+        snapshot.file_cache_misses += shard.file_cache_misses.load(std::memory_order_relaxed);
+        snapshot.sendfile_bytes += shard.sendfile_bytes.load(std::memory_order_relaxed);
+        for (size_t r = 0; r < static_cast<size_t>(ResponseCacheResult::Count); ++r) {
+            snapshot.response_cache[r] += shard.response_cache[r].load(std::memory_order_relaxed);
+        }
+        snapshot.response_cache_evictions += shard.response_cache_evictions.load(std::memory_order_relaxed);
+        for (size_t r = 0; r < static_cast<size_t>(ShedReason::Count); ++r) {
+            snapshot.shed_connections[r] += shard.shed_connections[r].load(std::memory_order_relaxed);
+            snapshot.shed_requests[r] += shard.shed_requests[r].load(std::memory_order_relaxed);
+        }
+    }
+
+    for (const MetricsSnapshot::Endpoint& endpoint : snapshot.endpoints) {
+        snapshot.total_requests += endpoint.requests;
+    }
+    for (size_t i = 0; i < kStatusSlots; ++i) {
+        if (status[i] != 0) {
+            snapshot.status_counts.emplace_back(static_cast<int>(i) + kMinStatus, status[i]);
+        }
+    }
+    return snapshot;
+}
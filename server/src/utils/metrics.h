@@ -0,0 +1,179 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Connection deadline that expired, see EventLoop.
+enum class TimeoutKind {
+    Header,   // Request head not received in time (slow or silent client)
+    Request,  // Whole request/response exchange took too long
+    Idle,     // Persistent connection idle between requests
+    Count
+};
+
+// Why a connection or request was turned away, see AdmissionControl.
+enum class ShedReason {
+    ConnectionLimit, // Too many open connections (503 at accept)
+    RateLimit,       // Client IP out of tokens (429)
+    QueueDelay,      // Worker queue delay above target (503)
+    Count
+};
+
+// How the ResponseCache answered a request to a cached route.
+enum class ResponseCacheResult {
+    Hit,        // Served from the cache
+    Miss,       // Ran the handler
+    Coalesced,  // Waited for a concurrent miss on the same key
+    Count
+};
+
+// Aggregated view of all metric shards, taken when /metrics is scraped.
+struct MetricsSnapshot {
+    struct Endpoint {
+        std::string name;
+        uint64_t requests = 0;
+        uint64_t latency_ns_sum = 0;
+        std::vector<uint64_t> latency_buckets; // Non-cumulative counts per bucket, last one is +Inf
+    };
+
+    uint64_t total_requests = 0;
+    std::vector<Endpoint> endpoints;
+    std::vector<std::pair<int, uint64_t>> status_counts; // (status code, count), only non-zero codes
+
+    uint64_t parsed_requests = 0;
+    uint64_t malformed_requests = 0;
+    uint64_t parsed_bytes = 0;
+    uint64_t parse_ns = 0;
+
+    int64_t timers_armed = 0;          // Timers currently pending in the event loops' wheels
+    uint64_t timers_fired = 0;
+    uint64_t timeouts[static_cast<size_t>(TimeoutKind::Count)] = {};
+
+    std::string io_backend;            // "epoll" or "io_uring"
+    uint64_t io_syscalls = 0;          // System calls made for network I/O
+
+    uint64_t heap_allocations = 0;     // operator new calls, process-wide
+    bool heap_allocations_counted = false; // The counting operator new is linked in
+
+    uint64_t file_cache_hits = 0;      // Static files served from the mapped cache
+    uint64_t file_cache_misses = 0;    // Static files opened from disk
+    uint64_t sendfile_bytes = 0;       // Response bytes sent with sendfile()
+
+    uint64_t response_cache[static_cast<size_t>(ResponseCacheResult::Count)] = {};
+    uint64_t response_cache_evictions = 0; // Entries dropped to stay within the cache's byte budget
+
+    uint64_t shed_connections[static_cast<size_t>(ShedReason::Count)] = {}; // Refused at accept
+    uint64_t shed_requests[static_cast<size_t>(ShedReason::Count)] = {};    // Answered without running a handler
+};
+
+// Request counters and latency histograms, sharded so the request path never
+// takes a lock. Each thread is assigned its own cache-line-aligned shard on
+// first use and only ever bumps relaxed atomics in it; shards are summed only
+// when snapshot() is called.
+class Metrics {
+public:
+    static constexpr size_t kMaxEndpoints = 32;
+    static constexpr size_t kShards = 64;
+    static constexpr int kMinStatus = 100;
+    static constexpr int kMaxStatus = 599;
+
+    // Upper bounds (in seconds) of the latency histogram buckets; a final
+    // +Inf bucket catches everything slower.
+    static constexpr std::array<double, 14> kLatencyBounds = {
+        0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+        0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 5.0};
+
+    static Metrics& getInstance();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    // Registers an endpoint and returns its slot. Call at startup, before
+    // requests are served. Throws std::length_error past kMaxEndpoints.
+    int register_endpoint(const std::string& name);
+
+    // Names of the registered endpoints, indexed by slot.
+    std::vector<std::string> endpoint_names() const;
+
+    // Counts one handled request against `endpoint` with its status and latency.
+    void record_request(int endpoint, int status, std::chrono::nanoseconds latency);
+
+    // Counts a response produced outside any endpoint (e.g. 503 from backpressure).
+    void record_status(int status);
+
+    void record_parse(uint64_t bytes, uint64_t parse_ns, bool complete, bool malformed);
+
+    // Reports a change in the number of armed timers and how many fired.
+    void record_timers(int64_t armed_delta, uint64_t fired);
+
+    void record_timeout(TimeoutKind kind);
+
+    // Counts system calls made for network I/O (accept, read, send, close,
+    // polling, wakeups), so backends can be compared per request.
+    void record_syscalls(uint64_t count);
+
+    // Counts a static file lookup that did or did not hit the file cache.
+    void record_file_cache(bool hit);
+
+    // Counts response bytes the kernel sent straight from a file.
+    void record_sendfile(uint64_t bytes);
+
+    // Counts a lookup in the response cache, and entries it evicted.
+    void record_response_cache(ResponseCacheResult result);
+    void record_response_cache_evictions(uint64_t count);
+
+    // Counts a connection (at accept) or a request turned away by admission control.
+    void record_shed(ShedReason reason, bool connection);
+
+    // Names the I/O backend the event loops run on. Call at startup.
+    void set_io_backend(const std::string& name);
+
+    MetricsSnapshot snapshot() const;
+
+private:
+    static constexpr size_t kBuckets = kLatencyBounds.size() + 1;
+    static constexpr size_t kStatusSlots = kMaxStatus - kMinStatus + 1;
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> requests[kMaxEndpoints];
+        std::atomic<uint64_t> latency_ns_sum[kMaxEndpoints];
+        std::atomic<uint64_t> latency_buckets[kMaxEndpoints][kBuckets];
+        std::atomic<uint64_t> status[kStatusSlots];
+        std::atomic<uint64_t> parsed_requests;
+        std::atomic<uint64_t> malformed_requests;
+        std::atomic<uint64_t> parsed_bytes;
+        std::atomic<uint64_t> parse_ns;
+        std::atomic<int64_t> timers_armed; // Sum over all shards is the gauge
+        std::atomic<uint64_t> timers_fired;
+        std::atomic<uint64_t> timeouts[static_cast<size_t>(TimeoutKind::Count)];
+        std::atomic<uint64_t> io_syscalls;
+        std::atomic<uint64_t> file_cache_hits;
+        std::atomic<uint64_t> file_cache_misses;
+        std::atomic<uint64_t> sendfile_bytes;
+        std::atomic<uint64_t> response_cache[static_cast<size_t>(ResponseCacheResult::Count)];
+        std::atomic<uint64_t> response_cache_evictions;
+        std::atomic<uint64_t> shed_connections[static_cast<size_t>(ShedReason::Count)];
+        std::atomic<uint64_t> shed_requests[static_cast<size_t>(ShedReason::Count)];
+    };
+
+    Metrics();
+
+    Shard& local_shard();
+    static size_t bucket_for(std::chrono::nanoseconds latency);
+
+    std::unique_ptr<Shard[]> shards_;
+    std::atomic<size_t> next_shard_{0};
+    std::string endpoint_names_[kMaxEndpoints];
+    std::atomic<int> endpoint_count_{0};
+    std::string io_backend_;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,243 @@
+#include "router.h"
+#include <algorithm>
+#include <stdexcept>
+#include "metrics.h"
+
+Router::Router() {
+    nodes_.emplace_back(); // Root
+
+    not_found_.method = "*";
+    not_found_.pattern = "unknown";
+    not_found_.metrics_slot = Metrics::getInstance().register_endpoint("unknown");
+    static const std::shared_ptr<const PreparedResponse> not_found = prepare_response(404, "Unknown endpoint\n");
+    not_found_.handler = [](const HttpRequest&) { return HttpResponse::prepared(not_found); };
+}
+
+Task<HttpResponse> run_route(const Route& route, const HttpRequest& request) {
+    if (route.async_handler) {
+        co_return co_await route.async_handler(request);
+    }
+    co_return route.handler(request);
+}
+
+void Router::cache(const std::string& method, const std::string& pattern, std::chrono::milliseconds ttl) {
+    for (const std::unique_ptr<Route>& route : routes_) {
+        if (route->method == method && route->pattern == pattern) {
+            route->cache_ttl = ttl;
+            return;
+        }
+    }
+    throw std::logic_error("no route " + method + " " + pattern + " to cache");
+}
+
+void Router::set_not_found(RouteHandler handler) {
+    not_found_.handler = std::move(handler);
+}
+
+int Router::child_for(int node, std::string_view segment, bool create) {
+    std::vector<std::pair<std::string, int>>& children = nodes_[node].children;
+    auto it = std::lower_bound(children.begin(), children.end(), segment,
+        [](const std::pair<std::string, int>& child, std::string_view key) { return child.first < key; });
+    if (it != children.end() && it->first == segment) {
+        return it->second;
+    }
+    if (!create) {
+        return -1;
+    }
+    int child = static_cast<int>(nodes_.size());
+    // Insert before growing nodes_: `children` refers into it.
+    children.insert(it, std::make_pair(std::string(segment), child));
+    nodes_.emplace_back();
+    return child;
+}
+
+void Router::add(const std::string& method, const std::string& pattern, RouteHandler handler) {
+    insert(method, pattern).handler = std::move(handler);
+}
+
+void Router::add_async(const std::string& method, const std::string& pattern, AsyncRouteHandler handler) {
+    insert(method, pattern).async_handler = std::move(handler);
+}
+
+void Router::check_parameters(const std::string& pattern) {
+    std::string_view rest(pattern);
+    if (!rest.empty() && rest.front() == '/') {
+        rest.remove_prefix(1);
+    }
+    int node = 0;
+    while (!rest.empty() && node >= 0) {
+        size_t slash = rest.find('/');
+        std::string_view segment = rest.substr(0, slash);
+        rest = slash == std::string_view::npos ? std::string_view() : rest.substr(slash + 1);
+        if (segment.empty() || segment.front() != ':') {
+            node = child_for(node, segment, false);
+            continue;
+        }
+        // Routes share the parameter node, and with it the name it is captured as.
+        const Node& current = nodes_[node];
+        if (current.param_child >= 0 && current.param_name != segment.substr(1)) {
+            throw std::logic_error("route " + pattern + " names parameter " + std::string(segment) +
+                                   " where another route has :" + current.param_name);
+        }
+        node = current.param_child;
+    }
+}
+
+Route& Router::insert(const std::string& method, const std::string& pattern) {
+    check_parameters(pattern); // Before anything is registered
+    int index = static_cast<int>(routes_.size());
+    std::unique_ptr<Route> route(new Route());
+    route->method = method;
+    route->pattern = pattern;
+    // One pattern under several methods is one endpoint in /metrics.
+    auto same_pattern = std::find_if(routes_.begin(), routes_.end(),
+        [&pattern](const std::unique_ptr<Route>& existing) { return existing->pattern == pattern; });
+    route->metrics_slot = same_pattern != routes_.end() ? (*same_pattern)->metrics_slot
+                                                        : Metrics::getInstance().register_endpoint(pattern);
+    routes_.push_back(std::move(route));
+    Route& inserted = *routes_.back();
+
+    std::string_view rest(pattern);
+    if (!rest.empty() && rest.front() == '/') {
+        rest.remove_prefix(1);
+    }
+
+    int node = 0;
+    while (!rest.empty()) {
+        size_t slash = rest.find('/');
+        std::string_view segment = rest.substr(0, slash);
+        rest = slash == std::string_view::npos ? std::string_view() : rest.substr(slash + 1);
+
+        if (segment == "*" && rest.empty()) {
+            nodes_[node].wildcard_routes.push_back(index);
+            update_not_allowed(nodes_[node].wildcard_not_allowed, nodes_[node].wildcard_routes);
+            return inserted;
+        }
+        if (!segment.empty() && segment.front() == ':') {
+            if (nodes_[node].param_child < 0) {
+                int child = static_cast<int>(nodes_.size());
+                nodes_.emplace_back();
+                nodes_[node].param_child = child;
+                nodes_[node].param_name = std::string(segment.substr(1));
+            }
+            node = nodes_[node].param_child;
+            continue;
+        }
+        node = child_for(node, segment, true);
+    }
+    nodes_[node].routes.push_back(index);
+    update_not_allowed(nodes_[node].not_allowed, nodes_[node].routes);
+    return inserted;
+}
+
+void Router::update_not_allowed(std::unique_ptr<Route>& not_allowed, const std::vector<int>& candidates) {
+    std::vector<std::string> methods;
+    auto allow_method = [&methods](const std::string& method) {
+        if (std::find(methods.begin(), methods.end(), method) == methods.end()) {
+            methods.push_back(method);
+        }
+    };
+    for (int index : candidates) {
+        const std::string& method = routes_[index]->method;
+        if (method == "*") {
+            not_allowed.reset();
+            return;
+        }
+        allow_method(method);
+        if (method == "GET") {
+            allow_method("HEAD"); // Answered by the GET route
+        }
+    }
+    std::string allow;
+    for (const std::string& method : methods) {
+        allow += allow.empty() ? method : ", " + method;
+    }
+
+    // Counted with unmatched paths: both are requests no controller handled.
+    not_allowed.reset(new Route());
+    not_allowed->method = "*";
+    not_allowed->pattern = "unknown";
+    not_allowed->metrics_slot = not_found_.metrics_slot;
+    std::shared_ptr<const PreparedResponse> response =
+        prepare_response(HttpResponse(405, "Method not allowed\n").add_header("Allow", allow));
+    not_allowed->handler = [response](const HttpRequest&) { return HttpResponse::prepared(response); };
+}
+
+const Route* Router::pick(const std::vector<int>& candidates, const std::unique_ptr<Route>& not_allowed,
+                          std::string_view method, const Route*& fallback) const {
+    const Route* get_route = nullptr;
+    for (int index : candidates) {
+        const Route& route = *routes_[index];
+        if (route.method == method || route.method == "*") {
+            return &route;
+        }
+        if (route.method == "GET" && get_route == nullptr) {
+            get_route = &route;
+        }
+    }
+    if (method == "HEAD" && get_route != nullptr) {
+        return get_route; // The event loop sends its head only
+    }
+    if (not_allowed && fallback == nullptr) {
+        fallback = not_allowed.get();
+    }
+    return nullptr;
+}
+
+bool Router::walk(int node, std::string_view path, std::string_view method, HttpRequest& request,
+                  const Route*& found, const Route*& fallback) const {
+    const Node& current = nodes_[node];
+
+    if (path.empty()) {
+        found = pick(current.routes, current.not_allowed, method, fallback);
+        if (found != nullptr) {
+            return true;
+        }
+    } else {
+        size_t slash = path.find('/');
+        std::string_view segment = path.substr(0, slash);
+        std::string_view rest = slash == std::string_view::npos ? std::string_view() : path.substr(slash + 1);
+
+        // Literal segments win over parameters, which win over wildcards.
+        auto it = std::lower_bound(current.children.begin(), current.children.end(), segment,
+            [](const std::pair<std::string, int>& child, std::string_view key) { return child.first < key; });
+        if (it != current.children.end() && it->first == segment &&
+            walk(it->second, rest, method, request, found, fallback)) {
+            return true;
+        }
+
+        if (current.param_child >= 0 && !segment.empty()) {
+            request.path_params.push_back(*request.arena, HttpField{current.param_name, segment});
+            if (walk(current.param_child, rest, method, request, found, fallback)) {
+                return true;
+            }
+            request.path_params.pop_back();
+        }
+    }
+
+    if (!current.wildcard_routes.empty()) {
+        found = pick(current.wildcard_routes, current.wildcard_not_allowed, method, fallback);
+        if (found != nullptr) {
+            request.path_params.push_back(*request.arena, HttpField{"*", path});
+            return true;
+        }
+    }
+    return false;
+}
+
+const Route* Router::match(HttpRequest& request) const {
+    if (!request.arena) {
+        request.arena = std::make_shared<Arena>(); // A request not built by HttpRequestParser
+    }
+    std::string_view path(request.path);
+    if (!path.empty() && path.front() == '/') {
+        path.remove_prefix(1);
+    }
+
+    const Route* found = nullptr;
+    const Route* not_allowed = nullptr;
+    if (walk(0, path, request.method, request, found, not_allowed)) {
+        return found;
+    }
+    return not_allowed != nullptr ? not_allowed : &not_found_;
+}
@@ -0,0 +1,95 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "task.h"
+
+using RouteHandler = std::function<HttpResponse(const HttpRequest& request)>;
+
+// Coroutine handler for routes that wait on timers or sockets (net/async.h).
+// The request outlives the returned task, which is awaited right away.
+using AsyncRouteHandler = std::function<Task<HttpResponse>(const HttpRequest& request)>;
+
+struct Route {
+    std::string method;   // "GET", "POST", ... or "*" for any method
+    std::string pattern;  // e.g. "/hello", "/users/:id", "/static/*"
+    RouteHandler handler;
+    AsyncRouteHandler async_handler; // Used instead of `handler` when set
+    int metrics_slot = 0; // Assigned at registration, so counting needs no lookups
+    std::chrono::milliseconds cache_ttl{0}; // > 0: GET responses go through the ResponseCache
+};
+
+// Runs the handler of `route`, synchronous or not.
+Task<HttpResponse> run_route(const Route& route, const HttpRequest& request);
+
+// Maps method + path to a controller. Patterns are split into segments and
+// stored in a trie: literal segments ("hello"), named parameters (":id",
+// captured into HttpRequest::path_params) and a trailing prefix wildcard
+// ("*", captured as path_params.find("*")). Matching walks the trie once per
+// request segment, so its cost is O(path length); captured parameters are
+// slices of the path, kept in the request's arena.
+//
+// Register every route at startup, before requests are served; match() is
+// then safe to call from any number of threads.
+class Router {
+public:
+    Router();
+
+    // Routes sharing a position must agree on its parameter name: adding
+    // "/users/:name/posts" after "/users/:id" throws std::logic_error.
+    void add(const std::string& method, const std::string& pattern, RouteHandler handler);
+    void get(const std::string& pattern, RouteHandler handler) { add("GET", pattern, std::move(handler)); }
+    void add_async(const std::string& method, const std::string& pattern, AsyncRouteHandler handler);
+    void get_async(const std::string& pattern, AsyncRouteHandler handler) { add_async("GET", pattern, std::move(handler)); }
+
+    // Keeps the responses of the route registered as `method` `pattern` for
+    // `ttl` (see net/response_cache.h); a zero `ttl` turns caching off.
+    // Throws std::logic_error if there is no such route.
+    void cache(const std::string& method, const std::string& pattern, std::chrono::milliseconds ttl);
+
+    // Handler used when no pattern matches the path (default: 404).
+    void set_not_found(RouteHandler handler);
+
+    // Returns the route for `request`, filling in request.path_params. HEAD
+    // falls back to the GET route of the path. Never returns nullptr: falls
+    // back to a 405 route, whose Allow header lists the path's methods, when
+    // the path exists for other methods only, and to the not-found route
+    // otherwise.
+    const Route* match(HttpRequest& request) const;
+
+private:
+    struct Node {
+        std::vector<std::pair<std::string, int>> children; // Literal segments, sorted for binary search
+        int param_child = -1;
+        std::string param_name;
+        std::vector<int> routes;          // Indices into routes_ ending at this node
+        std::vector<int> wildcard_routes; // Routes ending in "/*" below this node
+        // 405 answers for methods missing from `routes` and `wildcard_routes`;
+        // null when a "*" route takes every method.
+        std::unique_ptr<Route> not_allowed;
+        std::unique_ptr<Route> wildcard_not_allowed;
+    };
+
+    void check_parameters(const std::string& pattern);
+    Route& insert(const std::string& method, const std::string& pattern);
+    int child_for(int node, std::string_view segment, bool create);
+    void update_not_allowed(std::unique_ptr<Route>& not_allowed, const std::vector<int>& candidates);
+    const Route* pick(const std::vector<int>& candidates, const std::unique_ptr<Route>& not_allowed,
+                      std::string_view method, const Route*& fallback) const;
+    bool walk(int node, std::string_view path, std::string_view method, HttpRequest& request,
+              const Route*& found, const Route*& fallback) const;
+
+    std::vector<Node> nodes_;
+    std::vector<std::unique_ptr<Route>> routes_;
+    Route not_found_;
+};
+
+#endif // ROUTER_H
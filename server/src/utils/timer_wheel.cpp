@@ -0,0 +1,149 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+TimerWheel::TimerWheel(Clock::duration tick, Clock::time_point now) : tick_(tick), origin_(now) {
+    for (auto& level : slots_) {
+        for (Timer& slot : level) {
+            slot.prev_ = slot.next_ = &slot;
+        }
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    // Detach whatever is still armed, then the sentinels themselves, so no
+    // Timer destructor touches the wheel afterwards.
+    for (auto& level : slots_) {
+        for (Timer& slot : level) {
+            while (slot.next_ != &slot) {
+                slot.next_->unlink();
+            }
+            slot.prev_ = slot.next_ = nullptr;
+        }
+    }
+}
+
+uint64_t TimerWheel::tick_of(Clock::time_point time) const {
+    if (time <= origin_) {
+        return 0;
+    }
+    return static_cast<uint64_t>((time - origin_) / tick_);
+}
+
+void TimerWheel::schedule(Timer& timer, Clock::time_point deadline) {
+    timer.unlink();
+    // Round up so the timer never fires before its deadline.
+    Clock::duration offset = deadline > origin_ ? deadline - origin_ : Clock::duration::zero();
+    timer.expires_ = static_cast<uint64_t>((offset + tick_ - Clock::duration(1)) / tick_);
+    timer.wheel_ = this;
+    insert(timer);
+    size_++;
+}
+
+void TimerWheel::cancel(Timer& timer) {
+    timer.unlink();
+}
+
+void TimerWheel::insert(Timer& timer) {
+    uint64_t expires = std::max(timer.expires_, current_);
+    uint64_t delta = expires - current_;
+
+    int level = 0;
+    while (level < kLevels - 1 && delta >= (1ull << ((level + 1) * kSlotBits))) {
+        ++level;
+    }
+    uint64_t limit = 1ull << (kLevels * kSlotBits);
+    if (delta >= limit) {
+        expires = current_ + limit - 1; // Clamp: fires at the wheel's horizon instead
+    }
+    timer.expires_ = expires;
+
+    Timer& slot = slots_[level][(expires >> (level * kSlotBits)) & kSlotMask];
+    timer.prev_ = slot.prev_;
+    timer.next_ = &slot;
+    slot.prev_->next_ = &timer;
+    slot.prev_ = &timer;
+}
+
+void TimerWheel::splice(Timer& slot, Timer& into) {
+    if (slot.next_ == &slot) {
+        return;
+    }
+    into.next_ = slot.next_;
+    into.prev_ = slot.prev_;
+    into.next_->prev_ = &into;
+    into.prev_->next_ = &into;
+    slot.prev_ = slot.next_ = &slot;
+}
+
+void TimerWheel::cascade(int level) {
+    Timer pending;
+    pending.prev_ = pending.next_ = &pending;
+    splice(slots_[level][(current_ >> (level * kSlotBits)) & kSlotMask], pending);
+    while (pending.next_ != &pending) {
+        Timer* timer = pending.next_;
+        // Relink without touching size_: the timer stays armed.
+        timer->prev_->next_ = timer->next_;
+        timer->next_->prev_ = timer->prev_;
+        insert(*timer);
+    }
+    pending.prev_ = pending.next_ = nullptr;
+}
+
+size_t TimerWheel::advance(Clock::time_point now) {
+    uint64_t target = tick_of(now);
+    size_t fired = 0;
+    while (current_ <= target) {
+        if (size_ == 0) {
+            current_ = target + 1; // Nothing armed: skip the empty ticks
+            break;
+        }
+
+        uint64_t index = current_ & kSlotMask;
+        if (index == 0) {
+            for (int level = 1; level < kLevels; ++level) {
+                cascade(level);
+                if (((current_ >> (level * kSlotBits)) & kSlotMask) != 0) {
+                    break;
+                }
+            }
+        }
+
+        Timer pending;
+        pending.prev_ = pending.next_ = &pending;
+        pending.wheel_ = this;
+        splice(slots_[0][index], pending);
+        current_++; // Timers re-armed by the callbacks below land in later slots
+
+        while (pending.next_ != &pending) {
+            Timer* timer = pending.next_;
+            timer->unlink();
+            fired++;
+            if (timer->callback) {
+                timer->callback();
+            }
+        }
+        pending.prev_ = pending.next_ = nullptr;
+    }
+    return fired;
+}
+
+TimerWheel::Clock::duration TimerWheel::time_until_next(Clock::time_point now, Clock::duration max_wait) const {
+    if (size_ == 0) {
+        return max_wait;
+    }
+    // Level 0 only holds timers due within the current rotation; past that,
+    // wake up at the next rotation to cascade the higher levels.
+    uint64_t next = (current_ & kSlotMask) == 0 ? current_ : (current_ | kSlotMask) + 1;
+    for (uint64_t tick = current_; tick < current_ + kSlots; ++tick) {
+        const Timer& slot = slots_[0][tick & kSlotMask];
+        if (slot.next_ != &slot) {
+            next = tick;
+            break;
+        }
+    }
+    Clock::time_point wake = origin_ + tick_ * static_cast<Clock::rep>(next);
+    if (wake <= now) {
+        return Clock::duration::zero();
+    }
+    return std::min(wake - now, max_wait);
+}
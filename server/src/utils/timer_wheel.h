@@ -0,0 +1,97 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Hierarchical timing wheel (four levels of 64 slots, as in the classic
+// Linux kernel timer design). Timers are intrusive list nodes owned by the
+// caller, so arming, re-arming and cancelling are O(1) pointer updates with
+// no allocation; that makes it cheap to push a connection's deadline back
+// on every read. Level 0 has one slot per tick, and each higher level covers
+// 64 times the span of the one below. Timers in higher levels are moved down
+// ("cascaded") as time reaches their range.
+//
+// Deadlines are rounded up to the next tick, so a timer never fires early
+// but may fire up to one tick late. Not thread-safe: each EventLoop owns one.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    class Timer {
+    public:
+        Timer() = default;
+        explicit Timer(std::function<void()> callback) : callback(std::move(callback)) {}
+        ~Timer() { unlink(); }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        bool armed() const { return next_ != nullptr; }
+
+        std::function<void()> callback; // Runs on expiry; may re-arm or destroy the timer
+
+    private:
+        friend class TimerWheel;
+
+        void unlink() {
+            if (next_ != nullptr) {
+                prev_->next_ = next_;
+                next_->prev_ = prev_;
+                prev_ = next_ = nullptr;
+                wheel_->size_--;
+            }
+        }
+
+        TimerWheel* wheel_ = nullptr;
+        Timer* prev_ = nullptr;
+        Timer* next_ = nullptr;
+        uint64_t expires_ = 0; // Absolute tick
+    };
+
+    TimerWheel(Clock::duration tick, Clock::time_point now);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Arms `timer` to fire at `deadline`, replacing any earlier arming.
+    void schedule(Timer& timer, Clock::time_point deadline);
+
+    // Disarms `timer`; a no-op if it is not armed.
+    void cancel(Timer& timer);
+
+    // Fires every timer whose deadline has passed. Returns how many fired.
+    size_t advance(Clock::time_point now);
+
+    // How long the caller may sleep before advance() has work to do, capped
+    // at `max_wait`. Exact for level-0 timers; timers further out wake the
+    // loop once per level-0 rotation to cascade.
+    Clock::duration time_until_next(Clock::time_point now, Clock::duration max_wait) const;
+
+    size_t size() const { return size_; }
+
+private:
+    static constexpr int kLevels = 4;
+    static constexpr int kSlotBits = 6;
+    static constexpr uint64_t kSlots = 1u << kSlotBits;
+    static constexpr uint64_t kSlotMask = kSlots - 1;
+
+    uint64_t tick_of(Clock::time_point time) const;
+    void insert(Timer& timer);
+    void cascade(int level);
+
+    // Moves every timer of `slot` onto the (empty) list headed by `into`.
+    static void splice(Timer& slot, Timer& into);
+
+    // Each slot is a circular list headed by a sentinel Timer.
+    Timer slots_[kLevels][kSlots];
+    Clock::duration tick_;
+    Clock::time_point origin_;
+    uint64_t current_ = 0; // Next tick to process
+    size_t size_ = 0;
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,162 @@
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+
+std::array<TraceSpan, kTraceSpans> trace_spans(const TraceRecord& record) {
+    auto at = [&record](TraceStage stage) { return record.at[static_cast<size_t>(stage)]; };
+    auto span = [](const char* name, int64_t begin, int64_t end) {
+        return begin > 0 && end >= begin ? TraceSpan{name, begin, end} : TraceSpan{name, -1, -1};
+    };
+    int64_t parse_begin = at(TraceStage::Parsed) - static_cast<int64_t>(record.parse_ns);
+    return {{
+        span("read", at(TraceStage::Start), std::max(at(TraceStage::Start), parse_begin)),
+        span("parse", std::max(at(TraceStage::Start), parse_begin), at(TraceStage::Parsed)),
+        span("log", at(TraceStage::Parsed), at(TraceStage::Logged)),
+        span("prepare", at(TraceStage::Logged), at(TraceStage::Queued)),
+        span("queue", at(TraceStage::Queued), at(TraceStage::HandlerStart)),
+        span("handler", at(TraceStage::HandlerStart), at(TraceStage::HandlerEnd)),
+        span("wakeup", at(TraceStage::HandlerEnd), at(TraceStage::WriteStart)),
+        span("send", at(TraceStage::WriteStart), at(TraceStage::Sent)),
+    }};
+}
+
+TraceRing::TraceRing(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    slots_.reset(new Slot[size]);
+    for (size_t i = 0; i < size; ++i) {
+        for (std::atomic<uint64_t>& word : slots_[i].words) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+    mask_ = size - 1;
+}
+
+void TraceRing::push(const TraceRecord& record) {
+    uint64_t words[kWords] = {};
+    std::memcpy(words, &record, sizeof(record));
+
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[head & mask_];
+    uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // The odd sequence is visible before any word changes
+    for (size_t w = 0; w < kWords; ++w) {
+        slot.words[w].store(words[w], std::memory_order_relaxed);
+    }
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    head_.store(head + 1, std::memory_order_release);
+}
+
+void TraceRing::collect(std::vector<TraceRecord>& out) const {
+    uint64_t words[kWords];
+    for (size_t i = 0; i <= mask_; ++i) {
+        const Slot& slot = slots_[i];
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before == 0 || (before & 1) != 0) {
+            continue;
+        }
+        for (size_t w = 0; w < kWords; ++w) {
+            words[w] = slot.words[w].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before) {
+            continue; // Overwritten while we copied it
+        }
+        TraceRecord record;
+        std::memcpy(&record, words, sizeof(record));
+        out.push_back(record);
+    }
+}
+
+Tracer& Tracer::getInstance() {
+    static Tracer instance;
+    return instance;
+}
+
+void Tracer::configure(uint32_t sample_every, size_t ring_capacity) {
+    sample_every_ = sample_every;
+    ring_capacity_ = std::max<size_t>(1, ring_capacity);
+}
+
+bool Tracer::sample() {
+    if (sample_every_ == 0) {
+        return false;
+    }
+    thread_local uint32_t countdown = 0;
+    if (countdown == 0) {
+        countdown = sample_every_ - 1;
+        return true;
+    }
+    --countdown;
+    return false;
+}
+
+TraceRing& Tracer::local_ring() {
+    thread_local TraceRing* ring = nullptr;
+    if (ring == nullptr) {
+        std::lock_guard<std::mutex> guard(rings_mutex_);
+        rings_.emplace_back(new TraceRing(ring_capacity_));
+        ring = rings_.back().get();
+    }
+    return *ring;
+}
+
+void Tracer::record(const TraceRecord& record) {
+    local_ring().push(record);
+}
+
+std::vector<TraceRecord> Tracer::slowest(size_t count, size_t& held) const {
+    std::vector<TraceRecord> records;
+    {
+        std::lock_guard<std::mutex> guard(rings_mutex_);
+        for (const std::unique_ptr<TraceRing>& ring : rings_) {
+            ring->collect(records);
+        }
+    }
+    held = records.size();
+    count = std::min(count, records.size());
+    std::partial_sort(records.begin(), records.begin() + static_cast<std::ptrdiff_t>(count), records.end(),
+                      [](const TraceRecord& a, const TraceRecord& b) { return a.total_ns() > b.total_ns(); });
+    records.resize(count);
+    return records;
+}
+
+#if SERVER_TRACING
+
+void RequestTrace::begin(std::chrono::steady_clock::time_point started, std::chrono::steady_clock::time_point parsed,
+                         uint64_t parse_ns, bool new_connection) {
+    sampled_ = Tracer::getInstance().sample();
+    if (!sampled_) {
+        return;
+    }
+    record_ = TraceRecord();
+    record_.at[static_cast<size_t>(TraceStage::Start)] =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(started.time_since_epoch()).count();
+    record_.at[static_cast<size_t>(TraceStage::Parsed)] =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(parsed.time_since_epoch()).count();
+    record_.parse_ns = parse_ns;
+    record_.new_connection = new_connection;
+}
+
+void RequestTrace::describe(std::string_view method, std::string_view path) {
+    if (!sampled_) {
+        return;
+    }
+    std::memcpy(record_.method, method.data(), std::min(method.size(), sizeof(record_.method) - 1));
+    std::memcpy(record_.path, path.data(), std::min(path.size(), sizeof(record_.path) - 1));
+}
+
+void RequestTrace::finish(int status) {
+    if (!sampled_) {
+        return;
+    }
+    mark(TraceStage::Sent);
+    record_.status = static_cast<uint16_t>(status);
+    Tracer::getInstance().record(record_);
+    sampled_ = false;
+}
+
+#endif // SERVER_TRACING
@@ -0,0 +1,180 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Build with -DSERVER_TRACING=0 to compile request tracing out: RequestTrace
+// becomes an empty struct whose calls do nothing.
+#ifndef SERVER_TRACING
+#define SERVER_TRACING 1
+#endif
+
+// Points in a request's life at which a traced request is timestamped.
+enum class TraceStage {
+    Start,         // First byte of the request (accept, for a connection's first request)
+    Parsed,        // Request complete and parsed
+    Logged,        // Request log line written
+    Queued,        // Request copied out and about to be handed to the worker pool
+    HandlerStart,  // A worker started the handler
+    HandlerEnd,    // The handler produced its response
+    WriteStart,    // The event loop picked the response up
+    Sent,          // Last response byte handed to the kernel
+    Count
+};
+
+static constexpr size_t kTraceStages = static_cast<size_t>(TraceStage::Count);
+
+// One traced request, as kept in a TraceRing. Plain data, so a ring slot
+// can be copied word by word.
+struct TraceRecord {
+    int64_t at[kTraceStages] = {}; // steady_clock nanoseconds; 0 = stage not reached
+    uint64_t parse_ns = 0;         // Time inside the parser, part of Start..Parsed
+    uint16_t status = 0;
+    bool new_connection = false;   // First request on its connection: Start is the accept
+    char method[8] = {};           // NUL-terminated, truncated
+    char path[52] = {};
+
+    int64_t total_ns() const { return at[static_cast<size_t>(TraceStage::Sent)] - at[static_cast<size_t>(TraceStage::Start)]; }
+};
+
+static_assert(std::is_trivially_copyable<TraceRecord>::value, "TraceRecord is copied as raw words");
+
+// A stretch of a traced request between two stages, e.g. "handler" from
+// HandlerStart to HandlerEnd. Both ends are -1 if a stage was not reached.
+struct TraceSpan {
+    const char* name;
+    int64_t begin_ns;
+    int64_t end_ns;
+};
+
+static constexpr size_t kTraceSpans = 8;
+
+// Splits `record` into its read, parse, log, prepare, queue, handler,
+// wakeup and send spans, in that order.
+std::array<TraceSpan, kTraceSpans> trace_spans(const TraceRecord& record);
+
+// Fixed-size ring of the most recent records written by one thread. The
+// owner overwrites the oldest slot without waiting; readers copy slots
+// concurrently and skip any that changed while they were reading (a
+// sequence lock per slot, with the payload held in relaxed atomic words).
+class TraceRing {
+public:
+    explicit TraceRing(size_t capacity); // Rounded up to a power of two
+
+    TraceRing(const TraceRing&) = delete;
+    TraceRing& operator=(const TraceRing&) = delete;
+
+    // Owning thread only.
+    void push(const TraceRecord& record);
+
+    // Appends every complete record to `out`. Any thread.
+    void collect(std::vector<TraceRecord>& out) const;
+
+    uint64_t pushed() const { return head_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kWords = (sizeof(TraceRecord) + 7) / 8;
+
+    struct Slot {
+        std::atomic<uint64_t> sequence{0}; // Odd while being written, 0 while never written
+        std::atomic<uint64_t> words[kWords];
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    std::atomic<uint64_t> head_{0};
+};
+
+// Process-wide sampling decision and the per-thread rings traced requests
+// end up in. Every `sample_every`-th request per thread is traced; the rest
+// only pay for one thread-local countdown. Finished traces are pushed into
+// a ring owned by the event loop thread that sent the response, so
+// recording never takes a lock.
+class Tracer {
+public:
+    static Tracer& getInstance();
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // Call at startup, before requests are served. `sample_every` 0 turns
+    // tracing off; `ring_capacity` is the number of records kept per thread.
+    void configure(uint32_t sample_every, size_t ring_capacity);
+
+    uint32_t sample_every() const { return sample_every_; }
+
+    // Whether the calling thread's next request should be traced.
+    bool sample();
+
+    // Stores a finished trace in the calling thread's ring.
+    void record(const TraceRecord& record);
+
+    // The `count` slowest requests still held in any ring, slowest first.
+    // `held` is set to the number of records searched.
+    std::vector<TraceRecord> slowest(size_t count, size_t& held) const;
+
+private:
+    Tracer() = default;
+
+    TraceRing& local_ring();
+
+    uint32_t sample_every_ = 0;
+    size_t ring_capacity_ = 1024;
+    mutable std::mutex rings_mutex_; // Taken once per thread, and when dumping
+    std::vector<std::unique_ptr<TraceRing>> rings_;
+};
+
+#if SERVER_TRACING
+
+// The trace of the request a connection is working on. Copied along with
+// the request to the worker and back with its response; marks are no-ops
+// unless the request was sampled.
+class RequestTrace {
+public:
+    // Decides whether the request that has just been parsed is traced.
+    void begin(std::chrono::steady_clock::time_point started, std::chrono::steady_clock::time_point parsed,
+               uint64_t parse_ns, bool new_connection);
+
+    void describe(std::string_view method, std::string_view path);
+
+    void mark(TraceStage stage) {
+        if (sampled_) {
+            record_.at[static_cast<size_t>(stage)] = now_ns();
+        }
+    }
+
+    // Marks Sent and hands the record to the Tracer.
+    void finish(int status);
+
+private:
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool sampled_ = false;
+    TraceRecord record_;
+};
+
+#else
+
+class RequestTrace {
+public:
+    void begin(std::chrono::steady_clock::time_point, std::chrono::steady_clock::time_point, uint64_t, bool) {}
+    void describe(std::string_view, std::string_view) {}
+    void mark(TraceStage) {}
+    void finish(int) {}
+};
+
+#endif // SERVER_TRACING
+
+#endif // TRACE_H
@@ -0,0 +1,119 @@
+#include "worker_pool.h"
+#include "logger.h"
+#include <algorithm>
+#include <exception>
+
+WorkerPool::WorkerPool(int threads, size_t queue_capacity) : queue_(queue_capacity) {
+    for (int i = 0; i < threads; ++i) {
+        threads_.emplace_back(&WorkerPool::worker_main, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> guard(idle_mutex_);
+        stopping_.store(true);
+    }
+    idle_cv_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+bool WorkerPool::try_submit(Task& task) {
+    QueuedTask queued{std::move(task), std::chrono::steady_clock::now()};
+    if (!queue_.try_push(queued)) {
+        task = std::move(queued.task); // Hand the task back for a later retry
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+
+    // The fence pairs with the one in worker_main(): either we see the parked
+    // worker, or the worker sees our task before it parks.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle_workers_.load() > 0) {
+        std::lock_guard<std::mutex> guard(idle_mutex_);
+        idle_cv_.notify_one();
+    }
+    return true;
+}
+
+void WorkerPool::worker_main() {
+    QueuedTask queued;
+    while (true) {
+        if (!queue_.try_pop(queued)) {
+            std::unique_lock<std::mutex> lock(idle_mutex_);
+            idle_workers_.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            idle_cv_.wait(lock, [this] { return stopping_.load() || queue_.size() > 0; });
+            idle_workers_.fetch_sub(1);
+            if (stopping_.load() && queue_.size() == 0) {
+                return;
+            }
+            continue;
+        }
+
+        uint64_t wait_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - queued.enqueued).count());
+        started_.fetch_add(1, std::memory_order_relaxed);
+        wait_ns_total_.fetch_add(wait_ns, std::memory_order_relaxed);
+        uint64_t previous_max = wait_ns_max_.load(std::memory_order_relaxed);
+        while (wait_ns > previous_max &&
+               !wait_ns_max_.compare_exchange_weak(previous_max, wait_ns, std::memory_order_relaxed)) {
+        }
+        // Workers may race on the update; losing a sample now and then
+        // does not matter for an average.
+        uint64_t average = wait_ns_average_.load(std::memory_order_relaxed);
+        wait_ns_average_.store(average - average / 8 + wait_ns / 8, std::memory_order_relaxed);
+
+        busy_.fetch_add(1, std::memory_order_relaxed);
+        try {
+            queued.task();
+        } catch (const std::exception& e) {
+            LOG_ERROR(std::string("Worker task threw: ") + e.what());
+        }
+        busy_.fetch_sub(1, std::memory_order_relaxed);
+        completed_.fetch_add(1, std::memory_order_relaxed);
+        queued.task = nullptr;
+    }
+}
+
+std::chrono::nanoseconds WorkerPool::queue_delay() const {
+    // The average only moves when a worker dequeues; once the queue has
+    // drained, new tasks start right away whatever it last said.
+    if (queue_.size() == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    return std::chrono::nanoseconds(wait_ns_average_.load(std::memory_order_relaxed));
+}
+
+WorkerPoolStats WorkerPool::stats() const {
+    WorkerPoolStats stats;
+    stats.threads = static_cast<int>(threads_.size());
+    stats.busy_threads = busy_.load(std::memory_order_relaxed);
+    stats.queue_depth = queue_.size();
+    stats.queue_capacity = queue_.capacity();
+    stats.submitted = submitted_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    stats.started = started_.load(std::memory_order_relaxed);
+    stats.completed = completed_.load(std::memory_order_relaxed);
+    stats.wait_ns_total = wait_ns_total_.load(std::memory_order_relaxed);
+    stats.wait_ns_max = wait_ns_max_.load(std::memory_order_relaxed);
+    stats.wait_ns_average = wait_ns_average_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void accumulate(WorkerPoolStats& total, const WorkerPoolStats& part) {
+    total.threads += part.threads;
+    total.busy_threads += part.busy_threads;
+    total.queue_depth += part.queue_depth;
+    total.queue_capacity += part.queue_capacity;
+    total.submitted += part.submitted;
+    total.rejected += part.rejected;
+    total.started += part.started;
+    total.completed += part.completed;
+    total.wait_ns_total += part.wait_ns_total;
+    total.wait_ns_max = std::max(total.wait_ns_max, part.wait_ns_max);
+    total.wait_ns_average = std::max(total.wait_ns_average, part.wait_ns_average);
+}
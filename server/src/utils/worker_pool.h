@@ -0,0 +1,84 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "bounded_queue.h"
+
+// Point-in-time view of a WorkerPool, used to size the pool from /metrics.
+struct WorkerPoolStats {
+    int threads = 0;
+    int busy_threads = 0;
+    size_t queue_depth = 0;
+    size_t queue_capacity = 0;
+    uint64_t submitted = 0;
+    uint64_t rejected = 0;       // try_submit calls refused because the queue was full
+    uint64_t started = 0;        // Tasks a worker has dequeued
+    uint64_t completed = 0;
+    uint64_t wait_ns_total = 0;  // Sum of time tasks spent queued before a worker picked them up
+    uint64_t wait_ns_max = 0;
+    uint64_t wait_ns_average = 0; // Recent queue wait, see WorkerPool::queue_delay(); the worst pool's when accumulated
+};
+
+// Adds `part` into `total`, for reporting several pools as one.
+void accumulate(WorkerPoolStats& total, const WorkerPoolStats& part);
+
+// Fixed number of threads draining a bounded, lock-free task queue. Submission
+// never blocks: when the queue is full try_submit() returns false and the
+// caller decides how to push back (reject the request or stop accepting).
+class WorkerPool {
+public:
+    using Task = std::function<void()>;
+
+    WorkerPool(int threads, size_t queue_capacity);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Queues `task` for execution. Returns false if the queue is full, in
+    // which case `task` is left untouched so it can be retried later.
+    bool try_submit(Task& task);
+
+    // How long a task submitted now can expect to wait for a worker: a
+    // moving average of recent queue waits, or zero while the queue is empty.
+    // Cheap enough to consult for every request.
+    std::chrono::nanoseconds queue_delay() const;
+
+    WorkerPoolStats stats() const;
+
+private:
+    struct QueuedTask {
+        Task task;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    void worker_main();
+
+    BoundedQueue<QueuedTask> queue_;
+    std::vector<std::thread> threads_;
+
+    // Idle workers park on the condition variable; producers only take the
+    // mutex when someone is actually parked.
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    std::atomic<int> idle_workers_{0};
+    std::atomic<bool> stopping_{false};
+
+    std::atomic<int> busy_{0};
+    std::atomic<uint64_t> submitted_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> started_{0};
+    std::atomic<uint64_t> completed_{0};
+    std::atomic<uint64_t> wait_ns_total_{0};
+    std::atomic<uint64_t> wait_ns_max_{0};
+    std::atomic<uint64_t> wait_ns_average_{0}; // Exponentially weighted, 1/8 per task
+};
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,95 @@
+#include "test.h"
+#include <chrono>
+#include <cstdint>
+#include "net/admission.h"
+
+using Clock = ClientRateLimiter::Clock;
+using std::chrono::milliseconds;
+
+static const Clock::time_point kStart = Clock::time_point(std::chrono::hours(1));
+static const uint32_t kClient = 0x0100007f; // 127.0.0.1, network byte order
+static const uint32_t kOther = 0x0200007f;
+
+TEST(bucket_allows_a_burst_then_refills) {
+    ClientRateLimiter limiter(10, 3, 1); // 10 per second, bursts of 3
+    for (int i = 0; i < 3; ++i) {
+        CHECK(limiter.try_acquire(kClient, kStart));
+    }
+    CHECK(!limiter.try_acquire(kClient, kStart));
+    CHECK(!limiter.has_token(kClient, kStart));
+    CHECK(limiter.try_acquire(kOther, kStart)); // Buckets are per client
+
+    CHECK(!limiter.try_acquire(kClient, kStart + milliseconds(50)));
+    CHECK(limiter.try_acquire(kClient, kStart + milliseconds(150)));
+    CHECK(!limiter.try_acquire(kClient, kStart + milliseconds(150)));
+
+    // Refilled up to the burst, no further.
+    Clock::time_point later = kStart + std::chrono::seconds(60);
+    for (int i = 0; i < 3; ++i) {
+        CHECK(limiter.try_acquire(kClient, later));
+    }
+    CHECK(!limiter.try_acquire(kClient, later));
+}
+
+TEST(has_token_takes_nothing) {
+    ClientRateLimiter limiter(1, 1, 1);
+    CHECK(limiter.has_token(kClient, kStart));
+    CHECK_EQ(limiter.tracked(), 0u); // Unknown clients are not added
+    CHECK(limiter.has_token(kClient, kStart));
+    CHECK(limiter.try_acquire(kClient, kStart));
+    CHECK(!limiter.has_token(kClient, kStart));
+    CHECK_EQ(limiter.tracked(), 1u);
+}
+
+TEST(table_stays_bounded) {
+    ClientRateLimiter limiter(1, 1, 1000);
+    CHECK(limiter.capacity() >= 1000);
+    const uint32_t clients = 20000;
+    for (uint32_t address = 1; address <= clients; ++address) {
+        CHECK(limiter.try_acquire(address, kStart + milliseconds(address))); // A new client starts full
+    }
+    CHECK(limiter.tracked() <= limiter.capacity());
+    CHECK_EQ(limiter.tracked() + limiter.evictions(), clients);
+    CHECK(limiter.evictions() >= clients - limiter.capacity());
+
+    // The most recent clients are still tracked, with empty buckets.
+    CHECK(!limiter.try_acquire(clients, kStart + milliseconds(clients)));
+}
+
+TEST(connection_limit) {
+    AdmissionControl::Options options;
+    options.max_connections = 2;
+    AdmissionControl admission(options);
+    ShedReason reason = ShedReason::Count;
+    CHECK(admission.admit_connection(kClient, kStart, reason));
+    CHECK(admission.admit_connection(kClient, kStart, reason));
+    CHECK(!admission.admit_connection(kClient, kStart, reason));
+    CHECK(reason == ShedReason::ConnectionLimit);
+    CHECK_EQ(admission.stats().connections, 2);
+
+    admission.release_connection();
+    CHECK(admission.admit_connection(kOther, kStart, reason));
+}
+
+TEST(rate_limit_and_queue_delay) {
+    AdmissionControl::Options options;
+    options.rate = 1;
+    options.burst = 3;
+    options.max_queue_delay = milliseconds(10);
+    AdmissionControl admission(options);
+    ShedReason reason = ShedReason::Count;
+
+    CHECK(admission.admit_request(kClient, kStart, milliseconds(0), reason));
+    CHECK(!admission.admit_request(kClient, kStart, milliseconds(50), reason));
+    CHECK(reason == ShedReason::QueueDelay); // Still charged a token
+    CHECK(admission.admit_request(kClient, kStart, milliseconds(0), reason));
+    CHECK(!admission.admit_request(kClient, kStart, milliseconds(0), reason));
+    CHECK(reason == ShedReason::RateLimit);
+    CHECK(!admission.admit_connection(kClient, kStart, reason)); // Out of tokens at accept too
+    CHECK(reason == ShedReason::RateLimit);
+    CHECK(admission.admit_connection(kOther, kStart, reason));
+}
+
+int main() {
+    return run_tests();
+}
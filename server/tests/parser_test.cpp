@@ -0,0 +1,240 @@
+#include "test.h"
+#include <string>
+#include <string_view>
+#include "utils/httprequest_parser.h"
+
+static const std::string kRequest =
+    "POST /users/42?sort=asc&limit=10 HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 11\r\n"
+    "\r\n"
+    "hello world";
+
+static void check_request(const HttpRequestView& view) {
+    CHECK_EQ(view.method, "POST");
+    CHECK_EQ(view.target, "/users/42?sort=asc&limit=10");
+    CHECK_EQ(view.path, "/users/42");
+    CHECK_EQ(view.query, "sort=asc&limit=10");
+    CHECK_EQ(view.version, "HTTP/1.1");
+    CHECK_EQ(view.header_count, 3u);
+    CHECK_EQ(view.header("host"), "example.com");
+    CHECK_EQ(view.header("CONTENT-TYPE"), "text/plain");
+    CHECK_EQ(view.body, "hello world");
+    CHECK_EQ(view.length, kRequest.size());
+    CHECK(!view.stream_body);
+}
+
+// Parses `request` in one go. Returns the error status if it is malformed,
+// 0 if it is complete and -1 if it is not.
+static int parse_status(const std::string& request, const HttpRequestParser::Limits& limits = {}) {
+    HttpRequestParser parser(limits);
+    HttpRequestView view;
+    ParseStatus status = parser.feed(request, view);
+    if (status == ParseStatus::Malformed) {
+        return parser.error_status();
+    }
+    return status == ParseStatus::Complete ? 0 : -1;
+}
+
+TEST(request_split_at_every_offset) {
+    for (size_t split = 0; split < kRequest.size(); ++split) {
+        HttpRequestParser parser;
+        HttpRequestView view;
+        std::string received = kRequest.substr(0, split);
+        CHECK(parser.feed(received, view) == ParseStatus::NeedMore);
+        received = kRequest; // The rest arrives; the buffer is reallocated
+        CHECK(parser.feed(received, view) == ParseStatus::Complete);
+        check_request(view);
+    }
+}
+
+TEST(request_fed_one_byte_at_a_time) {
+    HttpRequestParser parser;
+    HttpRequestView view;
+    std::string received;
+    for (size_t i = 0; i + 1 < kRequest.size(); ++i) {
+        received += kRequest[i];
+        CHECK(parser.feed(received, view) == ParseStatus::NeedMore);
+    }
+    received += kRequest.back();
+    CHECK(parser.feed(received, view) == ParseStatus::Complete);
+    check_request(view);
+}
+
+TEST(pipelined_requests_are_parsed_one_by_one) {
+    std::string received = kRequest + "\r\nGET /next HTTP/1.1\r\n\r\n";
+    HttpRequestParser parser;
+    HttpRequestView view;
+    CHECK(parser.feed(received, view) == ParseStatus::Complete);
+    check_request(view);
+
+    std::string_view rest = std::string_view(received).substr(view.length);
+    parser.reset();
+    CHECK(parser.feed(rest, view) == ParseStatus::Complete);
+    CHECK_EQ(view.path, "/next");
+    CHECK_EQ(view.length, rest.size());
+}
+
+TEST(content_length_and_transfer_encoding_conflicts) {
+    const std::string head = "POST /upload HTTP/1.1\r\nHost: x\r\n";
+    CHECK_EQ(parse_status(head + "Content-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n"), 400);
+    CHECK_EQ(parse_status(head + "Transfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n"), 400);
+    CHECK_EQ(parse_status(head + "Content-Length: 5\r\nContent-Length: 6\r\n\r\nhello!"), 400);
+    CHECK_EQ(parse_status(head + "Content-Length: 5\r\nContent-Length: 5\r\n\r\nhello"), 0);
+    CHECK_EQ(parse_status(head + "Transfer-Encoding: chunked\r\nTransfer-Encoding: chunked\r\n\r\n"), 400);
+    CHECK_EQ(parse_status(head + "Transfer-Encoding: gzip\r\n\r\n"), 501);
+    CHECK_EQ(parse_status(head + "Content-Length: 5x\r\n\r\n"), 400);
+    CHECK_EQ(parse_status(head + "Content-Length:\r\n\r\n"), 400);
+}
+
+TEST(content_length_limits) {
+    const std::string head = "POST /upload HTTP/1.1\r\n";
+    CHECK_EQ(parse_status(head + "Content-Length: 1234567890123456789\r\n\r\n"), 413);
+    CHECK_EQ(parse_status(head + "Content-Length: 99999999999999999999999\r\n\r\n"), 413);
+    CHECK_EQ(parse_status(head + "Content-Length: 0000000000000000000000005\r\n\r\nhello"), 0);
+
+    HttpRequestParser::Limits limits;
+    limits.max_stream_body = 100;
+    CHECK_EQ(parse_status(head + "Content-Length: 101\r\n\r\n", limits), 413);
+
+    // Larger than max_body: complete at the end of the head, body streamed.
+    limits.max_body = 4;
+    HttpRequestParser parser(limits);
+    HttpRequestView view;
+    std::string request = head + "Content-Length: 5\r\n\r\nhel";
+    CHECK(parser.feed(request, view) == ParseStatus::Complete);
+    CHECK(view.stream_body);
+    CHECK_EQ(view.content_length, 5u);
+    CHECK_EQ(view.length, request.size() - 3);
+}
+
+TEST(malformed_request_lines_and_headers) {
+    CHECK_EQ(parse_status("GET / HTTP/2.0\r\n\r\n"), 505);
+    CHECK_EQ(parse_status("GET / HTTP/1.1\r\nX-Bad: a\x01" "b\r\n\r\n"), 400);
+    CHECK_EQ(parse_status(std::string("GET / HTTP/1.1\r\nX-Bad: a") + '\0' + "b\r\n\r\n"), 400);
+    CHECK_EQ(parse_status("GET / HTTP/1.1\r\nX-Tab: a\tb\r\n\r\n"), 0);
+    CHECK_EQ(parse_status("GET / HTTP/1.1\r\nNo colon\r\n\r\n"), 400);
+
+    HttpRequestParser::Limits limits;
+    limits.max_request_line = 32;
+    CHECK_EQ(parse_status("GET /" + std::string(40, 'a') + " HTTP/1.1\r\n\r\n", limits), 414);
+    CHECK_EQ(parse_status("GET /" + std::string(40, 'a'), limits), 414); // Before the line ends
+    limits.max_header_bytes = 64;
+    CHECK_EQ(parse_status("GET / HTTP/1.1\r\nX-Long: " + std::string(64, 'a') + "\r\n\r\n", limits), 431);
+}
+
+TEST(expect_continue) {
+    HttpRequestParser parser;
+    HttpRequestView view;
+    std::string request = "POST /upload HTTP/1.1\r\nExpect: 100-Continue\r\nContent-Length: 5\r\n\r\n";
+    CHECK(parser.feed(request, view) == ParseStatus::NeedMore);
+    CHECK(parser.headers_complete());
+    CHECK(parser.expects_continue());
+    request += "hello";
+    CHECK(parser.feed(request, view) == ParseStatus::Complete);
+    CHECK(view.expect_continue);
+
+    // HTTP/1.0 has no interim responses: the header is ignored.
+    HttpRequestParser old;
+    std::string request_10 = "POST /upload HTTP/1.0\r\nExpect: 100-continue\r\nContent-Length: 0\r\n\r\n";
+    CHECK(old.feed(request_10, view) == ParseStatus::Complete);
+    CHECK(!view.expect_continue);
+
+    CHECK_EQ(parse_status("POST /upload HTTP/1.1\r\nExpect: something-else\r\n\r\n"), 417);
+}
+
+// Decodes `encoded` as it would arrive in two reads split at `split`: like
+// the event loop, calls decode() until it returns 0, then waits for more.
+// Returns the body; `used` is how many bytes of `encoded` were framing and body.
+static std::string decode_split(BodyDecoder& decoder, const std::string& encoded, size_t split, size_t& used) {
+    std::string received = encoded.substr(0, split);
+    bool everything = split >= encoded.size();
+    std::string body;
+    used = 0;
+    while (decoder.active()) {
+        std::string_view data;
+        size_t taken = decoder.decode(std::string_view(received).substr(used), data);
+        body.append(data);
+        used += taken;
+        if (taken == 0) {
+            if (everything) {
+                break;
+            }
+            received = encoded;
+            everything = true;
+        }
+    }
+    return body;
+}
+
+static HttpRequestView chunked_view() {
+    HttpRequestView view;
+    view.stream_body = true;
+    view.chunked = true;
+    return view;
+}
+
+TEST(chunk_extensions_and_trailers_at_every_split) {
+    const std::string body =
+        "5;name=value\r\nhello\r\n"
+        "6 ; quoted=\"a;b\"\r\n world\r\n"
+        "A\r\n, chunked!\r\n"
+        "0;last\r\n"
+        "X-Checksum: abc\r\n"
+        "X-Other: 1\r\n"
+        "\r\n";
+    const std::string encoded = body + "GET /next HTTP/1.1\r\n\r\n"; // A pipelined request follows
+    for (size_t split = 0; split <= encoded.size(); ++split) {
+        BodyDecoder decoder;
+        decoder.start(chunked_view(), 0);
+        size_t used = 0;
+        CHECK_EQ(decode_split(decoder, encoded, split, used), "hello world, chunked!");
+        CHECK(decoder.done());
+        CHECK_EQ(used, body.size());
+    }
+}
+
+TEST(chunked_body_errors) {
+    struct Case {
+        std::string encoded;
+        uint64_t max_length;
+        int status;
+    };
+    const Case cases[] = {
+        {"zz\r\nhello\r\n0\r\n\r\n", 0, 400},     // Not a hex size
+        {";ext\r\nhello\r\n0\r\n\r\n", 0, 400},   // No size at all
+        {"5x\r\nhello\r\n0\r\n\r\n", 0, 400},     // Junk after the size
+        {"5\r\nhelloXX0\r\n\r\n", 0, 400},        // Missing CRLF after the data
+        {"5\r\nhello\r\n0\r\n\r\n", 4, 413},      // Past max_length
+        {"10000000000000000\r\n", 0, 413},       // Past any size
+        {std::string(5000, '1'), 0, 400},       // Size line that never ends
+    };
+    for (const Case& test : cases) {
+        BodyDecoder decoder;
+        decoder.start(chunked_view(), test.max_length);
+        size_t used = 0;
+        decode_split(decoder, test.encoded, test.encoded.size(), used);
+        CHECK(decoder.failed());
+        CHECK_EQ(decoder.error_status(), test.status);
+    }
+}
+
+TEST(content_length_body_is_counted_down) {
+    HttpRequestView view;
+    view.stream_body = true;
+    view.content_length = 5;
+    const std::string encoded = "helloGET /next HTTP/1.1\r\n\r\n";
+    for (size_t split = 0; split <= encoded.size(); ++split) {
+        BodyDecoder decoder;
+        decoder.start(view, 0);
+        size_t used = 0;
+        CHECK_EQ(decode_split(decoder, encoded, split, used), "hello");
+        CHECK(decoder.done());
+        CHECK_EQ(used, 5u);
+    }
+}
+
+int main() {
+    return run_tests();
+}
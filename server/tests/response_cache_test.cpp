@@ -0,0 +1,137 @@
+#include "test.h"
+#include <chrono>
+#include <coroutine>
+#include <string>
+#include <string_view>
+#include "net/response_cache.h"
+#include "utils/httprequest_parser.h"
+
+// Suspends a handler until the test opens it, standing in for a slow
+// backend call.
+struct Gate {
+    struct Awaiter {
+        Gate& gate;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { gate.waiting = handle; }
+        void await_resume() const noexcept {}
+    };
+
+    std::coroutine_handle<> waiting;
+
+    Awaiter wait() { return Awaiter{*this}; }
+
+    void open() {
+        std::coroutine_handle<> handle = waiting;
+        waiting = nullptr;
+        handle.resume();
+    }
+};
+
+struct Outcome {
+    bool done = false;
+    HttpResponse response;
+};
+
+// Drives a fetch the way the event loop drives a handler's Task.
+static Detached run(Task<HttpResponse> task, Outcome& outcome) {
+    outcome.response = co_await task;
+    outcome.done = true;
+}
+
+static bool has_body(const Outcome& outcome, std::string_view body) {
+    std::string_view payload = outcome.response.payload(true);
+    return payload.size() >= body.size() && payload.substr(payload.size() - body.size()) == body;
+}
+
+struct CountingRoute {
+    Route route;
+    Gate gate;
+    int calls = 0;
+    int status = 200;
+
+    CountingRoute() {
+        route.method = "GET";
+        route.pattern = "/report";
+        route.cache_ttl = std::chrono::seconds(60);
+        route.async_handler = [this](const HttpRequest&) -> Task<HttpResponse> {
+            calls++;
+            co_await gate.wait();
+            co_return HttpResponse(status, "computed\n");
+        };
+    }
+};
+
+static HttpRequest get(const std::string& target) {
+    return HttpRequestParser::parse("GET " + target + " HTTP/1.1\r\n\r\n");
+}
+
+TEST(concurrent_misses_are_coalesced) {
+    ResponseCache& cache = ResponseCache::getInstance();
+    cache.configure(1 << 20);
+    CountingRoute handler;
+    HttpRequest first = get("/report?a=1&b=2");
+    HttpRequest second = get("/report?b=2&a=1"); // The same key
+    Outcome first_outcome;
+    Outcome second_outcome;
+
+    run(cache.fetch(handler.route, first), first_outcome);
+    run(cache.fetch(handler.route, second), second_outcome);
+    CHECK_EQ(handler.calls, 1);
+    CHECK(!first_outcome.done);
+    CHECK(!second_outcome.done);
+
+    handler.gate.open(); // Outside an event loop the waiter resumes inline
+    CHECK_EQ(handler.calls, 1);
+    CHECK(first_outcome.done);
+    CHECK(second_outcome.done);
+    CHECK_EQ(first_outcome.response.status(), 200);
+    CHECK_EQ(second_outcome.response.status(), 200);
+    CHECK(has_body(first_outcome, "computed\n"));
+    CHECK(has_body(second_outcome, "computed\n"));
+
+    // Now a plain hit: answered without running the handler.
+    Outcome hit;
+    HttpRequest third = get("/report?a=1&b=2");
+    run(cache.fetch(handler.route, third), hit);
+    CHECK(hit.done);
+    CHECK_EQ(handler.calls, 1);
+    CHECK(has_body(hit, "computed\n"));
+
+    // A different query is a different key.
+    Outcome other;
+    HttpRequest fourth = get("/report?a=2");
+    run(cache.fetch(handler.route, fourth), other);
+    CHECK_EQ(handler.calls, 2);
+    handler.gate.open();
+    CHECK(other.done);
+}
+
+TEST(waiters_run_the_handler_when_the_response_is_not_shared) {
+    ResponseCache& cache = ResponseCache::getInstance();
+    cache.configure(1 << 20);
+    CountingRoute handler;
+    handler.status = 503; // Not cacheable
+    HttpRequest first = get("/failing");
+    HttpRequest second = get("/failing");
+    Outcome first_outcome;
+    Outcome second_outcome;
+
+    run(cache.fetch(handler.route, first), first_outcome);
+    run(cache.fetch(handler.route, second), second_outcome);
+    CHECK_EQ(handler.calls, 1);
+
+    handler.gate.open();
+    CHECK(first_outcome.done);
+    CHECK_EQ(first_outcome.response.status(), 503);
+    CHECK_EQ(handler.calls, 2); // The waiter went on to run it itself
+    CHECK(!second_outcome.done);
+
+    handler.gate.open();
+    CHECK(second_outcome.done);
+    CHECK_EQ(second_outcome.response.status(), 503);
+}
+
+int main() {
+    return run_tests();
+}
@@ -0,0 +1,138 @@
+#include "test.h"
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "utils/httprequest_parser.h"
+#include "utils/router.h"
+
+static HttpResponse ok(const HttpRequest&) {
+    return HttpResponse(200, "ok\n");
+}
+
+// One router for every test: each route takes a metrics slot for good.
+static const Router& router() {
+    static const Router* instance = []() {
+        Router* router = new Router();
+        router->get("/users/me", ok);
+        router->get("/users/:id", ok);
+        router->add("POST", "/users/:id", ok);
+        router->get("/users/:id/posts/:post", ok);
+        router->get("/files/*", ok);
+        router->get("/files/readme", ok);
+        router->add("*", "/any/:thing", ok);
+        return router;
+    }();
+    return *instance;
+}
+
+struct Match {
+    HttpRequest request;
+    const Route* route;
+};
+
+static Match match(const std::string& method, const std::string& target) {
+    Match result{HttpRequestParser::parse(method + " " + target + " HTTP/1.1\r\n\r\n"), nullptr};
+    result.route = router().match(result.request);
+    return result;
+}
+
+static std::string_view param(const HttpRequest& request, std::string_view name) {
+    const HttpField* field = request.path_params.find(name);
+    return field != nullptr ? field->value : std::string_view("(none)");
+}
+
+TEST(literals_win_over_parameters) {
+    Match me = match("GET", "/users/me");
+    CHECK_EQ(me.route->pattern, "/users/me");
+    CHECK_EQ(me.request.path_params.size(), 0u);
+
+    Match user = match("GET", "/users/42?verbose=1");
+    CHECK_EQ(user.route->pattern, "/users/:id");
+    CHECK_EQ(param(user.request, "id"), "42");
+}
+
+TEST(parameters_are_captured_after_backtracking) {
+    Match post = match("GET", "/users/42/posts/7");
+    CHECK_EQ(post.route->pattern, "/users/:id/posts/:post");
+    CHECK_EQ(param(post.request, "id"), "42");
+    CHECK_EQ(param(post.request, "post"), "7");
+
+    // "me" is a literal with no posts below it: the walk backs off to :id.
+    Match mine = match("GET", "/users/me/posts/7");
+    CHECK_EQ(mine.route->pattern, "/users/:id/posts/:post");
+    CHECK_EQ(param(mine.request, "id"), "me");
+    CHECK_EQ(mine.request.path_params.size(), 2u);
+}
+
+TEST(wildcards_come_last) {
+    Match readme = match("GET", "/files/readme");
+    CHECK_EQ(readme.route->pattern, "/files/readme");
+
+    Match nested = match("GET", "/files/docs/guide.html");
+    CHECK_EQ(nested.route->pattern, "/files/*");
+    CHECK_EQ(param(nested.request, "*"), "docs/guide.html");
+
+    Match below_readme = match("GET", "/files/readme/old");
+    CHECK_EQ(below_readme.route->pattern, "/files/*");
+    CHECK_EQ(param(below_readme.request, "*"), "readme/old");
+}
+
+TEST(methods) {
+    CHECK_EQ(match("POST", "/users/42").route->method, "POST");
+    CHECK_EQ(match("HEAD", "/users/42").route->method, "GET"); // The event loop sends the head only
+    CHECK_EQ(match("DELETE", "/any/thing").route->pattern, "/any/:thing");
+
+    Match not_allowed = match("DELETE", "/users/42");
+    CHECK_EQ(not_allowed.route->pattern, "unknown");
+    HttpResponse response = not_allowed.route->handler(not_allowed.request);
+    CHECK_EQ(response.status(), 405);
+    CHECK(response.payload(true).find("\r\nAllow: GET, HEAD, POST\r\n") != std::string_view::npos);
+
+    Match wildcard = match("PUT", "/files/a");
+    CHECK_EQ(wildcard.route->handler(wildcard.request).status(), 405);
+}
+
+TEST(unmatched_paths_are_not_found) {
+    for (const char* target : {"/", "/nope", "/users", "/users/42/posts", "/users/42/posts/7/extra"}) {
+        Match missing = match("GET", target);
+        CHECK_EQ(missing.route->pattern, "unknown");
+        CHECK_EQ(missing.route->handler(missing.request).status(), 404);
+    }
+}
+
+TEST(caching_a_missing_route_throws) {
+    Router router;
+    router.get("/hello", ok);
+    router.cache("GET", "/hello", std::chrono::milliseconds(100));
+    bool threw = false;
+    try {
+        router.cache("GET", "/missing", std::chrono::milliseconds(100));
+    } catch (const std::logic_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+TEST(conflicting_parameter_names_throw) {
+    Router router;
+    router.get("/teams/:id", ok);
+    router.get("/teams/:id/members/:member", ok); // The same name is fine
+    bool threw = false;
+    try {
+        router.get("/teams/:name/posts", ok);
+    } catch (const std::logic_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    // The rejected route left nothing behind.
+    HttpRequest posts = HttpRequestParser::parse("GET /teams/7/posts HTTP/1.1\r\n\r\n");
+    CHECK_EQ(router.match(posts)->pattern, "unknown");
+    HttpRequest member = HttpRequestParser::parse("GET /teams/7/members/3 HTTP/1.1\r\n\r\n");
+    CHECK_EQ(router.match(member)->pattern, "/teams/:id/members/:member");
+    CHECK_EQ(param(member, "id"), "7");
+}
+
+int main() {
+    return run_tests();
+}
@@ -0,0 +1,94 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Minimal unit test harness, one executable per test file (run by ctest).
+// TEST(name) registers a function; CHECK and CHECK_EQ report a failure and
+// let the test carry on, so one run shows every broken expectation.
+// run_tests() runs them all and returns the exit status for main().
+//
+//     TEST(parses_the_method) {
+//         CHECK_EQ(request.method, "GET");
+//     }
+//
+//     int main() { return run_tests(); }
+namespace test_detail {
+
+struct TestCase {
+    const char* name;
+    std::function<void()> run;
+};
+
+inline std::vector<TestCase>& tests() {
+    static std::vector<TestCase> registered;
+    return registered;
+}
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+struct Registrar {
+    Registrar(const char* name, std::function<void()> run) { tests().push_back(TestCase{name, std::move(run)}); }
+};
+
+inline void fail(const char* file, int line, const std::string& message) {
+    std::fprintf(stderr, "%s:%d: %s\n", file, line, message.c_str());
+    failures()++;
+}
+
+template <typename A, typename B>
+void check_eq(const A& actual, const B& expected, const char* expression, const char* file, int line) {
+    if (actual == expected) {
+        return;
+    }
+    std::ostringstream message;
+    message << "CHECK_EQ(" << expression << ") failed: got " << actual << ", expected " << expected;
+    fail(file, line, message.str());
+}
+
+} // namespace test_detail
+
+#define TEST_CONCAT_(a, b) a##b
+#define TEST_CONCAT(a, b) TEST_CONCAT_(a, b)
+
+#define TEST(name)                                                                        \
+    static void name();                                                                   \
+    static test_detail::Registrar TEST_CONCAT(name, _registrar)(#name, name);             \
+    static void name()
+
+#define CHECK(condition)                                                                  \
+    do {                                                                                  \
+        if (!(condition)) {                                                               \
+            test_detail::fail(__FILE__, __LINE__, "CHECK(" #condition ") failed");        \
+        }                                                                                 \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    test_detail::check_eq((actual), (expected), #actual ", " #expected, __FILE__, __LINE__)
+
+inline int run_tests() {
+    for (const test_detail::TestCase& test : test_detail::tests()) {
+        int before = test_detail::failures();
+        try {
+            test.run();
+        } catch (const std::exception& error) {
+            test_detail::fail(__FILE__, __LINE__, std::string(test.name) + " threw: " + error.what());
+        }
+        std::printf("%s %s\n", test_detail::failures() == before ? "PASS" : "FAIL", test.name);
+    }
+    if (test_detail::failures() > 0) {
+        std::printf("%d check(s) failed\n", test_detail::failures());
+        return 1;
+    }
+    return 0;
+}
+
+#endif // TEST_H
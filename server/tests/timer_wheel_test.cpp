@@ -0,0 +1,139 @@
+#include "test.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "utils/timer_wheel.h"
+
+using Clock = TimerWheel::Clock;
+using std::chrono::milliseconds;
+
+static const Clock::time_point kOrigin = Clock::time_point(std::chrono::hours(1));
+
+TEST(timers_fire_on_time_across_every_level) {
+    TimerWheel wheel(milliseconds(1), kOrigin);
+
+    // Start off a level boundary, so cascading has to cope with a wheel
+    // whose levels are not aligned to the timers.
+    const int64_t start = 37;
+    wheel.advance(kOrigin + milliseconds(start));
+
+    // Level 0 holds 64 ticks, level 1 64^2, level 2 64^3.
+    const int64_t offsets[] = {1, 2, 63, 64, 65, 127, 128, 4095, 4096, 4097, 10000, 262143, 262144, 262145, 300000};
+    std::vector<std::unique_ptr<TimerWheel::Timer>> timers;
+    std::vector<int64_t> fired_at;
+    int64_t now = start;
+    for (int64_t offset : offsets) {
+        size_t index = timers.size();
+        fired_at.push_back(-1);
+        timers.emplace_back(new TimerWheel::Timer([&fired_at, &now, index]() { fired_at[index] = now; }));
+        wheel.schedule(*timers.back(), kOrigin + milliseconds(start + offset));
+    }
+    CHECK_EQ(wheel.size(), timers.size());
+
+    const int64_t end = start + 300001;
+    for (now = start + 1; now <= end; ++now) {
+        wheel.advance(kOrigin + milliseconds(now));
+    }
+    for (size_t i = 0; i < timers.size(); ++i) {
+        CHECK_EQ(fired_at[i], start + offsets[i]);
+        CHECK(!timers[i]->armed());
+    }
+    CHECK_EQ(wheel.size(), 0u);
+}
+
+TEST(a_late_advance_fires_everything_due) {
+    TimerWheel wheel(milliseconds(1), kOrigin);
+    int fired = 0;
+    TimerWheel::Timer near([&fired]() { fired++; });
+    TimerWheel::Timer far([&fired]() { fired++; });
+    TimerWheel::Timer later([&fired]() { fired++; });
+    wheel.schedule(near, kOrigin + milliseconds(5));
+    wheel.schedule(far, kOrigin + milliseconds(100000));
+    wheel.schedule(later, kOrigin + milliseconds(100002));
+
+    CHECK_EQ(wheel.advance(kOrigin + milliseconds(100001)), 2u);
+    CHECK_EQ(fired, 2);
+    CHECK(later.armed());
+    CHECK_EQ(wheel.advance(kOrigin + milliseconds(100002)), 1u);
+    CHECK_EQ(fired, 3);
+}
+
+TEST(deadlines_between_ticks_round_up) {
+    TimerWheel wheel(milliseconds(10), kOrigin);
+    int fired = 0;
+    TimerWheel::Timer timer([&fired]() { fired++; });
+    wheel.schedule(timer, kOrigin + milliseconds(25));
+
+    wheel.advance(kOrigin + milliseconds(29));
+    CHECK_EQ(fired, 0); // Never early
+    wheel.advance(kOrigin + milliseconds(30));
+    CHECK_EQ(fired, 1); // At most one tick late
+}
+
+TEST(cancel_and_reschedule) {
+    TimerWheel wheel(milliseconds(1), kOrigin);
+    int cancelled = 0;
+    int moved = 0;
+    TimerWheel::Timer a([&cancelled]() { cancelled++; });
+    TimerWheel::Timer b([&moved]() { moved++; });
+    wheel.schedule(a, kOrigin + milliseconds(5000));
+    wheel.schedule(b, kOrigin + milliseconds(100));
+    wheel.schedule(b, kOrigin + milliseconds(6000)); // Pushed back, as on every read
+    CHECK_EQ(wheel.size(), 2u);
+
+    wheel.cancel(a);
+    wheel.cancel(a); // A no-op the second time
+    CHECK(!a.armed());
+    CHECK_EQ(wheel.size(), 1u);
+
+    wheel.advance(kOrigin + milliseconds(5999));
+    CHECK_EQ(moved, 0);
+    wheel.advance(kOrigin + milliseconds(6000));
+    CHECK_EQ(moved, 1);
+    CHECK_EQ(cancelled, 0);
+
+    {
+        TimerWheel::Timer destroyed;
+        wheel.schedule(destroyed, kOrigin + milliseconds(7000));
+        CHECK_EQ(wheel.size(), 1u);
+    } // Unlinks itself
+    CHECK_EQ(wheel.size(), 0u);
+}
+
+TEST(callbacks_may_rearm_their_timer) {
+    TimerWheel wheel(milliseconds(1), kOrigin);
+    std::vector<int64_t> fired_at;
+    int64_t now = 0;
+    TimerWheel::Timer periodic;
+    periodic.callback = [&]() {
+        fired_at.push_back(now);
+        if (fired_at.size() < 3) {
+            wheel.schedule(periodic, kOrigin + milliseconds(now + 100));
+        }
+    };
+    wheel.schedule(periodic, kOrigin + milliseconds(100));
+    for (now = 1; now <= 1000; ++now) {
+        wheel.advance(kOrigin + milliseconds(now));
+    }
+    CHECK_EQ(fired_at.size(), 3u);
+    if (fired_at.size() == 3) {
+        CHECK_EQ(fired_at[0], 100);
+        CHECK_EQ(fired_at[1], 200);
+        CHECK_EQ(fired_at[2], 300);
+    }
+}
+
+TEST(time_until_next) {
+    TimerWheel wheel(milliseconds(1), kOrigin);
+    CHECK(wheel.time_until_next(kOrigin, milliseconds(500)) == milliseconds(500)); // Nothing armed
+    TimerWheel::Timer timer;
+    wheel.schedule(timer, kOrigin + milliseconds(20));
+    CHECK(wheel.time_until_next(kOrigin, milliseconds(500)) == milliseconds(20));
+    CHECK(wheel.time_until_next(kOrigin, milliseconds(5)) == milliseconds(5));
+    CHECK(wheel.time_until_next(kOrigin + milliseconds(30), milliseconds(500)) == Clock::duration::zero());
+}
+
+int main() {
+    return run_tests();
+}
@@ -0,0 +1,338 @@
+// Decodes the server's binary access log (SERVER_ACCESS_LOG_DIR) into text
+// or JSON lines, optionally filtered. Works on files still being written:
+// a record is only read once its timestamp, written last, is set. Files are
+// named access-<pid>-<loop>[.<generation>].bin; pass those of several
+// processes (before and after a hot restart) to merge them.
+//
+//     accesslog /var/log/server/access-*.bin
+//     accesslog --sort --status 5xx --json /var/log/server/access-*.bin
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "utils/access_log.h"
+
+namespace {
+
+struct Options {
+    bool json = false;
+    bool sort = false;
+    int status = 0;             // Exact code, or 1..5 for a class ("4xx")
+    bool status_class = false;
+    std::string route;
+    bool filter_client = false;
+    uint32_t client = 0;        // Network byte order
+    int64_t since_ns = 0;
+    int64_t until_ns = INT64_MAX;
+    uint32_t min_latency_us = 0;
+    std::vector<std::string> files;
+};
+
+Options options;
+
+// A mapped log file; records point into the mapping.
+struct LogFile {
+    std::string path;
+    const AccessLogHeader* header = nullptr;
+    const AccessRecord* records = nullptr;
+    uint64_t count = 0;         // Records written so far
+};
+
+struct Entry {
+    const LogFile* file;
+    AccessRecord record;
+};
+
+bool open_log(const std::string& path, LogFile& file, std::string& error) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(AccessLogHeader)) {
+        close(fd);
+        error = "too short for an access log";
+        return false;
+    }
+    void* map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        error = std::strerror(errno);
+        return false;
+    }
+    const AccessLogHeader* header = static_cast<const AccessLogHeader*>(map);
+    std::string problem;
+    if (std::memcmp(header->magic, kAccessLogMagic, sizeof(header->magic)) != 0) {
+        problem = "not an access log";
+    } else if (header->version != kAccessLogVersion || header->record_size != sizeof(AccessRecord)) {
+        problem = "written by an incompatible server (version " + std::to_string(header->version) + ")";
+    } else if (header->route_count > kAccessLogRoutes) {
+        // route_name() indexes the route table by it.
+        problem = "corrupt header (" + std::to_string(header->route_count) + " routes)";
+    }
+    if (!problem.empty()) {
+        munmap(map, static_cast<size_t>(st.st_size));
+        error = problem;
+        return false;
+    }
+    file.path = path;
+    file.header = header;
+    file.records = reinterpret_cast<const AccessRecord*>(static_cast<const char*>(map) + sizeof(AccessLogHeader));
+    uint64_t capacity = std::min<uint64_t>(header->capacity,
+        (static_cast<size_t>(st.st_size) - sizeof(AccessLogHeader)) / sizeof(AccessRecord));
+    // Slots are filled in order, so the first empty one ends the log.
+    while (file.count < capacity &&
+           __atomic_load_n(&file.records[file.count].time_ns, __ATOMIC_ACQUIRE) != 0) {
+        ++file.count;
+    }
+    return true;
+}
+
+std::string route_name(const LogFile& file, uint16_t route) {
+    if (route == kNoRoute || route >= file.header->route_count) {
+        return "-";
+    }
+    const char* name = file.header->routes[route];
+    return std::string(name, strnlen(name, kAccessLogRouteName));
+}
+
+bool matches(const LogFile& file, const AccessRecord& record) {
+    if (options.status != 0 &&
+        (options.status_class ? record.status / 100 != options.status : record.status != options.status)) {
+        return false;
+    }
+    if (!options.route.empty() && route_name(file, record.route) != options.route) {
+        return false;
+    }
+    if (options.filter_client && record.client_address != options.client) {
+        return false;
+    }
+    return record.time_ns >= options.since_ns && record.time_ns < options.until_ns &&
+           record.latency_us >= options.min_latency_us;
+}
+
+std::string format_time(int64_t time_ns) {
+    std::time_t seconds = static_cast<std::time_t>(time_ns / 1000000000);
+    std::tm parts{};
+    gmtime_r(&seconds, &parts);
+    char text[64];
+    size_t length = std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &parts);
+    std::snprintf(text + length, sizeof(text) - length, ".%06" PRId64 "Z", (time_ns % 1000000000) / 1000);
+    return text;
+}
+
+std::string format_address(uint32_t address) {
+    char text[INET_ADDRSTRLEN];
+    in_addr in{};
+    in.s_addr = address;
+    return inet_ntop(AF_INET, &in, text, sizeof(text)) != nullptr ? text : "?";
+}
+
+void append_json_string(std::string& out, const std::string& text) {
+    out += '"';
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (byte < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", byte);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void print(const LogFile& file, const AccessRecord& record, std::string& line) {
+    const char* method = access_method_name(static_cast<AccessMethod>(record.method));
+    bool keep_alive = (record.flags & kAccessKeepAlive) != 0;
+    bool new_connection = (record.flags & kAccessNewConnection) != 0;
+    bool streamed = (record.flags & kAccessStreamed) != 0;
+    char number[64];
+    line.clear();
+    if (options.json) {
+        line += "{\"time\": \"" + format_time(record.time_ns) + "\", \"time_ns\": " + std::to_string(record.time_ns);
+        line += ", \"client\": \"" + format_address(record.client_address) + "\", \"port\": " +
+                std::to_string(record.client_port);
+        line += ", \"method\": \"" + std::string(method) + "\", \"route\": ";
+        append_json_string(line, route_name(file, record.route));
+        line += ", \"status\": " + std::to_string(record.status);
+        line += ", \"latency_us\": " + std::to_string(record.latency_us);
+        line += ", \"bytes_received\": " + std::to_string(record.bytes_received);
+        line += ", \"bytes_sent\": " + std::to_string(record.bytes_sent);
+        line += std::string(", \"keep_alive\": ") + (keep_alive ? "true" : "false");
+        line += std::string(", \"new_connection\": ") + (new_connection ? "true" : "false");
+        line += std::string(", \"streamed\": ") + (streamed ? "true" : "false") + "}\n";
+    } else {
+        std::snprintf(number, sizeof(number), "%.3fms", record.latency_us / 1e3);
+        line += format_time(record.time_ns) + ' ' + format_address(record.client_address) + ':' +
+                std::to_string(record.client_port) + ' ' + method + ' ' + route_name(file, record.route) + ' ' +
+                std::to_string(record.status) + ' ' + number + " in=" + std::to_string(record.bytes_received) +
+                " out=" + std::to_string(record.bytes_sent);
+        std::string flags;
+        if (new_connection) {
+            flags += ",new";
+        }
+        if (keep_alive) {
+            flags += ",keep-alive";
+        }
+        if (streamed) {
+            flags += ",streamed";
+        }
+        line += flags.empty() ? std::string(" -") : ' ' + flags.substr(1);
+        line += '\n';
+    }
+    std::fwrite(line.data(), 1, line.size(), stdout);
+}
+
+// Seconds since the epoch ("1760000000.5") or a UTC time
+// ("2026-10-17T09:15:02" or "2026-10-17 09:15:02").
+bool parse_time(const char* text, int64_t& time_ns) {
+    char* end = nullptr;
+    double seconds = std::strtod(text, &end);
+    if (end != text && *end == '\0') {
+        time_ns = static_cast<int64_t>(seconds * 1e9);
+        return true;
+    }
+    std::tm parts{};
+    const char* rest = strptime(text, "%Y-%m-%dT%H:%M:%S", &parts);
+    if (rest == nullptr) {
+        rest = strptime(text, "%Y-%m-%d %H:%M:%S", &parts);
+    }
+    if (rest == nullptr || (*rest != '\0' && std::strcmp(rest, "Z") != 0)) {
+        return false;
+    }
+    time_ns = static_cast<int64_t>(timegm(&parts)) * 1000000000;
+    return true;
+}
+
+bool parse_status(const char* text) {
+    size_t length = std::strlen(text);
+    if (length == 3 && text[0] >= '1' && text[0] <= '5' && (text[1] == 'x' || text[1] == 'X') &&
+        (text[2] == 'x' || text[2] == 'X')) {
+        options.status = text[0] - '0';
+        options.status_class = true;
+        return true;
+    }
+    options.status = std::atoi(text);
+    return options.status >= 100 && options.status <= 599;
+}
+
+void usage() {
+    std::cerr << "Usage: accesslog [options] FILE...\n"
+                 "  --json                 One JSON object per line instead of text\n"
+                 "  --sort                 Merge all files in time order (each file alone is already ordered)\n"
+                 "  --status CODE          Only responses with this status, or class such as 5xx\n"
+                 "  --route PATTERN        Only requests to this route, e.g. /hello (\"-\" for none)\n"
+                 "  --client IP            Only requests from this IPv4 address\n"
+                 "  --since TIME           Only responses sent at or after TIME (epoch seconds or UTC\n"
+                 "                         2026-10-17T09:15:02)\n"
+                 "  --until TIME           Only responses sent before TIME\n"
+                 "  --min-latency-ms MS    Only requests that took at least MS milliseconds\n";
+}
+
+bool parse_options(int argc, char** argv) {
+    enum { kJson = 1, kSort, kStatus, kRoute, kClient, kSince, kUntil, kMinLatency, kHelp };
+    static const option long_options[] = {
+        {"json", no_argument, nullptr, kJson},
+        {"sort", no_argument, nullptr, kSort},
+        {"status", required_argument, nullptr, kStatus},
+        {"route", required_argument, nullptr, kRoute},
+        {"client", required_argument, nullptr, kClient},
+        {"since", required_argument, nullptr, kSince},
+        {"until", required_argument, nullptr, kUntil},
+        {"min-latency-ms", required_argument, nullptr, kMinLatency},
+        {"help", no_argument, nullptr, kHelp},
+        {nullptr, 0, nullptr, 0}};
+    int option_code;
+    while ((option_code = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+        bool valid = true;
+        switch (option_code) {
+            case kJson: options.json = true; break;
+            case kSort: options.sort = true; break;
+            case kStatus: valid = parse_status(optarg); break;
+            case kRoute: options.route = optarg; break;
+            case kClient:
+                options.filter_client = true;
+                valid = inet_pton(AF_INET, optarg, &options.client) == 1;
+                break;
+            case kSince: valid = parse_time(optarg, options.since_ns); break;
+            case kUntil: valid = parse_time(optarg, options.until_ns); break;
+            case kMinLatency: options.min_latency_us = static_cast<uint32_t>(std::max(0.0, std::atof(optarg)) * 1000); break;
+            default: usage(); return false;
+        }
+        if (!valid) {
+            std::cerr << "accesslog: invalid value \"" << optarg << "\"" << std::endl;
+            return false;
+        }
+    }
+    for (int i = optind; i < argc; ++i) {
+        options.files.push_back(argv[i]);
+    }
+    if (options.files.empty()) {
+        usage();
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!parse_options(argc, argv)) {
+        return 2;
+    }
+    std::vector<LogFile> files(options.files.size());
+    int status = 0;
+    for (size_t i = 0; i < options.files.size(); ++i) {
+        std::string error;
+        if (!open_log(options.files[i], files[i], error)) {
+            std::cerr << "accesslog: " << options.files[i] << ": " << error << std::endl;
+            files[i].header = nullptr;
+            status = 1;
+        }
+    }
+
+    std::string line;
+    if (!options.sort) {
+        for (const LogFile& file : files) {
+            for (uint64_t r = 0; file.header != nullptr && r < file.count; ++r) {
+                if (matches(file, file.records[r])) {
+                    print(file, file.records[r], line);
+                }
+            }
+        }
+        return status;
+    }
+
+    std::vector<Entry> entries;
+    for (const LogFile& file : files) {
+        for (uint64_t r = 0; file.header != nullptr && r < file.count; ++r) {
+            if (matches(file, file.records[r])) {
+                entries.push_back(Entry{&file, file.records[r]});
+            }
+        }
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const Entry& a, const Entry& b) { return a.record.time_ns < b.record.time_ns; });
+    for (const Entry& entry : entries) {
+        print(*entry.file, entry.record, line);
+    }
+    return status;
+}